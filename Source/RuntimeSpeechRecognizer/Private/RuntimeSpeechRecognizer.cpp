@@ -2,6 +2,8 @@
 
 #include "RuntimeSpeechRecognizer.h"
 #include "SpeechRecognizerDefines.h"
+#include "SpeechRecognizerFrameMonitor.h"
+#include "SpeechRecognizerAudioBufferPool.h"
 
 #ifdef GGML_USE_BLAS
 #include "HAL/PlatformProcess.h"
@@ -35,10 +37,15 @@ void FRuntimeSpeechRecognizerModule::StartupModule()
 #error "OpenBLAS is only supported on Windows"
 #endif
 #endif
+
+	FSpeechRecognizerFrameMonitor::Get().Initialize();
 }
 
 void FRuntimeSpeechRecognizerModule::ShutdownModule()
 {
+	FSpeechRecognizerFrameMonitor::Get().Shutdown();
+	FSpeechRecognizerAudioBufferPool::Get().Trim();
+
 #ifdef GGML_USE_BLAS
 	if (OpenBLASLibHandle)
 	{
@@ -3,6 +3,7 @@
 #include "SpeechRecognizer.h"
 #include "SpeechRecognizerDefines.h"
 #include "SpeechRecognizerThread.h"
+#include "SpeechRecognizerAudioBufferPool.h"
 
 USpeechRecognizer::USpeechRecognizer()
 {
@@ -27,6 +28,12 @@ USpeechRecognizer::USpeechRecognizer()
 		OnRecognizedTextSegmentNative.Broadcast(RecognizedWords);
 	});
 
+	Thread->OnRecognizedTranslatedTextSegment.AddWeakLambda(this, [this](const FString& TranslatedWords)
+	{
+		OnRecognizedTranslatedTextSegment.Broadcast(TranslatedWords);
+		OnRecognizedTranslatedTextSegmentNative.Broadcast(TranslatedWords);
+	});
+
 	Thread->OnRecognitionProgress.AddWeakLambda(this, [this](int32 Progress)
 	{
 		OnRecognitionProgress.Broadcast(Progress);
@@ -38,6 +45,18 @@ USpeechRecognizer::USpeechRecognizer()
 		OnRecognitionStopped.Broadcast();
 		OnRecognitionStoppedNative.Broadcast();
 	});
+
+	Thread->OnLanguageDetected.AddWeakLambda(this, [this](const FSpeechRecognizerLanguageDetection& Detection)
+	{
+		OnLanguageDetected.Broadcast(Detection);
+		OnLanguageDetectedNative.Broadcast(Detection);
+	});
+
+	Thread->OnRecognizedCommand.AddWeakLambda(this, [this](const FSpeechRecognizerCommandResult& Result)
+	{
+		OnRecognizedCommand.Broadcast(Result);
+		OnRecognizedCommandNative.Broadcast(Result);
+	});
 }
 
 USpeechRecognizer* USpeechRecognizer::CreateSpeechRecognizer()
@@ -67,14 +86,37 @@ void USpeechRecognizer::StartSpeechRecognition(const FOnSpeechRecognitionStarted
 	Thread->StartThread().Next([OnStarted](bool bSucceeded) { OnStarted.ExecuteIfBound(bSucceeded); });
 }
 
+void USpeechRecognizer::PrewarmSpeechRecognition(const FOnSpeechRecognizerPrewarmedDynamic& OnPrewarmed)
+{
+	PrewarmSpeechRecognition(FOnSpeechRecognizerPrewarmedStatic::CreateWeakLambda(this, [OnPrewarmed](bool bSucceeded) { OnPrewarmed.ExecuteIfBound(bSucceeded); }));
+}
+
+void USpeechRecognizer::PrewarmSpeechRecognition(const FOnSpeechRecognizerPrewarmedStatic& OnPrewarmed)
+{
+	Thread->Prewarm().Next([OnPrewarmed](bool bSucceeded) { OnPrewarmed.ExecuteIfBound(bSucceeded); });
+}
+
 void USpeechRecognizer::StopSpeechRecognition()
 {
 	Thread->StopThread();
 }
 
+bool USpeechRecognizer::PauseSpeechRecognition()
+{
+	return Thread->Pause();
+}
+
+bool USpeechRecognizer::ResumeSpeechRecognition()
+{
+	return Thread->Resume();
+}
+
 void USpeechRecognizer::ProcessAudioData(TArray<float> PCMData, float SampleRate, int32 NumOfChannels, bool bLast)
 {
-	ProcessAudioData(Audio::FAlignedFloatBuffer(MoveTemp(PCMData)), SampleRate, NumOfChannels, bLast);
+	// The allocators differ, so the audio data has to be copied anyway. Copying it into a pooled buffer avoids allocating
+	Audio::FAlignedFloatBuffer PooledPCMData = AcquireAudioBuffer(PCMData.Num());
+	PooledPCMData.Append(PCMData);
+	ProcessAudioData(MoveTemp(PooledPCMData), SampleRate, NumOfChannels, bLast);
 }
 
 void USpeechRecognizer::ProcessAudioData(Audio::FAlignedFloatBuffer PCMData, float SampleRate, int32 NumOfChannels, bool bLast)
@@ -82,6 +124,11 @@ void USpeechRecognizer::ProcessAudioData(Audio::FAlignedFloatBuffer PCMData, flo
 	Thread->ProcessPCMData(MoveTemp(PCMData), SampleRate, NumOfChannels, bLast);
 }
 
+Audio::FAlignedFloatBuffer USpeechRecognizer::AcquireAudioBuffer(int32 NumOfSamples)
+{
+	return FSpeechRecognizerAudioBufferPool::Get().Acquire(NumOfSamples);
+}
+
 void USpeechRecognizer::ForceProcessPendingAudioData()
 {
 	Thread->ForceProcessPendingAudioData();
@@ -102,11 +149,76 @@ bool USpeechRecognizer::GetIsStopping() const
 	return Thread->GetIsStopping();
 }
 
+bool USpeechRecognizer::GetIsPaused() const
+{
+	return Thread->GetIsPaused();
+}
+
 bool USpeechRecognizer::GetIsFinished() const
 {
 	return Thread->GetIsFinished();
 }
 
+FSpeechRecognizerStageTimings USpeechRecognizer::GetStageTimings() const
+{
+	return Thread->GetStageTimings();
+}
+
+void USpeechRecognizer::ResetStageTimings()
+{
+	Thread->ResetStageTimings();
+}
+
+FSpeechRecognizerMetrics USpeechRecognizer::GetMetrics() const
+{
+	return Thread->GetMetrics();
+}
+
+void USpeechRecognizer::ResetMetrics()
+{
+	Thread->ResetMetrics();
+}
+
+FSpeechRecognizerMemoryUsage USpeechRecognizer::GetMemoryUsage() const
+{
+	return Thread->GetMemoryUsage();
+}
+
+FSpeechRecognizerMemoryUsage USpeechRecognizer::GetTotalMemoryUsage()
+{
+	return FSpeechRecognizerThread::GetTotalMemoryUsage();
+}
+
+FSpeechRecognizerFrameImpact USpeechRecognizer::GetFrameImpact()
+{
+	return FSpeechRecognizerThread::GetFrameImpact();
+}
+
+void USpeechRecognizer::ResetFrameImpact()
+{
+	FSpeechRecognizerThread::ResetFrameImpact();
+}
+
+FSpeechRecognizerAudioBufferPoolStats USpeechRecognizer::GetAudioBufferPoolStats()
+{
+	return FSpeechRecognizerAudioBufferPool::Get().GetStats();
+}
+
+void USpeechRecognizer::TrimAudioBufferPool()
+{
+	FSpeechRecognizerAudioBufferPool::Get().Trim();
+}
+
+void USpeechRecognizer::SetGraphProfilingEnabled(bool bEnabled)
+{
+	Thread->SetGraphProfilingEnabled(bEnabled);
+}
+
+bool USpeechRecognizer::ExportGraphProfile(const FString& FilePath) const
+{
+	return Thread->ExportGraphProfile(FilePath);
+}
+
 bool USpeechRecognizer::SetRecognitionParameters(const FSpeechRecognitionParameters& Parameters)
 {
 	return Thread->SetRecognitionParameters(Parameters);
@@ -142,16 +254,46 @@ bool USpeechRecognizer::SetNumOfThreads(int32 Value)
 	return Thread->SetNumOfThreads(Value);
 }
 
+bool USpeechRecognizer::SetNumOfStageThreads(int32 NumOfMelThreads, int32 NumOfEncoderThreads, int32 NumOfDecoderThreads)
+{
+	return Thread->SetNumOfStageThreads(NumOfMelThreads, NumOfEncoderThreads, NumOfDecoderThreads);
+}
+
+bool USpeechRecognizer::SetAutoTuneThreads(bool bAutoTune)
+{
+	return Thread->SetAutoTuneThreads(bAutoTune);
+}
+
 bool USpeechRecognizer::SetLanguage(ESpeechRecognizerLanguage Language)
 {
 	return Thread->SetLanguage(Language);
 }
 
+bool USpeechRecognizer::SetLanguageLock(bool bLock, float ProbabilityThreshold, int32 NumOfChunksToLock, int32 RecheckInterval, float RecheckTokenProbability)
+{
+	return Thread->SetLanguageLock(bLock, ProbabilityThreshold, NumOfChunksToLock, RecheckInterval, RecheckTokenProbability);
+}
+
 bool USpeechRecognizer::SetTranslateToEnglish(bool bTranslate)
 {
 	return Thread->SetTranslateToEnglish(bTranslate);
 }
 
+bool USpeechRecognizer::SetTranscribeAndTranslate(bool bEnable)
+{
+	return Thread->SetTranscribeAndTranslate(bEnable);
+}
+
+bool USpeechRecognizer::SetCommands(const TArray<FString>& Commands, float RejectionProbability)
+{
+	return Thread->SetCommands(Commands, RejectionProbability);
+}
+
+bool USpeechRecognizer::SetVocabulary(const TArray<FString>& Phrases, const FString& Characters, bool bConstrainToPhrases, float GrammarPenalty)
+{
+	return Thread->SetVocabulary(Phrases, Characters, bConstrainToPhrases, GrammarPenalty);
+}
+
 bool USpeechRecognizer::SetStepSize(int32 Value)
 {
 	return Thread->SetStepSize(Value);
@@ -192,6 +334,21 @@ bool USpeechRecognizer::SetEntropyThreshold(float Value)
 	return Thread->SetEntropyThreshold(Value);
 }
 
+bool USpeechRecognizer::SetNumOfParallelFallbackTemperatures(int32 Value)
+{
+	return Thread->SetNumOfParallelFallbackTemperatures(Value);
+}
+
+bool USpeechRecognizer::SetRepetitionDetection(int32 MaxNGramSize, int32 NumOfRepetitions)
+{
+	return Thread->SetRepetitionDetection(MaxNGramSize, NumOfRepetitions);
+}
+
+bool USpeechRecognizer::SetNoSpeechThreshold(float Value)
+{
+	return Thread->SetNoSpeechThreshold(Value);
+}
+
 bool USpeechRecognizer::SetSuppressBlank(bool Value)
 {
 	return Thread->SetSuppressBlank(Value);
@@ -207,7 +364,17 @@ bool USpeechRecognizer::SetBeamSize(int32 Value)
 	return Thread->SetBeamSize(Value);
 }
 
+bool USpeechRecognizer::SetSamplingStrategy(ESpeechRecognizerSamplingStrategy Value)
+{
+	return Thread->SetSamplingStrategy(Value);
+}
+
 bool USpeechRecognizer::SetInitialPrompt(const FString& Value)
 {
 	return Thread->SetInitialPrompt(Value);
 }
+
+bool USpeechRecognizer::SetIdleMemoryTrimDelay(float Value)
+{
+	return Thread->SetIdleMemoryTrimDelay(Value);
+}
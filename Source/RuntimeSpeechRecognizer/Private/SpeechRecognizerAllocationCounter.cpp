@@ -0,0 +1,154 @@
+﻿// Georgy Treshchev 2024.
+
+#include "SpeechRecognizerAllocationCounter.h"
+#include "SpeechRecognizerDefines.h"
+
+namespace
+{
+	/** Whether the allocations made on the current thread are counted */
+	thread_local bool bCounting = false;
+
+	/** Number of allocations counted on the current thread */
+	thread_local int64 NumOfThreadAllocations = 0;
+
+	/** Whether the allocation counter wraps the global allocator */
+	std::atomic<bool> bInstalled{false};
+
+	void CountAllocation()
+	{
+		if (bCounting)
+		{
+			++NumOfThreadAllocations;
+		}
+	}
+}
+
+void FSpeechRecognizerAllocationCounter::Install()
+{
+	check(IsInGameThread());
+	if (bInstalled || !GMalloc)
+	{
+		return;
+	}
+
+	GMalloc = new FSpeechRecognizerAllocationCounter(GMalloc);
+	bInstalled = true;
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Installed the speech recognizer allocation counter"));
+}
+
+bool FSpeechRecognizerAllocationCounter::IsInstalled()
+{
+	return bInstalled;
+}
+
+FSpeechRecognizerAllocationCounter::FCountScope::FCountScope(std::atomic<int64>& InNumOfAllocations)
+	: NumOfAllocations(InNumOfAllocations)
+	, NumOfAllocationsBefore(NumOfThreadAllocations)
+	, bPreviousCounting(bCounting)
+{
+	bCounting = bInstalled;
+}
+
+FSpeechRecognizerAllocationCounter::FCountScope::~FCountScope()
+{
+	bCounting = bPreviousCounting;
+
+	// The allocations of the nested count scopes are included as well
+	NumOfAllocations += NumOfThreadAllocations - NumOfAllocationsBefore;
+}
+
+FSpeechRecognizerAllocationCounter::FIgnoreScope::FIgnoreScope()
+	: bPreviousCounting(bCounting)
+{
+	bCounting = false;
+}
+
+FSpeechRecognizerAllocationCounter::FIgnoreScope::~FIgnoreScope()
+{
+	bCounting = bPreviousCounting;
+}
+
+FSpeechRecognizerAllocationCounter::FSpeechRecognizerAllocationCounter(FMalloc* InUsedMalloc)
+	: UsedMalloc(InUsedMalloc)
+{}
+
+void* FSpeechRecognizerAllocationCounter::Malloc(SIZE_T Count, uint32 Alignment)
+{
+	CountAllocation();
+	return UsedMalloc->Malloc(Count, Alignment);
+}
+
+void* FSpeechRecognizerAllocationCounter::Realloc(void* Original, SIZE_T Count, uint32 Alignment)
+{
+	// Shrinking or freeing through Realloc is not an allocation, but growing may move the memory
+	if (Count > 0)
+	{
+		CountAllocation();
+	}
+	return UsedMalloc->Realloc(Original, Count, Alignment);
+}
+
+void FSpeechRecognizerAllocationCounter::Free(void* Original)
+{
+	UsedMalloc->Free(Original);
+}
+
+SIZE_T FSpeechRecognizerAllocationCounter::QuantizeSize(SIZE_T Count, uint32 Alignment)
+{
+	return UsedMalloc->QuantizeSize(Count, Alignment);
+}
+
+bool FSpeechRecognizerAllocationCounter::GetAllocationSize(void* Original, SIZE_T& SizeOut)
+{
+	return UsedMalloc->GetAllocationSize(Original, SizeOut);
+}
+
+void FSpeechRecognizerAllocationCounter::Trim(bool bTrimThreadCaches)
+{
+	UsedMalloc->Trim(bTrimThreadCaches);
+}
+
+void FSpeechRecognizerAllocationCounter::SetupTLSCachesOnCurrentThread()
+{
+	UsedMalloc->SetupTLSCachesOnCurrentThread();
+}
+
+void FSpeechRecognizerAllocationCounter::ClearAndDisableTLSCachesOnCurrentThread()
+{
+	UsedMalloc->ClearAndDisableTLSCachesOnCurrentThread();
+}
+
+void FSpeechRecognizerAllocationCounter::InitializeStatsMetadata()
+{
+	UsedMalloc->InitializeStatsMetadata();
+}
+
+void FSpeechRecognizerAllocationCounter::UpdateStats()
+{
+	UsedMalloc->UpdateStats();
+}
+
+void FSpeechRecognizerAllocationCounter::GetAllocatorStats(FGenericMemoryStats& OutStats)
+{
+	UsedMalloc->GetAllocatorStats(OutStats);
+}
+
+void FSpeechRecognizerAllocationCounter::DumpAllocatorStats(FOutputDevice& Ar)
+{
+	UsedMalloc->DumpAllocatorStats(Ar);
+}
+
+bool FSpeechRecognizerAllocationCounter::IsInternallyThreadSafe() const
+{
+	return UsedMalloc->IsInternallyThreadSafe();
+}
+
+bool FSpeechRecognizerAllocationCounter::ValidateHeap()
+{
+	return UsedMalloc->ValidateHeap();
+}
+
+const TCHAR* FSpeechRecognizerAllocationCounter::GetDescriptiveName()
+{
+	return UsedMalloc->GetDescriptiveName();
+}
@@ -0,0 +1,77 @@
+﻿// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/MemoryBase.h"
+#include <atomic>
+
+/**
+ * Counts the heap allocations made while speech is being recognized, to check that the steady-state recognition does not allocate
+ * Wraps the global allocator, so it only sees the allocations made through FMemory (which includes the ggml CPU buffers and the standard containers of whisper), not the ones made with the C allocator directly
+ * Meant for benchmarking: once installed, it stays installed until the process exits, since the memory allocated through it may be freed at any time
+ */
+class FSpeechRecognizerAllocationCounter final : public FMalloc
+{
+public:
+	/**
+	 * Wraps the global allocator with the allocation counter. Does nothing if it is already installed
+	 * Should be called on the game thread before the speech recognizers to measure are started
+	 */
+	static void Install();
+
+	/**
+	 * Returns whether the allocation counter is installed
+	 */
+	static bool IsInstalled();
+
+	/**
+	 * Counts the allocations made on the calling thread within the scope, and adds them to the given counter when the scope ends
+	 */
+	struct FCountScope
+	{
+		explicit FCountScope(std::atomic<int64>& InNumOfAllocations);
+		~FCountScope();
+
+	private:
+		std::atomic<int64>& NumOfAllocations;
+		int64 NumOfAllocationsBefore;
+		bool bPreviousCounting;
+	};
+
+	/**
+	 * Excludes the allocations made on the calling thread within the scope from the count (e.g. the results handed over to the game thread)
+	 */
+	struct FIgnoreScope
+	{
+		FIgnoreScope();
+		~FIgnoreScope();
+
+	private:
+		bool bPreviousCounting;
+	};
+
+	//~ Begin FMalloc Interface
+	virtual void* Malloc(SIZE_T Count, uint32 Alignment) override;
+	virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override;
+	virtual void Free(void* Original) override;
+	virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override;
+	virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override;
+	virtual void Trim(bool bTrimThreadCaches) override;
+	virtual void SetupTLSCachesOnCurrentThread() override;
+	virtual void ClearAndDisableTLSCachesOnCurrentThread() override;
+	virtual void InitializeStatsMetadata() override;
+	virtual void UpdateStats() override;
+	virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override;
+	virtual void DumpAllocatorStats(FOutputDevice& Ar) override;
+	virtual bool IsInternallyThreadSafe() const override;
+	virtual bool ValidateHeap() override;
+	virtual const TCHAR* GetDescriptiveName() override;
+	//~ End FMalloc Interface
+
+private:
+	explicit FSpeechRecognizerAllocationCounter(FMalloc* InUsedMalloc);
+
+	/** The allocator being wrapped */
+	FMalloc* UsedMalloc;
+};
@@ -0,0 +1,154 @@
+﻿// Georgy Treshchev 2024.
+
+#include "SpeechRecognizerAudioBufferPool.h"
+#include "SpeechRecognizerStats.h"
+#include "Misc/EngineVersionComparison.h"
+#include "Misc/ScopeLock.h"
+
+FSpeechRecognizerAudioBufferPool::FSpeechRecognizerAudioBufferPool()
+{
+	for (FSizeClass& SizeClass : SizeClasses)
+	{
+		SizeClass.Buffers.Reserve(MaxBuffersPerSizeClass);
+	}
+}
+
+FSpeechRecognizerAudioBufferPool& FSpeechRecognizerAudioBufferPool::Get()
+{
+	static FSpeechRecognizerAudioBufferPool AudioBufferPool;
+	return AudioBufferPool;
+}
+
+Audio::FAlignedFloatBuffer FSpeechRecognizerAudioBufferPool::Acquire(int32 NumOfSamples)
+{
+	++NumOfAcquires;
+
+	const int32 SizeClassIndex = GetSizeClassForRequest(NumOfSamples);
+	if (SizeClassIndex == INDEX_NONE)
+	{
+		++NumOfAllocations;
+		Audio::FAlignedFloatBuffer Buffer;
+		Buffer.Reserve(NumOfSamples);
+		return Buffer;
+	}
+
+	{
+		FSizeClass& SizeClass = SizeClasses[SizeClassIndex];
+		FScopeLock Lock(&SizeClass.Guard);
+		if (SizeClass.Buffers.Num() > 0)
+		{
+#if UE_VERSION_OLDER_THAN(5, 4, 0)
+			Audio::FAlignedFloatBuffer Buffer = SizeClass.Buffers.Pop(false);
+#else
+			Audio::FAlignedFloatBuffer Buffer = SizeClass.Buffers.Pop(EAllowShrinking::No);
+#endif
+			const int64 BufferBytes = static_cast<int64>(Buffer.Max()) * sizeof(float);
+			--NumOfPooledBuffers;
+			PooledBytes -= BufferBytes;
+			DEC_MEMORY_STAT_BY(STAT_SpeechRecognizer_AudioBufferPoolMemory, BufferBytes);
+			++NumOfReuses;
+			return Buffer;
+		}
+	}
+
+	// Allocating the full capacity of the size class, so that the buffer goes back to the same class when released
+	++NumOfAllocations;
+	Audio::FAlignedFloatBuffer Buffer;
+	Buffer.Reserve(1 << (MinSizeClass + SizeClassIndex));
+	return Buffer;
+}
+
+void FSpeechRecognizerAudioBufferPool::Release(Audio::FAlignedFloatBuffer&& Buffer)
+{
+	const int32 SizeClassIndex = GetSizeClassForCapacity(Buffer.Max());
+	if (SizeClassIndex == INDEX_NONE)
+	{
+		if (Buffer.Max() > 0)
+		{
+			++NumOfDiscards;
+		}
+		Buffer.Empty();
+		return;
+	}
+
+	Buffer.Reset();
+
+	FSizeClass& SizeClass = SizeClasses[SizeClassIndex];
+	FScopeLock Lock(&SizeClass.Guard);
+	if (SizeClass.Buffers.Num() >= MaxBuffersPerSizeClass)
+	{
+		++NumOfDiscards;
+		Buffer.Empty();
+		return;
+	}
+
+	const int64 BufferBytes = static_cast<int64>(Buffer.Max()) * sizeof(float);
+	SizeClass.Buffers.Add(MoveTemp(Buffer));
+	++NumOfPooledBuffers;
+	PooledBytes += BufferBytes;
+	INC_MEMORY_STAT_BY(STAT_SpeechRecognizer_AudioBufferPoolMemory, BufferBytes);
+}
+
+void FSpeechRecognizerAudioBufferPool::Reserve(Audio::FAlignedFloatBuffer& Buffer, int32 NumOfSamples)
+{
+	if (Buffer.Max() >= NumOfSamples)
+	{
+		return;
+	}
+
+	// Growing to at least twice the current capacity, so that repeatedly appending small chunks moves the data only a logarithmic number of times
+	Audio::FAlignedFloatBuffer GrownBuffer = Acquire(FMath::Max(NumOfSamples, Buffer.Max() * 2));
+	GrownBuffer.Append(Buffer);
+	Release(MoveTemp(Buffer));
+	Buffer = MoveTemp(GrownBuffer);
+}
+
+void FSpeechRecognizerAudioBufferPool::Append(Audio::FAlignedFloatBuffer& Buffer, const float* Samples, int32 NumOfSamples)
+{
+	Reserve(Buffer, Buffer.Num() + NumOfSamples);
+	Buffer.Append(Samples, NumOfSamples);
+}
+
+void FSpeechRecognizerAudioBufferPool::Trim()
+{
+	for (FSizeClass& SizeClass : SizeClasses)
+	{
+		FScopeLock Lock(&SizeClass.Guard);
+		for (const Audio::FAlignedFloatBuffer& Buffer : SizeClass.Buffers)
+		{
+			const int64 BufferBytes = static_cast<int64>(Buffer.Max()) * sizeof(float);
+			--NumOfPooledBuffers;
+			PooledBytes -= BufferBytes;
+			DEC_MEMORY_STAT_BY(STAT_SpeechRecognizer_AudioBufferPoolMemory, BufferBytes);
+		}
+		SizeClass.Buffers.Reset();
+	}
+}
+
+FSpeechRecognizerAudioBufferPoolStats FSpeechRecognizerAudioBufferPool::GetStats() const
+{
+	FSpeechRecognizerAudioBufferPoolStats Stats;
+	Stats.NumOfAcquires = NumOfAcquires.load(std::memory_order_relaxed);
+	Stats.NumOfReuses = NumOfReuses.load(std::memory_order_relaxed);
+	Stats.NumOfAllocations = NumOfAllocations.load(std::memory_order_relaxed);
+	Stats.NumOfDiscards = NumOfDiscards.load(std::memory_order_relaxed);
+	Stats.NumOfPooledBuffers = NumOfPooledBuffers.load(std::memory_order_relaxed);
+	Stats.PooledBytes = PooledBytes.load(std::memory_order_relaxed);
+	return Stats;
+}
+
+int32 FSpeechRecognizerAudioBufferPool::GetSizeClassForRequest(int32 NumOfSamples)
+{
+	const int32 SizeClass = FMath::Max(MinSizeClass, static_cast<int32>(FMath::CeilLogTwo(static_cast<uint32>(FMath::Max(NumOfSamples, 1)))));
+	return SizeClass <= MaxSizeClass ? SizeClass - MinSizeClass : INDEX_NONE;
+}
+
+int32 FSpeechRecognizerAudioBufferPool::GetSizeClassForCapacity(int32 Capacity)
+{
+	if (Capacity < (1 << MinSizeClass))
+	{
+		return INDEX_NONE;
+	}
+	const int32 SizeClass = static_cast<int32>(FMath::FloorLog2(static_cast<uint32>(Capacity)));
+	return SizeClass <= MaxSizeClass ? SizeClass - MinSizeClass : INDEX_NONE;
+}
@@ -0,0 +1,107 @@
+﻿// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SpeechRecognizerTypes.h"
+#include "SampleBuffer.h"
+#include <atomic>
+
+/**
+ * Pool of the audio buffers used on the ingest path (submitted, pending, mixed and resampled, and queued audio data), shared by all speech recognizers
+ * Buffers are grouped into power-of-two size classes by capacity, so that a released buffer can serve any later request of its class without reallocating
+ * Capture callbacks typically submit small chunks of a handful of sizes many times per second, so in steady state every request is served from the pool
+ */
+class FSpeechRecognizerAudioBufferPool
+{
+public:
+	FSpeechRecognizerAudioBufferPool();
+
+	/**
+	 * Returns the audio buffer pool shared by all speech recognizers
+	 */
+	static FSpeechRecognizerAudioBufferPool& Get();
+
+	/**
+	 * Returns an empty buffer that can hold at least the given number of samples without reallocating
+	 *
+	 * @param NumOfSamples The number of samples the buffer must be able to hold
+	 * @return The buffer, reused from the pool if a buffer of the size class was released before
+	 */
+	Audio::FAlignedFloatBuffer Acquire(int32 NumOfSamples);
+
+	/**
+	 * Returns a buffer to the pool, leaving it empty. The buffer is freed instead if it is too small or too large to be pooled, or if its size class is full
+	 * Can be called from any thread
+	 *
+	 * @param Buffer The buffer to release
+	 */
+	void Release(Audio::FAlignedFloatBuffer&& Buffer);
+
+	/**
+	 * Makes sure the buffer can hold at least the given number of samples, moving its contents to a larger buffer from the pool if needed
+	 *
+	 * @param Buffer The buffer to grow
+	 * @param NumOfSamples The number of samples the buffer must be able to hold
+	 */
+	void Reserve(Audio::FAlignedFloatBuffer& Buffer, int32 NumOfSamples);
+
+	/**
+	 * Appends samples to the buffer, growing it with a buffer from the pool if needed
+	 *
+	 * @param Buffer The buffer to append to
+	 * @param Samples The samples to append
+	 * @param NumOfSamples The number of samples to append
+	 */
+	void Append(Audio::FAlignedFloatBuffer& Buffer, const float* Samples, int32 NumOfSamples);
+
+	/**
+	 * Frees all the buffers held by the pool
+	 */
+	void Trim();
+
+	/**
+	 * Returns the statistics of the pool
+	 */
+	FSpeechRecognizerAudioBufferPoolStats GetStats() const;
+
+private:
+	/** Size classes are powers of two of the capacity in samples, from 1024 samples (64 ms at 16 kHz) to 4M samples (~4 minutes at 16 kHz) */
+	static constexpr int32 MinSizeClass = 10;
+	static constexpr int32 MaxSizeClass = 22;
+	static constexpr int32 NumOfSizeClasses = MaxSizeClass - MinSizeClass + 1;
+
+	/** Maximum number of buffers kept per size class, which bounds the memory held by the pool */
+	static constexpr int32 MaxBuffersPerSizeClass = 16;
+
+	/**
+	 * Returns the smallest size class whose buffers can hold the given number of samples, or INDEX_NONE if the buffers are too large to be pooled
+	 */
+	static int32 GetSizeClassForRequest(int32 NumOfSamples);
+
+	/**
+	 * Returns the size class the buffer with the given capacity can be pooled in, or INDEX_NONE if it is too small or too large to be pooled
+	 */
+	static int32 GetSizeClassForCapacity(int32 Capacity);
+
+	/**
+	 * Released buffers of one size class
+	 */
+	struct FSizeClass
+	{
+		/** Released buffers, reserved up front so that releasing a buffer does not allocate */
+		TArray<Audio::FAlignedFloatBuffer> Buffers;
+
+		/** Data guard (mutex) for thread safety of the released buffers */
+		FCriticalSection Guard;
+	};
+
+	FSizeClass SizeClasses[NumOfSizeClasses];
+
+	std::atomic<int64> NumOfAcquires{0};
+	std::atomic<int64> NumOfReuses{0};
+	std::atomic<int64> NumOfAllocations{0};
+	std::atomic<int64> NumOfDiscards{0};
+	std::atomic<int32> NumOfPooledBuffers{0};
+	std::atomic<int64> PooledBytes{0};
+};
@@ -0,0 +1,202 @@
+﻿// Georgy Treshchev 2024.
+
+#include "SpeechRecognizerFrameMonitor.h"
+#include "SpeechRecognizerSettings.h"
+#include "SpeechRecognizerThread.h"
+#include "Misc/CoreDelegates.h"
+
+namespace
+{
+	/** Weight of the most recent frame in the smoothed frame time */
+	constexpr double FrameTimeSmoothing = 0.2;
+
+	/** Fraction of the budget the smoothed frame time has to drop below for the frame to no longer be critical, to avoid toggling the throttling every frame */
+	constexpr double FrameCriticalHysteresis = 0.9;
+
+	/** Granularity of the waiting in the Yield throttling mode, in seconds */
+	constexpr float YieldSleepSeconds = 0.001f;
+
+	/** Throttling counters of the recognition in progress on the current thread, null outside of a recognition scope */
+	thread_local FSpeechRecognizerThrottlingCounters* CurrentThrottlingCounters = nullptr;
+
+	/** Time the graphs of the recognition in progress on the current thread may still be delayed for in the Yield throttling mode, in seconds */
+	thread_local double RemainingYieldSeconds = 0;
+
+	/** Adds to an atomic double (fetch_add on floating point atomics requires C++20) */
+	void AtomicAdd(std::atomic<double>& Value, double Delta)
+	{
+		double Expected = Value.load(std::memory_order_relaxed);
+		while (!Value.compare_exchange_weak(Expected, Expected + Delta, std::memory_order_relaxed))
+		{
+		}
+	}
+}
+
+FSpeechRecognizerFrameMonitor& FSpeechRecognizerFrameMonitor::Get()
+{
+	static FSpeechRecognizerFrameMonitor FrameMonitor;
+	return FrameMonitor;
+}
+
+void FSpeechRecognizerFrameMonitor::Initialize()
+{
+	if (!BeginFrameHandle.IsValid())
+	{
+		BeginFrameHandle = FCoreDelegates::OnBeginFrame.AddRaw(this, &FSpeechRecognizerFrameMonitor::OnBeginFrame);
+	}
+}
+
+void FSpeechRecognizerFrameMonitor::Shutdown()
+{
+	if (BeginFrameHandle.IsValid())
+	{
+		FCoreDelegates::OnBeginFrame.Remove(BeginFrameHandle);
+		BeginFrameHandle.Reset();
+	}
+	bFrameCritical = false;
+}
+
+FSpeechRecognizerFrameMonitor::FRecognitionScope::FRecognitionScope(FSpeechRecognizerThrottlingCounters& InThrottlingCounters)
+	: PreviousThrottlingCounters(CurrentThrottlingCounters)
+	, PreviousRemainingYieldSeconds(RemainingYieldSeconds)
+{
+	FSpeechRecognizerFrameMonitor& FrameMonitor = Get();
+	++FrameMonitor.NumOfActiveRecognitions;
+	FrameMonitor.bRecognizedDuringFrame = true;
+
+	CurrentThrottlingCounters = &InThrottlingCounters;
+	RemainingYieldSeconds = FrameMonitor.MaxYieldMs.load(std::memory_order_relaxed) / 1000.0;
+	if (FrameMonitor.bFrameCritical.load(std::memory_order_relaxed))
+	{
+		++InThrottlingCounters.NumOfFrameCriticalChunks;
+	}
+}
+
+FSpeechRecognizerFrameMonitor::FRecognitionScope::~FRecognitionScope()
+{
+	--Get().NumOfActiveRecognitions;
+	CurrentThrottlingCounters = PreviousThrottlingCounters;
+	RemainingYieldSeconds = PreviousRemainingYieldSeconds;
+}
+
+int FSpeechRecognizerFrameMonitor::ThrottleGraph(int NumOfThreads)
+{
+	if (!bFrameCritical.load(std::memory_order_relaxed))
+	{
+		return NumOfThreads;
+	}
+
+	switch (FrameThrottling.load(std::memory_order_relaxed))
+	{
+	case ESpeechRecognizerFrameThrottling::CapThreads:
+	{
+		const int ThrottledThreads = FMath::Max(1, ThrottledNumOfThreads.load(std::memory_order_relaxed));
+		if (ThrottledThreads < NumOfThreads)
+		{
+			++NumOfThrottledGraphs;
+			if (CurrentThrottlingCounters)
+			{
+				++CurrentThrottlingCounters->NumOfThrottledGraphs;
+			}
+			return ThrottledThreads;
+		}
+		return NumOfThreads;
+	}
+	case ESpeechRecognizerFrameThrottling::Yield:
+	{
+		// The frame time only tells that the game is slow, not when its critical work happens, so a graph waits at most until the next frame begins,
+		// and the graphs of a chunk share a bounded delay, so that a game consistently above the budget (e.g. running at 30 fps) adds a bounded latency per chunk instead of a delay per graph
+		if (!CurrentThrottlingCounters || RemainingYieldSeconds <= 0)
+		{
+			return NumOfThreads;
+		}
+
+		const double StartTime = FPlatformTime::Seconds();
+		const uint64 StartFrame = FrameCounter.load(std::memory_order_relaxed);
+		while (bFrameCritical.load(std::memory_order_relaxed) && FrameCounter.load(std::memory_order_relaxed) == StartFrame && FPlatformTime::Seconds() - StartTime < RemainingYieldSeconds)
+		{
+			FPlatformProcess::Sleep(YieldSleepSeconds);
+		}
+
+		const double GraphYieldedSeconds = FPlatformTime::Seconds() - StartTime;
+		RemainingYieldSeconds -= GraphYieldedSeconds;
+		++NumOfThrottledGraphs;
+		AtomicAdd(YieldedSeconds, GraphYieldedSeconds);
+		++CurrentThrottlingCounters->NumOfThrottledGraphs;
+		CurrentThrottlingCounters->YieldedMicroseconds += static_cast<int64>(GraphYieldedSeconds * 1e6);
+		return NumOfThreads;
+	}
+	default:
+		return NumOfThreads;
+	}
+}
+
+FSpeechRecognizerFrameImpact FSpeechRecognizerFrameMonitor::GetFrameImpact() const
+{
+	FSpeechRecognizerFrameImpact FrameImpact;
+	FrameImpact.NumOfFramesWhileRecognizing = NumOfFramesWhileRecognizing.load(std::memory_order_relaxed);
+	FrameImpact.NumOfFramesWhileIdle = NumOfFramesWhileIdle.load(std::memory_order_relaxed);
+	FrameImpact.AverageFrameTimeMsWhileRecognizing = FrameImpact.NumOfFramesWhileRecognizing > 0 ? FrameTimeMsWhileRecognizing.load(std::memory_order_relaxed) / FrameImpact.NumOfFramesWhileRecognizing : 0.f;
+	FrameImpact.AverageFrameTimeMsWhileIdle = FrameImpact.NumOfFramesWhileIdle > 0 ? FrameTimeMsWhileIdle.load(std::memory_order_relaxed) / FrameImpact.NumOfFramesWhileIdle : 0.f;
+	FrameImpact.NumOfThrottledGraphs = NumOfThrottledGraphs.load(std::memory_order_relaxed);
+	FrameImpact.YieldedSeconds = YieldedSeconds.load(std::memory_order_relaxed);
+	return FrameImpact;
+}
+
+void FSpeechRecognizerFrameMonitor::ResetFrameImpact()
+{
+	FrameTimeMsWhileRecognizing = 0;
+	FrameTimeMsWhileIdle = 0;
+	NumOfFramesWhileRecognizing = 0;
+	NumOfFramesWhileIdle = 0;
+	NumOfThrottledGraphs = 0;
+	YieldedSeconds = 0;
+}
+
+void FSpeechRecognizerFrameMonitor::OnBeginFrame()
+{
+	const USpeechRecognizerSettings* Settings = GetDefault<USpeechRecognizerSettings>();
+	FrameThrottling = Settings->FrameThrottling;
+	ThrottledNumOfThreads = Settings->ThrottledNumOfThreads;
+	MaxYieldMs = Settings->MaxYieldMs;
+
+	++FrameCounter;
+
+	const double FrameStartTime = FPlatformTime::Seconds();
+	const double PreviousFrameStartTime = LastFrameStartTime;
+	LastFrameStartTime = FrameStartTime;
+
+	// The recognition flag is re-armed for the new frame if a recognition is still in progress
+	const bool bRecognizedDuringPreviousFrame = bRecognizedDuringFrame.exchange(NumOfActiveRecognitions.load() > 0);
+	if (PreviousFrameStartTime <= 0)
+	{
+		return;
+	}
+
+	const double FrameTimeMs = (FrameStartTime - PreviousFrameStartTime) * 1000.0;
+	if (bRecognizedDuringPreviousFrame)
+	{
+		AtomicAdd(FrameTimeMsWhileRecognizing, FrameTimeMs);
+		++NumOfFramesWhileRecognizing;
+	}
+	else
+	{
+		AtomicAdd(FrameTimeMsWhileIdle, FrameTimeMs);
+		++NumOfFramesWhileIdle;
+	}
+
+	SmoothedFrameTimeMs = SmoothedFrameTimeMs > 0 ? FMath::Lerp(SmoothedFrameTimeMs, FrameTimeMs, FrameTimeSmoothing) : FrameTimeMs;
+
+	if (Settings->FrameThrottling == ESpeechRecognizerFrameThrottling::Disabled)
+	{
+		bFrameCritical = false;
+	}
+	else if (bFrameCritical)
+	{
+		bFrameCritical = SmoothedFrameTimeMs > Settings->FrameTimeBudgetMs * FrameCriticalHysteresis;
+	}
+	else
+	{
+		bFrameCritical = SmoothedFrameTimeMs > Settings->FrameTimeBudgetMs;
+	}
+}
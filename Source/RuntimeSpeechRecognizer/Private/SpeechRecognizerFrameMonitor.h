@@ -0,0 +1,111 @@
+﻿// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SpeechRecognizerTypes.h"
+#include <atomic>
+
+struct FSpeechRecognizerThrottlingCounters;
+
+/**
+ * Watches the game frame time and throttles the ggml inference graphs while the game is in frame-critical work (the frame time is above the budget),
+ * so that inference does not compete with the game and render threads for the cores when the frame can least afford it
+ * Also measures the frame time while speech is being recognized versus while it is not, to quantify the impact of recognition on the game
+ */
+class FSpeechRecognizerFrameMonitor
+{
+public:
+	/**
+	 * Returns the frame monitor shared by all speech recognizers
+	 */
+	static FSpeechRecognizerFrameMonitor& Get();
+
+	/**
+	 * Starts watching the frame time. Called on module startup
+	 */
+	void Initialize();
+
+	/**
+	 * Stops watching the frame time. Called on module shutdown
+	 */
+	void Shutdown();
+
+	/**
+	 * Marks speech as being recognized on the calling thread within the scope (an audio chunk), for the frame time impact and the throttling of its graphs
+	 */
+	struct FRecognitionScope
+	{
+		/**
+		 * @param InThrottlingCounters The throttling counters of the speech recognizer, updated while the scope is active
+		 */
+		explicit FRecognitionScope(FSpeechRecognizerThrottlingCounters& InThrottlingCounters);
+		~FRecognitionScope();
+
+	private:
+		FSpeechRecognizerThrottlingCounters* PreviousThrottlingCounters;
+		double PreviousRemainingYieldSeconds;
+	};
+
+	/**
+	 * Applies the frame throttling to the next inference graph. Used by the whisper graph hook on the thread computing the graph
+	 * Depending on the throttling mode, either caps the number of threads or waits until the frame is no longer critical or the next frame begins
+	 * In the Yield mode, the graphs of an audio chunk are delayed by at most MaxYieldMs in total, and graphs computed outside of a recognition scope are not delayed
+	 *
+	 * @param NumOfThreads The number of threads the graph is about to be computed with
+	 * @return The number of threads to compute the graph with
+	 */
+	int ThrottleGraph(int NumOfThreads);
+
+	/**
+	 * Returns the measured impact of speech recognition on the frame time
+	 */
+	FSpeechRecognizerFrameImpact GetFrameImpact() const;
+
+	/**
+	 * Resets the measured impact of speech recognition on the frame time
+	 */
+	void ResetFrameImpact();
+
+private:
+	/**
+	 * Measures the duration of the previous frame and updates the frame-critical state. Called on the game thread at the beginning of every frame
+	 */
+	void OnBeginFrame();
+
+	/** Handle of the begin frame delegate */
+	FDelegateHandle BeginFrameHandle;
+
+	/** Time the previous frame began at, in seconds */
+	double LastFrameStartTime = 0;
+
+	/** Exponential moving average of the frame time, in milliseconds */
+	double SmoothedFrameTimeMs = 0;
+
+	/** Whether the game is currently in frame-critical work */
+	std::atomic<bool> bFrameCritical{false};
+
+	/** Number of frames that began, for the yielding graphs to stop waiting once the next frame begins */
+	std::atomic<uint64> FrameCounter{0};
+
+	/** Throttling settings, cached on the game thread since the settings object is not safe to read from the recognizer threads */
+	std::atomic<ESpeechRecognizerFrameThrottling> FrameThrottling{ESpeechRecognizerFrameThrottling::Disabled};
+	std::atomic<int32> ThrottledNumOfThreads{1};
+	std::atomic<float> MaxYieldMs{0};
+
+	/** Number of speech recognitions currently in progress */
+	std::atomic<int32> NumOfActiveRecognitions{0};
+
+	/** Whether speech was being recognized at any point during the current frame */
+	std::atomic<bool> bRecognizedDuringFrame{false};
+
+	/** Accumulated frame times and counts, split by whether speech was being recognized */
+	std::atomic<double> FrameTimeMsWhileRecognizing{0};
+	std::atomic<double> FrameTimeMsWhileIdle{0};
+	std::atomic<int32> NumOfFramesWhileRecognizing{0};
+	std::atomic<int32> NumOfFramesWhileIdle{0};
+
+	/** Number of throttled inference graphs and the total time they were delayed for */
+	std::atomic<int32> NumOfThrottledGraphs{0};
+	std::atomic<double> YieldedSeconds{0};
+};
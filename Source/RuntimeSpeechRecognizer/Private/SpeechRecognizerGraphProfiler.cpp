@@ -0,0 +1,199 @@
+﻿// Georgy Treshchev 2024.
+
+#include "SpeechRecognizerGraphProfiler.h"
+#include "SpeechRecognizerDefines.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+THIRD_PARTY_INCLUDES_START
+#include "ggml.h"
+THIRD_PARTY_INCLUDES_END
+
+namespace
+{
+	/** The whisper stage currently being computed on this thread */
+	thread_local const TCHAR* CurrentStage = TEXT("Unknown");
+
+	FString FormatShape(const int64 (&Shape)[4])
+	{
+		return FString::Printf(TEXT("%lldx%lldx%lldx%lld"), Shape[0], Shape[1], Shape[2], Shape[3]);
+	}
+}
+
+FSpeechRecognizerGraphProfiler::FStageScope::FStageScope(const TCHAR* Stage)
+	: PreviousStage(CurrentStage)
+{
+	CurrentStage = Stage;
+}
+
+FSpeechRecognizerGraphProfiler::FStageScope::~FStageScope()
+{
+	CurrentStage = PreviousStage;
+}
+
+void FSpeechRecognizerGraphProfiler::BeginCapture()
+{
+	ggml_graph_set_profile_callback(&FSpeechRecognizerGraphProfiler::OnNodeComputed, this);
+}
+
+void FSpeechRecognizerGraphProfiler::EndCapture()
+{
+	ggml_graph_set_profile_callback(nullptr, nullptr);
+}
+
+void FSpeechRecognizerGraphProfiler::Reset()
+{
+	FScopeLock Lock(&DataGuard);
+	Records.Empty();
+	NumOfGraphs = 0;
+}
+
+int32 FSpeechRecognizerGraphProfiler::GetNumOfRecordedNodes() const
+{
+	FScopeLock Lock(&DataGuard);
+	return Records.Num();
+}
+
+void FSpeechRecognizerGraphProfiler::OnNodeComputed(const ggml_cgraph* Graph, int NodeIndex, int NumOfThreads, int64_t StartUs, int64_t EndUs, void* UserData)
+{
+	FSpeechRecognizerGraphProfiler* Profiler = static_cast<FSpeechRecognizerGraphProfiler*>(UserData);
+	if (!Profiler || !Graph)
+	{
+		return;
+	}
+
+	const ggml_tensor* Node = ggml_graph_node(const_cast<ggml_cgraph*>(Graph), NodeIndex);
+	const ggml_tensor* Source0 = Node->src[0];
+	const ggml_tensor* Source1 = Node->src[1];
+
+	FScopeLock Lock(&Profiler->DataGuard);
+
+	// The first node of a graph starts a new graph
+	if (NodeIndex == 0)
+	{
+		++Profiler->NumOfGraphs;
+	}
+
+	FNodeRecord& Record = Profiler->Records.AddDefaulted_GetRef();
+	Record.GraphIndex = Profiler->NumOfGraphs - 1;
+	Record.NodeIndex = NodeIndex;
+	Record.Stage = CurrentStage;
+	Record.Op = ggml_op_desc(Node);
+	Record.Type = ggml_type_name(Node->type);
+	Record.SourceType = Source0 ? ggml_type_name(Source0->type) : "";
+	for (int32 Dimension = 0; Dimension < 4; ++Dimension)
+	{
+		Record.Shape[Dimension] = Node->ne[Dimension];
+		Record.Source0Shape[Dimension] = Source0 ? Source0->ne[Dimension] : 0;
+		Record.Source1Shape[Dimension] = Source1 ? Source1->ne[Dimension] : 0;
+	}
+	Record.NumOfThreads = NumOfThreads;
+	Record.StartUs = StartUs;
+	Record.EndUs = EndUs;
+}
+
+bool FSpeechRecognizerGraphProfiler::Export(const FString& FilePath) const
+{
+	FScopeLock Lock(&DataGuard);
+
+	if (Records.Num() <= 0)
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Warning, TEXT("Unable to export the graph profile to '%s' since no graph nodes were recorded"), *FilePath);
+		return false;
+	}
+
+	FString Output;
+
+	if (FPaths::GetExtension(FilePath).Equals(TEXT("csv"), ESearchCase::IgnoreCase))
+	{
+		/**
+		 * Node timings aggregated per graph, op and source type
+		 */
+		struct FAggregate
+		{
+			int32 GraphIndex;
+			const TCHAR* Stage;
+			const char* Op;
+			const char* SourceType;
+			int32 NumOfThreads;
+			int32 Count;
+			int64 TotalUs;
+			int64 MaxUs;
+		};
+
+		TArray<FAggregate> Aggregates;
+		TMap<int32, int64> GraphTotalsUs;
+		for (const FNodeRecord& Record : Records)
+		{
+			const int64 DurationUs = Record.EndUs - Record.StartUs;
+			GraphTotalsUs.FindOrAdd(Record.GraphIndex) += DurationUs;
+
+			// Records of the same graph are contiguous, so it is enough to look for the aggregate among the ones of the current graph
+			FAggregate* Aggregate = nullptr;
+			for (int32 AggregateIndex = Aggregates.Num() - 1; AggregateIndex >= 0 && Aggregates[AggregateIndex].GraphIndex == Record.GraphIndex; --AggregateIndex)
+			{
+				if (FCStringAnsi::Strcmp(Aggregates[AggregateIndex].Op, Record.Op) == 0 && FCStringAnsi::Strcmp(Aggregates[AggregateIndex].SourceType, Record.SourceType) == 0)
+				{
+					Aggregate = &Aggregates[AggregateIndex];
+					break;
+				}
+			}
+			if (!Aggregate)
+			{
+				Aggregate = &Aggregates.Add_GetRef({Record.GraphIndex, Record.Stage, Record.Op, Record.SourceType, Record.NumOfThreads, 0, 0, 0});
+			}
+
+			++Aggregate->Count;
+			Aggregate->TotalUs += DurationUs;
+			Aggregate->MaxUs = FMath::Max(Aggregate->MaxUs, DurationUs);
+		}
+
+		Output = TEXT("Graph,Stage,Op,SourceType,Threads,Count,TotalUs,AverageUs,MaxUs,GraphSharePercent\n");
+		for (const FAggregate& Aggregate : Aggregates)
+		{
+			const int64 GraphTotalUs = GraphTotalsUs.FindRef(Aggregate.GraphIndex);
+			Output += FString::Printf(TEXT("%d,%s,%hs,%hs,%d,%d,%lld,%.2f,%lld,%.2f\n"),
+				Aggregate.GraphIndex, Aggregate.Stage, Aggregate.Op, Aggregate.SourceType, Aggregate.NumOfThreads, Aggregate.Count,
+				Aggregate.TotalUs, static_cast<double>(Aggregate.TotalUs) / Aggregate.Count, Aggregate.MaxUs,
+				GraphTotalUs > 0 ? 100.0 * Aggregate.TotalUs / GraphTotalUs : 0.0);
+		}
+	}
+	else
+	{
+		// Chrome trace event format, with one complete event per graph and one per node nested inside it
+		const int64 BaseUs = Records[0].StartUs;
+		Output = TEXT("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+		int32 GraphStartIndex = 0;
+		for (int32 RecordIndex = 0; RecordIndex < Records.Num(); ++RecordIndex)
+		{
+			const FNodeRecord& Record = Records[RecordIndex];
+			Output += FString::Printf(TEXT("{\"name\":\"%hs\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%lld,\"dur\":%lld,\"args\":{\"graph\":%d,\"node\":%d,\"type\":\"%hs\",\"src0_type\":\"%hs\",\"shape\":\"%s\",\"src0_shape\":\"%s\",\"src1_shape\":\"%s\",\"threads\":%d}},\n"),
+				Record.Op, Record.Stage, Record.StartUs - BaseUs, Record.EndUs - Record.StartUs,
+				Record.GraphIndex, Record.NodeIndex, Record.Type, Record.SourceType,
+				*FormatShape(Record.Shape), *FormatShape(Record.Source0Shape), *FormatShape(Record.Source1Shape), Record.NumOfThreads);
+
+			const bool bLastOfGraph = RecordIndex == Records.Num() - 1 || Records[RecordIndex + 1].GraphIndex != Record.GraphIndex;
+			if (bLastOfGraph)
+			{
+				const FNodeRecord& FirstRecord = Records[GraphStartIndex];
+				Output += FString::Printf(TEXT("{\"name\":\"%s graph\",\"cat\":\"graph\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%lld,\"dur\":%lld,\"args\":{\"graph\":%d,\"nodes\":%d}},\n"),
+					Record.Stage, FirstRecord.StartUs - BaseUs, Record.EndUs - FirstRecord.StartUs, Record.GraphIndex, RecordIndex - GraphStartIndex + 1);
+				GraphStartIndex = RecordIndex + 1;
+			}
+		}
+
+		// Remove the trailing comma of the last event
+		Output.RemoveFromEnd(TEXT(",\n"));
+		Output += TEXT("\n]}\n");
+	}
+
+	if (!FFileHelper::SaveStringToFile(Output, *FilePath))
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Failed to write the graph profile to '%s'"), *FilePath);
+		return false;
+	}
+
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Exported the graph profile of %d graph(s) and %d node(s) to '%s'"), NumOfGraphs, Records.Num(), *FilePath);
+	return true;
+}
@@ -0,0 +1,106 @@
+﻿// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include <cstdint>
+
+struct ggml_cgraph;
+
+/**
+ * Opt-in profiler of the ggml CPU compute path
+ * Records the op type, shapes, thread count and wall time of every node of the graphs computed on the capturing thread,
+ * grouped per graph and labeled with the whisper stage (encoder, decoder) the graph belongs to
+ */
+class FSpeechRecognizerGraphProfiler
+{
+public:
+	/**
+	 * Labels the graphs computed within the scope with the given whisper stage. Used by the whisper profiling hook
+	 */
+	struct FStageScope
+	{
+		explicit FStageScope(const TCHAR* Stage);
+		~FStageScope();
+
+	private:
+		const TCHAR* PreviousStage;
+	};
+
+	/**
+	 * Starts recording the graphs computed on the calling thread
+	 */
+	void BeginCapture();
+
+	/**
+	 * Stops recording the graphs computed on the calling thread
+	 */
+	void EndCapture();
+
+	/**
+	 * Discards all the recorded nodes
+	 */
+	void Reset();
+
+	/**
+	 * Returns the number of recorded nodes
+	 */
+	int32 GetNumOfRecordedNodes() const;
+
+	/**
+	 * Exports the recorded nodes
+	 * A path with the .csv extension produces the node timings aggregated per graph and op, any other path produces a Chrome trace (chrome://tracing, Perfetto) of every node
+	 *
+	 * @param FilePath The path of the file to write
+	 * @return True if the file was written successfully, false otherwise
+	 */
+	bool Export(const FString& FilePath) const;
+
+private:
+	/** Called by ggml after each node has been computed by all threads */
+	static void OnNodeComputed(const ggml_cgraph* Graph, int NodeIndex, int NumOfThreads, int64_t StartUs, int64_t EndUs, void* UserData);
+
+	/**
+	 * A single recorded graph node
+	 */
+	struct FNodeRecord
+	{
+		/** Index of the graph the node belongs to (in the order the graphs were computed) */
+		int32 GraphIndex;
+
+		/** Index of the node within the graph */
+		int32 NodeIndex;
+
+		/** The whisper stage the graph belongs to */
+		const TCHAR* Stage;
+
+		/** Name of the op (static string owned by ggml) */
+		const char* Op;
+
+		/** Type of the node output and of its first source (usually the weights, which shows the quantization) */
+		const char* Type;
+		const char* SourceType;
+
+		/** Shapes of the node output and of its first two sources */
+		int64 Shape[4];
+		int64 Source0Shape[4];
+		int64 Source1Shape[4];
+
+		/** Number of threads used to compute the node */
+		int32 NumOfThreads;
+
+		/** Wall time of the node, in microseconds */
+		int64 StartUs;
+		int64 EndUs;
+	};
+
+	/** Nodes recorded since the profiler was reset */
+	TArray<FNodeRecord> Records;
+
+	/** Number of graphs recorded since the profiler was reset */
+	int32 NumOfGraphs = 0;
+
+	/** Data guard (mutex) for thread safety of the records */
+	mutable FCriticalSection DataGuard;
+};
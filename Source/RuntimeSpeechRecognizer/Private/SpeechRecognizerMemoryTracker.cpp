@@ -0,0 +1,276 @@
+﻿// Georgy Treshchev 2024.
+
+#include "SpeechRecognizerMemoryTracker.h"
+#include "SpeechRecognizerStats.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ScopeLock.h"
+
+#if !UE_VERSION_OLDER_THAN(5, 0, 0)
+LLM_DEFINE_TAG(SpeechRecognizer);
+LLM_DEFINE_TAG(SpeechRecognizer_Weights);
+LLM_DEFINE_TAG(SpeechRecognizer_KVCache);
+LLM_DEFINE_TAG(SpeechRecognizer_Compute);
+LLM_DEFINE_TAG(SpeechRecognizer_Mel);
+LLM_DEFINE_TAG(SpeechRecognizer_Other);
+#endif
+
+namespace
+{
+	/**
+	 * Header placed in front of every ggml CPU buffer, so that the buffer can be attributed correctly when it is freed (possibly from another thread)
+	 * Its size is a multiple of the alignment, which keeps the buffer itself aligned
+	 */
+	struct alignas(64) FBufferHeader
+	{
+		FSpeechRecognizerMemoryTracker* Tracker;
+		int64 Size;
+		ESpeechRecognizerMemoryCategory Category;
+	};
+
+	constexpr int32 NumOfCategories = static_cast<int32>(ESpeechRecognizerMemoryCategory::Num);
+
+	/** Tracker and category the ggml CPU buffers allocated on the current thread are attributed to */
+	thread_local FSpeechRecognizerMemoryTracker* CurrentTracker = nullptr;
+	thread_local ESpeechRecognizerMemoryCategory CurrentCategory = ESpeechRecognizerMemoryCategory::Other;
+
+	/** Number of bytes currently used by all speech recognizers per category */
+	std::atomic<int64> TotalBytes[NumOfCategories];
+
+	/** Identifier given to the next tracker */
+	std::atomic<int32> NextTrackerId{0};
+
+	/** All existing trackers, for the memory report */
+	TArray<FSpeechRecognizerMemoryTracker*>& GetTrackers()
+	{
+		static TArray<FSpeechRecognizerMemoryTracker*> Trackers;
+		return Trackers;
+	}
+
+	/** Data guard (mutex) for thread safety of the existing trackers */
+	FCriticalSection& GetTrackersGuard()
+	{
+		static FCriticalSection TrackersGuard;
+		return TrackersGuard;
+	}
+
+	/**
+	 * Allocates memory under the Low-Level Memory tracker tag of the given category
+	 */
+	void* MallocWithTag(ESpeechRecognizerMemoryCategory Category, SIZE_T Size)
+	{
+		switch (Category)
+		{
+		case ESpeechRecognizerMemoryCategory::Weights:
+		{
+			SPEECHRECOGNIZER_LLM_SCOPE(Weights);
+			return FMemory::Malloc(Size, alignof(FBufferHeader));
+		}
+		case ESpeechRecognizerMemoryCategory::KVCache:
+		{
+			SPEECHRECOGNIZER_LLM_SCOPE(KVCache);
+			return FMemory::Malloc(Size, alignof(FBufferHeader));
+		}
+		case ESpeechRecognizerMemoryCategory::Compute:
+		{
+			SPEECHRECOGNIZER_LLM_SCOPE(Compute);
+			return FMemory::Malloc(Size, alignof(FBufferHeader));
+		}
+		case ESpeechRecognizerMemoryCategory::Mel:
+		{
+			SPEECHRECOGNIZER_LLM_SCOPE(Mel);
+			return FMemory::Malloc(Size, alignof(FBufferHeader));
+		}
+		default:
+		{
+			SPEECHRECOGNIZER_LLM_SCOPE(Other);
+			return FMemory::Malloc(Size, alignof(FBufferHeader));
+		}
+		}
+	}
+
+	/**
+	 * Updates the memory stat of the given category
+	 */
+	void UpdateMemoryStat(ESpeechRecognizerMemoryCategory Category, int64 Delta)
+	{
+#if STATS
+		switch (Category)
+		{
+		case ESpeechRecognizerMemoryCategory::Weights:
+			INC_MEMORY_STAT_BY(STAT_SpeechRecognizer_WeightsMemory, Delta);
+			break;
+		case ESpeechRecognizerMemoryCategory::KVCache:
+			INC_MEMORY_STAT_BY(STAT_SpeechRecognizer_KVCacheMemory, Delta);
+			break;
+		case ESpeechRecognizerMemoryCategory::Compute:
+			INC_MEMORY_STAT_BY(STAT_SpeechRecognizer_ComputeMemory, Delta);
+			break;
+		case ESpeechRecognizerMemoryCategory::Mel:
+			INC_MEMORY_STAT_BY(STAT_SpeechRecognizer_MelMemory, Delta);
+			break;
+		default:
+			INC_MEMORY_STAT_BY(STAT_SpeechRecognizer_OtherMemory, Delta);
+			break;
+		}
+#endif
+	}
+
+	/**
+	 * Fills the memory usage from per-category byte counts
+	 */
+	FSpeechRecognizerMemoryUsage MakeMemoryUsage(const int64 (&Bytes)[NumOfCategories])
+	{
+		FSpeechRecognizerMemoryUsage MemoryUsage;
+		MemoryUsage.WeightsBytes = Bytes[static_cast<int32>(ESpeechRecognizerMemoryCategory::Weights)];
+		MemoryUsage.KVCacheBytes = Bytes[static_cast<int32>(ESpeechRecognizerMemoryCategory::KVCache)];
+		MemoryUsage.ComputeBytes = Bytes[static_cast<int32>(ESpeechRecognizerMemoryCategory::Compute)];
+		MemoryUsage.MelBytes = Bytes[static_cast<int32>(ESpeechRecognizerMemoryCategory::Mel)];
+		MemoryUsage.OtherBytes = Bytes[static_cast<int32>(ESpeechRecognizerMemoryCategory::Other)];
+		return MemoryUsage;
+	}
+
+	FAutoConsoleCommandWithWorldArgsAndOutputDevice MemReportCommand(
+		TEXT("RuntimeSpeechRecognizer.MemReport"),
+		TEXT("Lists the memory used by every speech recognizer (weights, KV caches, compute buffers, mel spectrogram)"),
+		FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+		{
+			FSpeechRecognizerMemoryTracker::DumpMemoryUsage(Ar);
+		}));
+}
+
+FSpeechRecognizerMemoryTracker::FSpeechRecognizerMemoryTracker()
+	: Id(NextTrackerId++)
+{
+	for (int32 CategoryIndex = 0; CategoryIndex < NumOfCategories; ++CategoryIndex)
+	{
+		AllocatedBytes[CategoryIndex].store(0, std::memory_order_relaxed);
+		ExternalBytes[CategoryIndex].store(0, std::memory_order_relaxed);
+	}
+
+	FScopeLock Lock(&GetTrackersGuard());
+	GetTrackers().Add(this);
+}
+
+FSpeechRecognizerMemoryTracker::~FSpeechRecognizerMemoryTracker()
+{
+	for (int32 CategoryIndex = 0; CategoryIndex < NumOfCategories; ++CategoryIndex)
+	{
+		SetExternalSize(static_cast<ESpeechRecognizerMemoryCategory>(CategoryIndex), 0);
+	}
+
+	ensureMsgf(GetMemoryUsage().GetTotalBytes() == 0, TEXT("Speech recognizer memory tracker destroyed while its ggml buffers are still allocated"));
+
+	FScopeLock Lock(&GetTrackersGuard());
+	GetTrackers().Remove(this);
+}
+
+FSpeechRecognizerMemoryTracker::FOwnerScope::FOwnerScope(FSpeechRecognizerMemoryTracker* Tracker)
+	: PreviousTracker(CurrentTracker)
+{
+	CurrentTracker = Tracker;
+}
+
+FSpeechRecognizerMemoryTracker::FOwnerScope::~FOwnerScope()
+{
+	CurrentTracker = PreviousTracker;
+}
+
+FSpeechRecognizerMemoryTracker::FCategoryScope::FCategoryScope(ESpeechRecognizerMemoryCategory Category)
+	: PreviousCategory(CurrentCategory)
+{
+	CurrentCategory = Category;
+}
+
+FSpeechRecognizerMemoryTracker::FCategoryScope::~FCategoryScope()
+{
+	CurrentCategory = PreviousCategory;
+}
+
+void* FSpeechRecognizerMemoryTracker::Malloc(size_t Size)
+{
+	FBufferHeader* Header = static_cast<FBufferHeader*>(MallocWithTag(CurrentCategory, sizeof(FBufferHeader) + Size));
+	if (!Header)
+	{
+		return nullptr;
+	}
+
+	Header->Tracker = CurrentTracker;
+	Header->Size = static_cast<int64>(Size);
+	Header->Category = CurrentCategory;
+	Account(Header->Tracker, Header->Category, Header->Size);
+
+	return Header + 1;
+}
+
+void FSpeechRecognizerMemoryTracker::Free(void* Ptr)
+{
+	if (!Ptr)
+	{
+		return;
+	}
+
+	FBufferHeader* Header = static_cast<FBufferHeader*>(Ptr) - 1;
+	Account(Header->Tracker, Header->Category, -Header->Size);
+	FMemory::Free(Header);
+}
+
+void FSpeechRecognizerMemoryTracker::SetExternalSize(ESpeechRecognizerMemoryCategory Category, int64 Size)
+{
+	const int64 PreviousSize = ExternalBytes[static_cast<int32>(Category)].exchange(Size, std::memory_order_relaxed);
+	if (PreviousSize != Size)
+	{
+		Account(this, Category, Size - PreviousSize);
+	}
+}
+
+FSpeechRecognizerMemoryUsage FSpeechRecognizerMemoryTracker::GetMemoryUsage() const
+{
+	int64 Bytes[NumOfCategories];
+	for (int32 CategoryIndex = 0; CategoryIndex < NumOfCategories; ++CategoryIndex)
+	{
+		Bytes[CategoryIndex] = AllocatedBytes[CategoryIndex].load(std::memory_order_relaxed);
+	}
+	return MakeMemoryUsage(Bytes);
+}
+
+FSpeechRecognizerMemoryUsage FSpeechRecognizerMemoryTracker::GetTotalMemoryUsage()
+{
+	int64 Bytes[NumOfCategories];
+	for (int32 CategoryIndex = 0; CategoryIndex < NumOfCategories; ++CategoryIndex)
+	{
+		Bytes[CategoryIndex] = TotalBytes[CategoryIndex].load(std::memory_order_relaxed);
+	}
+	return MakeMemoryUsage(Bytes);
+}
+
+void FSpeechRecognizerMemoryTracker::DumpMemoryUsage(FOutputDevice& Ar)
+{
+	auto LogMemoryUsage = [&Ar](const FString& Name, const FSpeechRecognizerMemoryUsage& MemoryUsage)
+	{
+		Ar.Logf(TEXT("%-24s %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f"), *Name,
+			MemoryUsage.WeightsBytes / 1048576.0, MemoryUsage.KVCacheBytes / 1048576.0, MemoryUsage.ComputeBytes / 1048576.0,
+			MemoryUsage.MelBytes / 1048576.0, MemoryUsage.OtherBytes / 1048576.0, MemoryUsage.GetTotalBytes() / 1048576.0);
+	};
+
+	Ar.Logf(TEXT("Runtime Speech Recognizer memory (MB):"));
+	Ar.Logf(TEXT("%-24s %10s %10s %10s %10s %10s %10s"), TEXT("Recognizer"), TEXT("Weights"), TEXT("KVCache"), TEXT("Compute"), TEXT("Mel"), TEXT("Other"), TEXT("Total"));
+	{
+		FScopeLock Lock(&GetTrackersGuard());
+		for (const FSpeechRecognizerMemoryTracker* Tracker : GetTrackers())
+		{
+			LogMemoryUsage(FString::Printf(TEXT("SpeechRecognizer %d"), Tracker->Id), Tracker->GetMemoryUsage());
+		}
+	}
+	LogMemoryUsage(TEXT("Total"), GetTotalMemoryUsage());
+}
+
+void FSpeechRecognizerMemoryTracker::Account(FSpeechRecognizerMemoryTracker* Tracker, ESpeechRecognizerMemoryCategory Category, int64 Delta)
+{
+	const int32 CategoryIndex = static_cast<int32>(Category);
+	if (Tracker)
+	{
+		Tracker->AllocatedBytes[CategoryIndex].fetch_add(Delta, std::memory_order_relaxed);
+	}
+	TotalBytes[CategoryIndex].fetch_add(Delta, std::memory_order_relaxed);
+	UpdateMemoryStat(Category, Delta);
+}
@@ -0,0 +1,127 @@
+﻿// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SpeechRecognizerTypes.h"
+#include "HAL/LowLevelMemTracker.h"
+#include "Misc/EngineVersionComparison.h"
+#include <atomic>
+
+#if !UE_VERSION_OLDER_THAN(5, 0, 0)
+LLM_DECLARE_TAG(SpeechRecognizer_Weights);
+LLM_DECLARE_TAG(SpeechRecognizer_KVCache);
+LLM_DECLARE_TAG(SpeechRecognizer_Compute);
+LLM_DECLARE_TAG(SpeechRecognizer_Mel);
+LLM_DECLARE_TAG(SpeechRecognizer_Other);
+
+/** Tags the allocations made within the scope with the Low-Level Memory tracker tag of the given category */
+#define SPEECHRECOGNIZER_LLM_SCOPE(Category) LLM_SCOPE_BYTAG(SpeechRecognizer_##Category)
+#else
+#define SPEECHRECOGNIZER_LLM_SCOPE(Category)
+#endif
+
+/**
+ * Category of the memory used by a speech recognizer
+ */
+enum class ESpeechRecognizerMemoryCategory : uint8
+{
+	Weights,
+	KVCache,
+	Compute,
+	Mel,
+	Other,
+	Num
+};
+
+/**
+ * Accounts the memory of the ggml CPU buffers (weights, KV caches, compute buffers) allocated by a speech recognizer
+ * The buffers are allocated through FMemory under the Low-Level Memory tracker tag of their category, so that they show up in LLM captures and memreport,
+ * and are attributed to the recognizer that allocated them, so that each recognizer can report its own memory (e.g. to enforce budgets)
+ */
+class FSpeechRecognizerMemoryTracker
+{
+public:
+	FSpeechRecognizerMemoryTracker();
+	~FSpeechRecognizerMemoryTracker();
+
+	/**
+	 * Attributes the ggml CPU buffers allocated on the calling thread within the scope to the given tracker
+	 */
+	struct FOwnerScope
+	{
+		explicit FOwnerScope(FSpeechRecognizerMemoryTracker* Tracker);
+		~FOwnerScope();
+
+	private:
+		FSpeechRecognizerMemoryTracker* PreviousTracker;
+	};
+
+	/**
+	 * Labels the ggml CPU buffers allocated on the calling thread within the scope with the given category. Used by the whisper memory hook
+	 */
+	struct FCategoryScope
+	{
+		explicit FCategoryScope(ESpeechRecognizerMemoryCategory Category);
+		~FCategoryScope();
+
+	private:
+		ESpeechRecognizerMemoryCategory PreviousCategory;
+	};
+
+	/**
+	 * Allocates a ggml CPU buffer, attributed to the tracker and the category of the calling thread. Used by the ggml allocation hook
+	 *
+	 * @param Size The size of the buffer, in bytes
+	 * @return The allocated buffer, or nullptr if the allocation failed
+	 */
+	static void* Malloc(size_t Size);
+
+	/**
+	 * Frees a ggml CPU buffer allocated with Malloc. Can be called from any thread
+	 *
+	 * @param Ptr The buffer to free
+	 */
+	static void Free(void* Ptr);
+
+	/**
+	 * Sets the size of the memory that belongs to the recognizer but is not allocated as a ggml CPU buffer (e.g. the mel spectrogram)
+	 *
+	 * @param Category The category of the memory
+	 * @param Size The current size of the memory, in bytes
+	 */
+	void SetExternalSize(ESpeechRecognizerMemoryCategory Category, int64 Size);
+
+	/**
+	 * Returns the memory currently used by the recognizer
+	 */
+	FSpeechRecognizerMemoryUsage GetMemoryUsage() const;
+
+	/**
+	 * Returns the memory currently used by all speech recognizers
+	 */
+	static FSpeechRecognizerMemoryUsage GetTotalMemoryUsage();
+
+	/**
+	 * Writes the memory used by every speech recognizer to the output device
+	 * Backs the RuntimeSpeechRecognizer.MemReport console command, which can be added to the [MemReportCommands] section of the engine config to be included in memreport
+	 *
+	 * @param Ar The output device to write to
+	 */
+	static void DumpMemoryUsage(FOutputDevice& Ar);
+
+private:
+	/**
+	 * Adds the given number of bytes to the category of the tracker (if any) and to the totals of all speech recognizers
+	 */
+	static void Account(FSpeechRecognizerMemoryTracker* Tracker, ESpeechRecognizerMemoryCategory Category, int64 Delta);
+
+	/** Number of bytes currently used per category (ggml CPU buffers and external memory) */
+	std::atomic<int64> AllocatedBytes[static_cast<int32>(ESpeechRecognizerMemoryCategory::Num)];
+
+	/** Number of bytes set with SetExternalSize per category */
+	std::atomic<int64> ExternalBytes[static_cast<int32>(ESpeechRecognizerMemoryCategory::Num)];
+
+	/** Identifier of the tracker, used to tell the recognizers apart in the memory report */
+	int32 Id;
+};
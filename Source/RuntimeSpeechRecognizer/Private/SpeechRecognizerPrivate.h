@@ -141,6 +141,30 @@
     #endif
 #endif
 
+#include "SpeechRecognizerStats.h"
+#include "SpeechRecognizerGraphProfiler.h"
+#include "SpeechRecognizerMemoryTracker.h"
+#include "SpeechRecognizerFrameMonitor.h"
+
+// Routes the whisper processing stages to the speech recognizer stats and Unreal Insights, and labels the ggml graphs recorded by the graph profiler
+#define WHISPER_PROFILE_SCOPE(Stage) \
+	SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_##Stage); \
+	FSpeechRecognizerGraphProfiler::FStageScope GraphProfilerStageScope(TEXT(#Stage))
+
+// Names the ggml compute worker threads and the whisper worker pool threads so that they can be told apart in Unreal Insights captures and debuggers, and applies the worker thread priority and affinity to them
+void RegisterSpeechRecognizerWorkerThread(int ThreadIndex);
+#define GGML_WORKER_THREAD_STARTED(ThreadIndex) RegisterSpeechRecognizerWorkerThread(ThreadIndex)
+
+// Allocates the ggml CPU buffers through FMemory, attributed to the speech recognizer and labeled with the whisper memory category, so that they are visible to LLM and memreport
+#define WHISPER_MEMORY_SCOPE(Category) \
+	SPEECHRECOGNIZER_LLM_SCOPE(Category); \
+	FSpeechRecognizerMemoryTracker::FCategoryScope MemoryCategoryScope(ESpeechRecognizerMemoryCategory::Category)
+#define GGML_CPU_BUFFER_MALLOC(Size) FSpeechRecognizerMemoryTracker::Malloc(Size)
+#define GGML_CPU_BUFFER_FREE(Ptr) FSpeechRecognizerMemoryTracker::Free(Ptr)
+
+// Caps or delays the ggml graphs while the game is in frame-critical work, according to the frame throttling settings
+#define WHISPER_GRAPH_N_THREADS(NumOfThreads) FSpeechRecognizerFrameMonitor::Get().ThrottleGraph(NumOfThreads)
+
 THIRD_PARTY_INCLUDES_START
 
 #include "whisper.h"
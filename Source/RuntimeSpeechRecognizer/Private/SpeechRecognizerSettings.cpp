@@ -21,6 +21,15 @@ USpeechRecognizerSettings::USpeechRecognizerSettings()
 #if WITH_EDITORONLY_DATA
   , ModelDownloadBaseUrl(TEXT("https://huggingface.co/ggerganov/whisper.cpp/resolve/main/"))
 #endif
+  , KVCacheType(ESpeechRecognizerKVCacheType::Default)
+  , RecognizerThreadPriority(ESpeechRecognizerThreadPriority::Highest)
+  , RecognizerThreadAffinityMask(0)
+  , WorkerThreadPriority(ESpeechRecognizerThreadPriority::Normal)
+  , WorkerThreadAffinityMask(0)
+  , FrameThrottling(ESpeechRecognizerFrameThrottling::Disabled)
+  , FrameTimeBudgetMs(16.67f)
+  , ThrottledNumOfThreads(1)
+  , MaxYieldMs(50.f)
 {
 }
 
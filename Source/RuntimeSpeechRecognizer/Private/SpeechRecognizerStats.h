@@ -0,0 +1,47 @@
+﻿// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+
+DECLARE_STATS_GROUP(TEXT("Runtime Speech Recognizer"), STATGROUP_RuntimeSpeechRecognizer, STATCAT_Advanced);
+
+// Audio ingestion (called from the thread submitting the audio data)
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Ingest"), STAT_SpeechRecognizer_Ingest, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Resample and mix"), STAT_SpeechRecognizer_Resample, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Enqueue"), STAT_SpeechRecognizer_Enqueue, STATGROUP_RuntimeSpeechRecognizer, );
+
+// Recognition stages (called from the speech recognizer thread)
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Recognize chunk"), STAT_SpeechRecognizer_Recognize, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Mel spectrogram"), STAT_SpeechRecognizer_Mel, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Encoder"), STAT_SpeechRecognizer_Encode, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Decoder"), STAT_SpeechRecognizer_Decode, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Sampling"), STAT_SpeechRecognizer_Sample, STATGROUP_RuntimeSpeechRecognizer, );
+
+// Delegate dispatch (called from the task graph)
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Dispatch"), STAT_SpeechRecognizer_Dispatch, STATGROUP_RuntimeSpeechRecognizer, );
+
+// Counters, accumulated across all speech recognizer instances
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Queued chunks"), STAT_SpeechRecognizer_QueueDepth, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Pending samples"), STAT_SpeechRecognizer_PendingSamples, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Decoded tokens"), STAT_SpeechRecognizer_DecodedTokens, STATGROUP_RuntimeSpeechRecognizer, );
+
+// Memory, accumulated across all speech recognizer instances
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Weights memory"), STAT_SpeechRecognizer_WeightsMemory, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_MEMORY_STAT_EXTERN(TEXT("KV cache memory"), STAT_SpeechRecognizer_KVCacheMemory, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Compute buffer memory"), STAT_SpeechRecognizer_ComputeMemory, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Mel spectrogram memory"), STAT_SpeechRecognizer_MelMemory, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Other memory"), STAT_SpeechRecognizer_OtherMemory, STATGROUP_RuntimeSpeechRecognizer, );
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Audio buffer pool memory"), STAT_SpeechRecognizer_AudioBufferPoolMemory, STATGROUP_RuntimeSpeechRecognizer, );
+
+/**
+ * Scope that shows up both in the stats system and in Unreal Insights captures
+ * Cycle counters already emit CPU trace events when stats are enabled, so a plain trace scope is only used when they are compiled out
+ */
+#if STATS
+#define SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(Stat) SCOPE_CYCLE_COUNTER(Stat)
+#else
+#define SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(Stat) TRACE_CPUPROFILER_EVENT_SCOPE(Stat)
+#endif
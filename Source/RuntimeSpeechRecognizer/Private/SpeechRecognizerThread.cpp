@@ -18,7 +18,111 @@
 #include "SpeechRecognizerSettings.h"
 
 #include "SpeechRecognizerPrivate.h"
+#include "SpeechRecognizerStats.h"
+#include "SpeechRecognizerGraphProfiler.h"
+#include "SpeechRecognizerMemoryTracker.h"
+#include "SpeechRecognizerFrameMonitor.h"
+#include "SpeechRecognizerAudioBufferPool.h"
+#include "SpeechRecognizerAllocationCounter.h"
+#include "SpeechRecognizerVocabularyFilter.h"
 #include "Engine/AssetManager.h"
+#include "Misc/ConfigCacheIni.h"
+
+DEFINE_STAT(STAT_SpeechRecognizer_Ingest);
+DEFINE_STAT(STAT_SpeechRecognizer_Resample);
+DEFINE_STAT(STAT_SpeechRecognizer_Enqueue);
+DEFINE_STAT(STAT_SpeechRecognizer_Recognize);
+DEFINE_STAT(STAT_SpeechRecognizer_Mel);
+DEFINE_STAT(STAT_SpeechRecognizer_Encode);
+DEFINE_STAT(STAT_SpeechRecognizer_Decode);
+DEFINE_STAT(STAT_SpeechRecognizer_Sample);
+DEFINE_STAT(STAT_SpeechRecognizer_Dispatch);
+DEFINE_STAT(STAT_SpeechRecognizer_QueueDepth);
+DEFINE_STAT(STAT_SpeechRecognizer_PendingSamples);
+DEFINE_STAT(STAT_SpeechRecognizer_DecodedTokens);
+DEFINE_STAT(STAT_SpeechRecognizer_WeightsMemory);
+DEFINE_STAT(STAT_SpeechRecognizer_KVCacheMemory);
+DEFINE_STAT(STAT_SpeechRecognizer_ComputeMemory);
+DEFINE_STAT(STAT_SpeechRecognizer_MelMemory);
+DEFINE_STAT(STAT_SpeechRecognizer_OtherMemory);
+DEFINE_STAT(STAT_SpeechRecognizer_AudioBufferPoolMemory);
+
+namespace
+{
+	/** Priority and CPU affinity of the ggml worker threads, cached from the settings when a speech recognizer starts since the workers can't read the settings object */
+	std::atomic<ESpeechRecognizerThreadPriority> WorkerThreadPriority{ESpeechRecognizerThreadPriority::Normal};
+	std::atomic<uint64> WorkerThreadAffinityMask{0};
+
+	/**
+	 * Converts the speech recognizer thread priority to the engine thread priority
+	 */
+	EThreadPriority ToEngineThreadPriority(ESpeechRecognizerThreadPriority Priority)
+	{
+		switch (Priority)
+		{
+		case ESpeechRecognizerThreadPriority::Lowest:
+			return TPri_Lowest;
+		case ESpeechRecognizerThreadPriority::BelowNormal:
+			return TPri_BelowNormal;
+		case ESpeechRecognizerThreadPriority::AboveNormal:
+			return TPri_AboveNormal;
+		case ESpeechRecognizerThreadPriority::Highest:
+			return TPri_Highest;
+		default:
+			return TPri_Normal;
+		}
+	}
+
+	/**
+	 * Converts the speech recognizer thread priority to the ggml scheduling priority
+	 */
+	ggml_sched_priority ToGgmlThreadPriority(ESpeechRecognizerThreadPriority Priority)
+	{
+		switch (Priority)
+		{
+		case ESpeechRecognizerThreadPriority::Lowest:
+		case ESpeechRecognizerThreadPriority::BelowNormal:
+			return GGML_SCHED_PRIO_LOW;
+		case ESpeechRecognizerThreadPriority::AboveNormal:
+			return GGML_SCHED_PRIO_MEDIUM;
+		case ESpeechRecognizerThreadPriority::Highest:
+			return GGML_SCHED_PRIO_HIGH;
+		default:
+			return GGML_SCHED_PRIO_NORMAL;
+		}
+	}
+}
+
+/**
+ * Called on every ggml compute worker thread when it starts
+ * Names the thread so that the recognition load can be identified next to the game and render threads in Unreal Insights captures,
+ * and applies the worker priority and CPU affinity from the settings
+ *
+ * @param ThreadIndex The index of the worker within the ggml thread pool (the calling thread has index 0 and is not a worker)
+ */
+void RegisterSpeechRecognizerWorkerThread(int ThreadIndex)
+{
+	const FString ThreadName = FString::Printf(TEXT("SpeechRecognizerWorker %d"), ThreadIndex);
+	FPlatformProcess::SetThreadName(*ThreadName);
+
+	const ESpeechRecognizerThreadPriority Priority = WorkerThreadPriority.load(std::memory_order_relaxed);
+	if (Priority != ESpeechRecognizerThreadPriority::Normal)
+	{
+		ggml_thread_apply_priority(ToGgmlThreadPriority(Priority));
+	}
+	const uint64 AffinityMask = WorkerThreadAffinityMask.load(std::memory_order_relaxed);
+	if (AffinityMask != 0)
+	{
+		FPlatformProcess::SetThreadAffinityMask(AffinityMask);
+	}
+#if UE_TRACE_ENABLED
+#if UE_VERSION_OLDER_THAN(5, 0, 0)
+	Trace::ThreadRegister(*ThreadName, FPlatformTLS::GetCurrentThreadId(), ThreadIndex);
+#else
+	UE::Trace::ThreadRegister(*ThreadName, FPlatformTLS::GetCurrentThreadId(), ThreadIndex);
+#endif
+#endif
+}
 
 namespace RSR_StringUtils
 {
@@ -48,6 +152,67 @@ namespace RSR_StringUtils
 	}
 }
 
+/**
+ * Broadcasts recognized text segments of the last whisper recognition
+ *
+ * @param SpeechRecognizerSharedPtr The speech recognizer thread to broadcast the text segments from
+ * @param WhisperContext The whisper context holding the text segments
+ * @param StartIndex Index of the first text segment to broadcast
+ * @param EndIndex Index past the last text segment to broadcast
+ * @param bTranslated Whether the text segments are the English translation of the dual transcription and translation mode
+ */
+void BroadcastTextSegments(const TSharedPtr<FSpeechRecognizerThread>& SpeechRecognizerSharedPtr, whisper_context* WhisperContext, int32 StartIndex, int32 EndIndex, bool bTranslated)
+{
+	for (int32 Index = StartIndex; Index < EndIndex; ++Index)
+	{
+		const char* TextPerSegment = whisper_full_get_segment_text(WhisperContext, static_cast<int>(Index));
+		// StringCast from UTF8CHAR to TCHAR is not supported in UE 5.0 and older
+		FString TextPerSegment_String =
+#if UE_VERSION_OLDER_THAN(5, 1, 0)
+		UTF8_TO_TCHAR(TextPerSegment);
+#else
+			[&TextPerSegment]()
+			{
+				auto TextPerSegment_TCHAR = StringCast<TCHAR>((const ANSICHAR*)TextPerSegment);
+				return FString(TextPerSegment_TCHAR.Get());
+			}();
+#endif
+
+		AsyncTask(ENamedThreads::AnyThread, [SpeechRecognizerSharedPtr, TextPerSegment_String = MoveTemp(TextPerSegment_String), bTranslated]() mutable
+		{
+			SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_Dispatch);
+			if (SpeechRecognizerSharedPtr.IsValid())
+			{
+				if (bTranslated)
+				{
+					UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Translated text segment: \"%s\""), *TextPerSegment_String);
+					SpeechRecognizerSharedPtr->OnRecognizedTranslatedTextSegment.Broadcast(TextPerSegment_String);
+				}
+				else
+				{
+					UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Recognized text segment: \"%s\""), *TextPerSegment_String);
+					SpeechRecognizerSharedPtr->OnRecognizedTextSegment.Broadcast(TextPerSegment_String);
+				}
+			}
+		});
+	}
+}
+
+/**
+ * Returns the number of tokens decoded by the last whisper recognition
+ *
+ * @param WhisperContext The whisper context holding the recognition results
+ */
+int32 GetNumOfDecodedTokens(whisper_context* WhisperContext)
+{
+	int32 NumOfDecodedTokens = 0;
+	for (int32 SegmentIndex = 0; SegmentIndex < whisper_full_n_segments(WhisperContext); ++SegmentIndex)
+	{
+		NumOfDecodedTokens += whisper_full_n_tokens(WhisperContext, SegmentIndex);
+	}
+	return NumOfDecodedTokens;
+}
+
 /**
  * Called when a new text segment is generated by the whisper
  *
@@ -78,33 +243,12 @@ void WhisperNewTextSegmentCallback(whisper_context* WhisperContext, whisper_stat
 		return;
 	}*/
 
-	const int32 TotalSegmentCount = whisper_full_n_segments(WhisperContext);
-	const int32 StartIndex = TotalSegmentCount - NewSegmentCount;
-
-	for (int32 Index = StartIndex; Index < TotalSegmentCount; ++Index)
-	{
-		const char* TextPerSegment = whisper_full_get_segment_text(WhisperContext, static_cast<int>(Index));
-		// StringCast from UTF8CHAR to TCHAR is not supported in UE 5.0 and older
-		FString TextPerSegment_String =
-#if UE_VERSION_OLDER_THAN(5, 1, 0)
-		UTF8_TO_TCHAR(TextPerSegment);
-#else
-			[&TextPerSegment]()
-			{
-				auto TextPerSegment_TCHAR = StringCast<TCHAR>((const ANSICHAR*)TextPerSegmentTextPerSegment);
-				return FString(TextPerSegment_TCHAR.Get());
-			}();
-#endif
+	// Handing the text over to the game thread allocates, which is not part of the recognition itself
+	FSpeechRecognizerAllocationCounter::FIgnoreScope AllocationIgnoreScope;
 
-		AsyncTask(ENamedThreads::AnyThread, [SpeechRecognizerSharedPtr, TextPerSegment_String = MoveTemp(TextPerSegment_String)]() mutable
-		{
-			if (SpeechRecognizerSharedPtr.IsValid())
-			{
-				UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Recognized text segment: \"%s\""), *TextPerSegment_String);
-				SpeechRecognizerSharedPtr->OnRecognizedTextSegment.Broadcast(TextPerSegment_String);
-			}
-		});
-	}
+	const int32 TotalSegmentCount = whisper_full_n_segments(WhisperContext);
+	const bool bTranslated = static_cast<FWhisperSpeechRecognizerUserData*>(UserData)->bTranslating;
+	BroadcastTextSegments(SpeechRecognizerSharedPtr, WhisperContext, TotalSegmentCount - NewSegmentCount, TotalSegmentCount, bTranslated);
 }
 
 /**
@@ -172,22 +316,151 @@ void WhisperProgressCallback(whisper_context* WhisperContext, whisper_state* Whi
 
 	// There is a bug in the whisper library where the progress callback is sometimes called with a value larger than 100
 	Progress = FMath::Clamp(Progress, 0, 100);
+	FSpeechRecognizerAllocationCounter::FIgnoreScope AllocationIgnoreScope;
 	AsyncTask(ENamedThreads::AnyThread, [SpeechRecognizerSharedPtr, Progress]() mutable
 	{
+		SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_Dispatch);
 		UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Speech recognition progress: %d"), Progress);
 		SpeechRecognizerSharedPtr->LastProgress = Progress;
 		SpeechRecognizerSharedPtr->OnRecognitionProgress.Broadcast(Progress);
 	});
 }
 
+/**
+ * The vocabulary the decoding is restricted to, built from the vocabulary phrases and characters of the recognition parameters
+ */
+struct FWhisperSpeechRecognizerVocabulary
+{
+	/** The phrases the vocabulary was built from */
+	TArray<FString> Phrases;
+
+	/** The characters the vocabulary was built from */
+	FString Characters;
+
+	/** Whether the grammar of the phrases was built */
+	bool bConstrainToPhrases = false;
+
+	/** The text tokens spelled only with the characters of the vocabulary, which are the only ones the output head computes the logits of */
+	TArray<whisper_token> Tokens;
+
+	/** The rules of the grammar matching a sequence of the phrases. Empty if the decoding is not constrained to the phrases */
+	TArray<TArray<whisper_grammar_element>> GrammarRules;
+
+	/** Pointers to the grammar rules, as expected by whisper */
+	TArray<const whisper_grammar_element*> GrammarRulePtrs;
+
+	/**
+	 * Collects the allowed tokens and builds the grammar from the phrases and characters
+	 *
+	 * @param WhisperContext The Whisper context whose vocabulary the tokens are collected from
+	 */
+	void Build(whisper_context* WhisperContext);
+};
+
+void FWhisperSpeechRecognizerVocabulary::Build(whisper_context* WhisperContext)
+{
+	// Space and basic punctuation are always allowed, since the language model separates words and sentences with them
+	FString AllowedText = TEXT(" .,!?") + Characters;
+	for (const FString& Phrase : Phrases)
+	{
+		AllowedText += Phrase;
+	}
+
+	// Letters are allowed in both cases, since the casing is up to the language model
+	AllowedText += AllowedText.ToLower() + AllowedText.ToUpper();
+
+	const FSpeechRecognizerVocabularyFilter VocabularyFilter(AllowedText);
+
+	Tokens.Reset();
+	const whisper_token TokenEOT = whisper_token_eot(WhisperContext);
+	for (whisper_token Token = 0; Token < TokenEOT; ++Token)
+	{
+		if (VocabularyFilter.IsTokenAllowed(whisper_token_to_str(WhisperContext, Token)))
+		{
+			Tokens.Add(Token);
+		}
+	}
+
+	GrammarRules.Reset();
+	GrammarRulePtrs.Reset();
+	if (!bConstrainToPhrases || Phrases.Num() == 0)
+	{
+		return;
+	}
+
+	// root        ::= item root | item
+	// item        ::= space phrase punctuation
+	// space       ::= " " | (nothing)
+	// phrase      ::= phrase 1 | phrase 2 | ... (case-insensitive)
+	// punctuation ::= [.,!?] | (nothing)
+	GrammarRules.SetNum(5);
+	GrammarRules[0] = {{WHISPER_GRETYPE_RULE_REF, 1}, {WHISPER_GRETYPE_RULE_REF, 0}, {WHISPER_GRETYPE_ALT, 0}, {WHISPER_GRETYPE_RULE_REF, 1}, {WHISPER_GRETYPE_END, 0}};
+	GrammarRules[1] = {{WHISPER_GRETYPE_RULE_REF, 2}, {WHISPER_GRETYPE_RULE_REF, 3}, {WHISPER_GRETYPE_RULE_REF, 4}, {WHISPER_GRETYPE_END, 0}};
+	GrammarRules[2] = {{WHISPER_GRETYPE_CHAR, ' '}, {WHISPER_GRETYPE_ALT, 0}, {WHISPER_GRETYPE_END, 0}};
+	GrammarRules[4] = {{WHISPER_GRETYPE_CHAR, '.'}, {WHISPER_GRETYPE_CHAR_ALT, ','}, {WHISPER_GRETYPE_CHAR_ALT, '!'}, {WHISPER_GRETYPE_CHAR_ALT, '?'}, {WHISPER_GRETYPE_ALT, 0}, {WHISPER_GRETYPE_END, 0}};
+
+	TArray<whisper_grammar_element>& PhraseRule = GrammarRules[3];
+	for (const FString& Phrase : Phrases)
+	{
+		if (PhraseRule.Num() > 0)
+		{
+			PhraseRule.Add({WHISPER_GRETYPE_ALT, 0});
+		}
+
+		const FString TrimmedPhrase = Phrase.TrimStartAndEnd();
+		for (int32 CharIndex = 0; CharIndex < TrimmedPhrase.Len(); ++CharIndex)
+		{
+			uint32 CodePoint = static_cast<uint32>(TrimmedPhrase[CharIndex]);
+
+			// Combining UTF-16 surrogate pairs, since the grammar matches Unicode code points
+			if (CodePoint >= 0xD800 && CodePoint <= 0xDBFF && CharIndex + 1 < TrimmedPhrase.Len())
+			{
+				const uint32 LowSurrogate = static_cast<uint32>(TrimmedPhrase[CharIndex + 1]);
+				if (LowSurrogate >= 0xDC00 && LowSurrogate <= 0xDFFF)
+				{
+					CodePoint = 0x10000 + ((CodePoint - 0xD800) << 10) + (LowSurrogate - 0xDC00);
+					++CharIndex;
+				}
+			}
+
+			const uint32 LowerCodePoint = CodePoint <= 0xFFFF ? static_cast<uint32>(FChar::ToLower(static_cast<TCHAR>(CodePoint))) : CodePoint;
+			const uint32 UpperCodePoint = CodePoint <= 0xFFFF ? static_cast<uint32>(FChar::ToUpper(static_cast<TCHAR>(CodePoint))) : CodePoint;
+			PhraseRule.Add({WHISPER_GRETYPE_CHAR, LowerCodePoint});
+			if (UpperCodePoint != LowerCodePoint)
+			{
+				PhraseRule.Add({WHISPER_GRETYPE_CHAR_ALT, UpperCodePoint});
+			}
+		}
+	}
+	PhraseRule.Add({WHISPER_GRETYPE_END, 0});
+
+	for (const TArray<whisper_grammar_element>& GrammarRule : GrammarRules)
+	{
+		GrammarRulePtrs.Add(GrammarRule.GetData());
+	}
+}
+
 FWhisperSpeechRecognizerState::FWhisperSpeechRecognizerState()
 	: WhisperContext(nullptr)
 , WhisperParameters(nullptr)
+, WhisperCommandSet(nullptr)
+, WhisperVocabulary(nullptr)
+, NumOfAllocations(0)
 {}
 
-bool FWhisperSpeechRecognizerState::Init(uint8* BulkDataPtr, int64 BulkDataSize, TSharedPtr<FSpeechRecognizerThread> SpeechRecognizerPtr)
+bool FWhisperSpeechRecognizerState::Init(uint8* BulkDataPtr, int64 BulkDataSize, TSharedPtr<FSpeechRecognizerThread> SpeechRecognizerPtr, ESpeechRecognizerKVCacheType KVCacheType)
 {
-	WhisperContext = whisper_init_from_buffer_with_params(BulkDataPtr, BulkDataSize, whisper_context_default_params());
+	whisper_context_params ContextParameters = whisper_context_default_params();
+
+	// Block-quantized KV caches are only read by the flash attention kernels
+	if (KVCacheType == ESpeechRecognizerKVCacheType::Q8_0)
+	{
+		ContextParameters.flash_attn = true;
+		ContextParameters.type_kv = GGML_TYPE_Q8_0;
+	}
+
+	// The inference state is allocated later by RestoreInferenceState, once the recognition parameters its KV caches are sized for are known
+	WhisperContext = whisper_init_from_buffer_with_params_no_state(BulkDataPtr, BulkDataSize, ContextParameters);
 	if (!WhisperContext)
 	{
 		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Failed to create whisper context from buffer"));
@@ -216,6 +489,9 @@ void FWhisperSpeechRecognizerState::Release()
 	}
 
 	ClearInitialPrompt();
+	ClearCommands();
+	ClearVocabulary();
+	ReleasedStageTimings = FSpeechRecognizerStageTimings();
 
 	if (WhisperParameters)
 	{
@@ -226,6 +502,111 @@ void FWhisperSpeechRecognizerState::Release()
 	WhisperUserData = FWhisperSpeechRecognizerUserData();
 }
 
+bool FWhisperSpeechRecognizerState::SetCommands(const TArray<FString>& InCommands)
+{
+	if (WhisperCommandSet && InCommands == Commands)
+	{
+		return true;
+	}
+
+	ClearCommands();
+	if (InCommands.Num() == 0)
+	{
+		return true;
+	}
+	if (!WhisperContext)
+	{
+		return false;
+	}
+
+	// The UTF-8 strings are only needed while the commands are tokenized
+	TArray<TArray<ANSICHAR>> CommandsUTF8;
+	CommandsUTF8.Reserve(InCommands.Num());
+	for (const FString& Command : InCommands)
+	{
+		const FTCHARToUTF8 CommandUTF8(*Command);
+		TArray<ANSICHAR>& CommandUTF8Chars = CommandsUTF8.AddDefaulted_GetRef();
+		CommandUTF8Chars.Append(CommandUTF8.Get(), CommandUTF8.Length());
+		CommandUTF8Chars.Add('\0');
+	}
+
+	TArray<const char*> CommandPtrs;
+	CommandPtrs.Reserve(CommandsUTF8.Num());
+	for (const TArray<ANSICHAR>& CommandUTF8Chars : CommandsUTF8)
+	{
+		CommandPtrs.Add(CommandUTF8Chars.GetData());
+	}
+
+	WhisperCommandSet = whisper_command_set_init(WhisperContext, CommandPtrs.GetData(), CommandPtrs.Num());
+	if (!WhisperCommandSet)
+	{
+		return false;
+	}
+	Commands = InCommands;
+	return true;
+}
+
+void FWhisperSpeechRecognizerState::ClearCommands()
+{
+	if (WhisperCommandSet)
+	{
+		whisper_command_set_free(WhisperCommandSet);
+		WhisperCommandSet = nullptr;
+	}
+	Commands.Reset();
+}
+
+bool FWhisperSpeechRecognizerState::SetVocabulary(const TArray<FString>& InPhrases, const FString& InCharacters, bool bConstrainToPhrases)
+{
+	if (WhisperVocabulary && WhisperVocabulary->Phrases == InPhrases && WhisperVocabulary->Characters == InCharacters && WhisperVocabulary->bConstrainToPhrases == bConstrainToPhrases)
+	{
+		return true;
+	}
+
+	ClearVocabulary();
+	if (InPhrases.Num() == 0 && InCharacters.IsEmpty())
+	{
+		return true;
+	}
+	if (!WhisperContext || !WhisperParameters)
+	{
+		return false;
+	}
+
+	WhisperVocabulary = new FWhisperSpeechRecognizerVocabulary();
+	WhisperVocabulary->Phrases = InPhrases;
+	WhisperVocabulary->Characters = InCharacters;
+	WhisperVocabulary->bConstrainToPhrases = bConstrainToPhrases;
+	WhisperVocabulary->Build(WhisperContext);
+
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Restricted the decoding to %d of %d tokens from %d vocabulary phrases and %d characters%s"),
+		WhisperVocabulary->Tokens.Num(), whisper_n_vocab(WhisperContext), InPhrases.Num(), InCharacters.Len(), WhisperVocabulary->GrammarRules.Num() > 0 ? TEXT(", constrained to the phrases") : TEXT(""));
+
+	// The Whisper parameters point into the vocabulary, which lives until it is cleared
+	WhisperParameters->allowed_tokens = WhisperVocabulary->Tokens.GetData();
+	WhisperParameters->n_allowed_tokens = WhisperVocabulary->Tokens.Num();
+	WhisperParameters->grammar_rules = WhisperVocabulary->GrammarRulePtrs.GetData();
+	WhisperParameters->n_grammar_rules = WhisperVocabulary->GrammarRulePtrs.Num();
+	WhisperParameters->i_start_rule = 0;
+	return true;
+}
+
+void FWhisperSpeechRecognizerState::ClearVocabulary()
+{
+	if (WhisperParameters)
+	{
+		WhisperParameters->allowed_tokens = nullptr;
+		WhisperParameters->n_allowed_tokens = 0;
+		WhisperParameters->grammar_rules = nullptr;
+		WhisperParameters->n_grammar_rules = 0;
+	}
+	if (WhisperVocabulary)
+	{
+		delete WhisperVocabulary;
+		WhisperVocabulary = nullptr;
+	}
+}
+
 void FWhisperSpeechRecognizerState::ClearInitialPrompt()
 {
 	if (WhisperParameters && WhisperParameters->initial_prompt)
@@ -235,6 +616,124 @@ void FWhisperSpeechRecognizerState::ClearInitialPrompt()
 	}
 }
 
+FSpeechRecognizerStageTimings FWhisperSpeechRecognizerState::GetStageTimings() const
+{
+	FScopeLock Lock(&ReleaseGuard);
+	FSpeechRecognizerStageTimings Timings;
+	if (!WhisperContext)
+	{
+		return Timings;
+	}
+
+	if (!WhisperContext->state)
+	{
+		Timings = ReleasedStageTimings;
+	}
+	else
+	{
+		const whisper_state* State = WhisperContext->state;
+		Timings.MelMs = State->t_mel_us * 1e-3f;
+		Timings.EncodeMs = State->t_encode_us * 1e-3f;
+		Timings.DecodeMs = State->t_decode_us * 1e-3f;
+		Timings.BatchDecodeMs = State->t_batchd_us * 1e-3f;
+		Timings.PromptMs = State->t_prompt_us * 1e-3f;
+		Timings.SampleMs = State->t_sample_us * 1e-3f;
+		Timings.NumEncode = State->n_encode;
+		Timings.NumDecode = State->n_decode;
+		Timings.NumBatchDecode = State->n_batchd;
+		Timings.NumPrompt = State->n_prompt;
+		Timings.NumSample = State->n_sample;
+		Timings.NumFallbacksLogProb = State->n_fail_p;
+		Timings.NumFallbacksEntropy = State->n_fail_h;
+	}
+
+	// Counted by the plugin, so they are kept while the inference state is released
+	Timings.NumAllocations = static_cast<int32>(NumOfAllocations);
+	Timings.NumFrameCriticalChunks = ThrottlingCounters.NumOfFrameCriticalChunks;
+	Timings.NumThrottledGraphs = ThrottlingCounters.NumOfThrottledGraphs;
+	Timings.YieldMs = ThrottlingCounters.YieldedMicroseconds * 1e-3f;
+	return Timings;
+}
+
+void FWhisperSpeechRecognizerState::ResetStageTimings()
+{
+	FScopeLock Lock(&ReleaseGuard);
+	ReleasedStageTimings = FSpeechRecognizerStageTimings();
+	NumOfAllocations = 0;
+	ThrottlingCounters.NumOfFrameCriticalChunks = 0;
+	ThrottlingCounters.NumOfThrottledGraphs = 0;
+	ThrottlingCounters.YieldedMicroseconds = 0;
+	if (!WhisperContext || !WhisperContext->state)
+	{
+		return;
+	}
+
+	whisper_reset_timings(WhisperContext);
+
+	// whisper_reset_timings does not reset the fallback counters
+	WhisperContext->state->n_fail_p = 0;
+	WhisperContext->state->n_fail_h = 0;
+}
+
+bool FWhisperSpeechRecognizerState::ReleaseInferenceState()
+{
+	FScopeLock Lock(&ReleaseGuard);
+	if (!WhisperContext || !WhisperContext->state)
+	{
+		return false;
+	}
+
+	// Read under the same lock as the release, so that GetStageTimings callers never see the timings of a state that is half released. GetStageTimings takes the lock again, which is fine since FCriticalSection is recursive
+	ReleasedStageTimings = GetStageTimings();
+	whisper_free_state(WhisperContext->state);
+	WhisperContext->state = nullptr;
+	return true;
+}
+
+bool FWhisperSpeechRecognizerState::RestoreInferenceState()
+{
+	FScopeLock Lock(&ReleaseGuard);
+	if (!WhisperContext)
+	{
+		return false;
+	}
+	if (WhisperContext->state)
+	{
+		return true;
+	}
+
+	whisper_state* State = whisper_init_state(WhisperContext);
+	if (!State)
+	{
+		return false;
+	}
+
+	// Carry the timings accumulated before the release over, so that the session timings are not reset by idle trimming
+	State->t_mel_us = static_cast<int64_t>(ReleasedStageTimings.MelMs * 1e3);
+	State->t_encode_us = static_cast<int64_t>(ReleasedStageTimings.EncodeMs * 1e3);
+	State->t_decode_us = static_cast<int64_t>(ReleasedStageTimings.DecodeMs * 1e3);
+	State->t_batchd_us = static_cast<int64_t>(ReleasedStageTimings.BatchDecodeMs * 1e3);
+	State->t_prompt_us = static_cast<int64_t>(ReleasedStageTimings.PromptMs * 1e3);
+	State->t_sample_us = static_cast<int64_t>(ReleasedStageTimings.SampleMs * 1e3);
+	State->n_encode = ReleasedStageTimings.NumEncode;
+	State->n_decode = ReleasedStageTimings.NumDecode;
+	State->n_batchd = ReleasedStageTimings.NumBatchDecode;
+	State->n_prompt = ReleasedStageTimings.NumPrompt;
+	State->n_sample = ReleasedStageTimings.NumSample;
+	State->n_fail_p = ReleasedStageTimings.NumFallbacksLogProb;
+	State->n_fail_h = ReleasedStageTimings.NumFallbacksEntropy;
+	ReleasedStageTimings = FSpeechRecognizerStageTimings();
+
+	WhisperContext->state = State;
+	return true;
+}
+
+bool FWhisperSpeechRecognizerState::HasInferenceState() const
+{
+	FScopeLock Lock(&ReleaseGuard);
+	return WhisperContext && WhisperContext->state;
+}
+
 FSpeechRecognitionParameters FSpeechRecognitionParameters::GetNonStreamingDefaults()
 {
 	// These are the default values for the whisper.cpp library
@@ -279,7 +778,8 @@ void FSpeechRecognitionParameters::FillWhisperStateParameters(FWhisperSpeechReco
 		WhisperState.WhisperParameters->print_special = false;
 	}
 
-	WhisperState.WhisperParameters->translate = bTranslateToEnglish;
+	// In the transcription and translation mode, the translation is decoded in a second pass after the transcription
+	WhisperState.WhisperParameters->translate = bTranslateToEnglish && !bTranscribeAndTranslate;
 
 	WhisperState.WhisperParameters->no_context = bNoContext;
 	WhisperState.WhisperParameters->single_segment = bSingleSegment;
@@ -287,32 +787,86 @@ void FSpeechRecognitionParameters::FillWhisperStateParameters(FWhisperSpeechReco
 	WhisperState.WhisperParameters->audio_ctx = AudioContextSize;
 	WhisperState.WhisperParameters->temperature_inc = TemperatureToIncrease;
 	WhisperState.WhisperParameters->entropy_thold = EntropyThreshold;
+	WhisperState.WhisperParameters->temperature_n_parallel = NumOfParallelFallbackTemperatures;
+	WhisperState.WhisperParameters->repetition_max_ngram = MaxRepetitionNGramSize;
+	WhisperState.WhisperParameters->repetition_n_repeats = NumOfRepetitionsToStop;
+	WhisperState.WhisperParameters->no_speech_thold = NoSpeechThreshold;
 
 	WhisperState.WhisperParameters->language = EnumToString(Language);
 	WhisperState.WhisperParameters->n_threads = NumOfThreads > 0 ? NumOfThreads : (FPlatformProcess::SupportsMultithreading() ? FMath::Min(6, FPlatformMisc::NumberOfCoresIncludingHyperthreads()) : 1);
+	WhisperState.WhisperParameters->n_threads_mel = NumOfMelThreads;
+	WhisperState.WhisperParameters->n_threads_encode = NumOfEncoderThreads;
+	WhisperState.WhisperParameters->n_threads_decode = NumOfDecoderThreads;
 
 	WhisperState.WhisperParameters->suppress_blank = bSuppressBlank;
 	WhisperState.WhisperParameters->suppress_non_speech_tokens = bSuppressNonSpeechTokens;
 
-	WhisperState.WhisperParameters->beam_search.beam_size = BeamSize;
-
-	WhisperState.ClearInitialPrompt();
+	// Beam search falls back to best-of sampling at non-zero temperatures, like greedy decoding does
+	WhisperState.WhisperParameters->strategy = SamplingStrategy == ESpeechRecognizerSamplingStrategy::BeamSearch ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY;
+	WhisperState.WhisperParameters->beam_search.beam_size = BeamSize > 0 ? FMath::Min(BeamSize, WHISPER_MAX_DECODERS) : 5;
 
-	if (InitialPrompt.Len() > 0)
+	// Size the KV caches of the next inference state for these parameters instead of the full model context. Whisper grows them if a chunk needs more
+	// Without a token limit, or when the previous text is used as the prompt, most of the text context can be used, so the full size is kept
+	// The hint mirrors the reservation whisper_full makes per segment, so that it does not need to grow the caches on the first chunk
+	if (MaxTokens > 0 && bNoContext)
 	{
-		// StringCast to UTF8CHAR is not supported in UE 4.27 and older
-		// We should use strdup to extend the lifetime of the string since TCHAR_TO_UTF8 and StringCast return temporary pointers
-		// (The memory is freed on FWhisperSpeechRecognizerState::Release)
-#if UE_VERSION_OLDER_THAN(5, 0, 0)
-		WhisperState.WhisperParameters->initial_prompt = RSR_StringUtils::Strdup(TCHAR_TO_UTF8(*InitialPrompt), InitialPrompt.Len());
-#else
-		const auto InitialPrompt_UTF8 = StringCast<UTF8CHAR>(*InitialPrompt);
-		WhisperState.WhisperParameters->initial_prompt = RSR_StringUtils::Strdup((const char*)InitialPrompt_UTF8.Get(), InitialPrompt_UTF8.Length());
-#endif
-	}
+		// The previous text marker, followed by the start of transcript, language, task and no timestamps tokens
+		constexpr int32 NumOfPromptControlTokens = 5;
 
-	// Setting up the new segment callback, which is called on every new recognized text segment
-	{
+		// Whisper overallocates the caches by this number of decoders to work around their fragmentation when several decoders run
+		constexpr int32 NumOfFragmentationDecoders = 2;
+
+		const int32 NumOfBeams = SamplingStrategy == ESpeechRecognizerSamplingStrategy::BeamSearch ? WhisperState.WhisperParameters->beam_search.beam_size : 1;
+		const int32 NumOfBestOf = WhisperState.WhisperParameters->greedy.best_of;
+		const int32 NumOfSamplingDecoders = NumOfParallelFallbackTemperatures > 0 && NumOfBeams == 1 ? FMath::Min(1 + NumOfParallelFallbackTemperatures * NumOfBestOf, WHISPER_MAX_DECODERS) : NumOfBestOf;
+		const int32 NumOfDecoders = FMath::Max(NumOfBeams, TemperatureToIncrease > 0.0f ? NumOfSamplingDecoders : 1);
+		const int32 CacheFactor = NumOfDecoders > 1 ? NumOfDecoders + NumOfFragmentationDecoders : 1;
+
+		// Whisper conditions each segment on at most half of the text context
+		const int32 MaxNumOfPromptTokens = whisper_n_text_ctx(WhisperState.WhisperContext) / 2;
+		const int32 NumOfInitialPromptTokens = InitialPrompt.Len() > 0 ? FMath::Min(whisper_token_count(WhisperState.WhisperContext, TCHAR_TO_UTF8(*InitialPrompt)), MaxNumOfPromptTokens) : 0;
+
+		// The generation stops one token after the limit
+		const int32 NumOfGeneratedTokens = MaxTokens + 1;
+
+		WhisperState.WhisperContext->params.kv_n_text_ctx = (NumOfPromptControlTokens + NumOfInitialPromptTokens + NumOfGeneratedTokens) * CacheFactor;
+	}
+	else
+	{
+		WhisperState.WhisperContext->params.kv_n_text_ctx = 0;
+	}
+	WhisperState.WhisperContext->params.kv_n_audio_ctx = AudioContextSize;
+
+	// The commands are only tokenized again when they change
+	if (!WhisperState.SetCommands(Commands))
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Failed to prepare the %d commands to spot (e.g. a command is too long), falling back to the free-form recognition"), Commands.Num());
+	}
+
+	// The allowed tokens and the grammar are only collected again when the vocabulary changes
+	if (!WhisperState.SetVocabulary(VocabularyPhrases, VocabularyCharacters, bConstrainToVocabularyPhrases))
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Failed to prepare the vocabulary of %d phrases, falling back to the unrestricted decoding"), VocabularyPhrases.Num());
+	}
+	WhisperState.WhisperParameters->grammar_penalty = VocabularyGrammarPenalty;
+
+	WhisperState.ClearInitialPrompt();
+
+	if (InitialPrompt.Len() > 0)
+	{
+		// StringCast to UTF8CHAR is not supported in UE 4.27 and older
+		// We should use strdup to extend the lifetime of the string since TCHAR_TO_UTF8 and StringCast return temporary pointers
+		// (The memory is freed on FWhisperSpeechRecognizerState::Release)
+#if UE_VERSION_OLDER_THAN(5, 0, 0)
+		WhisperState.WhisperParameters->initial_prompt = RSR_StringUtils::Strdup(TCHAR_TO_UTF8(*InitialPrompt), InitialPrompt.Len());
+#else
+		const auto InitialPrompt_UTF8 = StringCast<UTF8CHAR>(*InitialPrompt);
+		WhisperState.WhisperParameters->initial_prompt = RSR_StringUtils::Strdup((const char*)InitialPrompt_UTF8.Get(), InitialPrompt_UTF8.Length());
+#endif
+	}
+
+	// Setting up the new segment callback, which is called on every new recognized text segment
+	{
 		WhisperState.WhisperParameters->new_segment_callback = WhisperNewTextSegmentCallback;
 		WhisperState.WhisperParameters->new_segment_callback_user_data = &WhisperState.WhisperUserData;
 	}
@@ -336,6 +890,11 @@ void FSpeechRecognitionParameters::FillWhisperStateParameters(FWhisperSpeechReco
 	}
 }
 
+FSpeechRecognizerThread::FPendingAudioData::~FPendingAudioData()
+{
+	SetTotalMixedAndResampledSize(0);
+}
+
 bool FSpeechRecognizerThread::FPendingAudioData::AddAudio(Audio::FAlignedFloatBuffer&& AudioData, float SampleRate, uint32 NumOfChannels)
 {
 	if (SampleRate <= 0.0f || NumOfChannels <= 0)
@@ -344,32 +903,59 @@ bool FSpeechRecognizerThread::FPendingAudioData::AddAudio(Audio::FAlignedFloatBu
 		return false;
 	}
 	FScopeLock Lock(&DataGuard);
-	AudioDataMap.FindOrAdd(TTuple<float, uint32>{SampleRate, NumOfChannels}).Append(MoveTemp(AudioData));
+	Audio::FAlignedFloatBuffer& PendingPCMData = AudioDataMap.FindOrAdd(TTuple<float, uint32>{SampleRate, NumOfChannels});
+	FSpeechRecognizerAudioBufferPool& AudioBufferPool = FSpeechRecognizerAudioBufferPool::Get();
+	if (PendingPCMData.Num() == 0)
+	{
+		// Taking over the buffer of the audio data rather than copying it
+		AudioBufferPool.Release(MoveTemp(PendingPCMData));
+		PendingPCMData = MoveTemp(AudioData);
+	}
+	else
+	{
+		AudioBufferPool.Append(PendingPCMData, AudioData.GetData(), AudioData.Num());
+		AudioBufferPool.Release(MoveTemp(AudioData));
+	}
 	RecalculateTotalMixedAndResampledSize();
 	return true;
 }
 
 int64 FSpeechRecognizerThread::FPendingAudioData::GetTotalMixedAndResampledSize() const
 {
-	FScopeLock Lock(&DataGuard);
 	return TotalMixedAndResampledSize;
 }
 
+bool FSpeechRecognizerThread::FPendingAudioData::IsEmpty() const
+{
+	FScopeLock Lock(&DataGuard);
+	for (const auto& AudioDataPair : AudioDataMap)
+	{
+		if (AudioDataPair.Get<1>().Num() > 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 bool FSpeechRecognizerThread::FPendingAudioData::GetMixedAndResampledAudio(Audio::FAlignedFloatBuffer& OutPCMData)
 {
+	SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_Resample);
 	FScopeLock Lock(&DataGuard);
-	for (auto AudioDataPair : AudioDataMap)
+	FSpeechRecognizerAudioBufferPool& AudioBufferPool = FSpeechRecognizerAudioBufferPool::Get();
+	for (auto& AudioDataPair : AudioDataMap)
 	{
-		const int64 OriginalNumSamples = AudioDataPair.Get<1>().Num();
 		const float OriginalSampleRate = AudioDataPair.Get<0>().Get<0>();
 		const uint32 OriginalNumOfChannels = AudioDataPair.Get<0>().Get<1>();
 		Audio::FAlignedFloatBuffer& PCMData = AudioDataPair.Get<1>();
+		if (PCMData.Num() == 0)
+		{
+			continue;
+		}
 
 		// Resampling to WHISPER_SAMPLE_RATE (16kHz by default) if needed
 		if (static_cast<uint32>(OriginalSampleRate) != WHISPER_SAMPLE_RATE)
 		{
-			Audio::FAlignedFloatBuffer ResampledPCMData;
-
 			const Audio::FResamplingParameters ResampleParameters = {
 				Audio::EResamplingMethod::Linear,
 				static_cast<int32>(OriginalNumOfChannels),
@@ -378,34 +964,63 @@ bool FSpeechRecognizerThread::FPendingAudioData::GetMixedAndResampledAudio(Audio
 				PCMData
 			};
 
-			ResampledPCMData.AddUninitialized(Audio::GetOutputBufferSize(ResampleParameters));
+			const int32 NumOfResampledSamples = Audio::GetOutputBufferSize(ResampleParameters);
+			Audio::FAlignedFloatBuffer ResampledPCMData = AudioBufferPool.Acquire(NumOfResampledSamples);
+			ResampledPCMData.AddUninitialized(NumOfResampledSamples);
 			Audio::FResamplerResults ResampleResults;
 			ResampleResults.OutBuffer = &ResampledPCMData;
 
 			if (!Audio::Resample(ResampleParameters, ResampleResults))
 			{
 				UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Failed to resample audio data from %f to %f"), OriginalSampleRate, static_cast<float>(WHISPER_SAMPLE_RATE));
+				AudioBufferPool.Release(MoveTemp(ResampledPCMData));
 				return false;
 			}
 
+			AudioBufferPool.Release(MoveTemp(PCMData));
 			PCMData = MoveTemp(ResampledPCMData);
 		}
 
 		// Reducing the number of channels to 1 if needed
+		// The channels are summed in place, the same way TSampleBuffer::MixBufferToChannels(1) does, but without copying the audio data into a temporary buffer
 		if (OriginalNumOfChannels != 1)
 		{
-			Audio::TSampleBuffer<float> PCMSampleBuffer(PCMData, OriginalNumOfChannels, OriginalSampleRate);
+			const int32 NumOfFrames = PCMData.Num() / OriginalNumOfChannels;
+			float* Samples = PCMData.GetData();
+			for (int32 FrameIndex = 0; FrameIndex < NumOfFrames; ++FrameIndex)
 			{
-				PCMSampleBuffer.MixBufferToChannels(1);
+				float MixedSample = 0;
+				for (uint32 ChannelIndex = 0; ChannelIndex < OriginalNumOfChannels; ++ChannelIndex)
+				{
+					MixedSample += Samples[FrameIndex * OriginalNumOfChannels + ChannelIndex];
+				}
+				Samples[FrameIndex] = MixedSample;
 			}
-			Audio::FAlignedFloatBuffer WaveDataTemp = Audio::FAlignedFloatBuffer(PCMSampleBuffer.GetData(), PCMSampleBuffer.GetNumSamples());
-			PCMData = MoveTemp(WaveDataTemp);
+#if UE_VERSION_OLDER_THAN(5, 4, 0)
+			PCMData.SetNum(NumOfFrames, false);
+#else
+			PCMData.SetNum(NumOfFrames, EAllowShrinking::No);
+#endif
+		}
+
+		if (OutPCMData.Num() == 0)
+		{
+			// Taking over the buffer of the audio data rather than copying it
+			AudioBufferPool.Release(MoveTemp(OutPCMData));
+			OutPCMData = MoveTemp(PCMData);
+		}
+		else
+		{
+			AudioBufferPool.Append(OutPCMData, PCMData.GetData(), PCMData.Num());
+			AudioBufferPool.Release(MoveTemp(PCMData));
 		}
-		
-		OutPCMData.Append(MoveTemp(PCMData));
 	}
-	AudioDataMap.Empty();
-	TotalMixedAndResampledSize = 0;
+	// Keeping the keys and their slots allocated, since audio data usually keeps coming in with the same format
+	for (auto& AudioDataPair : AudioDataMap)
+	{
+		AudioBufferPool.Release(MoveTemp(AudioDataPair.Get<1>()));
+	}
+	SetTotalMixedAndResampledSize(0);
 	return true;
 }
 
@@ -415,7 +1030,7 @@ void FSpeechRecognizerThread::FPendingAudioData::RecalculateTotalMixedAndResampl
 	constexpr uint32 RequiredNumOfChannels = 1;
 
 	int64 TotalSize = 0;
-	for (auto AudioDataPair : AudioDataMap)
+	for (const auto& AudioDataPair : AudioDataMap)
 	{
 		const int64 OriginalNumSamples = AudioDataPair.Get<1>().Num();
 		const float OriginalSampleRate = AudioDataPair.Get<0>().Get<0>();
@@ -430,16 +1045,267 @@ void FSpeechRecognizerThread::FPendingAudioData::RecalculateTotalMixedAndResampl
 		// Calculate the estimated number of samples after resampling/remixing
 		TotalSize += static_cast<int64>(OriginalNumSamples / SampleRateRatio / NumChannelsRatio);
 	}
-	TotalMixedAndResampledSize = TotalSize;
+	SetTotalMixedAndResampledSize(TotalSize);
+}
+
+void FSpeechRecognizerThread::FPendingAudioData::SetTotalMixedAndResampledSize(int64 NewSize)
+{
+	if (NewSize > TotalMixedAndResampledSize)
+	{
+		INC_DWORD_STAT_BY(STAT_SpeechRecognizer_PendingSamples, NewSize - TotalMixedAndResampledSize);
+	}
+	else
+	{
+		DEC_DWORD_STAT_BY(STAT_SpeechRecognizer_PendingSamples, TotalMixedAndResampledSize - NewSize);
+	}
+	TotalMixedAndResampledSize = NewSize;
+}
+
+FSpeechRecognizerThread::FMetricsTracker::FMetricsTracker()
+{
+	Reset();
+}
+
+void FSpeechRecognizerThread::FMetricsTracker::Reset()
+{
+	for (int32 Index = 0; Index < WindowSize; ++Index)
+	{
+		AudioSecondsWindow[Index].store(0.f, std::memory_order_relaxed);
+		QueueSecondsWindow[Index].store(0.f, std::memory_order_relaxed);
+		ProcessingSecondsWindow[Index].store(0.f, std::memory_order_relaxed);
+		NumOfTokensWindow[Index].store(0, std::memory_order_relaxed);
+		DecodeSecondsWindow[Index].store(0.f, std::memory_order_relaxed);
+	}
+	NumOfFailedChunks.store(0, std::memory_order_relaxed);
+	ProcessedAudioMs.store(0, std::memory_order_relaxed);
+	NumFallbacksLogProb.store(0, std::memory_order_relaxed);
+	NumFallbacksEntropy.store(0, std::memory_order_relaxed);
+	NumRepetitionStops.store(0, std::memory_order_relaxed);
+	NumNoSpeechSkips.store(0, std::memory_order_relaxed);
+	NumOfDroppedChunks.store(0, std::memory_order_relaxed);
+	DroppedAudioMs.store(0, std::memory_order_relaxed);
+	NumOfIdleTrims.store(0, std::memory_order_relaxed);
+	NumOfWakeUps.store(0, std::memory_order_relaxed);
+	LastWakeUpUs.store(0, std::memory_order_relaxed);
+	TotalWakeUpUs.store(0, std::memory_order_relaxed);
+	LastBeamWidth.store(0, std::memory_order_relaxed);
+	NumOfProcessedChunks.store(0, std::memory_order_release);
+}
+
+void FSpeechRecognizerThread::FMetricsTracker::RecordChunk(double AudioSeconds, double QueueSeconds, double ProcessingSeconds, int32 NumOfTokens, int32 InNumFallbacksLogProb, int32 InNumFallbacksEntropy, int32 InNumRepetitionStops, int32 InNumNoSpeechSkips, double DecodeSeconds, int32 BeamWidth)
+{
+	// Only the speech recognizer thread records chunks, so the write position does not need to be reserved atomically
+	const int32 ChunkIndex = NumOfProcessedChunks.load(std::memory_order_relaxed);
+	const int32 WindowIndex = ChunkIndex % WindowSize;
+	AudioSecondsWindow[WindowIndex].store(static_cast<float>(AudioSeconds), std::memory_order_relaxed);
+	QueueSecondsWindow[WindowIndex].store(static_cast<float>(QueueSeconds), std::memory_order_relaxed);
+	ProcessingSecondsWindow[WindowIndex].store(static_cast<float>(ProcessingSeconds), std::memory_order_relaxed);
+	NumOfTokensWindow[WindowIndex].store(NumOfTokens, std::memory_order_relaxed);
+	DecodeSecondsWindow[WindowIndex].store(static_cast<float>(DecodeSeconds), std::memory_order_relaxed);
+	LastBeamWidth.store(BeamWidth, std::memory_order_relaxed);
+
+	ProcessedAudioMs.fetch_add(static_cast<int64>(AudioSeconds * 1000), std::memory_order_relaxed);
+	NumFallbacksLogProb.fetch_add(InNumFallbacksLogProb, std::memory_order_relaxed);
+	NumFallbacksEntropy.fetch_add(InNumFallbacksEntropy, std::memory_order_relaxed);
+	NumRepetitionStops.fetch_add(InNumRepetitionStops, std::memory_order_relaxed);
+	NumNoSpeechSkips.fetch_add(InNumNoSpeechSkips, std::memory_order_relaxed);
+	NumOfProcessedChunks.store(ChunkIndex + 1, std::memory_order_release);
+}
+
+void FSpeechRecognizerThread::FMetricsTracker::RecordFailedChunk()
+{
+	NumOfFailedChunks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FSpeechRecognizerThread::FMetricsTracker::RecordDroppedAudio(int32 NumOfChunks, double AudioSeconds)
+{
+	NumOfDroppedChunks.fetch_add(NumOfChunks, std::memory_order_relaxed);
+	DroppedAudioMs.fetch_add(static_cast<int64>(AudioSeconds * 1000), std::memory_order_relaxed);
+}
+
+void FSpeechRecognizerThread::FMetricsTracker::RecordIdleTrim()
+{
+	NumOfIdleTrims.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FSpeechRecognizerThread::FMetricsTracker::RecordWakeUp(double WakeUpSeconds)
+{
+	const int64 WakeUpUs = static_cast<int64>(WakeUpSeconds * 1e6);
+	LastWakeUpUs.store(WakeUpUs, std::memory_order_relaxed);
+	TotalWakeUpUs.fetch_add(WakeUpUs, std::memory_order_relaxed);
+	NumOfWakeUps.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FSpeechRecognizerThread::FMetricsTracker::GetMetrics(FSpeechRecognizerMetrics& OutMetrics) const
+{
+	const int32 NumOfChunks = NumOfProcessedChunks.load(std::memory_order_acquire);
+	const int32 NumOfWindowChunks = FMath::Min(NumOfChunks, WindowSize);
+
+	OutMetrics.NumOfProcessedChunks = NumOfChunks;
+	OutMetrics.NumOfFailedChunks = NumOfFailedChunks.load(std::memory_order_relaxed);
+	OutMetrics.ProcessedAudioSeconds = ProcessedAudioMs.load(std::memory_order_relaxed) * 1e-3f;
+	OutMetrics.NumFallbacksLogProb = NumFallbacksLogProb.load(std::memory_order_relaxed);
+	OutMetrics.NumFallbacksEntropy = NumFallbacksEntropy.load(std::memory_order_relaxed);
+	OutMetrics.NumRepetitionStops = NumRepetitionStops.load(std::memory_order_relaxed);
+	OutMetrics.NumNoSpeechSkips = NumNoSpeechSkips.load(std::memory_order_relaxed);
+	OutMetrics.NumOfDroppedChunks = NumOfDroppedChunks.load(std::memory_order_relaxed);
+	OutMetrics.DroppedAudioSeconds = DroppedAudioMs.load(std::memory_order_relaxed) * 1e-3f;
+	OutMetrics.NumOfIdleTrims = NumOfIdleTrims.load(std::memory_order_relaxed);
+	OutMetrics.NumOfWakeUps = NumOfWakeUps.load(std::memory_order_relaxed);
+	OutMetrics.LastWakeUpMs = LastWakeUpUs.load(std::memory_order_relaxed) * 1e-3f;
+	OutMetrics.AverageWakeUpMs = OutMetrics.NumOfWakeUps > 0 ? TotalWakeUpUs.load(std::memory_order_relaxed) * 1e-3f / OutMetrics.NumOfWakeUps : 0.f;
+	OutMetrics.BeamWidth = LastBeamWidth.load(std::memory_order_relaxed);
+
+	if (NumOfWindowChunks <= 0)
+	{
+		return;
+	}
+
+	// A chunk recorded while reading may replace the oldest entry of the window, which is acceptable for the rolling values
+	double TotalAudioSeconds = 0;
+	double TotalQueueSeconds = 0;
+	double TotalProcessingSeconds = 0;
+	int64 TotalNumOfTokens = 0;
+	double TotalDecodeSeconds = 0;
+	TArray<float, TInlineAllocator<WindowSize>> ChunkLatencies;
+	for (int32 WindowIndex = 0; WindowIndex < NumOfWindowChunks; ++WindowIndex)
+	{
+		const float QueueSeconds = QueueSecondsWindow[WindowIndex].load(std::memory_order_relaxed);
+		const float ProcessingSeconds = ProcessingSecondsWindow[WindowIndex].load(std::memory_order_relaxed);
+		TotalAudioSeconds += AudioSecondsWindow[WindowIndex].load(std::memory_order_relaxed);
+		TotalQueueSeconds += QueueSeconds;
+		TotalProcessingSeconds += ProcessingSeconds;
+		TotalNumOfTokens += NumOfTokensWindow[WindowIndex].load(std::memory_order_relaxed);
+		TotalDecodeSeconds += DecodeSecondsWindow[WindowIndex].load(std::memory_order_relaxed);
+		ChunkLatencies.Add((QueueSeconds + ProcessingSeconds) * 1000.f);
+	}
+	ChunkLatencies.Sort();
+
+	auto GetPercentile = [&ChunkLatencies](float Percentile)
+	{
+		const int32 Index = FMath::Clamp(FMath::CeilToInt(Percentile * ChunkLatencies.Num()) - 1, 0, ChunkLatencies.Num() - 1);
+		return ChunkLatencies[Index];
+	};
+
+	OutMetrics.RealTimeFactor = TotalAudioSeconds > 0 ? TotalProcessingSeconds / TotalAudioSeconds : 0;
+	OutMetrics.QueueLagSeconds = TotalQueueSeconds / NumOfWindowChunks;
+	OutMetrics.TokensPerSecond = TotalProcessingSeconds > 0 ? TotalNumOfTokens / TotalProcessingSeconds : 0;
+	OutMetrics.AverageDecodeMsPerToken = TotalNumOfTokens > 0 ? TotalDecodeSeconds * 1000 / TotalNumOfTokens : 0;
+	OutMetrics.AverageChunkLatencyMs = (TotalQueueSeconds + TotalProcessingSeconds) * 1000 / NumOfWindowChunks;
+	OutMetrics.P50ChunkLatencyMs = GetPercentile(0.5f);
+	OutMetrics.P95ChunkLatencyMs = GetPercentile(0.95f);
+	OutMetrics.P99ChunkLatencyMs = GetPercentile(0.99f);
+	OutMetrics.MaxChunkLatencyMs = ChunkLatencies.Last();
+}
+
+void FSpeechRecognizerThread::FLanguageLock::Configure(const FSpeechRecognitionParameters& Parameters)
+{
+	bEnabled = Parameters.bLockDetectedLanguage && Parameters.Language == ESpeechRecognizerLanguage::Auto;
+	ProbabilityThreshold = Parameters.LanguageLockProbabilityThreshold;
+	NumOfChunksToLock = FMath::Max(1, Parameters.NumOfChunksToLockLanguage);
+	RecheckInterval = FMath::Max(0, Parameters.LanguageRecheckInterval);
+	RecheckTokenProbability = Parameters.LanguageRecheckTokenProbability;
+
+	// Changing other parameters keeps the locked language, but a fixed language or a disabled lock drops it
+	if (!bEnabled)
+	{
+		Reset();
+	}
+}
+
+void FSpeechRecognizerThread::FLanguageLock::Reset()
+{
+	LockedLanguage = ESpeechRecognizerLanguage::Auto;
+	CandidateLanguage = ESpeechRecognizerLanguage::Auto;
+	NumOfConfidentChunks = 0;
+	NumOfChunksSinceDetection = 0;
+	bRecheckRequested = false;
+}
+
+ESpeechRecognizerLanguage FSpeechRecognizerThread::FLanguageLock::GetLanguageToRecognize() const
+{
+	if (LockedLanguage == ESpeechRecognizerLanguage::Auto || bRecheckRequested || (RecheckInterval > 0 && NumOfChunksSinceDetection >= RecheckInterval))
+	{
+		return ESpeechRecognizerLanguage::Auto;
+	}
+	return LockedLanguage;
+}
+
+bool FSpeechRecognizerThread::FLanguageLock::RecordDetection(ESpeechRecognizerLanguage Language, float Probability)
+{
+	NumOfChunksSinceDetection = 0;
+	bRecheckRequested = false;
+
+	const bool bConfident = Language != ESpeechRecognizerLanguage::Auto && Probability >= ProbabilityThreshold;
+	if (LockedLanguage != ESpeechRecognizerLanguage::Auto)
+	{
+		if (bConfident && Language == LockedLanguage)
+		{
+			return true;
+		}
+
+		UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Unlocked the session language '%hs' since the language was detected again as '%hs' with a probability of %.2f"), EnumToString(LockedLanguage), EnumToString(Language), Probability);
+		LockedLanguage = ESpeechRecognizerLanguage::Auto;
+	}
+
+	if (!bConfident)
+	{
+		CandidateLanguage = ESpeechRecognizerLanguage::Auto;
+		NumOfConfidentChunks = 0;
+		return false;
+	}
+
+	if (Language == CandidateLanguage)
+	{
+		++NumOfConfidentChunks;
+	}
+	else
+	{
+		CandidateLanguage = Language;
+		NumOfConfidentChunks = 1;
+	}
+
+	if (NumOfConfidentChunks < NumOfChunksToLock)
+	{
+		return false;
+	}
+
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Locked the session language to '%hs' after detecting it in %d chunks in a row"), EnumToString(Language), NumOfConfidentChunks);
+	LockedLanguage = Language;
+	return true;
+}
+
+void FSpeechRecognizerThread::FLanguageLock::RecordLockedChunk(float AverageTokenProbability)
+{
+	++NumOfChunksSinceDetection;
+	if (AverageTokenProbability < RecheckTokenProbability && !bRecheckRequested)
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Detecting the language of the next chunk again since the average token probability dropped to %.2f with the locked language '%hs'"), AverageTokenProbability, EnumToString(LockedLanguage));
+		bRecheckRequested = true;
+	}
 }
 
 FSpeechRecognizerThread::FSpeechRecognizerThread()
 	: bIsStopped(true)
 , bIsFinished(true)
 , bIsStopping(false)
+, bIsPaused(false)
+, bIsPausedAudioDropLogged(false)
+, WakeUpEvent(FPlatformProcess::GetSynchEventFromPool(false))
+, IdleMemoryTrimDelaySec(0)
+, bTranscribeAndTranslate(false)
+, CommandRejectionProbability(0)
+, bAutoTuneThreads(false)
+, AutoTunedThreadCounts(FIntVector::ZeroValue)
+, LastActivityTime(0)
+, bIsInferenceStateTrimmed(false)
+, bGraphProfilingEnabled(false)
+, GraphProfiler(MakeUnique<FSpeechRecognizerGraphProfiler>())
+, MemoryTracker(MakeUnique<FSpeechRecognizerMemoryTracker>())
 {
 	whisper_log_set([](enum ggml_log_level Level, const char* Text, void* UserData)
 	{
+		FSpeechRecognizerAllocationCounter::FIgnoreScope AllocationIgnoreScope;
 		if (Level == GGML_LOG_LEVEL_ERROR)
 		{
 			UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("%s"), *FString(Text));
@@ -457,7 +1323,9 @@ FSpeechRecognizerThread::FSpeechRecognizerThread()
 
 FSpeechRecognizerThread::~FSpeechRecognizerThread()
 {
+	DEC_DWORD_STAT_BY(STAT_SpeechRecognizer_QueueDepth, NumOfQueuedChunks.GetValue());
 	ReleaseMemory();
+	FPlatformProcess::ReturnSynchEventToPool(WakeUpEvent);
 }
 
 TFuture<bool> FSpeechRecognizerThread::StartThread()
@@ -470,7 +1338,7 @@ TFuture<bool> FSpeechRecognizerThread::StartThread()
 		return MakeFulfilledPromise<bool>(false).GetFuture();
 	}
 
-	if (GetIsStopped())
+	if (GetIsStopping())
 	{
 		const FString ShortErrorMessage = TEXT("Thread start failed");
 		const FString LongErrorMessage = TEXT("Unable to start a thread that is stopping");
@@ -521,9 +1389,23 @@ TFuture<bool> FSpeechRecognizerThread::StartThread()
 	{
 		ThisShared->StartThreadPromise->SetValue(bSuccess);
 		ThisShared->StartThreadPromise.Reset();
+
+		// A warm-up requested while starting can't run if the thread did not start
+		if (!bSuccess)
+		{
+			ThisShared->CompleteWarmUp(false);
+		}
 	};
 
-	auto OnLanguageModelLoaded = [ThisShared, SetStartThreadPromiseValue](bool bSuccess, uint8* ModelBulkDataPtr, int64 ModelBulkDataSize)
+	// The settings are read here since the language model may be loaded on a background thread
+	const USpeechRecognizerSettings* SpeechRecognizerSettings = GetDefault<USpeechRecognizerSettings>();
+	const EThreadPriority RecognizerThreadPriority = ToEngineThreadPriority(SpeechRecognizerSettings->RecognizerThreadPriority);
+	const uint64 RecognizerThreadAffinityMask = SpeechRecognizerSettings->RecognizerThreadAffinityMask != 0 ? static_cast<uint64>(SpeechRecognizerSettings->RecognizerThreadAffinityMask) : FPlatformAffinity::GetTaskGraphHighPriorityTaskMask();
+	WorkerThreadPriority = SpeechRecognizerSettings->WorkerThreadPriority;
+	WorkerThreadAffinityMask = static_cast<uint64>(SpeechRecognizerSettings->WorkerThreadAffinityMask);
+	const ESpeechRecognizerKVCacheType KVCacheType = SpeechRecognizerSettings->KVCacheType;
+
+	auto OnLanguageModelLoaded = [ThisShared, SetStartThreadPromiseValue, RecognizerThreadPriority, RecognizerThreadAffinityMask, KVCacheType](bool bSuccess, uint8* ModelBulkDataPtr, int64 ModelBulkDataSize)
 	{
 		if (!ThisShared.IsValid())
 		{
@@ -537,7 +1419,14 @@ TFuture<bool> FSpeechRecognizerThread::StartThread()
 			return;
 		}
 
-		if (!ThisShared->WhisperState.Init(ModelBulkDataPtr, ModelBulkDataSize, ThisShared))
+		bool bInitialized;
+		{
+			// The weights are allocated here, so they are attributed to this speech recognizer
+			FSpeechRecognizerMemoryTracker::FOwnerScope MemoryOwnerScope(ThisShared->MemoryTracker.Get());
+			bInitialized = ThisShared->WhisperState.Init(ModelBulkDataPtr, ModelBulkDataSize, ThisShared, KVCacheType);
+		}
+
+		if (!bInitialized)
 		{
 			const FString ShortErrorMessage = TEXT("Recognizer initialization failed");
 			const FString LongErrorMessage = TEXT("Failed to initialize whisper from the language model");
@@ -561,7 +1450,7 @@ TFuture<bool> FSpeechRecognizerThread::StartThread()
 				return;
 			}
 
-			if (ThisShared->RecognitionParameters.bTranslateToEnglish && !bMultilingual)
+			if ((ThisShared->RecognitionParameters.bTranslateToEnglish || ThisShared->RecognitionParameters.bTranscribeAndTranslate) && !bMultilingual)
 			{
 				const FString ShortErrorMessage = TEXT("Translation failed");
 				const FString LongErrorMessage = TEXT("The selected language model does not support multilingual recognition therefore translation is not possible");
@@ -572,13 +1461,46 @@ TFuture<bool> FSpeechRecognizerThread::StartThread()
 		}
 
 		ThisShared->Thread.Reset();
+		ThisShared->Metrics.Reset();
 
 		ThisShared->bIsStopping.AtomicSet(false);
-		ThisShared->RecognitionParameters.FillWhisperStateParameters(ThisShared->WhisperState);
+		ThisShared->bIsPaused.AtomicSet(false);
+		{
+			// Filling the parameters may rebuild the command set and the vocabulary, so it works on a copy rather than blocking the setters for that long
+			FSpeechRecognitionParameters AppliedParameters;
+			{
+				FScopeLock Lock(&ThisShared->RecognitionParametersGuard);
+				ThisShared->bRecognitionParametersChanged.AtomicSet(false);
+				AppliedParameters = ThisShared->RecognitionParameters;
+			}
+
+			AppliedParameters.FillWhisperStateParameters(ThisShared->WhisperState);
+			ThisShared->IdleMemoryTrimDelaySec = AppliedParameters.IdleMemoryTrimDelaySec;
+			ThisShared->bTranscribeAndTranslate = AppliedParameters.bTranscribeAndTranslate;
+			ThisShared->CommandRejectionProbability = AppliedParameters.CommandRejectionProbability;
+			ThisShared->LanguageLock.Reset();
+			ThisShared->LanguageLock.Configure(AppliedParameters);
+		}
+
+		bool bInferenceStateAllocated;
+		{
+			// The KV caches and compute buffers are allocated once the parameters they are sized for are filled
+			FSpeechRecognizerMemoryTracker::FOwnerScope MemoryOwnerScope(ThisShared->MemoryTracker.Get());
+			bInferenceStateAllocated = ThisShared->WhisperState.RestoreInferenceState();
+		}
+
+		if (!bInferenceStateAllocated)
+		{
+			const FString ShortErrorMessage = TEXT("Recognizer initialization failed");
+			const FString LongErrorMessage = TEXT("Failed to allocate the whisper inference state (KV caches and compute buffers)");
+			ThisShared->ReportError(ShortErrorMessage, LongErrorMessage);
+			SetStartThreadPromiseValue(ThisShared.ToSharedRef(), false);
+			return;
+		}
 		ThisShared->bIsStopped.AtomicSet(false);
 		ThisShared->bIsFinished.AtomicSet(true);
 
-		FRunnableThread* ThreadPtr = FRunnableThread::Create(ThisShared.Get(), TEXT("SpeechRecognizerThread"), 0, TPri_Highest, FPlatformAffinity::GetTaskGraphHighPriorityTaskMask());
+		FRunnableThread* ThreadPtr = FRunnableThread::Create(ThisShared.Get(), TEXT("SpeechRecognizerThread"), 0, RecognizerThreadPriority, RecognizerThreadAffinityMask);
 		if (!ThreadPtr)
 		{
 			const FString ShortErrorMessage = TEXT("Thread creation failed");
@@ -596,6 +1518,57 @@ TFuture<bool> FSpeechRecognizerThread::StartThread()
 	return StartThreadPromise->GetFuture();
 }
 
+TFuture<bool> FSpeechRecognizerThread::Prewarm()
+{
+	if (GetIsStopping())
+	{
+		const FString ShortErrorMessage = TEXT("Prewarm failed");
+		const FString LongErrorMessage = TEXT("Unable to prewarm the recognizer while the thread is stopping");
+		ReportError(ShortErrorMessage, LongErrorMessage);
+		return MakeFulfilledPromise<bool>(false).GetFuture();
+	}
+
+	TSharedRef<TPromise<bool>> WarmUpPromise = MakeShared<TPromise<bool>>();
+	TFuture<bool> WarmUpFuture = WarmUpPromise->GetFuture();
+	{
+		FScopeLock Lock(&WarmUpGuard);
+		WarmUpPromises.Add(WarmUpPromise);
+		bIsWarmUpRequested.AtomicSet(true);
+	}
+
+	// The warm-up also runs while paused
+	WakeUpEvent->Trigger();
+
+	// The thread worker runs the warm-up once it is started. If the thread is already starting, the warm-up is picked up the same way
+	// StartThread fails synchronously with an already fulfilled future on its early checks, which never reach the warm-up completion of the asynchronous path
+	if (GetIsStopped() && !StartThreadPromise.IsValid())
+	{
+		TFuture<bool> StartThreadFuture = StartThread();
+		if (StartThreadFuture.IsReady() && !StartThreadFuture.Get())
+		{
+			CompleteWarmUp(false);
+		}
+	}
+
+	return WarmUpFuture;
+}
+
+void FSpeechRecognizerThread::CompleteWarmUp(bool bSuccess)
+{
+	TArray<TSharedRef<TPromise<bool>>> CompletedWarmUpPromises;
+	{
+		FScopeLock Lock(&WarmUpGuard);
+		CompletedWarmUpPromises = MoveTemp(WarmUpPromises);
+		WarmUpPromises.Reset();
+		bIsWarmUpRequested.AtomicSet(false);
+	}
+
+	for (const TSharedRef<TPromise<bool>>& WarmUpPromise : CompletedWarmUpPromises)
+	{
+		WarmUpPromise->SetValue(bSuccess);
+	}
+}
+
 void FSpeechRecognizerThread::StopThread()
 {
 	if (DoesSharedInstanceExist())
@@ -611,21 +1584,81 @@ void FSpeechRecognizerThread::StopThread()
 	}
 }
 
+bool FSpeechRecognizerThread::Pause()
+{
+	if (GetIsStopped())
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to pause the recognition while the thread is stopped"));
+		return false;
+	}
+
+	if (GetIsStopping())
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to pause the recognition while the thread is stopping"));
+		return false;
+	}
+
+	if (GetIsPaused())
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Warning, TEXT("The recognition is already paused"));
+		return true;
+	}
+
+	bIsPausedAudioDropLogged.AtomicSet(false);
+	bIsPaused.AtomicSet(true);
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Paused the speech recognition"));
+	return true;
+}
+
+bool FSpeechRecognizerThread::Resume()
+{
+	if (!GetIsPaused())
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to resume the recognition since it is not paused"));
+		return false;
+	}
+
+	bIsPaused.AtomicSet(false);
+	WakeUpEvent->Trigger();
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Resumed the speech recognition"));
+	return true;
+}
+
+bool FSpeechRecognizerThread::GetIsPaused() const
+{
+	return bIsPaused;
+}
+
 void FSpeechRecognizerThread::ProcessPCMData(Audio::FAlignedFloatBuffer PCMData, float SampleRate, uint32 NumOfChannels, bool bLast)
 {
+	SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_Ingest);
+
 	if (GetIsStopped())
 	{
 		const FString ShortErrorMessage = TEXT("Audio processing failed");
 		const FString LongErrorMessage = TEXT("The audio data could not be processed to the recognizer since the thread is stopped");
 		ReportError(ShortErrorMessage, LongErrorMessage);
+		RecordDroppedAudio(PCMData.Num(), SampleRate, NumOfChannels);
 		return;
 	}
 
-	if (GetIsStopped())
+	if (GetIsStopping())
 	{
 		const FString ShortErrorMessage = TEXT("Audio processing failed");
 		const FString LongErrorMessage = TEXT("The audio data could not be processed to the recognizer since the thread is stopping");
 		ReportError(ShortErrorMessage, LongErrorMessage);
+		RecordDroppedAudio(PCMData.Num(), SampleRate, NumOfChannels);
+		return;
+	}
+
+	// Being paused is deliberate, so the audio is dropped without reporting an error, and only counted in the metrics
+	if (GetIsPaused())
+	{
+		if (!bIsPausedAudioDropLogged.AtomicSet(true))
+		{
+			UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Dropping the audio data submitted while the recognition is paused"));
+		}
+		RecordDroppedAudio(PCMData.Num(), SampleRate, NumOfChannels);
 		return;
 	}
 
@@ -635,24 +1668,31 @@ void FSpeechRecognizerThread::ProcessPCMData(Audio::FAlignedFloatBuffer PCMData,
 		const FString LongErrorMessage = TEXT("Invalid sample rate or number of channels");
 		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Invalid sample rate (%f) or number of channels (%d). Both must be greater than 0"), SampleRate, NumOfChannels);
 		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("P.S. Please make sure that the SampleRate pin of the ProcessPCMData function is properly connected, as this is a common mistake"));
+		RecordDroppedAudio(PCMData.Num(), SampleRate, NumOfChannels);
 		return;
 	}
 
 	// Make sure to process the data in background thread
+	// The audio data is handed over through a queue rather than captured by the task, and a task is only scheduled if none is already draining the queue
 	if (IsInGameThread())
 	{
-		AsyncTask(ENamedThreads::AnyBackgroundHiPriTask, [SpeechRecognizerSharedPtr = WhisperState.WhisperUserData.SpeechRecognizerWeakPtr.Pin(), PCMData = MoveTemp(PCMData), SampleRate, NumOfChannels, bLast]() mutable
+		SubmittedAudioQueue.Enqueue(FSubmittedAudioData{MoveTemp(PCMData), SampleRate, NumOfChannels, bLast});
+		if (!bSubmittedAudioTaskScheduled.exchange(true))
 		{
-			if (!SpeechRecognizerSharedPtr.IsValid())
+			AsyncTask(ENamedThreads::AnyBackgroundHiPriTask, [SpeechRecognizerSharedPtr = WhisperState.WhisperUserData.SpeechRecognizerWeakPtr.Pin()]() mutable
 			{
-				UE_LOG(LogRuntimeSpeechRecognizer, Warning, TEXT("Failed to process the audio data since the thread worker is invalid"));
-				return;
-			}
-			SpeechRecognizerSharedPtr->ProcessPCMData(MoveTemp(PCMData), SampleRate, NumOfChannels, bLast);
-		});
+				if (!SpeechRecognizerSharedPtr.IsValid())
+				{
+					UE_LOG(LogRuntimeSpeechRecognizer, Warning, TEXT("Failed to process the audio data since the thread worker is invalid"));
+					return;
+				}
+				SpeechRecognizerSharedPtr->ProcessSubmittedAudioData();
+			});
+		}
 		return;
 	}
 
+	const int32 StepSizeMs = GetRecognitionParameters().StepSizeMs;
 	if (bLast)
 	{
 		if (!PendingAudio.AddAudio(MoveTemp(PCMData), SampleRate, NumOfChannels))
@@ -671,13 +1711,13 @@ void FSpeechRecognizerThread::ProcessPCMData(Audio::FAlignedFloatBuffer PCMData,
 			ReportError(ShortErrorMessage, LongErrorMessage);
 			return;
 		}
-		AudioQueue.Enqueue(MoveTemp(PendingAudioData));
+		EnqueueAudioData(MoveTemp(PendingAudioData));
 		UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Enqueued audio data from the pending audio to the queue of the speech recognizer as the last data (num of samples: %d)"), NumOfQueuedSamples);
 	}
-	else if (RecognitionParameters.StepSizeMs > 0)
+	else if (StepSizeMs > 0)
 	{
 		// Calculate the number of samples per step
-		const int32 NumOfSamplesPerStep = (1e-3 * RecognitionParameters.StepSizeMs) * WHISPER_SAMPLE_RATE;
+		const int32 NumOfSamplesPerStep = (1e-3 * StepSizeMs) * WHISPER_SAMPLE_RATE;
 
 		// If pending audio is insufficient to fill the step size, append new data until sufficient
 		if (PCMData.Num() + PendingAudio.GetTotalMixedAndResampledSize() < NumOfSamplesPerStep)
@@ -709,18 +1749,33 @@ void FSpeechRecognizerThread::ProcessPCMData(Audio::FAlignedFloatBuffer PCMData,
 				ReportError(ShortErrorMessage, LongErrorMessage);
 				return;
 			}
-			AudioQueue.Enqueue(MoveTemp(PendingAudioData));
+			EnqueueAudioData(MoveTemp(PendingAudioData));
 			UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Enqueued audio data from the pending audio to the queue of the speech recognizer (num of samples: %d)"), NumOfQueuedSamples);
 		}
 	}
 	else
 	{
 		const int32 NumOfQueuedSamples = PCMData.Num();
-		AudioQueue.Enqueue(MoveTemp(PCMData));
+		EnqueueAudioData(MoveTemp(PCMData));
 		UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Enqueued audio data from the pending audio to the queue of the speech recognizer as the last data (num of samples: %d)"), NumOfQueuedSamples);
 	}
 }
 
+void FSpeechRecognizerThread::ProcessSubmittedAudioData()
+{
+	FSubmittedAudioData SubmittedAudio;
+	do
+	{
+		while (SubmittedAudioQueue.Dequeue(SubmittedAudio))
+		{
+			ProcessPCMData(MoveTemp(SubmittedAudio.PCMData), SubmittedAudio.SampleRate, SubmittedAudio.NumOfChannels, SubmittedAudio.bLast);
+		}
+		bSubmittedAudioTaskScheduled = false;
+	}
+	// Audio data submitted between the last dequeue and clearing the flag did not schedule a task, so it has to be processed here unless another task took over
+	while (!SubmittedAudioQueue.IsEmpty() && !bSubmittedAudioTaskScheduled.exchange(true));
+}
+
 void FSpeechRecognizerThread::ForceProcessPendingAudioData()
 {
 	if (GetIsStopped())
@@ -731,7 +1786,7 @@ void FSpeechRecognizerThread::ForceProcessPendingAudioData()
 		return;
 	}
 
-	if (GetIsStopped())
+	if (GetIsStopping())
 	{
 		const FString ShortErrorMessage = TEXT("Audio processing failed");
 		const FString LongErrorMessage = TEXT("The audio data could not be processed to the recognizer since the thread is stopping");
@@ -764,7 +1819,7 @@ void FSpeechRecognizerThread::ForceProcessPendingAudioData()
 		return;
 	}
 
-	AudioQueue.Enqueue(MoveTemp(PendingAudioData));
+	EnqueueAudioData(MoveTemp(PendingAudioData));
 	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Enqueued audio data from the pending audio to the queue of the speech recognizer as the last data (num of samples: %d)"), NumOfQueuedSamples);
 }
 
@@ -772,11 +1827,27 @@ void FSpeechRecognizerThread::ClearAudioData(bool bClearPendingAudioData, bool b
 {
 	if (bClearPendingAudioData)
 	{
+		const int64 NumOfPendingSamples = PendingAudio.GetTotalMixedAndResampledSize();
 		PendingAudio = FPendingAudioData();
-	}
+		if (NumOfPendingSamples > 0)
+		{
+			Metrics.RecordDroppedAudio(1, static_cast<double>(NumOfPendingSamples) / WHISPER_SAMPLE_RATE);
+		}
+	}
 	if (bClearAudioQueue)
 	{
-		AudioQueue.Empty();
+		FQueuedAudioData ClearedAudio;
+		while (AudioQueue.Dequeue(ClearedAudio))
+		{
+			FSpeechRecognizerAudioBufferPool::Get().Release(MoveTemp(ClearedAudio.PCMData));
+		}
+		const int32 NumOfClearedChunks = NumOfQueuedChunks.Set(0);
+		const int64 NumOfClearedSamples = NumOfQueuedSamples.Set(0);
+		DEC_DWORD_STAT_BY(STAT_SpeechRecognizer_QueueDepth, NumOfClearedChunks);
+		if (NumOfClearedChunks > 0)
+		{
+			Metrics.RecordDroppedAudio(NumOfClearedChunks, static_cast<double>(NumOfClearedSamples) / WHISPER_SAMPLE_RATE);
+		}
 	}
 }
 
@@ -790,7 +1861,7 @@ bool FSpeechRecognizerThread::Init()
 		return false;
 	}
 
-	if (GetIsStopped())
+	if (GetIsStopping())
 	{
 		const FString ShortErrorMessage = TEXT("Thread initialization failed");
 		const FString LongErrorMessage = TEXT("Unable to initialize a thread that is stopping");
@@ -809,36 +1880,205 @@ bool FSpeechRecognizerThread::Init()
 
 uint32 FSpeechRecognizerThread::Run()
 {
+	// The KV caches and compute buffers can be reallocated during recognition
+	FSpeechRecognizerMemoryTracker::FOwnerScope MemoryOwnerScope(MemoryTracker.Get());
+	LastActivityTime = FPlatformTime::Seconds();
+
+	bAutoTuneThreads = GetRecognitionParameters().bAutoTuneThreads;
+	if (bAutoTuneThreads && FPlatformProcess::SupportsMultithreading() && !AutoTuneThreads())
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Warning, TEXT("Failed to auto-tune the number of threads, using the configured thread counts"));
+	}
+
 	while (!GetIsStopped() && !GetIsStopping())
 	{
-		Audio::FAlignedFloatBuffer NewQueuedBuffer;
-		while (AudioQueue.Dequeue(NewQueuedBuffer))
+		if (bIsWarmUpRequested)
+		{
+			const bool bWarmedUp = WarmUp();
+			if (!bWarmedUp)
+			{
+				const FString ShortErrorMessage = TEXT("Prewarm failed");
+				const FString LongErrorMessage = TEXT("Failed to run the dummy mel, encode and decode to warm up the recognizer");
+				ReportError(ShortErrorMessage, LongErrorMessage);
+			}
+			CompleteWarmUp(bWarmedUp);
+			LastActivityTime = FPlatformTime::Seconds();
+		}
+
+		if (GetIsPaused())
+		{
+			// Everything stays allocated while paused, so resuming only has to wake this thread up
+			WakeUpEvent->Wait();
+			continue;
+		}
+
+		// Pausing takes effect at the next chunk boundary, leaving the rest of the queued audio to be recognized once resumed
+		FQueuedAudioData NewQueuedAudio;
+		while (!GetIsPaused() && AudioQueue.Dequeue(NewQueuedAudio))
 		{
+			// Parameters changed while running are applied at the chunk boundary, never in the middle of a whisper_full call
+			if (bRecognitionParametersChanged)
+			{
+				ApplyStagedRecognitionParameters();
+			}
+
+			SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_Recognize);
+			NumOfQueuedChunks.Decrement();
+			NumOfQueuedSamples.Subtract(NewQueuedAudio.PCMData.Num());
+			DEC_DWORD_STAT(STAT_SpeechRecognizer_QueueDepth);
+
 			bIsFinished.AtomicSet(false);
 
+			Audio::FAlignedFloatBuffer& NewQueuedBuffer = NewQueuedAudio.PCMData;
+			if (!WakeUpInferenceState())
+			{
+				const FString ShortErrorMessage = TEXT("Audio processing failed");
+				const FString LongErrorMessage = TEXT("Failed to rebuild the inference buffers released while the recognizer was idle");
+				ReportError(ShortErrorMessage, LongErrorMessage);
+				Metrics.RecordFailedChunk();
+				FSpeechRecognizerAudioBufferPool::Get().Release(MoveTemp(NewQueuedBuffer));
+				continue;
+			}
+
+			const double AudioSeconds = static_cast<double>(NewQueuedBuffer.Num()) / WHISPER_SAMPLE_RATE;
+			const double StartTime = FPlatformTime::Seconds();
+			const int32 NumFallbacksLogProbBefore = WhisperState.WhisperContext->state ? WhisperState.WhisperContext->state->n_fail_p : 0;
+			const int32 NumFallbacksEntropyBefore = WhisperState.WhisperContext->state ? WhisperState.WhisperContext->state->n_fail_h : 0;
+			const int32 NumRepetitionStopsBefore = WhisperState.WhisperContext->state ? WhisperState.WhisperContext->state->n_stop_r : 0;
+			const int32 NumNoSpeechSkipsBefore = WhisperState.WhisperContext->state ? WhisperState.WhisperContext->state->n_skip_s : 0;
+
+			// Time spent decoding (prompt, single-token and batched decoder calls, and sampling), to report the decoding cost of the beam width
+			auto GetDecodeUs = [this]() -> int64
+			{
+				const whisper_state* State = WhisperState.WhisperContext->state;
+				return State ? State->t_prompt_us + State->t_decode_us + State->t_batchd_us + State->t_sample_us : 0;
+			};
+			const int64 DecodeUsBefore = GetDecodeUs();
+
+			// The graphs are computed on this thread, so the profiler only needs to be installed here
+			const bool bProfileGraphs = bGraphProfilingEnabled;
+			if (bProfileGraphs)
+			{
+				GraphProfiler->BeginCapture();
+			}
+
 			// Resize the buffer to the minimum required size (1 second, plus 10% more due to a minor bug in checking the buffer size)
 			// see https://github.com/ggerganov/whisper.cpp/issues/39
 			constexpr float MinBufferDurationSec = 1.1;
 			if (NewQueuedBuffer.Num() < WHISPER_SAMPLE_RATE * MinBufferDurationSec)
 			{
+				FSpeechRecognizerAudioBufferPool::Get().Reserve(NewQueuedBuffer, static_cast<int32>(WHISPER_SAMPLE_RATE * MinBufferDurationSec));
 				NewQueuedBuffer.AddZeroed(WHISPER_SAMPLE_RATE * MinBufferDurationSec - NewQueuedBuffer.Num());
 			}
-			if (whisper_full_parallel(WhisperState.WhisperContext, *WhisperState.WhisperParameters, NewQueuedBuffer.GetData(), NewQueuedBuffer.Num(), 1) != 0)
+
+			// Once the session language is locked, the chunk is recognized in it without the language detection (an extra encoder pass and decoder step)
+			if (LanguageLock.IsEnabled())
+			{
+				WhisperState.WhisperParameters->language = EnumToString(LanguageLock.GetLanguageToRecognize());
+			}
+			const bool bDetectLanguage = FCStringAnsi::Strcmp(WhisperState.WhisperParameters->language, EnumToString(ESpeechRecognizerLanguage::Auto)) == 0;
+
+			// In the command mode, the chunk is scored against the commands instead of being transcribed
+			const bool bCommandMode = WhisperState.WhisperCommandSet != nullptr;
+
+			bool bRecognized;
+			{
+				FSpeechRecognizerFrameMonitor::FRecognitionScope FrameRecognitionScope(WhisperState.ThrottlingCounters);
+				FSpeechRecognizerAllocationCounter::FCountScope AllocationCountScope(WhisperState.NumOfAllocations);
+				bRecognized = bCommandMode ? RecognizeCommand(NewQueuedBuffer) : whisper_full_parallel(WhisperState.WhisperContext, *WhisperState.WhisperParameters, NewQueuedBuffer.GetData(), NewQueuedBuffer.Num(), 1) == 0;
+			}
+			if (!bRecognized)
 			{
 				UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Failed to process audio data with the size of %d samples to the whisper recognizer"), NewQueuedBuffer.Num());
+				Metrics.RecordFailedChunk();
 			}
 			else
 			{
 				UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Processed audio data with the size of %d samples to the whisper recognizer"), NewQueuedBuffer.Num());
+
+				int32 NumOfDecodedTokens = bCommandMode ? 0 : GetNumOfDecodedTokens(WhisperState.WhisperContext);
+
+				if (!bCommandMode && bDetectLanguage)
+				{
+					ReportLanguageDetection();
+				}
+				else if (!bCommandMode && LanguageLock.IsEnabled())
+				{
+					// Low confidence in the recognized tokens is the sign the speaker may have switched the language
+					float TokenProbabilitySum = 0;
+					int32 NumOfTextTokens = 0;
+					const whisper_token EndOfTextToken = whisper_token_eot(WhisperState.WhisperContext);
+					for (int32 SegmentIndex = 0; SegmentIndex < whisper_full_n_segments(WhisperState.WhisperContext); ++SegmentIndex)
+					{
+						for (int32 TokenIndex = 0; TokenIndex < whisper_full_n_tokens(WhisperState.WhisperContext, SegmentIndex); ++TokenIndex)
+						{
+							if (whisper_full_get_token_id(WhisperState.WhisperContext, SegmentIndex, TokenIndex) < EndOfTextToken)
+							{
+								TokenProbabilitySum += whisper_full_get_token_p(WhisperState.WhisperContext, SegmentIndex, TokenIndex);
+								++NumOfTextTokens;
+							}
+						}
+					}
+
+					// Chunks without text (e.g. silence) say nothing about the language
+					LanguageLock.RecordLockedChunk(NumOfTextTokens > 0 ? TokenProbabilitySum / NumOfTextTokens : 1.f);
+				}
+
+				if (!bCommandMode && bTranscribeAndTranslate)
+				{
+					FSpeechRecognizerFrameMonitor::FRecognitionScope FrameRecognitionScope(WhisperState.ThrottlingCounters);
+					FSpeechRecognizerAllocationCounter::FCountScope AllocationCountScope(WhisperState.NumOfAllocations);
+					NumOfDecodedTokens += TranslateRecognizedAudio();
+				}
+
+				const double EndTime = FPlatformTime::Seconds();
+				INC_DWORD_STAT_BY(STAT_SpeechRecognizer_DecodedTokens, NumOfDecodedTokens);
+
+				const int32 NumFallbacksLogProb = WhisperState.WhisperContext->state ? WhisperState.WhisperContext->state->n_fail_p - NumFallbacksLogProbBefore : 0;
+				const int32 NumFallbacksEntropy = WhisperState.WhisperContext->state ? WhisperState.WhisperContext->state->n_fail_h - NumFallbacksEntropyBefore : 0;
+				const int32 NumRepetitionStops = WhisperState.WhisperContext->state ? WhisperState.WhisperContext->state->n_stop_r - NumRepetitionStopsBefore : 0;
+				const int32 NumNoSpeechSkips = WhisperState.WhisperContext->state ? WhisperState.WhisperContext->state->n_skip_s - NumNoSpeechSkipsBefore : 0;
+				const double DecodeSeconds = FMath::Max<int64>(0, GetDecodeUs() - DecodeUsBefore) * 1e-6;
+				const int32 BeamWidth = WhisperState.WhisperParameters->strategy == WHISPER_SAMPLING_BEAM_SEARCH ? WhisperState.WhisperParameters->beam_search.beam_size : 1;
+				UE_LOG(LogRuntimeSpeechRecognizer, Verbose, TEXT("Decoded %d tokens with a beam width of %d in %.2f ms (%.3f ms per token)"), NumOfDecodedTokens, BeamWidth, DecodeSeconds * 1000, NumOfDecodedTokens > 0 ? DecodeSeconds * 1000 / NumOfDecodedTokens : 0);
+				Metrics.RecordChunk(AudioSeconds, StartTime - NewQueuedAudio.EnqueueTime, EndTime - StartTime, NumOfDecodedTokens, FMath::Max(0, NumFallbacksLogProb), FMath::Max(0, NumFallbacksEntropy), FMath::Max(0, NumRepetitionStops), FMath::Max(0, NumNoSpeechSkips), DecodeSeconds, BeamWidth);
+			}
+
+			if (bProfileGraphs)
+			{
+				GraphProfiler->EndCapture();
 			}
+
+			if (WhisperState.WhisperContext->state)
+			{
+				MemoryTracker->SetExternalSize(ESpeechRecognizerMemoryCategory::Mel, WhisperState.WhisperContext->state->mel.data.capacity() * sizeof(float));
+			}
+
+			FSpeechRecognizerAudioBufferPool::Get().Release(MoveTemp(NewQueuedBuffer));
+			LastActivityTime = FPlatformTime::Seconds();
 		}
 
+		// Paused in the middle of the queue, which is neither finished nor idle
+		if (GetIsPaused())
+		{
+			continue;
+		}
+
+		// Parameters changed while idle are applied right away, so that e.g. the idle memory trimming delay takes effect
+		if (bRecognitionParametersChanged)
+		{
+			ApplyStagedRecognitionParameters();
+		}
+
+		TrimIdleMemory();
+
 		if (DoesSharedInstanceExist() && PendingAudio.GetTotalMixedAndResampledSize() == 0 && !GetIsFinished())
 		{
 			bIsFinished.AtomicSet(true);
 			TSharedPtr<FSpeechRecognizerThread> ThisShared = AsShared();
 			AsyncTask(ENamedThreads::AnyThread, [ThisShared]()
 			{
+				SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_Dispatch);
 				if (!ThisShared.IsValid())
 				{
 					UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Failed to get shared instance"));
@@ -863,6 +2103,7 @@ uint32 FSpeechRecognizerThread::Run()
 			TSharedPtr<FSpeechRecognizerThread> ThisShared = AsShared();
 			AsyncTask(ENamedThreads::AnyThread, [ThisShared]()
 			{
+				SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_Dispatch);
 				if (!ThisShared.IsValid())
 				{
 					UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Failed to get shared instance"));
@@ -880,6 +2121,7 @@ void FSpeechRecognizerThread::Stop()
 {
 	bIsStopping.AtomicSet(true);
 	bIsFinished.AtomicSet(true);
+	WakeUpEvent->Trigger();
 	WhisperState.WhisperUserData = FWhisperSpeechRecognizerUserData();
 	FRunnable::Stop();
 	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Stopping the speech recognizer thread"));
@@ -890,26 +2132,18 @@ void FSpeechRecognizerThread::Exit()
 	bIsStopping.AtomicSet(false);
 	bIsStopped.AtomicSet(true);
 	bIsFinished.AtomicSet(true);
+	bIsPaused.AtomicSet(false);
+	CompleteWarmUp(false);
 	ReleaseMemory();
 	FRunnable::Exit();
 }
 
 bool FSpeechRecognizerThread::SetRecognitionParameters(const FSpeechRecognitionParameters& Parameters)
 {
-	if (!GetIsStopped())
+	return StageRecognitionParameters(TEXT("recognition parameters"), [&Parameters](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set recognition parameters while the thread is running"));
-		return false;
-	}
-
-	if (GetIsStopped())
-	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set recognition parameters while the thread is stopping"));
-		return false;
-	}
-
-	RecognitionParameters = Parameters;
-	return true;
+		StagedParameters = Parameters;
+	});
 }
 
 FSpeechRecognitionParameters FSpeechRecognizerThread::GetNonStreamingDefaults()
@@ -924,322 +2158,434 @@ FSpeechRecognitionParameters FSpeechRecognizerThread::GetStreamingDefaults()
 
 FSpeechRecognitionParameters FSpeechRecognizerThread::GetRecognitionParameters() const
 {
+	FScopeLock Lock(&RecognitionParametersGuard);
 	return RecognitionParameters;
 }
 
 bool FSpeechRecognizerThread::SetNonStreamingDefaults()
 {
-	if (!GetIsStopped())
-	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set non-streaming defaults while the thread is running"));
-		return false;
-	}
-
-	if (GetIsStopped())
+	return StageRecognitionParameters(TEXT("non-streaming defaults"), [](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set non-streaming defaults while the thread is stopping"));
-		return false;
-	}
-
-	RecognitionParameters.SetNonStreamingDefaults();
-	return true;
+		StagedParameters.SetNonStreamingDefaults();
+	});
 }
 
 bool FSpeechRecognizerThread::SetStreamingDefaults()
 {
-	if (!GetIsStopped())
+	return StageRecognitionParameters(TEXT("streaming defaults"), [](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set streaming defaults while the thread is running"));
-		return false;
-	}
+		StagedParameters.SetStreamingDefaults();
+	});
+}
 
-	if (GetIsStopped())
+bool FSpeechRecognizerThread::SetNumOfThreads(int32 Value)
+{
+	return StageRecognitionParameters(TEXT("the number of threads"), [Value](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set streaming defaults while the thread is stopping"));
-		return false;
-	}
-
-	RecognitionParameters.SetStreamingDefaults();
-	return true;
+		StagedParameters.NumOfThreads = Value;
+	});
 }
 
-bool FSpeechRecognizerThread::SetNumOfThreads(int32 Value)
+bool FSpeechRecognizerThread::SetNumOfStageThreads(int32 NumOfMelThreads, int32 NumOfEncoderThreads, int32 NumOfDecoderThreads)
 {
-	if (!GetIsStopped())
+	if (NumOfMelThreads < 0 || NumOfEncoderThreads < 0 || NumOfDecoderThreads < 0)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the number of threads while the thread is running"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set a negative number of stage threads"));
 		return false;
 	}
 
-	if (GetIsStopped())
+	return StageRecognitionParameters(TEXT("the number of stage threads"), [NumOfMelThreads, NumOfEncoderThreads, NumOfDecoderThreads](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the number of threads while the thread is stopping"));
-		return false;
-	}
+		StagedParameters.NumOfMelThreads = NumOfMelThreads;
+		StagedParameters.NumOfEncoderThreads = NumOfEncoderThreads;
+		StagedParameters.NumOfDecoderThreads = NumOfDecoderThreads;
+	});
+}
 
-	RecognitionParameters.NumOfThreads = Value;
-	return true;
+bool FSpeechRecognizerThread::SetAutoTuneThreads(bool bAutoTune)
+{
+	return StageRecognitionParameters(TEXT("thread auto-tuning"), [bAutoTune](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.bAutoTuneThreads = bAutoTune;
+	});
 }
 
 bool FSpeechRecognizerThread::SetLanguage(ESpeechRecognizerLanguage Language)
 {
-	if (!GetIsStopped())
+	const USpeechRecognizerSettings* SpeechRecognizerSettings = GetDefault<USpeechRecognizerSettings>();
+	if (Language == ESpeechRecognizerLanguage::Auto && SpeechRecognizerSettings->ModelLanguage == ESpeechRecognizerModelLanguage::EnglishOnly)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set language while the thread is running"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set language to 'auto' when the model is English only"));
 		return false;
 	}
 
-	if (GetIsStopped())
+	// The language is also checked when the thread starts, but a running thread only picks the language up at the next chunk
+	if (Language != ESpeechRecognizerLanguage::Auto && whisper_lang_id(EnumToString(Language)) == -1)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set language while the thread is stopping"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set language to '%hs' since it is not supported by whisper"), EnumToString(Language));
 		return false;
 	}
 
-	const USpeechRecognizerSettings* SpeechRecognizerSettings = GetDefault<USpeechRecognizerSettings>();
-	if (RecognitionParameters.Language == ESpeechRecognizerLanguage::Auto && SpeechRecognizerSettings->ModelLanguage == ESpeechRecognizerModelLanguage::EnglishOnly)
+	if (!GetIsStopped() && Language == ESpeechRecognizerLanguage::Auto && WhisperState.WhisperContext && !whisper_is_multilingual(WhisperState.WhisperContext))
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set language to 'auto' when the model is English only"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set language to 'auto' since the loaded language model is not multilingual"));
 		return false;
 	}
 
-	RecognitionParameters.Language = Language;
-	return true;
+	return StageRecognitionParameters(TEXT("language"), [Language](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.Language = Language;
+	});
 }
 
-bool FSpeechRecognizerThread::SetTranslateToEnglish(bool bTranslate)
+bool FSpeechRecognizerThread::SetLanguageLock(bool bLock, float ProbabilityThreshold, int32 NumOfChunksToLock, int32 RecheckInterval, float RecheckTokenProbability)
 {
-	if (!GetIsStopped())
+	if (ProbabilityThreshold < 0 || ProbabilityThreshold > 1 || RecheckTokenProbability < 0 || RecheckTokenProbability > 1)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set translation while the thread is running"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the language lock probabilities to %f and %f since they must be between 0 and 1"), ProbabilityThreshold, RecheckTokenProbability);
 		return false;
 	}
 
-	if (GetIsStopped())
+	if (NumOfChunksToLock < 1 || RecheckInterval < 0)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set translation while the thread is stopping"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the language lock to %d chunks with a recheck interval of %d chunks since the number of chunks must be positive and the interval non-negative"), NumOfChunksToLock, RecheckInterval);
 		return false;
 	}
 
-	RecognitionParameters.bTranslateToEnglish = bTranslate;
-	return true;
+	return StageRecognitionParameters(TEXT("language lock"), [bLock, ProbabilityThreshold, NumOfChunksToLock, RecheckInterval, RecheckTokenProbability](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.bLockDetectedLanguage = bLock;
+		StagedParameters.LanguageLockProbabilityThreshold = ProbabilityThreshold;
+		StagedParameters.NumOfChunksToLockLanguage = NumOfChunksToLock;
+		StagedParameters.LanguageRecheckInterval = RecheckInterval;
+		StagedParameters.LanguageRecheckTokenProbability = RecheckTokenProbability;
+	});
 }
 
-bool FSpeechRecognizerThread::SetStepSize(int32 Value)
+bool FSpeechRecognizerThread::SetTranslateToEnglish(bool bTranslate)
 {
-	if (!GetIsStopped())
+	if (!GetIsStopped() && bTranslate && WhisperState.WhisperContext && !whisper_is_multilingual(WhisperState.WhisperContext))
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set step size while the thread is running"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to enable translation since the loaded language model is not multilingual"));
 		return false;
 	}
 
-	if (GetIsStopped())
+	return StageRecognitionParameters(TEXT("translation"), [bTranslate](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set step size while the thread is stopping"));
-		return false;
-	}
-
-	RecognitionParameters.StepSizeMs = Value;
-	return true;
+		StagedParameters.bTranslateToEnglish = bTranslate;
+	});
 }
 
-bool FSpeechRecognizerThread::SetNoContext(bool bNoContext)
+bool FSpeechRecognizerThread::SetTranscribeAndTranslate(bool bEnable)
 {
-	if (!GetIsStopped())
+	if (!GetIsStopped() && bEnable && WhisperState.WhisperContext && !whisper_is_multilingual(WhisperState.WhisperContext))
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set no context while the thread is running"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to enable transcription and translation since the loaded language model is not multilingual"));
 		return false;
 	}
 
-	if (GetIsStopped())
+	return StageRecognitionParameters(TEXT("transcription and translation"), [bEnable](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set no context while the thread is stopping"));
-		return false;
-	}
-
-	RecognitionParameters.bNoContext = bNoContext;
-	return true;
+		StagedParameters.bTranscribeAndTranslate = bEnable;
+	});
 }
 
-bool FSpeechRecognizerThread::SetSingleSegment(bool bSingleSegment)
+bool FSpeechRecognizerThread::SetStepSize(int32 Value)
 {
-	if (!GetIsStopped())
+	return StageRecognitionParameters(TEXT("step size"), [Value](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set single segment while the thread is running"));
-		return false;
-	}
+		StagedParameters.StepSizeMs = Value;
+	});
+}
 
-	if (GetIsStopped())
+bool FSpeechRecognizerThread::SetNoContext(bool bNoContext)
+{
+	return StageRecognitionParameters(TEXT("no context"), [bNoContext](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set single segment while the thread is stopping"));
-		return false;
-	}
-
-	RecognitionParameters.bSingleSegment = bSingleSegment;
-	return true;
+		StagedParameters.bNoContext = bNoContext;
+	});
 }
 
-bool FSpeechRecognizerThread::SetMaxTokens(int32 Value)
+bool FSpeechRecognizerThread::SetSingleSegment(bool bSingleSegment)
 {
-	if (!GetIsStopped())
+	return StageRecognitionParameters(TEXT("single segment"), [bSingleSegment](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set max tokens while the thread is running"));
-		return false;
-	}
+		StagedParameters.bSingleSegment = bSingleSegment;
+	});
+}
 
-	if (GetIsStopped())
+bool FSpeechRecognizerThread::SetMaxTokens(int32 Value)
+{
+	return StageRecognitionParameters(TEXT("max tokens"), [Value](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set max tokens while the thread is stopping"));
-		return false;
-	}
-
-	RecognitionParameters.MaxTokens = Value;
-	return true;
+		StagedParameters.MaxTokens = Value;
+	});
 }
 
 bool FSpeechRecognizerThread::SetSpeedUp(bool bSpeedUp)
 {
-	if (!GetIsStopped())
+	return StageRecognitionParameters(TEXT("speed up"), [bSpeedUp](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set speed up while the thread is running"));
-		return false;
-	}
+		StagedParameters.bSpeedUp = bSpeedUp;
+	});
+}
 
-	if (GetIsStopped())
+bool FSpeechRecognizerThread::SetAudioContextSize(int32 Value)
+{
+	return StageRecognitionParameters(TEXT("audio context size"), [Value](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set speed up while the thread is stopping"));
-		return false;
-	}
+		StagedParameters.AudioContextSize = Value;
+	});
+}
 
-	RecognitionParameters.bSpeedUp = bSpeedUp;
-	return true;
+bool FSpeechRecognizerThread::SetTemperatureToIncrease(float Value)
+{
+	return StageRecognitionParameters(TEXT("temperature to increase"), [Value](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.TemperatureToIncrease = Value;
+	});
 }
 
-bool FSpeechRecognizerThread::SetAudioContextSize(int32 Value)
+bool FSpeechRecognizerThread::SetEntropyThreshold(float Value)
 {
-	if (!GetIsStopped())
+	return StageRecognitionParameters(TEXT("entropy threshold"), [Value](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set audio context size while the thread is running"));
-		return false;
-	}
+		StagedParameters.EntropyThreshold = Value;
+	});
+}
 
-	if (GetIsStopped())
+bool FSpeechRecognizerThread::SetNumOfParallelFallbackTemperatures(int32 Value)
+{
+	if (Value < 0)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set audio context size while the thread is stopping"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set a negative number of parallel fallback temperatures"));
 		return false;
 	}
 
-	RecognitionParameters.AudioContextSize = Value;
-	return true;
+	return StageRecognitionParameters(TEXT("number of parallel fallback temperatures"), [Value](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.NumOfParallelFallbackTemperatures = Value;
+	});
 }
 
-bool FSpeechRecognizerThread::SetTemperatureToIncrease(float Value)
+bool FSpeechRecognizerThread::SetRepetitionDetection(int32 MaxNGramSize, int32 NumOfRepetitions)
 {
-	if (!GetIsStopped())
+	if (MaxNGramSize < 0)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set temperature to increase while the thread is running"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set a negative repetition n-gram size"));
 		return false;
 	}
 
-	if (GetIsStopped())
+	if (NumOfRepetitions < 2)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set temperature to increase while the thread is stopping"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the number of repetitions to stop the decoding to %d since it must be at least 2"), NumOfRepetitions);
 		return false;
 	}
 
-	RecognitionParameters.TemperatureToIncrease = Value;
-	return true;
+	return StageRecognitionParameters(TEXT("repetition detection"), [MaxNGramSize, NumOfRepetitions](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.MaxRepetitionNGramSize = MaxNGramSize;
+		StagedParameters.NumOfRepetitionsToStop = NumOfRepetitions;
+	});
 }
 
-bool FSpeechRecognizerThread::SetEntropyThreshold(float Value)
+bool FSpeechRecognizerThread::SetNoSpeechThreshold(float Value)
 {
-	if (!GetIsStopped())
+	if (Value < 0 || Value > 1)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set entropy threshold while the thread is running"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the no speech threshold to %f since it must be between 0 and 1"), Value);
 		return false;
 	}
 
-	if (GetIsStopped())
+	return StageRecognitionParameters(TEXT("no speech threshold"), [Value](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set entropy threshold while the thread is stopping"));
-		return false;
-	}
-
-	RecognitionParameters.EntropyThreshold = Value;
-	return true;
+		StagedParameters.NoSpeechThreshold = Value;
+	});
 }
 
 bool FSpeechRecognizerThread::SetSuppressBlank(bool Value)
 {
-	if (!GetIsStopped())
+	return StageRecognitionParameters(TEXT("suppress blanks in output"), [Value](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set suppress blanks in output while the thread is running"));
-		return false;
-	}
+		StagedParameters.bSuppressBlank = Value;
+	});
+}
 
-	if (GetIsStopped())
+bool FSpeechRecognizerThread::SetSuppressNonSpeechTokens(bool Value)
+{
+	return StageRecognitionParameters(TEXT("suppress non speech tokens in output"), [Value](FSpeechRecognitionParameters& StagedParameters)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set suppress blanks in output while the thread is stopping"));
-		return false;
-	}
+		StagedParameters.bSuppressNonSpeechTokens = Value;
+	});
+}
 
-	RecognitionParameters.bSuppressBlank = Value;
-	return true;
+bool FSpeechRecognizerThread::SetBeamSize(int32 Value)
+{
+	return StageRecognitionParameters(TEXT("beam size"), [Value](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.BeamSize = Value;
+	});
 }
 
-bool FSpeechRecognizerThread::SetSuppressNonSpeechTokens(bool Value)
+bool FSpeechRecognizerThread::SetSamplingStrategy(ESpeechRecognizerSamplingStrategy Value)
 {
-	if (!GetIsStopped())
+	return StageRecognitionParameters(TEXT("sampling strategy"), [Value](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.SamplingStrategy = Value;
+	});
+}
+
+bool FSpeechRecognizerThread::SetCommands(const TArray<FString>& Commands, float RejectionProbability)
+{
+	if (RejectionProbability < 0 || RejectionProbability > 1)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set suppress non speech tokens in output while the thread is running"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the command rejection probability to %f since it must be between 0 and 1"), RejectionProbability);
 		return false;
 	}
 
-	if (GetIsStopped())
+	for (const FString& Command : Commands)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set suppress non speech tokens in output while the thread is stopping"));
-		return false;
+		if (Command.TrimStartAndEnd().IsEmpty())
+		{
+			UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the commands since one of them is empty"));
+			return false;
+		}
 	}
 
-	RecognitionParameters.bSuppressNonSpeechTokens = Value;
-	return true;
+	return StageRecognitionParameters(TEXT("commands"), [Commands, RejectionProbability](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.Commands = Commands;
+		StagedParameters.CommandRejectionProbability = RejectionProbability;
+	});
 }
 
-bool FSpeechRecognizerThread::SetBeamSize(int32 Value)
+bool FSpeechRecognizerThread::SetVocabulary(const TArray<FString>& Phrases, const FString& Characters, bool bConstrainToPhrases, float GrammarPenalty)
 {
-	if (!GetIsStopped())
+	if (GrammarPenalty < 0)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set beam size while the thread is running"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the vocabulary grammar penalty to %f since it must be non-negative"), GrammarPenalty);
 		return false;
 	}
 
-	if (GetIsStopped())
+	for (const FString& Phrase : Phrases)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set beam size while the thread is stopping"));
-		return false;
+		if (Phrase.TrimStartAndEnd().IsEmpty())
+		{
+			UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the vocabulary since one of its phrases is empty"));
+			return false;
+		}
 	}
 
-	RecognitionParameters.BeamSize = Value;
-	return true;
+	return StageRecognitionParameters(TEXT("vocabulary"), [Phrases, Characters, bConstrainToPhrases, GrammarPenalty](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.VocabularyPhrases = Phrases;
+		StagedParameters.VocabularyCharacters = Characters;
+		StagedParameters.bConstrainToVocabularyPhrases = bConstrainToPhrases;
+		StagedParameters.VocabularyGrammarPenalty = GrammarPenalty;
+	});
 }
 
 bool FSpeechRecognizerThread::SetInitialPrompt(const FString& Value)
 {
-	if (!GetIsStopped())
+	return StageRecognitionParameters(TEXT("initial prompt"), [&Value](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.InitialPrompt = Value;
+	});
+}
+
+bool FSpeechRecognizerThread::SetIdleMemoryTrimDelay(float Value)
+{
+	if (Value < 0)
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set beam size while the thread is running"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set a negative idle memory trim delay"));
 		return false;
 	}
 
-	if (GetIsStopped())
+	return StageRecognitionParameters(TEXT("idle memory trim delay"), [Value](FSpeechRecognitionParameters& StagedParameters)
+	{
+		StagedParameters.IdleMemoryTrimDelaySec = Value;
+	});
+}
+
+bool FSpeechRecognizerThread::StageRecognitionParameters(const TCHAR* ParameterName, TFunctionRef<void(FSpeechRecognitionParameters&)> Stage)
+{
+	if (GetIsStopping())
 	{
-		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set beam size while the thread is stopping"));
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set %s while the thread is stopping"), ParameterName);
 		return false;
 	}
 
-	RecognitionParameters.InitialPrompt = Value;
+	FScopeLock Lock(&RecognitionParametersGuard);
+	Stage(RecognitionParameters);
+
+	// A stopped thread applies the parameters when it starts
+	if (!GetIsStopped())
+	{
+		bRecognitionParametersChanged.AtomicSet(true);
+		UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Staged %s, which will be applied before the next audio chunk is recognized"), ParameterName);
+	}
 	return true;
 }
 
+void FSpeechRecognizerThread::ApplyStagedRecognitionParameters()
+{
+	// The parameters are validated and filled from a copy, since filling them may rebuild the command set and the vocabulary, and the setters should not wait for that
+	FSpeechRecognitionParameters AppliedParameters;
+	{
+		FScopeLock Lock(&RecognitionParametersGuard);
+		bRecognitionParametersChanged.AtomicSet(false);
+		AppliedParameters = RecognitionParameters;
+	}
+
+	// Same checks as when starting the thread, since the language model can't change while running
+	const bool bMultilingual = whisper_is_multilingual(WhisperState.WhisperContext) != 0;
+	if (!bMultilingual && (AppliedParameters.Language == ESpeechRecognizerLanguage::Auto || AppliedParameters.bTranslateToEnglish || AppliedParameters.bTranscribeAndTranslate))
+	{
+		const FString ShortErrorMessage = TEXT("Parameters update failed");
+		const FString LongErrorMessage = TEXT("The selected language model does not support multilingual recognition therefore automatic language detection and translation are not possible. Falling back to English without translation");
+		ReportError(ShortErrorMessage, LongErrorMessage);
+		AppliedParameters.Language = ESpeechRecognizerLanguage::En;
+		AppliedParameters.bTranslateToEnglish = false;
+		AppliedParameters.bTranscribeAndTranslate = false;
+
+		// The fallback is written back unless newer parameters were staged meanwhile, which are checked again when they are applied
+		FScopeLock Lock(&RecognitionParametersGuard);
+		if (!bRecognitionParametersChanged)
+		{
+			RecognitionParameters.Language = AppliedParameters.Language;
+			RecognitionParameters.bTranslateToEnglish = false;
+			RecognitionParameters.bTranscribeAndTranslate = false;
+		}
+	}
+
+	AppliedParameters.FillWhisperStateParameters(WhisperState);
+	IdleMemoryTrimDelaySec = AppliedParameters.IdleMemoryTrimDelaySec;
+	bTranscribeAndTranslate = AppliedParameters.bTranscribeAndTranslate;
+	CommandRejectionProbability = AppliedParameters.CommandRejectionProbability;
+	LanguageLock.Configure(AppliedParameters);
+
+	// Filling the parameters resets the per-stage thread counts, so the auto-tuned ones are reapplied
+	// The stages are only benchmarked again when the auto-tuning has just been enabled, since a benchmark would hold up the queued chunks for seconds
+	// Other changes (e.g. of the audio context size) keep the current tuning until the next Prewarm
+	const bool bAutoTuneRequested = AppliedParameters.bAutoTuneThreads && !bAutoTuneThreads;
+	bAutoTuneThreads = AppliedParameters.bAutoTuneThreads;
+	if (bAutoTuneRequested)
+	{
+		if (FPlatformProcess::SupportsMultithreading() && !AutoTuneThreads())
+		{
+			UE_LOG(LogRuntimeSpeechRecognizer, Warning, TEXT("Failed to auto-tune the number of threads, using the configured thread counts"));
+		}
+	}
+	else if (bAutoTuneThreads && AutoTunedThreadCounts.GetMin() > 0)
+	{
+		WhisperState.WhisperParameters->n_threads_mel = AutoTunedThreadCounts.X;
+		WhisperState.WhisperParameters->n_threads_encode = AutoTunedThreadCounts.Y;
+		WhisperState.WhisperParameters->n_threads_decode = AutoTunedThreadCounts.Z;
+	}
+
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Applied the staged recognition parameters"));
+}
+
 bool FSpeechRecognizerThread::GetIsStopped() const
 {
 	return bIsStopped;
@@ -1255,6 +2601,98 @@ bool FSpeechRecognizerThread::GetIsFinished() const
 	return bIsFinished;
 }
 
+FSpeechRecognizerStageTimings FSpeechRecognizerThread::GetStageTimings() const
+{
+	return WhisperState.GetStageTimings();
+}
+
+void FSpeechRecognizerThread::ResetStageTimings()
+{
+	WhisperState.ResetStageTimings();
+}
+
+void FSpeechRecognizerThread::EnableAllocationCounting()
+{
+	FSpeechRecognizerAllocationCounter::Install();
+}
+
+FSpeechRecognizerMetrics FSpeechRecognizerThread::GetMetrics() const
+{
+	FSpeechRecognizerMetrics OutMetrics;
+	Metrics.GetMetrics(OutMetrics);
+	OutMetrics.NumOfQueuedChunks = NumOfQueuedChunks.GetValue();
+	OutMetrics.BacklogSeconds = static_cast<double>(NumOfQueuedSamples.GetValue() + PendingAudio.GetTotalMixedAndResampledSize()) / WHISPER_SAMPLE_RATE;
+	return OutMetrics;
+}
+
+void FSpeechRecognizerThread::ResetMetrics()
+{
+	Metrics.Reset();
+}
+
+void FSpeechRecognizerThread::SetGraphProfilingEnabled(bool bEnabled)
+{
+	if (bEnabled && !bGraphProfilingEnabled)
+	{
+		GraphProfiler->Reset();
+	}
+	bGraphProfilingEnabled.AtomicSet(bEnabled);
+}
+
+bool FSpeechRecognizerThread::GetGraphProfilingEnabled() const
+{
+	return bGraphProfilingEnabled;
+}
+
+bool FSpeechRecognizerThread::ExportGraphProfile(const FString& FilePath) const
+{
+	return GraphProfiler->Export(FilePath);
+}
+
+FSpeechRecognizerMemoryUsage FSpeechRecognizerThread::GetMemoryUsage() const
+{
+	return MemoryTracker->GetMemoryUsage();
+}
+
+FSpeechRecognizerMemoryUsage FSpeechRecognizerThread::GetTotalMemoryUsage()
+{
+	return FSpeechRecognizerMemoryTracker::GetTotalMemoryUsage();
+}
+
+FSpeechRecognizerFrameImpact FSpeechRecognizerThread::GetFrameImpact()
+{
+	return FSpeechRecognizerFrameMonitor::Get().GetFrameImpact();
+}
+
+void FSpeechRecognizerThread::ResetFrameImpact()
+{
+	FSpeechRecognizerFrameMonitor::Get().ResetFrameImpact();
+}
+
+bool FSpeechRecognizerThread::SetLanguageModelDataOverride(TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe> LanguageModelData)
+{
+	if (!GetIsStopped())
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the language model data while the thread is running"));
+		return false;
+	}
+
+	if (GetIsStopping())
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set the language model data while the thread is stopping"));
+		return false;
+	}
+
+	if (LanguageModelData.IsValid() && LanguageModelData->Num() <= 0)
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Unable to set empty language model data"));
+		return false;
+	}
+
+	LanguageModelDataOverride = MoveTemp(LanguageModelData);
+	return true;
+}
+
 void FSpeechRecognizerThread::LoadLanguageModel(FOnLanguageModelLoaded&& OnLoadLanguageModel)
 {
 	const USpeechRecognizerSettings* SpeechRecognizerSettings = GetDefault<USpeechRecognizerSettings>();
@@ -1277,6 +2715,29 @@ void FSpeechRecognizerThread::LoadLanguageModel(FOnLanguageModelLoaded&& OnLoadL
 		return;
 	}
 
+	// The language model data was provided directly, so there is no need to load the asset
+	if (LanguageModelDataOverride.IsValid())
+	{
+		AsyncTask(ENamedThreads::AnyBackgroundHiPriTask, [ThisShared, OnLoadLanguageModel = MoveTemp(OnLoadLanguageModel), LanguageModelData = LanguageModelDataOverride]() mutable
+		{
+			// The callback takes ownership of the buffer and frees it once the whisper context is initialized, the same way as with the asset bulk data copy
+			const int64 ModelBulkDataSize = LanguageModelData->Num();
+			uint8* ModelBulkDataPtr = static_cast<uint8*>(FMemory::Malloc(ModelBulkDataSize));
+			if (!ModelBulkDataPtr)
+			{
+				const FString ShortErrorMessage = TEXT("Language model buffer retrieval failed");
+				const FString LongErrorMessage = FString::Printf(TEXT("Failed to allocate %lld bytes for the language model data"), ModelBulkDataSize);
+				ThisShared->ReportError(ShortErrorMessage, LongErrorMessage);
+				OnLoadLanguageModel(false, nullptr, 0);
+				return;
+			}
+
+			FMemory::Memcpy(ModelBulkDataPtr, LanguageModelData->GetData(), ModelBulkDataSize);
+			OnLoadLanguageModel(true, ModelBulkDataPtr, ModelBulkDataSize);
+		});
+		return;
+	}
+
 	const FString AssetPath = SpeechRecognizerSettings->GetLanguageModelAssetPath();
 
 	TSoftObjectPtr<USpeechRecognizerModel> LazySpeechRecognizerModel = TSoftObjectPtr<USpeechRecognizerModel>(FSoftObjectPath(AssetPath));
@@ -1343,10 +2804,433 @@ void FSpeechRecognizerThread::LoadLanguageModel(FOnLanguageModelLoaded&& OnLoadL
 		}, FStreamableManager::AsyncLoadHighPriority);
 }
 
+void FSpeechRecognizerThread::EnqueueAudioData(Audio::FAlignedFloatBuffer&& PCMData)
+{
+	SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_Enqueue);
+	NumOfQueuedSamples.Add(PCMData.Num());
+	AudioQueue.Enqueue(FQueuedAudioData{MoveTemp(PCMData), FPlatformTime::Seconds()});
+	NumOfQueuedChunks.Increment();
+	INC_DWORD_STAT(STAT_SpeechRecognizer_QueueDepth);
+}
+
+void FSpeechRecognizerThread::RecordDroppedAudio(int64 NumOfSamples, float SampleRate, uint32 NumOfChannels)
+{
+	const double AudioSeconds = SampleRate > 0.0f && NumOfChannels > 0 ? static_cast<double>(NumOfSamples) / NumOfChannels / SampleRate : 0;
+	Metrics.RecordDroppedAudio(1, AudioSeconds);
+}
+
+bool FSpeechRecognizerThread::AutoTuneThreads()
+{
+	if (!WakeUpInferenceState())
+	{
+		return false;
+	}
+
+	whisper_context* WhisperContext = WhisperState.WhisperContext;
+	whisper_state* WhisperContextState = WhisperContext ? WhisperContext->state : nullptr;
+	if (!WhisperContextState || !WhisperState.WhisperParameters)
+	{
+		return false;
+	}
+
+	const int32 NumOfLogicalCores = FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+	const int32 NumOfPhysicalCores = FPlatformMisc::NumberOfCores();
+	const int32 AudioContextSize = WhisperState.WhisperParameters->audio_ctx;
+
+	// The optimal thread counts depend on the CPU, the language model and the size of the encoder graph
+	FString CacheKey = FString::Printf(TEXT("%s_%dC%dT_%hs_%d_%d"), *FPlatformMisc::GetCPUBrand().TrimStartAndEnd(), NumOfPhysicalCores, NumOfLogicalCores,
+		whisper_model_type_readable(WhisperContext), whisper_model_ftype(WhisperContext), AudioContextSize);
+	for (TCHAR& Character : CacheKey)
+	{
+		if (!FChar::IsAlnum(Character))
+		{
+			Character = TEXT('_');
+		}
+	}
+
+	static const TCHAR* CacheSection = TEXT("RuntimeSpeechRecognizer.ThreadTuning");
+
+	auto ApplyThreadCounts = [this, &CacheKey](int32 NumOfMelThreads, int32 NumOfEncoderThreads, int32 NumOfDecoderThreads)
+	{
+		WhisperState.WhisperParameters->n_threads_mel = NumOfMelThreads;
+		WhisperState.WhisperParameters->n_threads_encode = NumOfEncoderThreads;
+		WhisperState.WhisperParameters->n_threads_decode = NumOfDecoderThreads;
+		AutoTunedThreadCounts = FIntVector(NumOfMelThreads, NumOfEncoderThreads, NumOfDecoderThreads);
+		AutoTunedCacheKey = CacheKey;
+	};
+
+	// Tuned before in this session, which also covers the config cache written asynchronously on the game thread
+	if (CacheKey == AutoTunedCacheKey && AutoTunedThreadCounts.GetMin() > 0)
+	{
+		ApplyThreadCounts(AutoTunedThreadCounts.X, AutoTunedThreadCounts.Y, AutoTunedThreadCounts.Z);
+		return true;
+	}
+
+	// Use the cached result if this device was tuned before
+	{
+		FString CachedValue;
+		if (GConfig && GConfig->GetString(CacheSection, *CacheKey, CachedValue, GEngineIni))
+		{
+			TArray<FString> CachedThreadCounts;
+			CachedValue.ParseIntoArray(CachedThreadCounts, TEXT(","));
+			if (CachedThreadCounts.Num() == 3)
+			{
+				const int32 NumOfMelThreads = FCString::Atoi(*CachedThreadCounts[0]);
+				const int32 NumOfEncoderThreads = FCString::Atoi(*CachedThreadCounts[1]);
+				const int32 NumOfDecoderThreads = FCString::Atoi(*CachedThreadCounts[2]);
+				if (NumOfMelThreads > 0 && NumOfEncoderThreads > 0 && NumOfDecoderThreads > 0)
+				{
+					UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Using the cached auto-tuned thread counts (mel: %d, encoder: %d, decoder: %d)"), NumOfMelThreads, NumOfEncoderThreads, NumOfDecoderThreads);
+					ApplyThreadCounts(NumOfMelThreads, NumOfEncoderThreads, NumOfDecoderThreads);
+					return true;
+				}
+			}
+		}
+	}
+
+	// Thread counts to benchmark, including the number of physical and logical cores
+	TArray<int32> Candidates;
+	for (int32 Candidate : {1, 2, 3, 4, 6, 8, 12, 16})
+	{
+		if (Candidate <= NumOfLogicalCores)
+		{
+			Candidates.AddUnique(Candidate);
+		}
+	}
+	Candidates.AddUnique(NumOfPhysicalCores);
+	Candidates.AddUnique(NumOfLogicalCores);
+
+	// On hybrid CPUs only the performance cores usually have two hardware threads, so the number of performance cores can be estimated from the core counts
+	// Staying within the performance cores avoids the whole graph waiting on the slower efficiency cores at every barrier
+	{
+		const int32 NumOfPerformanceCores = NumOfLogicalCores - NumOfPhysicalCores;
+		if (NumOfPerformanceCores > 0 && NumOfPerformanceCores < NumOfPhysicalCores)
+		{
+			Candidates.AddUnique(NumOfPerformanceCores);
+		}
+	}
+	Candidates.Sort();
+
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Auto-tuning the number of threads for '%s' (%d physical, %d logical cores), this only happens once per device and language model"),
+		*FPlatformMisc::GetCPUBrand().TrimStartAndEnd(), NumOfPhysicalCores, NumOfLogicalCores);
+
+	// Benchmarks a stage for every candidate and returns the fastest thread count, or 0 if the stage failed or the thread is stopping
+	auto FindFastestThreadCount = [this, &Candidates](const TCHAR* StageName, TFunctionRef<bool(int32)> RunStage) -> int32
+	{
+		int32 FastestThreadCount = 0;
+		double FastestSeconds = TNumericLimits<double>::Max();
+		for (int32 NumOfThreads : Candidates)
+		{
+			if (GetIsStopped() || GetIsStopping())
+			{
+				return 0;
+			}
+
+			const double StartTime = FPlatformTime::Seconds();
+			if (!RunStage(NumOfThreads))
+			{
+				return 0;
+			}
+			const double ElapsedSeconds = FPlatformTime::Seconds() - StartTime;
+
+			UE_LOG(LogRuntimeSpeechRecognizer, Verbose, TEXT("Auto-tuning %s: %d threads took %.2f ms"), StageName, NumOfThreads, ElapsedSeconds * 1000);
+			if (ElapsedSeconds < FastestSeconds)
+			{
+				FastestSeconds = ElapsedSeconds;
+				FastestThreadCount = NumOfThreads;
+			}
+		}
+		return FastestThreadCount;
+	};
+
+	// Silence costs the same to process as speech
+	TArray<float> Silence;
+	Silence.SetNumZeroed(WHISPER_SAMPLE_RATE * 10);
+
+	const int32 NumOfMelThreads = FindFastestThreadCount(TEXT("mel"), [WhisperContext, WhisperContextState, &Silence](int32 NumOfThreads)
+	{
+		return whisper_pcm_to_mel_with_state(WhisperContext, WhisperContextState, Silence.GetData(), Silence.Num(), NumOfThreads) == 0;
+	});
+
+	// The encoder runs at the configured audio context size, the same way whisper_full does. The first run only warms up the weights
+	WhisperContextState->exp_n_audio_ctx = AudioContextSize;
+	const bool bEncoderWarmedUp = NumOfMelThreads > 0 && whisper_encode_with_state(WhisperContext, WhisperContextState, 0, NumOfLogicalCores) == 0;
+	const int32 NumOfEncoderThreads = !bEncoderWarmedUp ? 0 : FindFastestThreadCount(TEXT("encoder"), [WhisperContext, WhisperContextState](int32 NumOfThreads)
+	{
+		return whisper_encode_with_state(WhisperContext, WhisperContextState, 0, NumOfThreads) == 0;
+	});
+
+	// A few single-token steps, which is what the decoder spends most of its time on
+	const int32 NumOfDecoderThreads = NumOfEncoderThreads <= 0 ? 0 : FindFastestThreadCount(TEXT("decoder"), [WhisperContext, WhisperContextState](int32 NumOfThreads)
+	{
+		constexpr int32 NumOfSteps = 8;
+		const whisper_token Token = whisper_token_sot(WhisperContext);
+		for (int32 Step = 0; Step < NumOfSteps; ++Step)
+		{
+			if (whisper_decode_with_state(WhisperContext, WhisperContextState, &Token, 1, Step, NumOfThreads) != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	});
+
+	// The benchmark should not show up in the stage timings of the session
+	WhisperState.ResetStageTimings();
+
+	if (NumOfDecoderThreads <= 0)
+	{
+		return false;
+	}
+
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Auto-tuned thread counts (mel: %d, encoder: %d, decoder: %d)"), NumOfMelThreads, NumOfEncoderThreads, NumOfDecoderThreads);
+	ApplyThreadCounts(NumOfMelThreads, NumOfEncoderThreads, NumOfDecoderThreads);
+
+	// The config cache is not thread-safe, so it is written on the game thread
+	AsyncTask(ENamedThreads::GameThread, [CacheKey, CachedValue = FString::Printf(TEXT("%d,%d,%d"), NumOfMelThreads, NumOfEncoderThreads, NumOfDecoderThreads)]()
+	{
+		if (GConfig)
+		{
+			GConfig->SetString(CacheSection, *CacheKey, *CachedValue, GEngineIni);
+			GConfig->Flush(false, GEngineIni);
+		}
+	});
+
+	return true;
+}
+
+bool FSpeechRecognizerThread::WarmUp()
+{
+	if (!WakeUpInferenceState())
+	{
+		return false;
+	}
+
+	// A prewarm is an explicit request to tune, e.g. for an audio context size changed since the start. Free if nothing changed
+	if (bAutoTuneThreads && FPlatformProcess::SupportsMultithreading() && !AutoTuneThreads())
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Warning, TEXT("Failed to auto-tune the number of threads, using the configured thread counts"));
+	}
+
+	whisper_context* WhisperContext = WhisperState.WhisperContext;
+	whisper_state* WhisperContextState = WhisperContext ? WhisperContext->state : nullptr;
+	if (!WhisperContextState || !WhisperState.WhisperParameters)
+	{
+		return false;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	const whisper_full_params& WhisperParameters = *WhisperState.WhisperParameters;
+	const int32 NumOfMelThreads = WhisperParameters.n_threads_mel > 0 ? WhisperParameters.n_threads_mel : WhisperParameters.n_threads;
+	const int32 NumOfEncoderThreads = WhisperParameters.n_threads_encode > 0 ? WhisperParameters.n_threads_encode : WhisperParameters.n_threads;
+	const int32 NumOfDecoderThreads = WhisperParameters.n_threads_decode > 0 ? WhisperParameters.n_threads_decode : WhisperParameters.n_threads;
+
+	// The same minimum amount of audio as whisper_full is given, which also sizes the mel spectrogram buffer
+	TArray<float> Silence;
+	Silence.SetNumZeroed(WHISPER_SAMPLE_RATE * 1.1f);
+	if (whisper_pcm_to_mel_with_state(WhisperContext, WhisperContextState, Silence.GetData(), Silence.Num(), NumOfMelThreads) != 0)
+	{
+		return false;
+	}
+
+	// The encoder runs at the configured audio context size, the same way whisper_full does, which faults in the encoder weights
+	WhisperContextState->exp_n_audio_ctx = WhisperParameters.audio_ctx;
+	if (whisper_encode_with_state(WhisperContext, WhisperContextState, 0, NumOfEncoderThreads) != 0)
+	{
+		return false;
+	}
+
+	// A prompt-sized batch followed by a single-token step, which are the two shapes of decoder graphs whisper_full computes
+	const whisper_token PromptTokens[] = {whisper_token_sot(WhisperContext), whisper_token_transcribe(WhisperContext), whisper_token_not(WhisperContext)};
+	if (whisper_decode_with_state(WhisperContext, WhisperContextState, PromptTokens, UE_ARRAY_COUNT(PromptTokens), 0, NumOfDecoderThreads) != 0
+		|| whisper_decode_with_state(WhisperContext, WhisperContextState, &PromptTokens[UE_ARRAY_COUNT(PromptTokens) - 1], 1, UE_ARRAY_COUNT(PromptTokens), NumOfDecoderThreads) != 0)
+	{
+		return false;
+	}
+
+	// The warm-up should not show up in the stage timings of the session
+	WhisperState.ResetStageTimings();
+
+	MemoryTracker->SetExternalSize(ESpeechRecognizerMemoryCategory::Mel, WhisperContextState->mel.data.capacity() * sizeof(float));
+
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Warmed up the speech recognizer in %.2f ms"), (FPlatformTime::Seconds() - StartTime) * 1000);
+	return true;
+}
+
+void FSpeechRecognizerThread::TrimIdleMemory()
+{
+	// Called on every idle iteration of the thread worker, so the pending audio, which has to be locked, is only checked once the trim is due
+	if (bIsInferenceStateTrimmed || IdleMemoryTrimDelaySec <= 0 || GetIsPaused() || FPlatformTime::Seconds() - LastActivityTime < IdleMemoryTrimDelaySec || !AudioQueue.IsEmpty())
+	{
+		return;
+	}
+
+	if (!PendingAudio.IsEmpty() || !WhisperState.ReleaseInferenceState())
+	{
+		return;
+	}
+
+	bIsInferenceStateTrimmed = true;
+
+	MemoryTracker->SetExternalSize(ESpeechRecognizerMemoryCategory::Mel, 0);
+	Metrics.RecordIdleTrim();
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Released the inference buffers after %.1f seconds without audio, the memory used is now %.2f MB"),
+		IdleMemoryTrimDelaySec, MemoryTracker->GetMemoryUsage().GetTotalBytes() / 1048576.0);
+}
+
+bool FSpeechRecognizerThread::WakeUpInferenceState()
+{
+	if (WhisperState.HasInferenceState())
+	{
+		return true;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	if (!WhisperState.RestoreInferenceState())
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Failed to rebuild the inference buffers"));
+		return false;
+	}
+
+	bIsInferenceStateTrimmed = false;
+
+	const double WakeUpSeconds = FPlatformTime::Seconds() - StartTime;
+	Metrics.RecordWakeUp(WakeUpSeconds);
+	UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Rebuilt the inference buffers released while idle in %.2f ms"), WakeUpSeconds * 1000);
+	return true;
+}
+
 void FSpeechRecognizerThread::ReleaseMemory()
 {
 	Thread.Reset();
 	WhisperState.Release();
+	bIsInferenceStateTrimmed = false;
+	MemoryTracker->SetExternalSize(ESpeechRecognizerMemoryCategory::Mel, 0);
+}
+
+bool FSpeechRecognizerThread::RecognizeCommand(const Audio::FAlignedFloatBuffer& PCMData)
+{
+	whisper_context* WhisperContext = WhisperState.WhisperContext;
+	const TArray<FString>& Commands = WhisperState.Commands;
+
+	CommandLogProbabilities.SetNumUninitialized(Commands.Num());
+	if (whisper_command_set_score_with_state(WhisperContext, WhisperContext->state, WhisperState.WhisperCommandSet, *WhisperState.WhisperParameters, PCMData.GetData(), PCMData.Num(), CommandLogProbabilities.GetData()) < 0)
+	{
+		return false;
+	}
+
+	// Building the result that is handed over to the game thread allocates, which is not part of the recognition itself
+	FSpeechRecognizerAllocationCounter::FIgnoreScope AllocationIgnoreScope;
+
+	FSpeechRecognizerCommandResult Result;
+	Result.Candidates.Reserve(Commands.Num());
+	for (int32 CommandIndex = 0; CommandIndex < Commands.Num(); ++CommandIndex)
+	{
+		FSpeechRecognizerCommandCandidate& Candidate = Result.Candidates.AddDefaulted_GetRef();
+		Candidate.Command = Commands[CommandIndex];
+		Candidate.CommandIndex = CommandIndex;
+		Candidate.LogProbability = CommandLogProbabilities[CommandIndex];
+		Candidate.Probability = FMath::Exp(Candidate.LogProbability);
+	}
+	Result.Candidates.StableSort([](const FSpeechRecognizerCommandCandidate& A, const FSpeechRecognizerCommandCandidate& B)
+	{
+		return A.LogProbability > B.LogProbability;
+	});
+
+	const FSpeechRecognizerCommandCandidate& BestCandidate = Result.Candidates[0];
+	Result.bRejected = BestCandidate.Probability < CommandRejectionProbability;
+	Result.CommandIndex = Result.bRejected ? INDEX_NONE : BestCandidate.CommandIndex;
+
+	if (DoesSharedInstanceExist())
+	{
+		TSharedPtr<FSpeechRecognizerThread> ThisShared = AsShared();
+		AsyncTask(ENamedThreads::AnyThread, [ThisShared, Result = MoveTemp(Result)]()
+		{
+			SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_Dispatch);
+			const FSpeechRecognizerCommandCandidate& BestCandidate = Result.Candidates[0];
+			UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Recognized command \"%s\" with a probability of %.3f per token%s"), *BestCandidate.Command, BestCandidate.Probability, Result.bRejected ? TEXT(" (rejected)") : TEXT(""));
+			ThisShared->OnRecognizedCommand.Broadcast(Result);
+		});
+	}
+	return true;
+}
+
+int32 FSpeechRecognizerThread::TranslateRecognizedAudio()
+{
+	whisper_context* WhisperContext = WhisperState.WhisperContext;
+	if (!WhisperContext->state)
+	{
+		return 0;
+	}
+
+	// The language of the transcription, so that the translation does not detect it again
+	const char* Language = whisper_lang_str(WhisperContext->state->lang_id);
+
+	// Translating English gives back the transcription, so it is broadcast as is instead of being decoded again
+	if (FCStringAnsi::Strcmp(Language, EnumToString(ESpeechRecognizerLanguage::En)) == 0)
+	{
+		if (DoesSharedInstanceExist())
+		{
+			BroadcastTextSegments(AsShared(), WhisperContext, 0, whisper_full_n_segments(WhisperContext), true);
+		}
+		return 0;
+	}
+
+	whisper_full_params TranslationParameters = *WhisperState.WhisperParameters;
+	TranslationParameters.translate = true;
+	TranslationParameters.language = Language;
+	TranslationParameters.detect_language = false;
+	TranslationParameters.progress_callback = nullptr;
+
+	// No samples are passed, so the mel spectrogram and the encoder output of the transcription are reused
+	WhisperState.WhisperUserData.bTranslating = true;
+	const bool bTranslated = whisper_full_with_state(WhisperContext, WhisperContext->state, TranslationParameters, nullptr, 0) == 0;
+	WhisperState.WhisperUserData.bTranslating = false;
+
+	if (!bTranslated)
+	{
+		UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("Failed to translate the recognized audio data to English"));
+		return 0;
+	}
+
+	return GetNumOfDecodedTokens(WhisperContext);
+}
+
+void FSpeechRecognizerThread::ReportLanguageDetection()
+{
+	const whisper_state* State = WhisperState.WhisperContext->state;
+	if (!State || State->lang_id < 0 || State->lang_id >= static_cast<int32>(State->lang_probs.size()))
+	{
+		return;
+	}
+
+	FSpeechRecognizerLanguageDetection Detection;
+	Detection.Language = StringToEnum(whisper_lang_str(State->lang_id));
+	Detection.Probability = State->lang_probs[State->lang_id];
+
+	// Only the plausible languages are reported, which keeps the broadcast map small
+	constexpr float MinReportedProbability = 0.01f;
+	for (int32 LanguageId = 0; LanguageId < static_cast<int32>(State->lang_probs.size()); ++LanguageId)
+	{
+		const ESpeechRecognizerLanguage Language = StringToEnum(whisper_lang_str(LanguageId));
+		if (Language != ESpeechRecognizerLanguage::Auto && State->lang_probs[LanguageId] >= MinReportedProbability)
+		{
+			Detection.Probabilities.Add(Language, State->lang_probs[LanguageId]);
+		}
+	}
+
+	Detection.bLanguageLocked = LanguageLock.IsEnabled() && LanguageLock.RecordDetection(Detection.Language, Detection.Probability);
+
+	if (DoesSharedInstanceExist())
+	{
+		TSharedPtr<FSpeechRecognizerThread> ThisShared = AsShared();
+		AsyncTask(ENamedThreads::AnyThread, [ThisShared, Detection = MoveTemp(Detection)]()
+		{
+			SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_Dispatch);
+			UE_LOG(LogRuntimeSpeechRecognizer, Log, TEXT("Detected language '%hs' with a probability of %.2f%s"), EnumToString(Detection.Language), Detection.Probability, Detection.bLanguageLocked ? TEXT(" (session language locked)") : TEXT(""));
+			ThisShared->OnLanguageDetected.Broadcast(Detection);
+		});
+	}
 }
 
 void FSpeechRecognizerThread::ReportError(const FString& ShortErrorMessage, const FString& LongErrorMessage)
@@ -1356,6 +3240,7 @@ void FSpeechRecognizerThread::ReportError(const FString& ShortErrorMessage, cons
 		TSharedPtr<FSpeechRecognizerThread> ThisShared = AsShared();
 		AsyncTask(ENamedThreads::AnyThread, [ThisShared, ShortErrorMessage, LongErrorMessage]() mutable
 		{
+			SPEECHRECOGNIZER_SCOPE_CYCLE_COUNTER(STAT_SpeechRecognizer_Dispatch);
 			if (ThisShared)
 			{
 				UE_LOG(LogRuntimeSpeechRecognizer, Error, TEXT("%s: %s"), *ShortErrorMessage, *LongErrorMessage);
@@ -0,0 +1,154 @@
+﻿// Georgy Treshchev 2024.
+
+#include "SpeechRecognizerVocabularyFilter.h"
+
+namespace
+{
+	bool IsContinuationByte(uint8 Byte)
+	{
+		return (Byte & 0xC0) == 0x80;
+	}
+
+	/**
+	 * Returns the number of bytes of the UTF-8 sequence started by the lead byte, or 0 if it is not a lead byte
+	 */
+	int32 GetSequenceLength(uint8 LeadByte)
+	{
+		if (LeadByte < 0x80)
+		{
+			return 1;
+		}
+		if ((LeadByte & 0xE0) == 0xC0)
+		{
+			return 2;
+		}
+		if ((LeadByte & 0xF0) == 0xE0)
+		{
+			return 3;
+		}
+		if ((LeadByte & 0xF8) == 0xF0)
+		{
+			return 4;
+		}
+		return 0;
+	}
+
+	uint32 DecodeSequence(const uint8* Bytes, int32 SequenceLength)
+	{
+		static const uint8 LeadByteMasks[] = {0, 0x7F, 0x1F, 0x0F, 0x07};
+		uint32 CodePoint = Bytes[0] & LeadByteMasks[SequenceLength];
+		for (int32 ByteIndex = 1; ByteIndex < SequenceLength; ++ByteIndex)
+		{
+			CodePoint = (CodePoint << 6) | (Bytes[ByteIndex] & 0x3F);
+		}
+		return CodePoint;
+	}
+}
+
+FSpeechRecognizerVocabularyFilter::FSpeechRecognizerVocabularyFilter(const FString& AllowedText)
+{
+	const FTCHARToUTF8 AllowedTextUTF8(*AllowedText);
+	const uint8* AllowedBytes = reinterpret_cast<const uint8*>(AllowedTextUTF8.Get());
+	const int32 NumOfAllowedBytes = AllowedTextUTF8.Length();
+
+	for (int32 ByteIndex = 0; ByteIndex < NumOfAllowedBytes;)
+	{
+		const int32 SequenceLength = GetSequenceLength(AllowedBytes[ByteIndex]);
+		if (SequenceLength == 0 || ByteIndex + SequenceLength > NumOfAllowedBytes)
+		{
+			++ByteIndex;
+			continue;
+		}
+
+		const uint8* Sequence = AllowedBytes + ByteIndex;
+		AllowedCodePoints.Add(DecodeSequence(Sequence, SequenceLength));
+
+		// Every way the character can be split between tokens
+		for (int32 SplitIndex = 1; SplitIndex < SequenceLength; ++SplitIndex)
+		{
+			AllowedPrefixes.Add(PackFragment(Sequence, SplitIndex));
+			AllowedSuffixes.Add(PackFragment(Sequence + SplitIndex, SequenceLength - SplitIndex));
+			for (int32 FragmentEnd = SplitIndex + 1; FragmentEnd < SequenceLength; ++FragmentEnd)
+			{
+				AllowedFragments.Add(PackFragment(Sequence + SplitIndex, FragmentEnd - SplitIndex));
+			}
+		}
+
+		ByteIndex += SequenceLength;
+	}
+}
+
+bool FSpeechRecognizerVocabularyFilter::IsTokenAllowed(const char* TokenText) const
+{
+	const uint8* TokenBytes = reinterpret_cast<const uint8*>(TokenText);
+	const int32 NumOfTokenBytes = TokenText ? static_cast<int32>(FCStringAnsi::Strlen(TokenText)) : 0;
+	if (NumOfTokenBytes == 0)
+	{
+		return false;
+	}
+
+	// The continuation bytes at the start of the token end a character started by the previous tokens
+	int32 ByteIndex = 0;
+	while (ByteIndex < NumOfTokenBytes && IsContinuationByte(TokenBytes[ByteIndex]))
+	{
+		++ByteIndex;
+	}
+	if (ByteIndex > 3)
+	{
+		return false;
+	}
+	if (ByteIndex > 0)
+	{
+		const uint32 Fragment = PackFragment(TokenBytes, ByteIndex);
+		if (ByteIndex == NumOfTokenBytes)
+		{
+			// The whole token may also be the middle of a character split into more than two tokens
+			return AllowedSuffixes.Contains(Fragment) || AllowedFragments.Contains(Fragment);
+		}
+		if (!AllowedSuffixes.Contains(Fragment))
+		{
+			return false;
+		}
+	}
+
+	while (ByteIndex < NumOfTokenBytes)
+	{
+		const int32 SequenceLength = GetSequenceLength(TokenBytes[ByteIndex]);
+		if (SequenceLength == 0)
+		{
+			return false;
+		}
+
+		int32 NumOfSequenceBytes = 1;
+		while (NumOfSequenceBytes < SequenceLength && ByteIndex + NumOfSequenceBytes < NumOfTokenBytes && IsContinuationByte(TokenBytes[ByteIndex + NumOfSequenceBytes]))
+		{
+			++NumOfSequenceBytes;
+		}
+
+		if (NumOfSequenceBytes < SequenceLength)
+		{
+			// A truncated character is only valid at the end of the token, where it is continued by the next tokens
+			return ByteIndex + NumOfSequenceBytes == NumOfTokenBytes && AllowedPrefixes.Contains(PackFragment(TokenBytes + ByteIndex, NumOfSequenceBytes));
+		}
+
+		if (!AllowedCodePoints.Contains(DecodeSequence(TokenBytes + ByteIndex, SequenceLength)))
+		{
+			return false;
+		}
+		ByteIndex += SequenceLength;
+	}
+
+	return true;
+}
+
+uint32 FSpeechRecognizerVocabularyFilter::PackFragment(const uint8* Bytes, int32 NumOfBytes)
+{
+	check(NumOfBytes > 0 && NumOfBytes <= 3);
+
+	uint32 Fragment = static_cast<uint32>(NumOfBytes) << 24;
+	for (int32 ByteIndex = 0; ByteIndex < NumOfBytes; ++ByteIndex)
+	{
+		Fragment |= static_cast<uint32>(Bytes[ByteIndex]) << (8 * ByteIndex);
+	}
+	return Fragment;
+}
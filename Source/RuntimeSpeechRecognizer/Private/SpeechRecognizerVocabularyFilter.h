@@ -0,0 +1,47 @@
+﻿// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Tells whether a token of the language model is spelled only with the characters of a vocabulary
+ * Tokens are pieces of UTF-8 text that may split a multi-byte character between them, so a token is matched by its decoded code points,
+ * except for the bytes at its start and end that belong to a character split with the neighboring tokens, which must be a part of the encoding of an allowed character
+ */
+class FSpeechRecognizerVocabularyFilter
+{
+public:
+	/**
+	 * Collects the allowed characters
+	 *
+	 * @param AllowedText The text containing every allowed character
+	 */
+	explicit FSpeechRecognizerVocabularyFilter(const FString& AllowedText);
+
+	/**
+	 * Returns whether the token is spelled only with the allowed characters
+	 *
+	 * @param TokenText The null-terminated UTF-8 bytes of the token
+	 * @return True if the token is allowed, false otherwise
+	 */
+	bool IsTokenAllowed(const char* TokenText) const;
+
+private:
+	/**
+	 * Packs up to 3 bytes of a split character along with their number, to be looked up in the fragment sets
+	 */
+	static uint32 PackFragment(const uint8* Bytes, int32 NumOfBytes);
+
+	/** The code points of the allowed characters */
+	TSet<uint32> AllowedCodePoints;
+
+	/** The leading bytes of the allowed multi-byte characters, which may end a token */
+	TSet<uint32> AllowedPrefixes;
+
+	/** The trailing bytes of the allowed multi-byte characters, which may start a token */
+	TSet<uint32> AllowedSuffixes;
+
+	/** The continuation bytes of the allowed multi-byte characters, which may make up a whole token when a character is split into more than two tokens */
+	TSet<uint32> AllowedFragments;
+};
@@ -0,0 +1,57 @@
+﻿// Georgy Treshchev 2024.
+
+#include "SpeechRecognizerVocabularyFilter.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpeechRecognizerVocabularyFilterTest, "RuntimeSpeechRecognizer.Vocabulary.MixedScriptTokens", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSpeechRecognizerVocabularyFilterTest::RunTest(const FString& Parameters)
+{
+	// Cyrillic (2-byte) and CJK (3-byte) characters together, in both cases the same way the vocabulary is built
+	const FString VocabularyText = TEXT(" .,!?") + FString(TEXT("Привет日本"));
+	const FSpeechRecognizerVocabularyFilter VocabularyFilter(VocabularyText + VocabularyText.ToLower() + VocabularyText.ToUpper());
+
+	struct FTokenCase
+	{
+		const TCHAR* Description;
+		const char* TokenText;
+		bool bExpectedAllowed;
+	};
+
+	const FTokenCase TokenCases[] =
+	{
+		{TEXT("Whole Cyrillic word"), "\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82", true},
+		{TEXT("Lowercase Cyrillic piece with a space"), " \xD0\xBF\xD1\x80\xD0\xB8", true},
+		{TEXT("Whole CJK word"), "\xE6\x97\xA5\xE6\x9C\xAC", true},
+		{TEXT("Mixed scripts with punctuation"), "\xD0\xB2\xD0\xB5\xD1\x82\xE6\x97\xA5.", true},
+		{TEXT("Latin letter"), "a", false},
+
+		// Characters that are not in the vocabulary, although every one of their bytes is used by a character that is
+		{TEXT("Cyrillic character made of allowed bytes"), "\xD1\x9F", false},
+		{TEXT("CJK character made of allowed bytes"), "\xE6\x97\xAC", false},
+
+		// Characters split between tokens
+		{TEXT("Start of an allowed CJK character"), "\xE6\x97", true},
+		{TEXT("Lead byte of an allowed CJK character after a space"), " \xE6", true},
+		{TEXT("End of an allowed CJK character"), "\x97\xA5", true},
+		{TEXT("End of an allowed CJK character followed by a whole one"), "\xA5\xE6\x9C\xAC", true},
+		{TEXT("Middle of an allowed CJK character"), "\x9C", true},
+		{TEXT("End of an allowed Cyrillic character followed by the start of one"), "\x80\xD0", true},
+		{TEXT("Start of a CJK character that is not allowed"), "\xE6\x80", false},
+		{TEXT("End of a character that is not allowed"), "\xBB", false},
+		{TEXT("Continuation bytes out of order"), "\xAC\xA5", false},
+		{TEXT("Truncated character in the middle of the token"), "\xD0 ", false},
+		{TEXT("Invalid byte"), "\xFF", false},
+	};
+
+	for (const FTokenCase& TokenCase : TokenCases)
+	{
+		TestEqual(TokenCase.Description, VocabularyFilter.IsTokenAllowed(TokenCase.TokenText), TokenCase.bExpectedAllowed);
+	}
+
+	return true;
+}
+
+#endif
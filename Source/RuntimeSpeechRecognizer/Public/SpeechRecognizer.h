@@ -14,6 +14,13 @@ DECLARE_DYNAMIC_DELEGATE_OneParam(FOnSpeechRecognitionStartedDynamic, bool, bSuc
 DECLARE_DELEGATE_OneParam(FOnSpeechRecognitionStartedStatic, bool);
 
 
+/** Dynamic delegate for speech recognizer prewarmed */
+DECLARE_DYNAMIC_DELEGATE_OneParam(FOnSpeechRecognizerPrewarmedDynamic, bool, bSucceeded);
+
+/** Static delegate for speech recognizer prewarmed */
+DECLARE_DELEGATE_OneParam(FOnSpeechRecognizerPrewarmedStatic, bool);
+
+
 /** Dynamic delegate for speech recognition finished */
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnSpeechRecognitionFinishedDynamic);
 
@@ -48,6 +55,20 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnSpeechRecognitionStoppedDynamic);
 DECLARE_MULTICAST_DELEGATE(FOnSpeechRecognitionStoppedStatic);
 
 
+/** Dynamic delegate for the automatic language detection of an audio chunk */
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnSpeechRecognizerLanguageDetectedDynamic, const FSpeechRecognizerLanguageDetection&, Detection);
+
+/** Static delegate for the automatic language detection of an audio chunk */
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnSpeechRecognizerLanguageDetectedStatic, const FSpeechRecognizerLanguageDetection&);
+
+
+/** Dynamic delegate for the commands spotted in an audio chunk in the command mode */
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnSpeechRecognizedCommandDynamic, const FSpeechRecognizerCommandResult&, Result);
+
+/** Static delegate for the commands spotted in an audio chunk in the command mode */
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnSpeechRecognizedCommandStatic, const FSpeechRecognizerCommandResult&);
+
+
 /**
  * Represents a speech recognizer that can recognize spoken words
  */
@@ -82,6 +103,22 @@ public:
 	 */
 	void StartSpeechRecognition(const FOnSpeechRecognitionStartedStatic& OnStarted);
 
+	/**
+	 * Makes the speech recognizer hot so that the first recognized audio is as fast as the following ones. Ensure that all the needed parameters are set before calling this function
+	 * Starts the speech recognition if it is not started yet, then runs a dummy recognition pass at the configured audio context size. Intended to be hidden behind loading screens
+	 *
+	 * @param OnPrewarmed Delegate called with true once the speech recognizer is hot, or with false if it failed to start or warm up
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Main")
+	void PrewarmSpeechRecognition(const FOnSpeechRecognizerPrewarmedDynamic& OnPrewarmed);
+
+	/**
+	 * Makes the speech recognizer hot so that the first recognized audio is as fast as the following ones. Suitable for use in C++
+	 *
+	 * @param OnPrewarmed Delegate called with true once the speech recognizer is hot, or with false if it failed to start or warm up
+	 */
+	void PrewarmSpeechRecognition(const FOnSpeechRecognizerPrewarmedStatic& OnPrewarmed);
+
 	/**
 	 * Stops the speech recognition. The speech recognition can be started again after calling this function
 	 *
@@ -90,6 +127,23 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Main")
 	void StopSpeechRecognition();
 
+	/**
+	 * Pauses the speech recognition, keeping the language model and the recognizer alive so that it can be resumed instantly (e.g. between push-to-talk rounds)
+	 * Audio data that is already queued is recognized once resumed, while audio data processed during the pause is rejected
+	 *
+	 * @return True if the speech recognition was paused successfully, false otherwise
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Main")
+	bool PauseSpeechRecognition();
+
+	/**
+	 * Resumes the speech recognition paused with PauseSpeechRecognition
+	 *
+	 * @return True if the speech recognition was resumed successfully, false otherwise
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Main")
+	bool ResumeSpeechRecognition();
+
 	/**
 	 * Processes the audio data and recognizes the words
 	 *
@@ -111,6 +165,15 @@ public:
 	 */
 	void ProcessAudioData(Audio::FAlignedFloatBuffer PCMData, float SampleRate, int32 NumOfChannels, bool bLast);
 
+	/**
+	 * Returns an empty audio buffer from the pool shared by all speech recognizers, to be filled and passed to ProcessAudioData. Suitable for use in C++
+	 * Buffers passed to ProcessAudioData are returned to the pool once processed, so capturing into buffers acquired here does not allocate in steady state
+	 *
+	 * @param NumOfSamples The number of samples the buffer must be able to hold without reallocating
+	 * @return The empty audio buffer
+	 */
+	static Audio::FAlignedFloatBuffer AcquireAudioBuffer(int32 NumOfSamples);
+
 	/**
 	 * Processes audio data that was queued before but not yet processed, especially useful when using step size functionality
 	 * This function ensures all audio data is processed, even if it did not fit into the step size yet
@@ -144,6 +207,14 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Info")
 	bool GetIsStopping() const;
 
+	/**
+	 * Returns whether the speech recognition is paused or not
+	 *
+	 * @return True if the speech recognition is paused, false otherwise
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Info")
+	bool GetIsPaused() const;
+
 	/**
 	 * Returns whether all the audio data has been processed or not
 	 *
@@ -152,6 +223,99 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Info")
 	bool GetIsFinished() const;
 
+	/**
+	 * Returns the per-stage timings (mel, encoder, decoder, sampling) accumulated since the speech recognition was started or the timings were last reset
+	 *
+	 * @return The accumulated per-stage timings
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Info")
+	FSpeechRecognizerStageTimings GetStageTimings() const;
+
+	/**
+	 * Resets the accumulated per-stage timings
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Info")
+	void ResetStageTimings();
+
+	/**
+	 * Returns the live health metrics of the speech recognition session (real-time factor, queue lag, chunk latency percentiles, tokens per second, fallbacks, dropped audio)
+	 * Cheap enough to be polled every frame
+	 *
+	 * @return The current metrics
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Info")
+	FSpeechRecognizerMetrics GetMetrics() const;
+
+	/**
+	 * Resets the rolling values and counters of the metrics. The metrics are also reset every time the speech recognition is started
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Info")
+	void ResetMetrics();
+
+	/**
+	 * Returns the memory currently used by this speech recognizer (model weights, KV caches, compute buffers, mel spectrogram)
+	 * The memory is allocated when the speech recognition is started and released when it is stopped
+	 *
+	 * @return The memory usage broken down by category
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Info")
+	FSpeechRecognizerMemoryUsage GetMemoryUsage() const;
+
+	/**
+	 * Returns the memory currently used by all speech recognizers. Useful to enforce a memory budget before starting another speech recognition
+	 *
+	 * @return The memory usage broken down by category
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Info")
+	static FSpeechRecognizerMemoryUsage GetTotalMemoryUsage();
+
+	/**
+	 * Returns the measured impact of speech recognition (across all speech recognizers) on the game frame time
+	 * Useful to tune the threading and frame throttling settings in the project settings
+	 *
+	 * @return The average frame time while recognizing and while idle, and the number of throttled inference graphs
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Profiling")
+	static FSpeechRecognizerFrameImpact GetFrameImpact();
+
+	/**
+	 * Resets the measured impact of speech recognition on the game frame time
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Profiling")
+	static void ResetFrameImpact();
+
+	/**
+	 * Returns the statistics of the pool of audio buffers used to submit, mix, resample and queue audio data, shared by all speech recognizers
+	 *
+	 * @return The number of requests served with and without allocating, and the memory held by the pool
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Info")
+	static FSpeechRecognizerAudioBufferPoolStats GetAudioBufferPoolStats();
+
+	/**
+	 * Frees the audio buffers held by the pool shared by all speech recognizers, e.g. after the speech recognition is no longer needed
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Info")
+	static void TrimAudioBufferPool();
+
+	/**
+	 * Enables or disables recording of the per-node timings (op type, shapes, thread count, wall time) of the encoder and decoder graphs
+	 * Enabling discards the previously recorded nodes. Intended for profiling only since recording adds overhead to every node
+	 *
+	 * @param bEnabled Whether to record the graph nodes
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Profiling")
+	void SetGraphProfilingEnabled(bool bEnabled);
+
+	/**
+	 * Exports the recorded per-node timings of the encoder and decoder graphs
+	 *
+	 * @param FilePath The path of the file to write. The .csv extension produces the timings aggregated per graph and op, any other extension produces a Chrome trace (.json) viewable in chrome://tracing or Perfetto
+	 * @return True if the file was written successfully, false otherwise
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Profiling")
+	bool ExportGraphProfile(const FString& FilePath) const;
+
 	/** Dynamic delegate broadcast when all the audio data has been processed */
 	UPROPERTY(BlueprintAssignable, Category = "Runtime Speech Recognizer|Delegates")
 	FOnSpeechRecognitionFinishedDynamic OnRecognitionFinished;
@@ -166,6 +330,13 @@ public:
 	/** Static delegate broadcast when recognized words are received */
 	FOnSpeechRecognizedTextSegmentStatic OnRecognizedTextSegmentNative;
 
+	/** Dynamic delegate broadcast when recognized words translated to English are received in the transcription and translation mode */
+	UPROPERTY(BlueprintAssignable, Category = "Runtime Speech Recognizer|Delegates")
+	FOnSpeechRecognizedTextSegmentDynamic OnRecognizedTranslatedTextSegment;
+
+	/** Static delegate broadcast when recognized words translated to English are received in the transcription and translation mode */
+	FOnSpeechRecognizedTextSegmentStatic OnRecognizedTranslatedTextSegmentNative;
+
 	/** Dynamic delegate broadcast when an error occurs during speech recognition */
 	UPROPERTY(BlueprintAssignable, Category = "Runtime Speech Recognizer|Delegates")
 	FOnSpeechRecognitionErrorDynamic OnRecognitionError;
@@ -187,12 +358,26 @@ public:
 	/** Static delegate broadcast when the speech recognition thread is fully stopped */
 	FOnSpeechRecognitionStoppedStatic OnRecognitionStoppedNative;
 
+	/** Dynamic delegate broadcast when the language of an audio chunk is automatically detected, with the detected language, its probability and whether the session language got locked */
+	UPROPERTY(BlueprintAssignable, Category = "Runtime Speech Recognizer|Delegates")
+	FOnSpeechRecognizerLanguageDetectedDynamic OnLanguageDetected;
+
+	/** Static delegate broadcast when the language of an audio chunk is automatically detected, with the detected language, its probability and whether the session language got locked */
+	FOnSpeechRecognizerLanguageDetectedStatic OnLanguageDetectedNative;
+
+	/** Dynamic delegate broadcast when an audio chunk is scored against the commands in the command mode, with the ranked commands */
+	UPROPERTY(BlueprintAssignable, Category = "Runtime Speech Recognizer|Delegates")
+	FOnSpeechRecognizedCommandDynamic OnRecognizedCommand;
+
+	/** Static delegate broadcast when an audio chunk is scored against the commands in the command mode, with the ranked commands */
+	FOnSpeechRecognizedCommandStatic OnRecognizedCommandNative;
+
 	/**
 	 * Sets the parameters for speech recognition. If you want to change only specific parameters, consider using the individual setter functions
 	 *
 	 * @param Parameters The parameters to use for speech recognition
 	 * @return True if the parameters were set successfully, false otherwise
-	 * @note Can only be called when the thread worker is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|All")
 	bool SetRecognitionParameters(const FSpeechRecognitionParameters& Parameters);
@@ -222,7 +407,7 @@ public:
 	 * Sets the default parameters suitable for non-streaming speech recognition
 	 *
 	 * @return True if the parameters were set successfully, false otherwise
-	 * @note Can only be called when the thread worker is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|All")
 	bool SetNonStreamingDefaults();
@@ -231,7 +416,7 @@ public:
 	 * Sets the default parameters suitable for streaming speech recognition
 	 *
 	 * @return True if the parameters were set successfully, false otherwise
-	 * @note Can only be called when the thread worker is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|All")
 	bool SetStreamingDefaults();
@@ -241,40 +426,117 @@ public:
 	 *
 	 * @param Value The number of threads to use
 	 * @return True if the number of threads was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 * @note Set this value to 0 to use the number of cores
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetNumOfThreads(int32 Value);
 
+	/**
+	 * Sets the number of threads to use for the individual recognition stages
+	 * The encoder scales with the number of cores, while the decoder often gets slower beyond a few threads
+	 *
+	 * @param NumOfMelThreads The number of threads to use for the log mel spectrogram
+	 * @param NumOfEncoderThreads The number of threads to use for the encoder
+	 * @param NumOfDecoderThreads The number of threads to use for the decoder
+	 * @return True if the number of threads was set successfully, false otherwise
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
+	 * @note Set a value to 0 to use the number of threads set with SetNumOfThreads
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
+	bool SetNumOfStageThreads(int32 NumOfMelThreads, int32 NumOfEncoderThreads, int32 NumOfDecoderThreads);
+
+	/**
+	 * Sets whether to benchmark the per-stage thread counts on this device when the recognition starts
+	 * The result is cached, so the benchmark only delays the first start on a given device and language model
+	 *
+	 * @param bAutoTune Whether to auto-tune the per-stage thread counts
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
+	bool SetAutoTuneThreads(bool bAutoTune);
+
 	/**
 	 * Sets the language to use for speech recognition
 	 *
 	 * @param Language The language to use. Must be supported by the selected language model in the Editor settings
 	 * @return True if the language was successfully set, false otherwise
-	 * @note Can only be called when the thread worker is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 * @note Setting the language to Auto will decrease the recognition accuracy and performance
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetLanguage(ESpeechRecognizerLanguage Language);
 
+	/**
+	 * Sets whether and how the session language is locked after a confident automatic language detection
+	 * Once locked, the next chunks are recognized in the locked language without the detection, which saves an encoder pass and a decoder step per chunk
+	 *
+	 * @param bLock Whether to lock the session language once the automatic language detection is confident about it. Only applicable when the language is Auto
+	 * @param ProbabilityThreshold Probability the detected language must reach for the chunk to count towards locking the session language, from 0 to 1
+	 * @param NumOfChunksToLock Number of chunks in a row the same language must be confidently detected in to lock the session language
+	 * @param RecheckInterval Number of chunks recognized with the locked language after which the language is detected again. Never if 0
+	 * @param RecheckTokenProbability If the average probability of the recognized tokens of a chunk falls below this value, the language is detected again for the next chunk
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
+	bool SetLanguageLock(bool bLock, float ProbabilityThreshold = 0.8f, int32 NumOfChunksToLock = 3, int32 RecheckInterval = 50, float RecheckTokenProbability = 0.3f);
+
 	/**
 	 * Sets whether to translate the recognized words to English
 	 *
 	 * @param bTranslate Whether to translate the recognized words to English or not. If true, the language model must be multilingual
 	 * @return True if the translation was successfully set, false otherwise
-	 * @note Can only be called when the thread worker is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetTranslateToEnglish(bool bTranslate);
 
+	/**
+	 * Sets whether to produce both the transcription in the original language and its English translation
+	 * The translation is decoded from the encoder output of the transcription, so both cost much less than two speech recognizers. The translation is broadcast through OnRecognizedTranslatedTextSegment
+	 *
+	 * @param bEnable Whether to produce both the transcription and the translation. If true, the language model must be multilingual
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
+	bool SetTranscribeAndTranslate(bool bEnable);
+
+	/**
+	 * Sets the phrases to spot instead of transcribing the speech freely (command mode), e.g. voice commands
+	 * Each audio chunk is scored against all the commands in one bounded step instead of being transcribed, and the ranked commands are broadcast through OnRecognizedCommand
+	 *
+	 * @param Commands The phrases to spot, written the way they would be transcribed (e.g. with the same casing). The command mode is disabled if empty
+	 * @param RejectionProbability Probability per token, from 0 to 1, the most probable command must reach not to be rejected. Never rejected if 0
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
+	bool SetCommands(const TArray<FString>& Commands, float RejectionProbability = 0.f);
+
+	/**
+	 * Sets the vocabulary the recognized text is limited to, e.g. the phrases of a command grammar or the words and alphabet of a game chat
+	 * The decoder only computes the logits of the tokens that can spell the vocabulary, which makes every decoding step cheaper
+	 *
+	 * @param Phrases The phrases the recognized text is limited to
+	 * @param Characters The characters the recognized text can be spelled with in addition to those of the phrases. No restriction if both are empty
+	 * @param bConstrainToPhrases Whether the recognized text must be a sequence of the phrases (grammar-constrained decoding)
+	 * @param GrammarPenalty Logit penalty of the tokens the grammar of the phrases does not allow. The larger, the stricter
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
+	bool SetVocabulary(const TArray<FString>& Phrases, const FString& Characters, bool bConstrainToPhrases = false, float GrammarPenalty = 100.f);
+
 	/**
 	 * Sets the step size in milliseconds. Determines how often to send audio data for recognition.
 	 * 5000 ms (5 seconds) is used by default
 	 *
 	 * @param Value The step size in milliseconds
 	 * @return True if the step size was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 * @note Set this value to 0 to disable step size
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
@@ -285,7 +547,7 @@ public:
 	 *
 	 * @param bNoContext Whether to use past transcription (if any) as initial prompt for the decoder
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetNoContext(bool bNoContext);
@@ -295,7 +557,7 @@ public:
 	 *
 	 * @param bSingleSegment Whether to force single segment output (useful for streaming)
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetSingleSegment(bool bSingleSegment);
@@ -305,7 +567,7 @@ public:
 	 *
 	 * @param Value The maximum number of tokens per text segment (0 = no limit)
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetMaxTokens(int32 Value);
@@ -315,7 +577,7 @@ public:
 	 *
 	 * @param bSpeedUp Whether to speed up the recognition by using a smaller model
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetSpeedUp(bool bSpeedUp);
@@ -325,7 +587,7 @@ public:
 	 *
 	 * @param Value The size of the audio context
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetAudioContextSize(int32 Value);
@@ -335,7 +597,7 @@ public:
 	 *
 	 * @param Value The temperature to increase when falling back when the decoding fails to meet either of the thresholds below
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetTemperatureToIncrease(float Value);
@@ -346,17 +608,52 @@ public:
 	 *
 	 * @param Value The entropy threshold
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetEntropyThreshold(float Value);
 
+	/**
+	 * Sets the number of fallback temperatures decoded together with the current one, so that a segment failing the thresholds does not need another decoding pass
+	 * The first temperature that passes is used. Only applicable with the greedy sampling strategy
+	 *
+	 * @param Value The number of fallback temperatures decoded together with the current one. Disabled if 0
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
+	bool SetNumOfParallelFallbackTemperatures(int32 Value);
+
+	/**
+	 * Sets the repetition detector, which stops the decoding once it loops over the same tokens (e.g. "thank you thank you ..." on noise or music)
+	 * The decoding keeps one copy of the repeated tokens and resumes from the timestamp of the last kept token, instead of decoding the loop until the token limit and then falling back to a higher temperature
+	 * Disabled by default, since speech that legitimately repeats itself (e.g. counting) may be cut short
+	 *
+	 * @param MaxNGramSize Longest n-gram of tokens to look for. Disabled if 0
+	 * @param NumOfRepetitions Number of times in a row an n-gram must be repeated to stop the decoding, at least 2
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
+	bool SetRepetitionDetection(int32 MaxNGramSize = 8, int32 NumOfRepetitions = 4);
+
+	/**
+	 * Sets the no speech threshold
+	 * If the probability of no speech after the first decoding step is higher than this value, the window is skipped without being decoded
+	 *
+	 * @param Value The no speech threshold, from 0 to 1 (e.g. 0.8). Disabled if 1. Stricter than OpenAI's "no_speech_threshold" since there is no average log probability check, so it needs a higher value
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
+	bool SetNoSpeechThreshold(float Value);
+
 	/**
 	 * Sets whether to suppress blanks showing up in outputs
 	 *
 	 * @param Value Whether to suppress blanks showing up in outputs
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 * @author https://github.com/amartinz
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
@@ -367,7 +664,7 @@ public:
 	 *
 	 * @param Value Whether to suppress non speech tokens showing up in outputs
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
 	 * @author https://github.com/amartinz
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
@@ -382,6 +679,15 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetBeamSize(int32 Value);
 
+	/**
+	 * Sets the strategy used to pick the tokens of the recognized text (greedy or beam search)
+	 * 
+	 * @param Value The sampling strategy
+	 * @return True if the setting was set successfully, false otherwise
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
+	bool SetSamplingStrategy(ESpeechRecognizerSamplingStrategy Value);
+
 	/**
 	 * Sets the initial prompt for the first window
 	 * This can be used to provide context for the recognition to make it more likely to predict the words correctly
@@ -392,6 +698,17 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
 	bool SetInitialPrompt(const FString& Value);
 
+	/**
+	 * Sets the time without audio after which the inference buffers (KV caches, compute buffers) are released while the language model stays loaded
+	 * The buffers are rebuilt when new audio arrives, and the cost of rebuilding them is reported in the metrics
+	 *
+	 * @param Value The idle time in seconds. Set to 0 to disable releasing the inference buffers
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the speech recognition is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Runtime Speech Recognizer|Setters|Individual")
+	bool SetIdleMemoryTrimDelay(float Value);
+
 private:
 	/** The thread that handles speech recognition */
 	TSharedPtr<FSpeechRecognizerThread> Thread;
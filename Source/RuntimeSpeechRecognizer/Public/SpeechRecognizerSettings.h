@@ -39,6 +39,45 @@ public:
 	UPROPERTY(Config, EditAnywhere, Category = "Advanced Runtime Speech Recognizer")
 	FString ModelDownloadCustomName;
 
+	/** Storage type of the attention KV caches. Quantized caches use less memory, which matters most for large models, beam search and many concurrent speech recognizers */
+	UPROPERTY(Config, EditAnywhere, Category = "Advanced Runtime Speech Recognizer")
+	ESpeechRecognizerKVCacheType KVCacheType;
+
+	/** Priority of the speech recognizer thread, which also computes part of every inference graph */
+	UPROPERTY(Config, EditAnywhere, Category = "Runtime Speech Recognizer Threading")
+	ESpeechRecognizerThreadPriority RecognizerThreadPriority;
+
+	/** CPU affinity mask of the speech recognizer thread (bit N allows core N). Uses the task graph high priority mask if 0 */
+	UPROPERTY(Config, EditAnywhere, Category = "Runtime Speech Recognizer Threading")
+	int64 RecognizerThreadAffinityMask;
+
+	/** Priority of the ggml worker threads that compute the inference graphs together with the speech recognizer thread */
+	UPROPERTY(Config, EditAnywhere, Category = "Runtime Speech Recognizer Threading")
+	ESpeechRecognizerThreadPriority WorkerThreadPriority;
+
+	/** CPU affinity mask of the ggml worker threads (bit N allows core N). The affinity is not changed if 0 */
+	UPROPERTY(Config, EditAnywhere, Category = "Runtime Speech Recognizer Threading")
+	int64 WorkerThreadAffinityMask;
+
+	/** How inference reacts while the game is in frame-critical work, to avoid frame hitches caused by inference competing with the game and render threads */
+	UPROPERTY(Config, EditAnywhere, Category = "Runtime Speech Recognizer Threading")
+	ESpeechRecognizerFrameThrottling FrameThrottling;
+
+	/** Frame time above which the game is considered to be in frame-critical work, in milliseconds */
+	UPROPERTY(Config, EditAnywhere, meta = (ClampMin = "1.0", UIMin = "1.0", EditCondition = "FrameThrottling != ESpeechRecognizerFrameThrottling::Disabled"), Category = "Runtime Speech Recognizer Threading")
+	float FrameTimeBudgetMs;
+
+	/** Number of threads inference graphs are computed with in frame-critical work when using the Cap Threads throttling */
+	UPROPERTY(Config, EditAnywhere, meta = (ClampMin = "1", UIMin = "1", EditCondition = "FrameThrottling == ESpeechRecognizerFrameThrottling::CapThreads"), Category = "Runtime Speech Recognizer Threading")
+	int32 ThrottledNumOfThreads;
+
+	/**
+	 * Maximum total time the inference graphs of an audio chunk are delayed in frame-critical work when using the Yield throttling, in milliseconds
+	 * Each graph waits at most until the next frame begins, so that a game that is consistently above the budget only adds this much latency per chunk
+	 */
+	UPROPERTY(Config, EditAnywhere, meta = (ClampMin = "0.0", UIMin = "0.0", EditCondition = "FrameThrottling == ESpeechRecognizerFrameThrottling::Yield"), Category = "Runtime Speech Recognizer Threading")
+	float MaxYieldMs;
+
 	/**
 	 * Get the name of the language model asset
 	 * The format is "[AssetName]"
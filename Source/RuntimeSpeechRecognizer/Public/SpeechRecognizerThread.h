@@ -4,10 +4,11 @@
 
 #include "CoreMinimal.h"
 #include "SpeechRecognizerTypes.h"
-#include "Containers/Queue.h"
+#include "Misc/ScopeLock.h"
 #include "SampleBuffer.h"
 #include "HAL/Runnable.h"
 #include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter64.h"
 #include "Templates/UniquePtr.h"
 #include "Async/Future.h"
 #include <atomic>
@@ -17,8 +18,13 @@
 // Forward declarations
 class FSpeechRecognizerThread;
 class USpeechRecognizerSettings;
+class FSpeechRecognizerGraphProfiler;
+class FSpeechRecognizerMemoryTracker;
+class FEvent;
 struct whisper_context;
 struct whisper_full_params;
+struct whisper_command_set;
+struct FWhisperSpeechRecognizerVocabulary;
 
 /** Static delegate for speech recognition finished recognizing all the queued audio data */
 DECLARE_MULTICAST_DELEGATE(FOnSpeechRecognitionFinished);
@@ -35,6 +41,12 @@ DECLARE_MULTICAST_DELEGATE_OneParam(FOnSpeechRecognitionProgress, int32 /* Progr
 /** Dynamic delegate for speech recognition thread fully stopped */
 DECLARE_MULTICAST_DELEGATE(FOnSpeechRecognitionStopped);
 
+/** Static delegate for the automatic language detection of an audio chunk. The detection result is passed as a parameter */
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnSpeechRecognizerLanguageDetected, const FSpeechRecognizerLanguageDetection&);
+
+/** Static delegate for the commands spotted in an audio chunk in the command mode. The ranked commands are passed as a parameter */
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnSpeechRecognizedCommand, const FSpeechRecognizerCommandResult&);
+
 /**
  * User data for Whisper speech recognizer
  * Used to identify the thread worker responsible for recognized words
@@ -43,6 +55,24 @@ struct RUNTIMESPEECHRECOGNIZER_API FWhisperSpeechRecognizerUserData
 {
 	/** Weak pointer to the speech recognizer thread */
 	TWeakPtr<FSpeechRecognizerThread> SpeechRecognizerWeakPtr;
+
+	/** Whether the English translation of the transcription and translation mode is being decoded, so that its segments are broadcast separately */
+	bool bTranslating = false;
+};
+
+/**
+ * Frame throttling counters of a speech recognizer, updated by the frame monitor while its audio chunks are recognized
+ */
+struct FSpeechRecognizerThrottlingCounters
+{
+	/** Number of audio chunks whose recognition started while the game was in frame-critical work */
+	std::atomic<int32> NumOfFrameCriticalChunks{0};
+
+	/** Number of inference graphs that were throttled */
+	std::atomic<int32> NumOfThrottledGraphs{0};
+
+	/** Total time inference graphs were delayed in the Yield throttling mode, in microseconds */
+	std::atomic<int64> YieldedMicroseconds{0};
 };
 
 /**
@@ -61,15 +91,31 @@ struct RUNTIMESPEECHRECOGNIZER_API FWhisperSpeechRecognizerState
 	/** The user data associated with the Whisper speech recognizer */
 	FWhisperSpeechRecognizerUserData WhisperUserData;
 
+	/** The tokenized commands of the command mode. Null when not in the command mode */
+	whisper_command_set* WhisperCommandSet;
+
+	/** The commands the command set was built from */
+	TArray<FString> Commands;
+
+	/** The vocabulary the decoding is restricted to. Null when the decoding is not restricted */
+	FWhisperSpeechRecognizerVocabulary* WhisperVocabulary;
+
+	/** Number of heap allocations made by the recognition since the timings were last reset, counted only while the allocation counter is enabled */
+	std::atomic<int64> NumOfAllocations;
+
+	/** Frame throttling counters of the recognition since the timings were last reset */
+	FSpeechRecognizerThrottlingCounters ThrottlingCounters;
+
 	/**
 	 * Initializes the Whisper speech recognizer state. This also allocates memory for the context, parameters, and user data
 	 *
 	 * @param BulkDataPtr Bulk data pointer to the language model
 	 * @param BulkDataSize The size of the bulk data
 	 * @param SpeechRecognizerPtr Pointer to the speech recognizer thread
+	 * @param KVCacheType Storage type of the attention KV caches of the inference state
 	 * @return True if the initialization was successful, false otherwise
 	 */
-	bool Init(uint8* BulkDataPtr, int64 BulkDataSize, TSharedPtr<FSpeechRecognizerThread> SpeechRecognizerPtr);
+	bool Init(uint8* BulkDataPtr, int64 BulkDataSize, TSharedPtr<FSpeechRecognizerThread> SpeechRecognizerPtr, ESpeechRecognizerKVCacheType KVCacheType);
 
 	/**
 	 * Releases the resources associated with the Whisper speech recognizer state
@@ -81,14 +127,78 @@ struct RUNTIMESPEECHRECOGNIZER_API FWhisperSpeechRecognizerState
 	 */
 	void ClearInitialPrompt();
 
+	/**
+	 * Builds the command set of the command mode from the given commands, unless it was built from the same commands already
+	 *
+	 * @param InCommands The commands to spot. The command mode is disabled if empty
+	 * @return True if the command set was built, false otherwise (in which case the command mode is disabled)
+	 */
+	bool SetCommands(const TArray<FString>& InCommands);
+
+	/**
+	 * Frees the command set, disabling the command mode
+	 */
+	void ClearCommands();
+
+	/**
+	 * Builds the vocabulary the decoding is restricted to and points the Whisper parameters to it, unless it was built from the same vocabulary already
+	 *
+	 * @param InPhrases The phrases the recognized text is limited to
+	 * @param InCharacters The characters the recognized text can be spelled with in addition to those of the phrases
+	 * @param bConstrainToPhrases Whether the recognized text must follow the phrases (grammar-constrained decoding)
+	 * @return True if the vocabulary was built, false otherwise (in which case the decoding is not restricted)
+	 */
+	bool SetVocabulary(const TArray<FString>& InPhrases, const FString& InCharacters, bool bConstrainToPhrases);
+
+	/**
+	 * Frees the vocabulary, so that the decoding is not restricted
+	 */
+	void ClearVocabulary();
+
+	/**
+	 * Returns the per-stage timings accumulated by whisper since the context was created or the timings were last reset
+	 *
+	 * @return The accumulated per-stage timings. All zeros if the context is not initialized
+	 */
+	FSpeechRecognizerStageTimings GetStageTimings() const;
+
+	/**
+	 * Resets the per-stage timings accumulated by whisper
+	 */
+	void ResetStageTimings();
+
+	/**
+	 * Releases the inference state (KV caches, compute buffers, mel spectrogram, logits) while keeping the model weights resident
+	 * The per-stage timings accumulated so far are preserved
+	 *
+	 * @return True if the inference state was released, false if it was not allocated
+	 */
+	bool ReleaseInferenceState();
+
+	/**
+	 * Allocates the inference state if it is not allocated, either after Init or after it was released
+	 * Its KV caches are sized for the parameters last filled with FSpeechRecognitionParameters::FillWhisperStateParameters and grown on demand
+	 *
+	 * @return True if the inference state is allocated, false if the allocation failed
+	 */
+	bool RestoreInferenceState();
+
+	/**
+	 * Returns whether the inference state is allocated
+	 */
+	bool HasInferenceState() const;
+
 private:
 	/** Release guard (mutex) for thread safety */
 	mutable FCriticalSection ReleaseGuard;
+
+	/** Per-stage timings accumulated before the inference state was released, restored along with the inference state */
+	FSpeechRecognizerStageTimings ReleasedStageTimings;
 };
 
 /**
  * Parameters for speech recognition
- * These parameters are intended to be immutable once the speech recognition thread is running
+ * These parameters can be changed while the speech recognition thread is running, in which case they are applied before the next audio chunk is recognized
  * This is not an exhaustive list of parameters available in Whisper. Only the most important ones are exposed here
  * When adding more parameters, make sure to update the FillWhisperStateParameters() function
  */
@@ -101,14 +211,95 @@ struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognitionParameters
 	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"), Category = "Runtime Speech Recognizer")
 	int32 NumOfThreads = 0;
 
+	/** The number of threads to use for the log mel spectrogram. Uses NumOfThreads if 0 */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"), Category = "Runtime Speech Recognizer")
+	int32 NumOfMelThreads = 0;
+
+	/** The number of threads to use for the encoder (and language detection), which scales well with the number of cores. Uses NumOfThreads if 0 */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"), Category = "Runtime Speech Recognizer")
+	int32 NumOfEncoderThreads = 0;
+
+	/** The number of threads to use for the decoder, whose single-token steps often get slower beyond a few threads. Uses NumOfThreads if 0 */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"), Category = "Runtime Speech Recognizer")
+	int32 NumOfDecoderThreads = 0;
+
+	/**
+	 * Whether to benchmark the mel, encoder and decoder thread counts on this device when the recognition starts, overriding the thread counts above
+	 * The result is cached per CPU, language model and audio context size in the engine config, so the benchmark only runs the first time
+	 * Parameters changed while running keep the current tuning, since benchmarking would hold up the recognition. Prewarm tunes again for the new parameters
+	 */
+	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
+	bool bAutoTuneThreads = false;
+
 	/** The language to use for speech recognition */
 	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
 	ESpeechRecognizerLanguage Language = ESpeechRecognizerLanguage::En;
 
+	/**
+	 * Whether to lock the session language once the automatic language detection is confident about it, so that the next chunks skip the detection (an extra encoder pass and decoder step per chunk)
+	 * Only applicable when the language is Auto. The detections are broadcast through the language detected delegate
+	 */
+	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
+	bool bLockDetectedLanguage = false;
+
+	/** Probability the detected language must reach for the chunk to count towards locking the session language, from 0 to 1 */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", ClampMax = "1", UIMin = "0", UIMax = "1"), Category = "Runtime Speech Recognizer")
+	float LanguageLockProbabilityThreshold = 0.8f;
+
+	/** Number of chunks in a row the same language must be confidently detected in to lock the session language */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "1", UIMin = "1"), Category = "Runtime Speech Recognizer")
+	int32 NumOfChunksToLockLanguage = 3;
+
+	/** Number of chunks recognized with the locked language after which the language is detected again. Never if 0 */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"), Category = "Runtime Speech Recognizer")
+	int32 LanguageRecheckInterval = 50;
+
+	/** If the average probability of the recognized tokens of a chunk falls below this value while the language is locked, the language is detected again for the next chunk */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", ClampMax = "1", UIMin = "0", UIMax = "1"), Category = "Runtime Speech Recognizer")
+	float LanguageRecheckTokenProbability = 0.3f;
+
 	/** Whether to translate the recognized words to English or not */
 	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
 	bool bTranslateToEnglish = false;
 
+	/**
+	 * Whether to produce both the transcription in the original language and its English translation. Takes precedence over bTranslateToEnglish
+	 * The translation is decoded from the encoder output of the transcription, which costs much less than a second recognizer. It is broadcast through the translated text segment delegate
+	 */
+	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
+	bool bTranscribeAndTranslate = false;
+
+	/**
+	 * Phrases to spot instead of transcribing the speech freely (command mode), e.g. voice commands. Disabled if empty
+	 * Each chunk is scored against all the phrases at once with one encoder pass and a batched decoding of their shared prefixes, so the cost is bounded by the phrases instead of the speech
+	 * Only the first 30 seconds of a chunk are scored. Phrases should be written the way they would be transcribed, e.g. with the same casing
+	 */
+	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
+	TArray<FString> Commands;
+
+	/** Probability per token, from 0 to 1, the most probable command must reach not to be rejected in the command mode. Never rejected if 0 */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", ClampMax = "1", UIMin = "0", UIMax = "1"), Category = "Runtime Speech Recognizer")
+	float CommandRejectionProbability = 0.f;
+
+	/**
+	 * Phrases the recognized text is limited to, e.g. the commands of a command grammar or the vocabulary of a game chat. No restriction if both this and VocabularyCharacters are empty
+	 * The decoder only computes the logits of the tokens spelled with the characters of the phrases and VocabularyCharacters (plus space and basic punctuation) instead of projecting onto the whole vocabulary of the language model
+	 */
+	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
+	TArray<FString> VocabularyPhrases;
+
+	/** Characters the recognized text can be spelled with in addition to those of the vocabulary phrases, e.g. the alphabet of the language to filter the output to. Letters are allowed in both cases */
+	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
+	FString VocabularyCharacters;
+
+	/** Whether the recognized text must be a sequence of the vocabulary phrases (grammar-constrained decoding, case-insensitive). Otherwise only the tokens are restricted */
+	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
+	bool bConstrainToVocabularyPhrases = false;
+
+	/** Logit penalty of the tokens the grammar of the vocabulary phrases does not allow. The larger, the stricter */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"), Category = "Runtime Speech Recognizer")
+	float VocabularyGrammarPenalty = 100.f;
+
 	/** The step size in milliseconds used to accumulate audio in the pending audio buffer to be queued (e.g. 5000 ms = 5 seconds) */
 	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"), Category = "Runtime Speech Recognizer")
 	int32 StepSizeMs = 5000;
@@ -141,6 +332,35 @@ struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognitionParameters
 	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
 	float EntropyThreshold = 2.4f;
 
+	/**
+	 * Number of fallback temperatures decoded together with the current one, so that a segment failing the thresholds above does not need another decoding pass. Disabled if 0
+	 * The first temperature that passes is used, and the higher ones are cancelled as soon as it is known. Each extra temperature adds the decoders of a best-of decoding (8 decoders at most in total)
+	 * Only applicable with the greedy sampling strategy and a positive temperature to increase
+	 */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"), Category = "Runtime Speech Recognizer")
+	int32 NumOfParallelFallbackTemperatures = 0;
+
+	/**
+	 * Longest n-gram of tokens the repetition detector looks for. Disabled if 0 (the default), 8 is a good starting point
+	 * On noise or music the decoding often loops over the same words (e.g. "thank you thank you ..."). Once the last tokens are the same n-gram repeated NumOfRepetitionsToStop times,
+	 * the decoding stops with one copy of the n-gram, and the next window starts at the timestamp of the last kept token, instead of the loop being decoded until the token limit and then again at a higher temperature
+	 * Speech that legitimately repeats itself (e.g. counting or chanting) may be cut short, which is why it is opt-in
+	 */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"), Category = "Runtime Speech Recognizer")
+	int32 MaxRepetitionNGramSize = 0;
+
+	/** Number of times in a row an n-gram must be repeated for the repetition detector to stop the decoding */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "2", UIMin = "2"), Category = "Runtime Speech Recognizer")
+	int32 NumOfRepetitionsToStop = 4;
+
+	/**
+	 * If the probability of no speech after the first decoding step is higher than this value, the window is skipped without being decoded, from 0 to 1. Disabled if 1
+	 * Saves the decoding of silence and noise, which otherwise tends to produce made-up text. 0.8 to 0.9 is a good starting point
+	 * Unlike OpenAI's "no_speech_threshold", the window is skipped before its text is decoded, without also requiring a low average log probability, so the same value skips more speech than there
+	 */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", ClampMax = "1", UIMin = "0", UIMax = "1"), Category = "Runtime Speech Recognizer")
+	float NoSpeechThreshold = 1.f;
+
 	/** Whether to suppress blanks showing up in outputs */
 	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
 	bool bSuppressBlank = true;
@@ -149,7 +369,14 @@ struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognitionParameters
 	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
 	bool bSuppressNonSpeechTokens = false;
 	
-	/** Number of beams in beam search, only applicable when temperature is zero */
+	/** How the tokens of the recognized text are picked */
+	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
+	ESpeechRecognizerSamplingStrategy SamplingStrategy = ESpeechRecognizerSamplingStrategy::Greedy;
+
+	/**
+	 * Number of beams in beam search (5 if not greater than 0, at most 8). Only applicable with the beam search sampling strategy, and when the temperature is zero
+	 * The beams share the KV cache entries of their common prefix, so the cost of a beam is mostly its decoding work (see AverageDecodeMsPerToken in the metrics)
+	 */
 	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
 	int32 BeamSize = -1.f;
 
@@ -160,6 +387,13 @@ struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognitionParameters
 	UPROPERTY(BlueprintReadWrite, Category = "Runtime Speech Recognizer")
 	FString InitialPrompt;
 
+	/**
+	 * Time without audio after which the inference buffers (KV caches, compute buffers, mel spectrogram) are released, in seconds. Disabled if 0
+	 * The language model weights stay resident, and the buffers are rebuilt when new audio arrives, which adds a small delay to that audio
+	 */
+	UPROPERTY(BlueprintReadWrite, meta = (ClampMin = "0", UIMin = "0"), Category = "Runtime Speech Recognizer")
+	float IdleMemoryTrimDelaySec = 0.f;
+
 	/**
 	 * Returns the default parameters suitable for non-streaming speech recognition
 	 * @return The default parameters suitable for non-streaming speech recognition
@@ -209,12 +443,79 @@ private:
 	/** Promise for starting the thread. Invalidated once the thread is fully started */
 	TUniquePtr<TPromise<bool>> StartThreadPromise;
 
+public:
+	/**
+	 * Makes the recognizer hot, so that the first recognized audio does not pay for the one-time costs (graph building, buffer reservation, cold weights)
+	 * Starts the thread worker if it is stopped (loading the language model and allocating the whisper state), then runs a dummy mel, encode and decode
+	 * at the configured audio context size on the thread worker. Intended to be hidden behind loading screens
+	 *
+	 * @return True once the recognizer is hot, false if the thread could not be started or the warm-up failed
+	 */
+	TFuture<bool> Prewarm();
+
+private:
+	/**
+	 * Runs a dummy mel, encode and decode on the thread worker. Called by the thread worker when a warm-up is requested
+	 *
+	 * @return True if the warm-up succeeded, false otherwise
+	 */
+	bool WarmUp();
+
+	/**
+	 * Completes all the pending warm-up promises with the given result
+	 */
+	void CompleteWarmUp(bool bSuccess);
+
+	/** Promises of the requested warm-ups. Completed by the thread worker once the warm-up finished */
+	TArray<TSharedRef<TPromise<bool>>> WarmUpPromises;
+
+	/** Data guard (mutex) for thread safety of the warm-up promises */
+	FCriticalSection WarmUpGuard;
+
+	/** Whether a warm-up was requested and is yet to be run by the thread worker */
+	FThreadSafeBool bIsWarmUpRequested;
+
 public:
 	/**
 	 * Stops the thread worker
 	 */
 	void StopThread();
 
+	/**
+	 * Suspends the recognition while keeping the language model, the whisper state and the thread worker alive, so that it can be resumed instantly
+	 * Audio data that is already queued is kept and recognized once resumed, while audio data processed during the pause is rejected
+	 *
+	 * @return True if the recognition was paused, false otherwise
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	bool Pause();
+
+	/**
+	 * Resumes the recognition suspended with Pause
+	 *
+	 * @return True if the recognition was resumed, false otherwise
+	 */
+	bool Resume();
+
+	/**
+	 * Returns whether the recognition is paused or not
+	 *
+	 * @return True if the recognition is paused, false otherwise
+	 */
+	bool GetIsPaused() const;
+
+private:
+	/** Whether the recognition is paused. The thread worker waits for the wake-up event while paused */
+	FThreadSafeBool bIsPaused;
+
+	/** Whether the audio dropped during the current pause was logged already, so that it is logged once per pause rather than on every capture callback */
+	FThreadSafeBool bIsPausedAudioDropLogged;
+
+	/** Event the thread worker waits for while paused. Triggered to wake the thread worker up on resume, warm-up and stop */
+	FEvent* WakeUpEvent;
+
+public:
+
 	/**
 	 * Processes the audio data and recognizes the words
 	 *
@@ -268,12 +569,105 @@ public:
 	 */
 	bool GetIsFinished() const;
 
+	/**
+	 * Returns the per-stage timings (mel, encoder, decoder, sampling) accumulated since the thread was started or the timings were last reset
+	 *
+	 * @return The accumulated per-stage timings
+	 */
+	FSpeechRecognizerStageTimings GetStageTimings() const;
+
+	/**
+	 * Resets the accumulated per-stage timings
+	 */
+	void ResetStageTimings();
+
+	/**
+	 * Starts counting the heap allocations made by the recognition of all speech recognizers, reported in the per-stage timings
+	 * Wraps the global allocator for the rest of the process lifetime, so it is meant for benchmarking (e.g. to check that the steady-state recognition does not allocate)
+	 * Should be called on the game thread before the speech recognizers to measure are started
+	 */
+	static void EnableAllocationCounting();
+
+	/**
+	 * Returns the live health metrics of the current speech recognition session (real-time factor, queue lag, chunk latency, tokens per second, fallbacks, dropped audio)
+	 * Lock-free and cheap enough to be polled every frame
+	 *
+	 * @return The current metrics
+	 */
+	FSpeechRecognizerMetrics GetMetrics() const;
+
+	/**
+	 * Resets the rolling values and counters of the metrics. The metrics are also reset every time the thread is started
+	 */
+	void ResetMetrics();
+
+	/**
+	 * Enables or disables recording of the per-node timings of the ggml graphs (encoder, decoder) computed during recognition
+	 * Enabling discards the previously recorded nodes. Intended for profiling only since recording adds overhead to every node
+	 *
+	 * @param bEnabled Whether to record the graph nodes
+	 */
+	void SetGraphProfilingEnabled(bool bEnabled);
+
+	/**
+	 * Returns whether the per-node timings of the ggml graphs are being recorded
+	 */
+	bool GetGraphProfilingEnabled() const;
+
+	/**
+	 * Exports the recorded per-node timings of the ggml graphs
+	 *
+	 * @param FilePath The path of the file to write. The .csv extension produces the timings aggregated per graph and op, any other extension produces a Chrome trace (.json)
+	 * @return True if the file was written successfully, false otherwise
+	 */
+	bool ExportGraphProfile(const FString& FilePath) const;
+
+	/**
+	 * Returns the memory currently used by this speech recognizer (model weights, KV caches, compute buffers, mel spectrogram)
+	 * The memory is allocated when the thread is started and released when it is stopped
+	 *
+	 * @return The memory usage broken down by category
+	 */
+	FSpeechRecognizerMemoryUsage GetMemoryUsage() const;
+
+	/**
+	 * Returns the memory currently used by all speech recognizers
+	 *
+	 * @return The memory usage broken down by category
+	 */
+	static FSpeechRecognizerMemoryUsage GetTotalMemoryUsage();
+
+	/**
+	 * Returns the measured impact of speech recognition (across all speech recognizers) on the game frame time
+	 *
+	 * @return The average frame time while recognizing and while idle, and the number of throttled inference graphs
+	 */
+	static FSpeechRecognizerFrameImpact GetFrameImpact();
+
+	/**
+	 * Resets the measured impact of speech recognition on the game frame time
+	 */
+	static void ResetFrameImpact();
+
+	/**
+	 * Sets the language model data to use instead of the language model asset defined in the project settings
+	 * Intended for tools that need to run different models without changing the project settings, such as benchmarks
+	 *
+	 * @param LanguageModelData The language model data in ggml format. Pass nullptr to use the language model asset again
+	 * @return True if the language model data was set successfully, false otherwise
+	 * @note Can only be called when the thread worker is stopped
+	 */
+	bool SetLanguageModelDataOverride(TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe> LanguageModelData);
+
 	/** Delegate broadcast when all the audio data has been processed */
 	FOnSpeechRecognitionFinished OnRecognitionFinished;
 
 	/** Delegate broadcast when recognized words are received */
 	FOnSpeechRecognizedTextSegment OnRecognizedTextSegment;
 
+	/** Delegate broadcast when recognized words translated to English are received in the transcription and translation mode */
+	FOnSpeechRecognizedTextSegment OnRecognizedTranslatedTextSegment;
+
 	/** Delegate broadcast when the speech recognition progress changes */
 	FOnSpeechRecognitionProgress OnRecognitionProgress;
 
@@ -283,12 +677,18 @@ public:
 	/** Delegate broadcast when the speech recognition thread fully stopped */
 	FOnSpeechRecognitionStopped OnRecognitionStopped;
 
+	/** Delegate broadcast when the language of an audio chunk is automatically detected */
+	FOnSpeechRecognizerLanguageDetected OnLanguageDetected;
+
+	/** Delegate broadcast when an audio chunk is scored against the commands in the command mode */
+	FOnSpeechRecognizedCommand OnRecognizedCommand;
+
 	/**
 	 * Sets the parameters for speech recognition. If you want to change only specific parameters, consider using the individual setter functions
 	 *
 	 * @param Parameters The parameters to use for speech recognition
 	 * @return True if the parameters were set successfully, false otherwise
-	 * @note Can only be called when the thread worker is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	bool SetRecognitionParameters(const FSpeechRecognitionParameters& Parameters);
 
@@ -314,7 +714,7 @@ public:
 	 * Sets the default parameters suitable for non-streaming speech recognition
 	 *
 	 * @return True if the parameters were set successfully, false otherwise
-	 * @note Can only be called when the thread worker is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	bool SetNonStreamingDefaults();
 
@@ -322,7 +722,7 @@ public:
 	 * Sets the default parameters suitable for streaming speech recognition
 	 *
 	 * @return True if the parameters were set successfully, false otherwise
-	 * @note Can only be called when the thread worker is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	bool SetStreamingDefaults();
 
@@ -331,37 +731,102 @@ public:
 	 *
 	 * @param Value The number of threads to use
 	 * @return True if the number of threads was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 * @note Set this value to 0 to use the number of cores
 	 */
 	bool SetNumOfThreads(int32 Value);
 
+	/**
+	 * Sets the number of threads to use for the individual recognition stages
+	 *
+	 * @param NumOfMelThreads The number of threads to use for the log mel spectrogram
+	 * @param NumOfEncoderThreads The number of threads to use for the encoder
+	 * @param NumOfDecoderThreads The number of threads to use for the decoder
+	 * @return True if the number of threads was set successfully, false otherwise
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
+	 * @note Set a value to 0 to use the number of threads set with SetNumOfThreads
+	 */
+	bool SetNumOfStageThreads(int32 NumOfMelThreads, int32 NumOfEncoderThreads, int32 NumOfDecoderThreads);
+
+	/**
+	 * Sets whether to benchmark the per-stage thread counts on this device when the recognition starts
+	 *
+	 * @param bAutoTune Whether to auto-tune the per-stage thread counts
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized. Enabling it then tunes before that chunk
+	 */
+	bool SetAutoTuneThreads(bool bAutoTune);
+
 	/**
 	 * Sets the language to use for speech recognition
 	 *
 	 * @param Language The language to use. Must be supported by the selected language model in the Editor settings
 	 * @return True if the language was successfully set, false otherwise
-	 * @note Can only be called when the thread worker is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 * @note Setting the language to Auto will decrease the recognition accuracy and performance
 	 */
 	bool SetLanguage(ESpeechRecognizerLanguage Language);
 
+	/**
+	 * Sets whether and how the session language is locked after a confident automatic language detection
+	 *
+	 * @param bLock Whether to lock the session language once the automatic language detection is confident about it. Only applicable when the language is Auto
+	 * @param ProbabilityThreshold Probability the detected language must reach for the chunk to count towards locking the session language, from 0 to 1
+	 * @param NumOfChunksToLock Number of chunks in a row the same language must be confidently detected in to lock the session language
+	 * @param RecheckInterval Number of chunks recognized with the locked language after which the language is detected again. Never if 0
+	 * @param RecheckTokenProbability If the average probability of the recognized tokens of a chunk falls below this value, the language is detected again for the next chunk
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	bool SetLanguageLock(bool bLock, float ProbabilityThreshold, int32 NumOfChunksToLock, int32 RecheckInterval, float RecheckTokenProbability);
+
 	/**
 	 * Sets whether to translate the recognized words to English
 	 *
 	 * @param bTranslate Whether to translate the recognized words to English or not. If true, the language model must be multilingual
 	 * @return True if the translation was successfully set, false otherwise
-	 * @note Can only be called when the thread worker is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	bool SetTranslateToEnglish(bool bTranslate);
 
+	/**
+	 * Sets whether to produce both the transcription in the original language and its English translation
+	 *
+	 * @param bEnable Whether to produce both the transcription and the translation. If true, the language model must be multilingual
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	bool SetTranscribeAndTranslate(bool bEnable);
+
+	/**
+	 * Sets the phrases to spot instead of transcribing the speech freely (command mode)
+	 *
+	 * @param Commands The phrases to spot, written the way they would be transcribed. The command mode is disabled if empty
+	 * @param RejectionProbability Probability per token, from 0 to 1, the most probable command must reach not to be rejected. Never rejected if 0
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	bool SetCommands(const TArray<FString>& Commands, float RejectionProbability);
+
+	/**
+	 * Sets the vocabulary the recognized text is limited to
+	 *
+	 * @param Phrases The phrases the recognized text is limited to
+	 * @param Characters The characters the recognized text can be spelled with in addition to those of the phrases. No restriction if both are empty
+	 * @param bConstrainToPhrases Whether the recognized text must be a sequence of the phrases (grammar-constrained decoding)
+	 * @param GrammarPenalty Logit penalty of the tokens the grammar of the phrases does not allow
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	bool SetVocabulary(const TArray<FString>& Phrases, const FString& Characters, bool bConstrainToPhrases, float GrammarPenalty);
+
 	/**
 	 * Sets the step size in milliseconds. Determines how often to send audio data for recognition.
 	 * 5000 ms (5 seconds) is used by default
 	 *
 	 * @param Value The step size in milliseconds
 	 * @return True if the step size was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 * @note Set this value to 0 to disable step size
 	 */
 	bool SetStepSize(int32 Value);
@@ -371,7 +836,7 @@ public:
 	 *
 	 * @param bNoContext Whether to use past transcription (if any) as initial prompt for the decoder
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	bool SetNoContext(bool bNoContext);
 
@@ -380,7 +845,7 @@ public:
 	 *
 	 * @param bSingleSegment Whether to force single segment output (useful for streaming)
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	bool SetSingleSegment(bool bSingleSegment);
 
@@ -389,7 +854,7 @@ public:
 	 *
 	 * @param Value The maximum number of tokens per text segment (0 = no limit)
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	bool SetMaxTokens(int32 Value);
 
@@ -398,7 +863,7 @@ public:
 	 *
 	 * @param bSpeedUp Whether to speed up the recognition by using a smaller model
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	bool SetSpeedUp(bool bSpeedUp);
 
@@ -407,7 +872,7 @@ public:
 	 *
 	 * @param Value The size of the audio context
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	bool SetAudioContextSize(int32 Value);
 
@@ -416,7 +881,7 @@ public:
 	 *
 	 * @param Value The temperature to increase when falling back when the decoding fails to meet either of the thresholds below
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	bool SetTemperatureToIncrease(float Value);
 
@@ -426,16 +891,44 @@ public:
 	 *
 	 * @param Value The entropy threshold
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 */
 	bool SetEntropyThreshold(float Value);
 
+	/**
+	 * Sets the number of fallback temperatures decoded together with the current one
+	 *
+	 * @param Value The number of fallback temperatures decoded together with the current one. Disabled if 0
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	bool SetNumOfParallelFallbackTemperatures(int32 Value);
+
+	/**
+	 * Sets the repetition detector, which stops the decoding once it loops over the same tokens
+	 *
+	 * @param MaxNGramSize Longest n-gram of tokens to look for. Disabled if 0
+	 * @param NumOfRepetitions Number of times in a row an n-gram must be repeated to stop the decoding, at least 2
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	bool SetRepetitionDetection(int32 MaxNGramSize, int32 NumOfRepetitions);
+
+	/**
+	 * Sets the no speech threshold
+	 *
+	 * @param Value Probability of no speech after the first decoding step above which the window is skipped, from 0 to 1. Disabled if 1
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	bool SetNoSpeechThreshold(float Value);
+
 	/**
 	 * Sets whether to suppress blanks showing up in outputs
 	 *
 	 * @param Value Whether to suppress blanks showing up in outputs
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 * @author https://github.com/amartinz
 	 */
 	bool SetSuppressBlank(bool Value);
@@ -445,7 +938,7 @@ public:
 	 *
 	 * @param Value Whether to suppress non speech tokens showing up in outputs
 	 * @return True if the setting was set successfully, false otherwise
-	 * @note Can only be called when the thread is stopped
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
 	 * @author https://github.com/amartinz
 	 */
 	bool SetSuppressNonSpeechTokens(bool Value);
@@ -458,6 +951,14 @@ public:
 	 */
 	bool SetBeamSize(int32 Value);
 
+	/**
+	 * Sets the strategy used to pick the tokens of the recognized text (greedy or beam search)
+	 * 
+	 * @param Value The sampling strategy
+	 * @return True if the setting was set successfully, false otherwise
+	 */
+	bool SetSamplingStrategy(ESpeechRecognizerSamplingStrategy Value);
+
 	/**
 	 * Sets the initial prompt for the first window
 	 * This can be used to provide context for the recognition to make it more likely to predict the words correctly
@@ -467,6 +968,15 @@ public:
 	 */
 	bool SetInitialPrompt(const FString& Value);
 
+	/**
+	 * Sets the time without audio after which the inference buffers are released while the language model weights stay resident
+	 *
+	 * @param Value The idle time in seconds. Set to 0 to disable releasing the inference buffers
+	 * @return True if the setting was set successfully, false otherwise
+	 * @note Can also be called while the thread worker is running, in which case the change is applied before the next audio chunk is recognized
+	 */
+	bool SetIdleMemoryTrimDelay(float Value);
+
 private:
 	/**
 	 * Callback type for loading the language model data
@@ -483,6 +993,63 @@ private:
 	 */
 	void LoadLanguageModel(FOnLanguageModelLoaded&& OnLoadLanguageModel);
 
+	/**
+	 * Adds the mixed and resampled audio data to the queue of the speech recognizer
+	 *
+	 * @param PCMData The audio data to enqueue
+	 */
+	void EnqueueAudioData(Audio::FAlignedFloatBuffer&& PCMData);
+
+	/**
+	 * Processes the audio data submitted on the game thread, on the background thread this is called from
+	 * Keeps draining until no submitted audio data is left, so that only one such task is scheduled at a time and the audio data is processed in order
+	 */
+	void ProcessSubmittedAudioData();
+
+	/**
+	 * Records audio data that could not be submitted to the recognizer in the metrics
+	 *
+	 * @param NumOfSamples The number of interleaved samples in the audio data
+	 * @param SampleRate The sample rate of the audio data
+	 * @param NumOfChannels The number of channels of the audio data
+	 */
+	void RecordDroppedAudio(int64 NumOfSamples, float SampleRate, uint32 NumOfChannels);
+
+	/**
+	 * Finds the fastest mel, encoder and decoder thread counts for this device and applies them to the whisper parameters
+	 * Uses the cached result if this device was tuned before, otherwise benchmarks the stages on silence and caches the result (written on the game thread)
+	 * Only called when the thread worker starts, on Prewarm and when the auto-tuning gets enabled, since benchmarking takes seconds
+	 *
+	 * @return True if the thread counts were applied, false if tuning failed or was interrupted
+	 */
+	bool AutoTuneThreads();
+
+	/**
+	 * Releases the inference state if the thread worker has been idle for longer than the configured delay. Called by the thread worker when there is no audio to process
+	 */
+	void TrimIdleMemory();
+
+	/**
+	 * Rebuilds the inference state if it was released while idle, recording the wake-up cost in the metrics. Called by the thread worker before using the inference state
+	 *
+	 * @return True if the inference state is available, false otherwise
+	 */
+	bool WakeUpInferenceState();
+
+	/**
+	 * Stages a change of the recognition parameters. If the thread worker is running, the change is applied before the next audio chunk is recognized
+	 *
+	 * @param ParameterName The name of the changed parameter, for logging
+	 * @param Stage The function changing the recognition parameters
+	 * @return True if the change was staged successfully, false otherwise
+	 */
+	bool StageRecognitionParameters(const TCHAR* ParameterName, TFunctionRef<void(FSpeechRecognitionParameters&)> Stage);
+
+	/**
+	 * Applies the staged recognition parameters to the whisper parameters. Called by the thread worker between audio chunks
+	 */
+	void ApplyStagedRecognitionParameters();
+
 	/**
 	 * Releases the memory used by the language model. Intended to be called when the thread is stopped
 	 */
@@ -496,6 +1063,29 @@ private:
 	 */
 	void ReportError(const FString& ShortErrorMessage, const FString& LongErrorMessage);
 
+	/**
+	 * Records the automatic language detection of the last recognized chunk in the language lock and broadcasts it
+	 * Only called from the speech recognizer thread after a chunk recognized with the language detection
+	 */
+	void ReportLanguageDetection();
+
+	/**
+	 * Decodes the English translation of the last recognized chunk from its encoder output and broadcasts it
+	 * Only called from the speech recognizer thread in the transcription and translation mode
+	 *
+	 * @return The number of decoded tokens
+	 */
+	int32 TranslateRecognizedAudio();
+
+	/**
+	 * Scores the audio chunk against the commands of the command mode and broadcasts the ranked commands
+	 * Only called from the speech recognizer thread
+	 *
+	 * @param PCMData The audio chunk to score
+	 * @return True if the audio chunk was scored, false otherwise
+	 */
+	bool RecognizeCommand(const Audio::FAlignedFloatBuffer& PCMData);
+
 private:
 	/** Whether the thread worker is stopped or not */
 	FThreadSafeBool bIsStopped;
@@ -509,8 +1099,284 @@ private:
 	/** Thread instance */
 	TUniquePtr<FRunnableThread> Thread;
 
+	/**
+	 * Multi-producer, multi-consumer FIFO queue backed by a ring buffer guarded by a lock
+	 * Unlike TQueue, which allocates a node for every enqueued item, the ring only allocates when it grows beyond the deepest the queue has been so far
+	 */
+	template <typename ItemType>
+	struct TRingQueue
+	{
+		/**
+		 * Adds an item to the end of the queue
+		 */
+		void Enqueue(ItemType&& Item)
+		{
+			FScopeLock Lock(&Guard);
+			if (NumOfItems == Items.Num())
+			{
+				// Growing the ring, moving the items so that they start at the beginning
+				TArray<ItemType> GrownItems;
+				GrownItems.SetNum(FMath::Max(8, Items.Num() * 2));
+				for (int32 ItemIndex = 0; ItemIndex < NumOfItems; ++ItemIndex)
+				{
+					GrownItems[ItemIndex] = MoveTemp(Items[(Head + ItemIndex) % Items.Num()]);
+				}
+				Items = MoveTemp(GrownItems);
+				Head = 0;
+			}
+			Items[(Head + NumOfItems) % Items.Num()] = MoveTemp(Item);
+			++NumOfItems;
+		}
+
+		/**
+		 * Removes the item at the beginning of the queue
+		 *
+		 * @param OutItem The removed item
+		 * @return True if an item was removed, false if the queue is empty
+		 */
+		bool Dequeue(ItemType& OutItem)
+		{
+			FScopeLock Lock(&Guard);
+			if (NumOfItems == 0)
+			{
+				return false;
+			}
+			OutItem = MoveTemp(Items[Head]);
+			Head = (Head + 1) % Items.Num();
+			--NumOfItems;
+			return true;
+		}
+
+		bool IsEmpty() const
+		{
+			FScopeLock Lock(&Guard);
+			return NumOfItems == 0;
+		}
+
+	private:
+		/** Ring buffer of the items. Slots outside of the queued range hold default-constructed (moved-from) items */
+		TArray<ItemType> Items;
+
+		/** Index of the first queued item in the ring buffer */
+		int32 Head = 0;
+
+		/** Number of queued items */
+		int32 NumOfItems = 0;
+
+		/** Data guard (mutex) for thread safety of the queue */
+		mutable FCriticalSection Guard;
+	};
+
+	/**
+	 * Audio data submitted on the game thread, waiting to be processed on a background thread
+	 */
+	struct FSubmittedAudioData
+	{
+		/** Audio data as submitted (not yet mixed and resampled) */
+		Audio::FAlignedFloatBuffer PCMData;
+
+		float SampleRate = 0;
+		uint32 NumOfChannels = 0;
+		bool bLast = false;
+	};
+
+	/** Audio data submitted on the game thread, waiting to be processed on a background thread */
+	TRingQueue<FSubmittedAudioData> SubmittedAudioQueue;
+
+	/** Whether a background task processing the submitted audio data is scheduled or running */
+	std::atomic<bool> bSubmittedAudioTaskScheduled{false};
+
+	/**
+	 * Audio data waiting in the queue to be processed
+	 */
+	struct FQueuedAudioData
+	{
+		/** Mixed and resampled audio data */
+		Audio::FAlignedFloatBuffer PCMData;
+
+		/** Time the audio data was added to the queue, in seconds (FPlatformTime::Seconds) */
+		double EnqueueTime = 0;
+	};
+
 	/** Queue of audio data waiting to be processed */
-	TQueue<Audio::FAlignedFloatBuffer> AudioQueue;
+	TRingQueue<FQueuedAudioData> AudioQueue;
+
+	/** Number of audio data chunks currently in the queue */
+	FThreadSafeCounter NumOfQueuedChunks;
+
+	/** Number of mixed and resampled samples currently in the queue */
+	FThreadSafeCounter64 NumOfQueuedSamples;
+
+	/**
+	 * Lock-free collector of the session metrics
+	 * Chunks are recorded by the speech recognizer thread only, while dropped audio can be recorded from any thread
+	 */
+	struct FMetricsTracker
+	{
+		FMetricsTracker();
+
+		/** Number of the most recently processed chunks the rolling values are computed over */
+		static constexpr int32 WindowSize = 64;
+
+		/**
+		 * Resets the rolling values and counters
+		 */
+		void Reset();
+
+		/**
+		 * Records a processed chunk
+		 *
+		 * @param AudioSeconds Duration of the chunk audio, in seconds
+		 * @param QueueSeconds Time the chunk spent in the queue, in seconds
+		 * @param ProcessingSeconds Time spent recognizing the chunk, in seconds
+		 * @param NumOfTokens Number of tokens decoded for the chunk
+		 * @param NumFallbacksLogProb Number of temperature fallbacks caused by the log probability threshold
+		 * @param NumFallbacksEntropy Number of temperature fallbacks caused by the entropy threshold
+		 * @param NumRepetitionStops Number of decodings stopped by the repetition detector
+		 * @param NumNoSpeechSkips Number of windows skipped by the no speech threshold
+		 * @param DecodeSeconds Time spent decoding the prompt and the tokens of the chunk, including sampling, in seconds
+		 * @param BeamWidth Number of beams (or decoders) the chunk was decoded with
+		 */
+		void RecordChunk(double AudioSeconds, double QueueSeconds, double ProcessingSeconds, int32 NumOfTokens, int32 NumFallbacksLogProb, int32 NumFallbacksEntropy, int32 NumRepetitionStops, int32 NumNoSpeechSkips, double DecodeSeconds, int32 BeamWidth);
+
+		/**
+		 * Records a chunk the recognizer failed to process
+		 */
+		void RecordFailedChunk();
+
+		/**
+		 * Records discarded audio data
+		 *
+		 * @param NumOfChunks Number of discarded audio submissions
+		 * @param AudioSeconds Duration of the discarded audio, in seconds
+		 */
+		void RecordDroppedAudio(int32 NumOfChunks, double AudioSeconds);
+
+		/**
+		 * Records a release of the inference state after the recognizer was idle
+		 */
+		void RecordIdleTrim();
+
+		/**
+		 * Records a rebuild of the released inference state
+		 *
+		 * @param WakeUpSeconds Time the rebuild took, in seconds
+		 */
+		void RecordWakeUp(double WakeUpSeconds);
+
+		/**
+		 * Fills the rolling values and counters of the metrics
+		 *
+		 * @param OutMetrics The metrics to fill
+		 */
+		void GetMetrics(FSpeechRecognizerMetrics& OutMetrics) const;
+
+	private:
+		/** Per-chunk values of the rolling window, written as a ring buffer */
+		std::atomic<float> AudioSecondsWindow[WindowSize];
+		std::atomic<float> QueueSecondsWindow[WindowSize];
+		std::atomic<float> ProcessingSecondsWindow[WindowSize];
+		std::atomic<int32> NumOfTokensWindow[WindowSize];
+		std::atomic<float> DecodeSecondsWindow[WindowSize];
+
+		/** Total number of recorded chunks, also used as the write position of the ring buffer */
+		std::atomic<int32> NumOfProcessedChunks;
+
+		std::atomic<int32> NumOfFailedChunks;
+		std::atomic<int64> ProcessedAudioMs;
+		std::atomic<int32> NumFallbacksLogProb;
+		std::atomic<int32> NumFallbacksEntropy;
+		std::atomic<int32> NumRepetitionStops;
+		std::atomic<int32> NumNoSpeechSkips;
+		std::atomic<int32> NumOfDroppedChunks;
+		std::atomic<int64> DroppedAudioMs;
+		std::atomic<int32> NumOfIdleTrims;
+		std::atomic<int32> NumOfWakeUps;
+		std::atomic<int64> LastWakeUpUs;
+		std::atomic<int64> TotalWakeUpUs;
+		std::atomic<int32> LastBeamWidth;
+	};
+
+	/** Metrics of the current speech recognition session */
+	FMetricsTracker Metrics;
+
+	/**
+	 * Session language lock of the automatic language detection
+	 * Only accessed by the speech recognizer thread
+	 */
+	struct FLanguageLock
+	{
+		/**
+		 * Copies the language lock parameters, unlocking the language if the lock no longer applies
+		 *
+		 * @param Parameters The recognition parameters being applied
+		 */
+		void Configure(const FSpeechRecognitionParameters& Parameters);
+
+		/**
+		 * Unlocks the language and forgets the previous detections, e.g. when a new session starts
+		 */
+		void Reset();
+
+		/**
+		 * Returns whether the language lock applies to the current recognition parameters
+		 */
+		bool IsEnabled() const { return bEnabled; }
+
+		/**
+		 * Returns the language the next chunk is recognized in, or Auto if it has to be detected
+		 */
+		ESpeechRecognizerLanguage GetLanguageToRecognize() const;
+
+		/**
+		 * Records the automatic language detection of a chunk, locking or unlocking the session language
+		 *
+		 * @param Language The detected language
+		 * @param Probability Probability of the detected language
+		 * @return True if the session language is locked after the detection
+		 */
+		bool RecordDetection(ESpeechRecognizerLanguage Language, float Probability);
+
+		/**
+		 * Records a chunk recognized with the locked language
+		 *
+		 * @param AverageTokenProbability Average probability of the recognized tokens of the chunk
+		 */
+		void RecordLockedChunk(float AverageTokenProbability);
+
+	private:
+		/** Copies of the language lock parameters */
+		bool bEnabled = false;
+		float ProbabilityThreshold = 0.8f;
+		int32 NumOfChunksToLock = 3;
+		int32 RecheckInterval = 50;
+		float RecheckTokenProbability = 0.3f;
+
+		/** Language the session is locked to, Auto if not locked */
+		ESpeechRecognizerLanguage LockedLanguage = ESpeechRecognizerLanguage::Auto;
+
+		/** Language confidently detected in the last chunks, and the number of those chunks in a row */
+		ESpeechRecognizerLanguage CandidateLanguage = ESpeechRecognizerLanguage::Auto;
+		int32 NumOfConfidentChunks = 0;
+
+		/** Number of chunks recognized with the locked language since it was last detected */
+		int32 NumOfChunksSinceDetection = 0;
+
+		/** Whether the language is detected again for the next chunk because the recognition confidence dropped */
+		bool bRecheckRequested = false;
+	};
+
+	/** Session language lock, configured from the recognition parameters when they are applied */
+	FLanguageLock LanguageLock;
+
+	/** Whether the per-node timings of the ggml graphs are being recorded */
+	FThreadSafeBool bGraphProfilingEnabled;
+
+	/** Recorder of the per-node timings of the ggml graphs */
+	TUniquePtr<FSpeechRecognizerGraphProfiler> GraphProfiler;
+
+	/** Accounts the memory of the ggml buffers allocated by this speech recognizer */
+	TUniquePtr<FSpeechRecognizerMemoryTracker> MemoryTracker;
 
 	/**
 	 * Pending audio data that automatically mixes and resamples audio data based on the whisper recognition requirements
@@ -526,6 +1392,7 @@ private:
 		{
 			*this = Other;
 		}
+		~FPendingAudioData();
 
 		FPendingAudioData& operator=(FPendingAudioData&& Other) noexcept
 		{
@@ -533,7 +1400,8 @@ private:
 			{
 				FScopeLock Lock(&DataGuard);
 				AudioDataMap = MoveTemp(Other.AudioDataMap);
-				TotalMixedAndResampledSize = Other.TotalMixedAndResampledSize;
+				SetTotalMixedAndResampledSize(Other.TotalMixedAndResampledSize);
+				Other.SetTotalMixedAndResampledSize(0);
 			}
 			return *this;
 		}
@@ -544,7 +1412,7 @@ private:
 			{
 				FScopeLock Lock(&DataGuard);
 				AudioDataMap = Other.AudioDataMap;
-				TotalMixedAndResampledSize = Other.TotalMixedAndResampledSize;
+				SetTotalMixedAndResampledSize(Other.TotalMixedAndResampledSize);
 			}
 			return *this;
 		}
@@ -565,6 +1433,12 @@ private:
 		 */
 		int64 GetTotalMixedAndResampledSize() const;
 
+		/**
+		 * Checks whether there is no pending audio data, including amounts too small to count towards the estimated mixed and resampled size
+		 * @return True if there is no pending audio data, false otherwise
+		 */
+		bool IsEmpty() const;
+
 		/**
 		 * Gets the mixed and resampled audio data
 		 * @param OutPCMData The mixed and resampled audio data
@@ -578,12 +1452,17 @@ private:
 		 */
 		void RecalculateTotalMixedAndResampledSize();
 
+		/**
+		 * Sets the estimated total size of the mixed and resampled audio data, keeping the pending samples stat in sync
+		 */
+		void SetTotalMixedAndResampledSize(int64 NewSize);
+
 	private:
 		/** Map of audio data keyed by sample rate and number of channels */
 		TMap<TPair<float /*SampleRate*/, uint32 /*NumOfChannels*/>, Audio::FAlignedFloatBuffer> AudioDataMap;
 
-		/** Estimated total size of the mixed and resampled audio data */
-		int64 TotalMixedAndResampledSize = 0;
+		/** Estimated total size of the mixed and resampled audio data. Atomic so that it can be read without taking the data guard */
+		std::atomic<int64> TotalMixedAndResampledSize { 0 };
 
 		/** Data guard (mutex) for thread safety of the audio data map */
 		mutable FCriticalSection DataGuard;
@@ -595,9 +1474,45 @@ private:
 	/** Whisper state */
 	FWhisperSpeechRecognizerState WhisperState;
 
-	/** Recognition parameters */
+	/** Recognition parameters. Changes made while the thread worker is running are applied to the whisper parameters at the next chunk boundary */
 	FSpeechRecognitionParameters RecognitionParameters;
 
+	/** Data guard (mutex) for thread safety of the recognition parameters */
+	mutable FCriticalSection RecognitionParametersGuard;
+
+	/** Whether the recognition parameters were changed while the thread worker is running and are yet to be applied */
+	FThreadSafeBool bRecognitionParametersChanged;
+
+	/** Time without audio after which the inference state is released, in seconds. Copied from the recognition parameters when they are applied */
+	float IdleMemoryTrimDelaySec;
+
+	/** Whether to also decode the English translation of each chunk. Copied from the recognition parameters when they are applied */
+	bool bTranscribeAndTranslate;
+
+	/** Probability per token the most probable command must reach not to be rejected. Copied from the recognition parameters when they are applied */
+	float CommandRejectionProbability;
+
+	/** Whether the thread counts are auto-tuned. Copied from the recognition parameters when they are applied, to tell when the auto-tuning gets enabled */
+	bool bAutoTuneThreads;
+
+	/** The auto-tuned mel (X), encoder (Y) and decoder (Z) thread counts, reapplied when the parameters change. Zero if not tuned yet */
+	FIntVector AutoTunedThreadCounts;
+
+	/** The configuration key the thread counts were last auto-tuned for */
+	FString AutoTunedCacheKey;
+
+	/** Log-probabilities of the commands scored for the last chunk, kept so that scoring does not allocate */
+	TArray<float> CommandLogProbabilities;
+
+	/** Time the thread worker last used the inference state, in seconds (FPlatformTime::Seconds) */
+	double LastActivityTime;
+
+	/** Whether the inference state was released by the idle memory trimming and is yet to be rebuilt. Only accessed by the thread worker */
+	bool bIsInferenceStateTrimmed;
+
+	/** Language model data used instead of the language model asset, if set */
+	TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe> LanguageModelDataOverride;
+
 public:
 	/** The last progress made in the speech recognition process */
 	std::atomic<int32> LastProgress { 0 };
@@ -413,6 +413,26 @@ RUNTIMESPEECHRECOGNIZER_API inline const char* EnumToString(ESpeechRecognizerLan
 	}
 }
 
+/**
+ * Convert a language string used by the Whisper API to ESpeechRecognizerLanguage
+ * Returns ESpeechRecognizerLanguage::Auto if the language is not one of ESpeechRecognizerLanguage
+ */
+RUNTIMESPEECHRECOGNIZER_API inline ESpeechRecognizerLanguage StringToEnum(const char* String)
+{
+	if (String)
+	{
+		for (int32 Index = static_cast<int32>(ESpeechRecognizerLanguage::En); Index <= static_cast<int32>(ESpeechRecognizerLanguage::Su); ++Index)
+		{
+			const ESpeechRecognizerLanguage Language = static_cast<ESpeechRecognizerLanguage>(Index);
+			if (FCStringAnsi::Strcmp(EnumToString(Language), String) == 0)
+			{
+				return Language;
+			}
+		}
+	}
+	return ESpeechRecognizerLanguage::Auto;
+}
+
 RUNTIMESPEECHRECOGNIZER_API inline FString GetModelDownloadBaseUrl(ESpeechRecognizerModelSize ModelSize, ESpeechRecognizerModelLanguage ModelLanguage)
 {
 	switch (ModelSize) {
@@ -445,3 +465,439 @@ RUNTIMESPEECHRECOGNIZER_API inline FString GetModelDownloadBaseUrl(ESpeechRecogn
 		return TEXT("");
 	}
 }
+
+/**
+ * Per-stage timings accumulated by the whisper recognizer, mirroring the counters whisper keeps internally
+ * The times are accumulated since the recognizer was started or the timings were last reset
+ */
+USTRUCT(BlueprintType, Category = "Runtime Speech Recognizer")
+struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognizerStageTimings
+{
+	GENERATED_BODY()
+
+	/** Time spent computing the log mel spectrogram, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float MelMs = 0.f;
+
+	/** Time spent in the encoder, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float EncodeMs = 0.f;
+
+	/** Time spent in single-token decoder calls (text generation), in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float DecodeMs = 0.f;
+
+	/** Time spent in batched decoder calls (multiple decoders), in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float BatchDecodeMs = 0.f;
+
+	/** Time spent decoding the prompt, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float PromptMs = 0.f;
+
+	/** Time spent sampling tokens from the logits, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float SampleMs = 0.f;
+
+	/** Number of encoder calls */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumEncode = 0;
+
+	/** Number of single-token decoder calls */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumDecode = 0;
+
+	/** Number of tokens processed by batched decoder calls */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumBatchDecode = 0;
+
+	/** Number of prompt tokens processed by the decoder */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumPrompt = 0;
+
+	/** Number of sampling steps */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumSample = 0;
+
+	/** Number of temperature fallbacks caused by the log probability threshold */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumFallbacksLogProb = 0;
+
+	/** Number of temperature fallbacks caused by the entropy threshold */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumFallbacksEntropy = 0;
+
+	/** Number of heap allocations made by the recognition. Only counted after FSpeechRecognizerThread::EnableAllocationCounting is called, zero otherwise */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumAllocations = 0;
+
+	/** Number of audio chunks whose recognition started while the game was in frame-critical work (see the frame throttling settings) */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumFrameCriticalChunks = 0;
+
+	/** Number of inference graphs throttled because the game was in frame-critical work */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumThrottledGraphs = 0;
+
+	/** Time inference graphs were delayed in the Yield throttling mode, in milliseconds. Not part of the total time of the stages */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float YieldMs = 0.f;
+
+	/**
+	 * Returns the total time spent in all the stages, in milliseconds
+	 */
+	float GetTotalMs() const
+	{
+		return MelMs + EncodeMs + DecodeMs + BatchDecodeMs + PromptMs + SampleMs;
+	}
+
+	/**
+	 * Returns the number of generated tokens (single-token and batched decoder calls)
+	 */
+	int32 GetNumDecodedTokens() const
+	{
+		return NumDecode + NumBatchDecode;
+	}
+};
+
+/**
+ * Live health metrics of a speech recognition session
+ * Rolling values (averages and percentiles) are computed over the most recently processed audio chunks, while counters are accumulated since the session was started or the metrics were last reset
+ */
+USTRUCT(BlueprintType, Category = "Runtime Speech Recognizer")
+struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognizerMetrics
+{
+	GENERATED_BODY()
+
+	/** Rolling average real-time factor (processing time divided by audio duration). Values above 1 mean the recognizer cannot keep up with the incoming audio */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float RealTimeFactor = 0.f;
+
+	/** Rolling average time chunks spent waiting in the queue before being processed, in seconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float QueueLagSeconds = 0.f;
+
+	/** Duration of the audio currently waiting to be processed (queued and pending), in seconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float BacklogSeconds = 0.f;
+
+	/** Number of audio chunks currently in the queue */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumOfQueuedChunks = 0;
+
+	/** Rolling average latency of a chunk from being enqueued until its recognition finished, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float AverageChunkLatencyMs = 0.f;
+
+	/** Rolling median chunk latency, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float P50ChunkLatencyMs = 0.f;
+
+	/** Rolling 95th percentile chunk latency, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float P95ChunkLatencyMs = 0.f;
+
+	/** Rolling 99th percentile chunk latency, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float P99ChunkLatencyMs = 0.f;
+
+	/** Rolling maximum chunk latency, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float MaxChunkLatencyMs = 0.f;
+
+	/** Rolling average number of decoded tokens per second of processing time */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float TokensPerSecond = 0.f;
+
+	/**
+	 * Rolling average decoding cost per generated token (prompt, decoder and sampling time), in milliseconds
+	 * Grows with the beam width, so comparing it across beam widths shows the latency paid for the accuracy of a wider beam
+	 */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float AverageDecodeMsPerToken = 0.f;
+
+	/** Number of beams (or decoders) the most recent chunk was decoded with. 1 for greedy decoding */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 BeamWidth = 0;
+
+	/** Number of audio chunks processed */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumOfProcessedChunks = 0;
+
+	/** Number of audio chunks the recognizer failed to process */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumOfFailedChunks = 0;
+
+	/** Duration of the processed audio, in seconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float ProcessedAudioSeconds = 0.f;
+
+	/** Number of temperature fallbacks caused by the log probability threshold */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumFallbacksLogProb = 0;
+
+	/** Number of temperature fallbacks caused by the entropy threshold */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumFallbacksEntropy = 0;
+
+	/** Number of decodings stopped early by the repetition detector, each saving the decoding of a loop up to the token limit and its temperature fallback */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumRepetitionStops = 0;
+
+	/** Number of windows skipped without being decoded because of the no speech threshold */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumNoSpeechSkips = 0;
+
+	/** Number of audio submissions that were discarded (rejected because of the thread state or invalid format, or cleared before being processed) */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumOfDroppedChunks = 0;
+
+	/** Duration of the discarded audio, in seconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float DroppedAudioSeconds = 0.f;
+
+	/** Number of times the inference buffers (KV caches, compute buffers, mel spectrogram) were released after the recognizer was idle */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumOfIdleTrims = 0;
+
+	/** Number of times the released inference buffers were rebuilt when new audio arrived */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumOfWakeUps = 0;
+
+	/** Time the most recent rebuild of the released inference buffers took, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float LastWakeUpMs = 0.f;
+
+	/** Average time a rebuild of the released inference buffers took, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float AverageWakeUpMs = 0.f;
+};
+
+/**
+ * How the speech recognizer picks the tokens of the recognized text
+ */
+UENUM(BlueprintType, Category = "Runtime Speech Recognizer")
+enum class ESpeechRecognizerSamplingStrategy : uint8
+{
+	Greedy UMETA(ToolTip = "Picks the most likely token at every step. The fastest strategy"),
+	BeamSearch UMETA(DisplayName = "Beam Search", ToolTip = "Keeps the BeamSize most likely sequences at every step and picks the best one at the end. More accurate, but every beam adds decoding work")
+};
+
+/**
+ * Storage type of the attention KV caches of the speech recognizer
+ */
+UENUM(BlueprintType, Category = "Runtime Speech Recognizer")
+enum class ESpeechRecognizerKVCacheType : uint8
+{
+	Default UMETA(ToolTip = "The KV caches use the floating-point type of the language model weights"),
+	Q8_0 UMETA(DisplayName = "Quantized (Q8_0)", ToolTip = "The KV caches are quantized to 8 bits, which roughly halves their memory and the bandwidth of the decoding steps at a small accuracy cost. Enables flash attention, which is the attention that reads quantized caches")
+};
+
+/**
+ * Memory used by a speech recognizer, broken down by category
+ * Includes the ggml CPU buffers (model weights, KV caches, compute buffers) and the mel spectrogram, which make up almost all of the memory used during recognition
+ */
+USTRUCT(BlueprintType, Category = "Runtime Speech Recognizer")
+struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognizerMemoryUsage
+{
+	GENERATED_BODY()
+
+	/** Memory used by the weights of the language model, in bytes */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int64 WeightsBytes = 0;
+
+	/** Memory used by the self-attention, cross-attention and padding KV caches, in bytes. The caches are sized for the recognition parameters and grown on demand */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int64 KVCacheBytes = 0;
+
+	/** Memory used by the compute buffers of the encoder and decoder graphs, in bytes */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int64 ComputeBytes = 0;
+
+	/** Memory used by the mel spectrogram of the last processed audio chunk, in bytes */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int64 MelBytes = 0;
+
+	/** Memory used by other ggml CPU buffers (e.g. alignment heads masks), in bytes */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int64 OtherBytes = 0;
+
+	/** Returns the total memory used, in bytes */
+	int64 GetTotalBytes() const
+	{
+		return WeightsBytes + KVCacheBytes + ComputeBytes + MelBytes + OtherBytes;
+	}
+};
+
+/**
+ * Statistics of the pool of audio buffers used to submit, mix, resample and queue audio data, shared by all speech recognizers
+ */
+USTRUCT(BlueprintType, Category = "Runtime Speech Recognizer")
+struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognizerAudioBufferPoolStats
+{
+	GENERATED_BODY()
+
+	/** Number of buffers requested from the pool */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int64 NumOfAcquires = 0;
+
+	/** Number of requests served with a previously released buffer, without allocating */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int64 NumOfReuses = 0;
+
+	/** Number of requests that had to allocate a new buffer */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int64 NumOfAllocations = 0;
+
+	/** Number of released buffers that were freed instead of pooled (too small, too large, or their size class was full) */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int64 NumOfDiscards = 0;
+
+	/** Number of buffers currently held by the pool */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumOfPooledBuffers = 0;
+
+	/** Memory currently held by the pool, in bytes */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int64 PooledBytes = 0;
+
+	/** Returns the fraction of the requests served without allocating, from 0 to 1 */
+	float GetReuseRatio() const
+	{
+		return NumOfAcquires > 0 ? static_cast<float>(NumOfReuses) / NumOfAcquires : 0.f;
+	}
+};
+
+/**
+ * Priority of the threads used by the speech recognizer
+ */
+UENUM(BlueprintType, Category = "Runtime Speech Recognizer")
+enum class ESpeechRecognizerThreadPriority : uint8
+{
+	Lowest,
+	BelowNormal,
+	Normal,
+	AboveNormal,
+	Highest
+};
+
+/**
+ * How the speech recognizer reacts when the game is in frame-critical work (the frame time is above the budget)
+ */
+UENUM(BlueprintType, Category = "Runtime Speech Recognizer")
+enum class ESpeechRecognizerFrameThrottling : uint8
+{
+	Disabled UMETA(ToolTip = "Inference always uses the configured number of threads"),
+	CapThreads UMETA(DisplayName = "Cap Threads", ToolTip = "Inference graphs are computed with fewer threads while the frame time is above the budget"),
+	Yield UMETA(ToolTip = "Inference graphs are delayed until the next frame while the frame time is above the budget, up to a limit per audio chunk")
+};
+
+/**
+ * Measured impact of speech recognition on the game frame time, accumulated across all speech recognizers
+ */
+USTRUCT(BlueprintType, Category = "Runtime Speech Recognizer")
+struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognizerFrameImpact
+{
+	GENERATED_BODY()
+
+	/** Average frame time of the frames during which speech was being recognized, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float AverageFrameTimeMsWhileRecognizing = 0.f;
+
+	/** Average frame time of the frames during which no speech was being recognized, in milliseconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float AverageFrameTimeMsWhileIdle = 0.f;
+
+	/** Number of frames during which speech was being recognized */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumOfFramesWhileRecognizing = 0;
+
+	/** Number of frames during which no speech was being recognized */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumOfFramesWhileIdle = 0;
+
+	/** Number of inference graphs that were throttled because the frame time was above the budget */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 NumOfThrottledGraphs = 0;
+
+	/** Total time inference graphs were delayed in the Yield throttling mode, in seconds */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float YieldedSeconds = 0.f;
+
+	/** Returns the increase of the average frame time while speech is being recognized, in milliseconds */
+	float GetFrameTimeImpactMs() const
+	{
+		return NumOfFramesWhileRecognizing > 0 && NumOfFramesWhileIdle > 0 ? AverageFrameTimeMsWhileRecognizing - AverageFrameTimeMsWhileIdle : 0.f;
+	}
+};
+
+/**
+ * Result of the automatic language detection of an audio chunk
+ */
+USTRUCT(BlueprintType, Category = "Runtime Speech Recognizer")
+struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognizerLanguageDetection
+{
+	GENERATED_BODY()
+
+	/** The most probable language of the chunk */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	ESpeechRecognizerLanguage Language = ESpeechRecognizerLanguage::Auto;
+
+	/** Probability of the detected language, from 0 to 1 */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float Probability = 0.f;
+
+	/** Probabilities of the languages that are at least 1% probable */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	TMap<ESpeechRecognizerLanguage, float> Probabilities;
+
+	/** Whether the session language is locked after this detection, in which case the next chunks are recognized in the detected language without detecting it again */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	bool bLanguageLocked = false;
+};
+
+/**
+ * Score of a command spotted in an audio chunk in the command mode
+ */
+USTRUCT(BlueprintType, Category = "Runtime Speech Recognizer")
+struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognizerCommandCandidate
+{
+	GENERATED_BODY()
+
+	/** The command */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	FString Command;
+
+	/** Index of the command in the commands of the recognition parameters */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 CommandIndex = INDEX_NONE;
+
+	/** Average log-probability per token of the command, the end of the text included */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float LogProbability = 0.f;
+
+	/** Probability per token of the command, from 0 to 1 (the exponential of the log-probability) */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	float Probability = 0.f;
+};
+
+/**
+ * Commands spotted in an audio chunk in the command mode
+ */
+USTRUCT(BlueprintType, Category = "Runtime Speech Recognizer")
+struct RUNTIMESPEECHRECOGNIZER_API FSpeechRecognizerCommandResult
+{
+	GENERATED_BODY()
+
+	/** All the commands, the most probable first */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	TArray<FSpeechRecognizerCommandCandidate> Candidates;
+
+	/** Index of the recognized command in the commands of the recognition parameters, INDEX_NONE if rejected */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	int32 CommandIndex = INDEX_NONE;
+
+	/** Whether the most probable command is below the rejection probability, e.g. because no command was spoken */
+	UPROPERTY(BlueprintReadOnly, Category = "Runtime Speech Recognizer")
+	bool bRejected = false;
+};
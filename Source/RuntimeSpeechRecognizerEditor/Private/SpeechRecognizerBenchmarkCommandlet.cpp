@@ -0,0 +1,692 @@
+﻿// Georgy Treshchev 2024.
+
+#include "SpeechRecognizerBenchmarkCommandlet.h"
+#include "SpeechRecognizerEditorDefines.h"
+#include "RuntimeSpeechRecognizerEditor.h"
+#include "SpeechRecognizerSettings.h"
+#include "Audio.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/App.h"
+#include "Misc/EngineVersion.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonSerializer.h"
+#include "Serialization/JsonWriter.h"
+#include <atomic>
+
+USpeechRecognizerBenchmarkCommandlet::USpeechRecognizerBenchmarkCommandlet()
+	: TimeoutSeconds(600)
+	, bCountAllocations(false)
+	, MaxKVCacheWordErrorRate(0.05)
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+	ShowErrorCount = true;
+}
+
+int32 USpeechRecognizerBenchmarkCommandlet::Main(const FString& Params)
+{
+	TArray<FString> Tokens;
+	TArray<FString> Switches;
+	TMap<FString, FString> ParamsMap;
+	ParseCommandLine(*Params, Tokens, Switches, ParamsMap);
+
+	TArray<FCorpusClip> Corpus;
+	if (!LoadCorpus(ParamsMap.FindRef(TEXT("Corpus")), Corpus))
+	{
+		UE_LOG(LogEditorRuntimeSpeechRecognizer, Error, TEXT("Failed to load the benchmark corpus. Please specify a WAV file or a directory with WAV files using -Corpus=<Path>"));
+		return 1;
+	}
+
+	const TArray<FBenchmarkModel> Models = FindInstalledModels(ParamsMap.FindRef(TEXT("Models")));
+	if (Models.Num() <= 0)
+	{
+		UE_LOG(LogEditorRuntimeSpeechRecognizer, Error, TEXT("No installed language models found. Please download the language models to benchmark from the project settings first"));
+		return 1;
+	}
+
+	TArray<int32> ThreadCounts;
+	{
+		TArray<FString> ThreadCountStrings;
+		ParamsMap.FindRef(TEXT("Threads")).ParseIntoArray(ThreadCountStrings, TEXT(","));
+		for (const FString& ThreadCountString : ThreadCountStrings)
+		{
+			const int32 ThreadCount = FCString::Atoi(*ThreadCountString);
+			if (ThreadCount > 0)
+			{
+				ThreadCounts.AddUnique(ThreadCount);
+			}
+		}
+		if (ThreadCounts.Num() <= 0)
+		{
+			const int32 NumOfCores = FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+			for (int32 ThreadCount = 1; ThreadCount < NumOfCores; ThreadCount *= 2)
+			{
+				ThreadCounts.Add(ThreadCount);
+			}
+			ThreadCounts.AddUnique(NumOfCores);
+		}
+	}
+
+	TArray<FBenchmarkPreset> Presets;
+	{
+		TArray<FBenchmarkPreset> AvailablePresets;
+		AvailablePresets.Add({TEXT("NonStreaming"), FSpeechRecognitionParameters::GetNonStreamingDefaults(), false});
+		AvailablePresets.Add({TEXT("Streaming"), FSpeechRecognitionParameters::GetStreamingDefaults(), true});
+
+		// The same parameters with both KV cache types, to compare the decoding time, the KV cache memory and the transcripts
+		// The quantized caches also enable flash attention, which is part of what is being compared
+		AvailablePresets.Add({TEXT("KVCacheDefault"), FSpeechRecognitionParameters::GetNonStreamingDefaults(), false, ESpeechRecognizerKVCacheType::Default});
+		AvailablePresets.Add({TEXT("KVCacheQ8_0"), FSpeechRecognitionParameters::GetNonStreamingDefaults(), false, ESpeechRecognizerKVCacheType::Q8_0});
+
+		// The same parameters with the greedy-like single beam and with a growing number of beams, to measure the decoding cost of every beam
+		for (const int32 BeamSize : {1, 2, 5})
+		{
+			FSpeechRecognitionParameters BeamSearchParameters = FSpeechRecognitionParameters::GetNonStreamingDefaults();
+			BeamSearchParameters.SamplingStrategy = ESpeechRecognizerSamplingStrategy::BeamSearch;
+			BeamSearchParameters.BeamSize = BeamSize;
+			AvailablePresets.Add({FString::Printf(TEXT("Beam%d"), BeamSize), BeamSearchParameters, false});
+		}
+
+		// The non-streaming parameters without the temperature fallback, so that every token is sampled once and the sampling time per token is not skewed by the re-decoded windows
+		{
+			FSpeechRecognitionParameters SamplingParameters = FSpeechRecognitionParameters::GetNonStreamingDefaults();
+			SamplingParameters.TemperatureToIncrease = -1.f;
+			AvailablePresets.Add({TEXT("Sampling"), SamplingParameters, false});
+		}
+
+		const FString PresetsFilter = ParamsMap.Contains(TEXT("Presets")) ? ParamsMap.FindRef(TEXT("Presets")) : TEXT("NonStreaming,Streaming");
+		TArray<FString> PresetNames;
+		PresetsFilter.ParseIntoArray(PresetNames, TEXT(","));
+		for (const FString& PresetName : PresetNames)
+		{
+			if (const FBenchmarkPreset* Preset = AvailablePresets.FindByPredicate([&PresetName](const FBenchmarkPreset& AvailablePreset) { return AvailablePreset.Name.Equals(PresetName, ESearchCase::IgnoreCase); }))
+			{
+				Presets.Add(*Preset);
+			}
+			else
+			{
+				FString SupportedPresetNames;
+				for (const FBenchmarkPreset& AvailablePreset : AvailablePresets)
+				{
+					SupportedPresetNames += (SupportedPresetNames.IsEmpty() ? TEXT("") : TEXT(", ")) + AvailablePreset.Name;
+				}
+				UE_LOG(LogEditorRuntimeSpeechRecognizer, Warning, TEXT("Unknown benchmark preset '%s'. Supported presets are %s"), *PresetName, *SupportedPresetNames);
+			}
+		}
+		if (Presets.Num() <= 0)
+		{
+			UE_LOG(LogEditorRuntimeSpeechRecognizer, Error, TEXT("No valid benchmark presets specified"));
+			return 1;
+		}
+
+		// The transcripts of the quantized KV caches are only meaningful next to the ones of the default KV caches
+		auto ContainsPreset = [&Presets](const TCHAR* PresetName)
+		{
+			return Presets.ContainsByPredicate([PresetName](const FBenchmarkPreset& Preset) { return Preset.Name == PresetName; });
+		};
+		if (ContainsPreset(TEXT("KVCacheQ8_0")) && !ContainsPreset(TEXT("KVCacheDefault")))
+		{
+			UE_LOG(LogEditorRuntimeSpeechRecognizer, Display, TEXT("Adding the KVCacheDefault preset to compare the transcripts of the KVCacheQ8_0 preset with"));
+			Presets.Add(*AvailablePresets.FindByPredicate([](const FBenchmarkPreset& AvailablePreset) { return AvailablePreset.Name == TEXT("KVCacheDefault"); }));
+		}
+	}
+
+	const int32 NumOfIterations = FMath::Max(1, FCString::Atoi(*ParamsMap.FindRef(TEXT("Iterations"))));
+	if (ParamsMap.Contains(TEXT("Timeout")))
+	{
+		TimeoutSeconds = FMath::Max(1.0, FCString::Atod(*ParamsMap.FindRef(TEXT("Timeout"))));
+	}
+	if (ParamsMap.Contains(TEXT("MaxKVCacheWER")))
+	{
+		MaxKVCacheWordErrorRate = FMath::Max(0.0, FCString::Atod(*ParamsMap.FindRef(TEXT("MaxKVCacheWER"))));
+	}
+
+	// The allocator is wrapped before any speech recognizer is started, so that all of their allocations go through the counter
+	bCountAllocations = Switches.Contains(TEXT("CountAllocations"));
+	if (bCountAllocations)
+	{
+		FSpeechRecognizerThread::EnableAllocationCounting();
+	}
+
+	const FString OutputPath = ParamsMap.Contains(TEXT("Output"))
+		? FPaths::ConvertRelativePathToFull(ParamsMap.FindRef(TEXT("Output")))
+		: FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("SpeechRecognizerBenchmark"), FString::Printf(TEXT("Benchmark-%s.json"), *FDateTime::Now().ToString()));
+
+	UE_LOG(LogEditorRuntimeSpeechRecognizer, Display, TEXT("Running speech recognizer benchmark: %d clip(s), %d model(s), %d thread count(s), %d preset(s), %d iteration(s)"), Corpus.Num(), Models.Num(), ThreadCounts.Num(), Presets.Num(), NumOfIterations);
+
+	TArray<FBenchmarkResult> Results;
+	for (const FBenchmarkModel& Model : Models)
+	{
+		TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe> ModelData = MakeShared<TArray64<uint8>, ESPMode::ThreadSafe>();
+		if (!FFileHelper::LoadFileToArray(*ModelData, *Model.FilePath))
+		{
+			UE_LOG(LogEditorRuntimeSpeechRecognizer, Error, TEXT("Failed to load the language model file '%s', skipping"), *Model.FilePath);
+			continue;
+		}
+
+		for (const FBenchmarkPreset& Preset : Presets)
+		{
+			for (const int32 NumOfThreads : ThreadCounts)
+			{
+				for (int32 Iteration = 0; Iteration < NumOfIterations; ++Iteration)
+				{
+					FBenchmarkResult& Result = Results.AddDefaulted_GetRef();
+					Result.ModelName = FString::Printf(TEXT("%s (%s)"), *UEnum::GetValueAsName(Model.ModelSize).ToString(), *UEnum::GetValueAsName(Model.ModelLanguage).ToString());
+					Result.ModelFileName = FPaths::GetCleanFilename(Model.FilePath);
+					Result.PresetName = Preset.Name;
+					Result.NumOfThreads = NumOfThreads;
+					Result.Iteration = Iteration;
+
+					RunConfiguration(ModelData, Preset, NumOfThreads, Corpus, Result);
+
+					UE_LOG(LogEditorRuntimeSpeechRecognizer, Display, TEXT("%s | %s | %d thread(s) | iteration %d: %s, RTF %.3f, %.1f tokens/s, mel %.1f ms, encode %.1f ms, decode %.1f ms, batch decode %.1f ms, prompt %.1f ms, sample %.1f ms (%.3f ms/token), peak memory %.1f MB, peak KV cache %.1f MB"),
+						*Result.ModelName, *Result.PresetName, Result.NumOfThreads, Result.Iteration, Result.bSucceeded ? TEXT("succeeded") : TEXT("failed"),
+						Result.GetRealTimeFactor(), Result.GetTokensPerSecond(),
+						Result.StageTimings.MelMs, Result.StageTimings.EncodeMs, Result.StageTimings.DecodeMs, Result.StageTimings.BatchDecodeMs, Result.StageTimings.PromptMs, Result.StageTimings.SampleMs, Result.GetSampleMsPerToken(),
+						Result.PeakUsedPhysicalMB, Result.PeakKVCacheMB);
+				}
+			}
+		}
+	}
+
+	// The quantized KV caches are compared with the default ones for the same model, thread count and iteration, so that only the KV cache type differs
+	for (FBenchmarkResult& Result : Results)
+	{
+		if (Result.PresetName != TEXT("KVCacheQ8_0") || !Result.bSucceeded)
+		{
+			continue;
+		}
+
+		const FBenchmarkResult* ReferenceResult = Results.FindByPredicate([&Result](const FBenchmarkResult& OtherResult)
+		{
+			return OtherResult.PresetName == TEXT("KVCacheDefault") && OtherResult.bSucceeded && OtherResult.ModelFileName == Result.ModelFileName
+				&& OtherResult.NumOfThreads == Result.NumOfThreads && OtherResult.Iteration == Result.Iteration;
+		});
+		if (!ReferenceResult)
+		{
+			UE_LOG(LogEditorRuntimeSpeechRecognizer, Warning, TEXT("%s | %s | %d thread(s) | iteration %d: no successful KVCacheDefault run to compare the transcripts with"),
+				*Result.ModelName, *Result.PresetName, Result.NumOfThreads, Result.Iteration);
+			continue;
+		}
+
+		Result.WordErrorRate = ComputeWordErrorRate(ReferenceResult->ClipTranscripts, Result.ClipTranscripts);
+		if (Result.WordErrorRate > MaxKVCacheWordErrorRate)
+		{
+			UE_LOG(LogEditorRuntimeSpeechRecognizer, Error, TEXT("%s | %s | %d thread(s) | iteration %d: word error rate against the KVCacheDefault transcripts is %.2f%%, above the maximum of %.2f%%"),
+				*Result.ModelName, *Result.PresetName, Result.NumOfThreads, Result.Iteration, Result.WordErrorRate * 100, MaxKVCacheWordErrorRate * 100);
+			Result.bSucceeded = false;
+		}
+		else
+		{
+			UE_LOG(LogEditorRuntimeSpeechRecognizer, Display, TEXT("%s | %s | %d thread(s) | iteration %d: word error rate against the KVCacheDefault transcripts is %.2f%%"),
+				*Result.ModelName, *Result.PresetName, Result.NumOfThreads, Result.Iteration, Result.WordErrorRate * 100);
+		}
+	}
+
+	if (!WriteResults(OutputPath, Results))
+	{
+		UE_LOG(LogEditorRuntimeSpeechRecognizer, Error, TEXT("Failed to write the benchmark results to '%s'"), *OutputPath);
+		return 1;
+	}
+
+	UE_LOG(LogEditorRuntimeSpeechRecognizer, Display, TEXT("Speech recognizer benchmark results written to '%s'"), *OutputPath);
+	return Results.ContainsByPredicate([](const FBenchmarkResult& Result) { return !Result.bSucceeded; }) ? 1 : 0;
+}
+
+bool USpeechRecognizerBenchmarkCommandlet::LoadCorpus(const FString& CorpusPath, TArray<FCorpusClip>& OutCorpus)
+{
+	if (CorpusPath.IsEmpty())
+	{
+		return false;
+	}
+
+	const FString CorpusPathFull = FPaths::ConvertRelativePathToFull(CorpusPath);
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	TArray<FString> Files;
+	if (PlatformFile.DirectoryExists(*CorpusPathFull))
+	{
+		PlatformFile.FindFilesRecursively(Files, *CorpusPathFull, TEXT("wav"));
+		Files.Sort();
+	}
+	else if (PlatformFile.FileExists(*CorpusPathFull))
+	{
+		Files.Add(CorpusPathFull);
+	}
+
+	for (const FString& File : Files)
+	{
+		TArray<uint8> WaveData;
+		if (!FFileHelper::LoadFileToArray(WaveData, *File))
+		{
+			UE_LOG(LogEditorRuntimeSpeechRecognizer, Warning, TEXT("Failed to read the corpus file '%s', skipping"), *File);
+			continue;
+		}
+
+		FWaveModInfo WaveInfo;
+		FString ErrorMessage;
+		if (!WaveInfo.ReadWaveInfo(WaveData.GetData(), WaveData.Num(), &ErrorMessage))
+		{
+			UE_LOG(LogEditorRuntimeSpeechRecognizer, Warning, TEXT("Failed to parse the corpus file '%s' (%s), skipping"), *File, *ErrorMessage);
+			continue;
+		}
+
+		FCorpusClip Clip;
+		Clip.Name = FPaths::GetCleanFilename(File);
+		Clip.SampleRate = *WaveInfo.pSamplesPerSec;
+		Clip.NumOfChannels = *WaveInfo.pChannels;
+
+		const uint16 BitsPerSample = *WaveInfo.pBitsPerSample;
+		if (BitsPerSample == 16)
+		{
+			const int16* Samples = reinterpret_cast<const int16*>(WaveInfo.SampleDataStart);
+			const int32 NumOfSamples = WaveInfo.SampleDataSize / sizeof(int16);
+			Clip.PCMData.SetNumUninitialized(NumOfSamples);
+			for (int32 SampleIndex = 0; SampleIndex < NumOfSamples; ++SampleIndex)
+			{
+				Clip.PCMData[SampleIndex] = Samples[SampleIndex] / 32768.f;
+			}
+		}
+		else if (BitsPerSample == 32)
+		{
+			const int32 NumOfSamples = WaveInfo.SampleDataSize / sizeof(float);
+			Clip.PCMData.SetNumUninitialized(NumOfSamples);
+			FMemory::Memcpy(Clip.PCMData.GetData(), WaveInfo.SampleDataStart, NumOfSamples * sizeof(float));
+		}
+		else
+		{
+			UE_LOG(LogEditorRuntimeSpeechRecognizer, Warning, TEXT("Unsupported bit depth %d in the corpus file '%s' (only 16-bit PCM and 32-bit float are supported), skipping"), BitsPerSample, *File);
+			continue;
+		}
+
+		UE_LOG(LogEditorRuntimeSpeechRecognizer, Log, TEXT("Loaded corpus clip '%s' (%.2f s, %.0f Hz, %d channel(s))"), *Clip.Name, Clip.GetDuration(), Clip.SampleRate, Clip.NumOfChannels);
+		OutCorpus.Add(MoveTemp(Clip));
+	}
+
+	return OutCorpus.Num() > 0;
+}
+
+TArray<USpeechRecognizerBenchmarkCommandlet::FBenchmarkModel> USpeechRecognizerBenchmarkCommandlet::FindInstalledModels(const FString& ModelsFilter)
+{
+	TArray<FBenchmarkModel> Models;
+
+	const FRuntimeSpeechRecognizerEditorModule& EditorModule = FModuleManager::LoadModuleChecked<FRuntimeSpeechRecognizerEditorModule>(TEXT("RuntimeSpeechRecognizerEditor"));
+	const USpeechRecognizerSettings* SpeechRecognizerSettings = GetDefault<USpeechRecognizerSettings>();
+	const UEnum* ModelSizeEnum = StaticEnum<ESpeechRecognizerModelSize>();
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+	TArray<FString> FilteredModelNames;
+	ModelsFilter.ParseIntoArray(FilteredModelNames, TEXT(","));
+
+	// The last enum entry is the autogenerated _MAX value
+	for (int32 EnumIndex = 0; EnumIndex < ModelSizeEnum->NumEnums() - 1; ++EnumIndex)
+	{
+		const ESpeechRecognizerModelSize ModelSize = static_cast<ESpeechRecognizerModelSize>(ModelSizeEnum->GetValueByIndex(EnumIndex));
+
+		// The custom model size is only known from the project settings
+		if (ModelSize == ESpeechRecognizerModelSize::Custom && (!SpeechRecognizerSettings || SpeechRecognizerSettings->ModelSize != ESpeechRecognizerModelSize::Custom))
+		{
+			continue;
+		}
+
+		if (FilteredModelNames.Num() > 0 && !FilteredModelNames.Contains(ModelSizeEnum->GetNameStringByIndex(EnumIndex)))
+		{
+			continue;
+		}
+
+		for (const ESpeechRecognizerModelLanguage ModelLanguage : {ESpeechRecognizerModelLanguage::EnglishOnly, ESpeechRecognizerModelLanguage::Multilingual})
+		{
+			if ((ModelLanguage == ESpeechRecognizerModelLanguage::EnglishOnly && !DoesSupportEnglishOnlyModelLanguage(ModelSize))
+				|| (ModelLanguage == ESpeechRecognizerModelLanguage::Multilingual && !DoesSupportMultilingualModelLanguage(ModelSize)))
+			{
+				continue;
+			}
+
+			const FString FilePath = FPaths::ConvertRelativePathToFull(EditorModule.GetEditorLMFilePath(ModelSize, ModelLanguage));
+			if (!PlatformFile.FileExists(*FilePath) || Models.ContainsByPredicate([&FilePath](const FBenchmarkModel& Model) { return Model.FilePath == FilePath; }))
+			{
+				continue;
+			}
+
+			Models.Add({ModelSize, ModelLanguage, FilePath});
+		}
+	}
+
+	return Models;
+}
+
+void USpeechRecognizerBenchmarkCommandlet::RunConfiguration(const TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe>& ModelData, const FBenchmarkPreset& Preset, int32 NumOfThreads, const TArray<FCorpusClip>& Corpus, FBenchmarkResult& OutResult) const
+{
+	TSharedPtr<FSpeechRecognizerThread> Recognizer = MakeShared<FSpeechRecognizerThread>();
+
+	FSpeechRecognitionParameters Parameters = Preset.Parameters;
+	Parameters.NumOfThreads = NumOfThreads;
+	Parameters.Language = ESpeechRecognizerLanguage::En;
+
+	if (!Recognizer->SetRecognitionParameters(Parameters) || !Recognizer->SetLanguageModelDataOverride(ModelData))
+	{
+		return;
+	}
+
+	std::atomic<int32> NumOfFinished{0};
+	Recognizer->OnRecognitionFinished.AddLambda([&NumOfFinished]()
+	{
+		++NumOfFinished;
+	});
+
+	FCriticalSection TranscriptGuard;
+	FString Transcript;
+	Recognizer->OnRecognizedTextSegment.AddLambda([&TranscriptGuard, &Transcript](const FString& RecognizedWords)
+	{
+		FScopeLock Lock(&TranscriptGuard);
+		Transcript += RecognizedWords;
+	});
+
+	const uint64 UsedPhysicalBefore = FPlatformMemory::GetStats().UsedPhysical;
+	uint64 PeakUsedPhysical = UsedPhysicalBefore;
+	int64 PeakKVCacheBytes = 0;
+	auto SampleMemory = [&PeakUsedPhysical, &PeakKVCacheBytes, &Recognizer]()
+	{
+		PeakUsedPhysical = FMath::Max<uint64>(PeakUsedPhysical, FPlatformMemory::GetStats().UsedPhysical);
+		PeakKVCacheBytes = FMath::Max<int64>(PeakKVCacheBytes, Recognizer->GetMemoryUsage().KVCacheBytes);
+	};
+
+	bool bSucceeded = true;
+
+	// Load the language model and start the thread
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		TFuture<bool> StartFuture;
+		{
+			// The KV cache type is read from the project settings when the thread starts
+			USpeechRecognizerSettings* SpeechRecognizerSettings = GetMutableDefault<USpeechRecognizerSettings>();
+			TGuardValue<ESpeechRecognizerKVCacheType> KVCacheTypeGuard(SpeechRecognizerSettings->KVCacheType, Preset.KVCacheType.Get(SpeechRecognizerSettings->KVCacheType));
+			StartFuture = Recognizer->StartThread();
+		}
+		if (!WaitUntil([&StartFuture]() { return StartFuture.IsReady(); }, SampleMemory) || !StartFuture.Get())
+		{
+			UE_LOG(LogEditorRuntimeSpeechRecognizer, Error, TEXT("Failed to start the speech recognizer for '%s'"), *OutResult.ModelName);
+			bSucceeded = false;
+		}
+		OutResult.LoadSeconds = FPlatformTime::Seconds() - StartTime;
+	}
+
+	auto RecognizeCorpus = [this, &Recognizer, &Preset, &Parameters, &Corpus, &NumOfFinished, &SampleMemory, &bSucceeded, &OutResult, &TranscriptGuard, &Transcript](bool bMeasure)
+	{
+		for (const FCorpusClip& Clip : Corpus)
+		{
+			int32 ClipTranscriptStart;
+			{
+				FScopeLock Lock(&TranscriptGuard);
+				ClipTranscriptStart = Transcript.Len();
+			}
+
+			// Streaming presets submit the audio in chunks of the step size, the same way it would be captured from a microphone
+			const int32 NumOfSamplesPerChunk = Preset.bSplitIntoSteps && Parameters.StepSizeMs > 0
+				? FMath::Max<int32>(Clip.NumOfChannels, static_cast<int32>(Parameters.StepSizeMs * 1e-3 * Clip.SampleRate) * Clip.NumOfChannels)
+				: Clip.PCMData.Num();
+
+			for (int32 ChunkStart = 0; ChunkStart < Clip.PCMData.Num() && bSucceeded; ChunkStart += NumOfSamplesPerChunk)
+			{
+				const int32 ChunkSize = FMath::Min(NumOfSamplesPerChunk, Clip.PCMData.Num() - ChunkStart);
+				Audio::FAlignedFloatBuffer ChunkData(Clip.PCMData.GetData() + ChunkStart, ChunkSize);
+
+				const int32 ExpectedNumOfFinished = NumOfFinished + 1;
+				const double StartTime = FPlatformTime::Seconds();
+				Recognizer->ProcessPCMData(MoveTemp(ChunkData), Clip.SampleRate, Clip.NumOfChannels, true);
+				if (!WaitUntil([&NumOfFinished, ExpectedNumOfFinished]() { return NumOfFinished >= ExpectedNumOfFinished; }, SampleMemory))
+				{
+					UE_LOG(LogEditorRuntimeSpeechRecognizer, Error, TEXT("Timed out recognizing the corpus clip '%s' with '%s'"), *Clip.Name, *OutResult.ModelName);
+					bSucceeded = false;
+				}
+				const double ChunkLatency = FPlatformTime::Seconds() - StartTime;
+
+				if (bMeasure)
+				{
+					OutResult.ProcessingSeconds += ChunkLatency;
+					OutResult.MaxChunkLatencySeconds = FMath::Max(OutResult.MaxChunkLatencySeconds, ChunkLatency);
+					++OutResult.NumOfChunks;
+				}
+			}
+
+			if (bMeasure)
+			{
+				OutResult.AudioSeconds += Clip.GetDuration();
+
+				FScopeLock Lock(&TranscriptGuard);
+				OutResult.ClipTranscripts.Add(Transcript.Mid(ClipTranscriptStart).TrimStartAndEnd());
+			}
+		}
+	};
+
+	if (bSucceeded)
+	{
+		// The buffers of the recognition grow to the largest chunk of the corpus during the extra pass, so that the measured pass is the steady state
+		if (bCountAllocations)
+		{
+			RecognizeCorpus(false);
+
+			FScopeLock Lock(&TranscriptGuard);
+			Transcript.Reset();
+		}
+
+		Recognizer->ResetStageTimings();
+		RecognizeCorpus(true);
+		OutResult.StageTimings = Recognizer->GetStageTimings();
+
+		if (bCountAllocations && OutResult.StageTimings.NumAllocations > 0)
+		{
+			UE_LOG(LogEditorRuntimeSpeechRecognizer, Error, TEXT("The steady-state recognition with '%s' allocated %d time(s) on the heap, while it is expected not to allocate"), *OutResult.ModelName, OutResult.StageTimings.NumAllocations);
+			bSucceeded = false;
+		}
+	}
+
+	Recognizer->StopThread();
+	if (!WaitUntil([&Recognizer]() { return Recognizer->GetIsStopped() && !Recognizer->GetIsStopping(); }, SampleMemory))
+	{
+		UE_LOG(LogEditorRuntimeSpeechRecognizer, Warning, TEXT("Timed out stopping the speech recognizer for '%s'"), *OutResult.ModelName);
+	}
+
+	// Make sure no delegates referencing the local state are broadcast after returning
+	Recognizer->OnRecognitionFinished.Clear();
+	Recognizer->OnRecognizedTextSegment.Clear();
+	FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+
+	{
+		FScopeLock Lock(&TranscriptGuard);
+		OutResult.Transcript = Transcript.TrimStartAndEnd();
+	}
+
+	OutResult.bSucceeded = bSucceeded;
+	OutResult.PeakUsedPhysicalMB = PeakUsedPhysical / (1024.0 * 1024.0);
+	OutResult.PeakMemoryDeltaMB = (static_cast<int64>(PeakUsedPhysical) - static_cast<int64>(UsedPhysicalBefore)) / (1024.0 * 1024.0);
+	OutResult.PeakKVCacheMB = PeakKVCacheBytes / (1024.0 * 1024.0);
+}
+
+bool USpeechRecognizerBenchmarkCommandlet::WaitUntil(TFunctionRef<bool()> Predicate, TFunctionRef<void()> OnTick) const
+{
+	const double StartTime = FPlatformTime::Seconds();
+	while (!Predicate())
+	{
+		if (FPlatformTime::Seconds() - StartTime > TimeoutSeconds)
+		{
+			return false;
+		}
+
+		FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+		OnTick();
+		FPlatformProcess::Sleep(0.001f);
+	}
+	return true;
+}
+
+bool USpeechRecognizerBenchmarkCommandlet::WriteResults(const FString& OutputPath, const TArray<FBenchmarkResult>& Results)
+{
+	FString Output;
+
+	if (FPaths::GetExtension(OutputPath).Equals(TEXT("csv"), ESearchCase::IgnoreCase))
+	{
+		Output = TEXT("Model,ModelFile,Preset,Threads,Iteration,Succeeded,AudioSeconds,ProcessingSeconds,RealTimeFactor,LoadSeconds,Chunks,MaxChunkLatencySeconds,TokensPerSecond,DecoderTokensPerSecond,MelMs,EncodeMs,DecodeMs,BatchDecodeMs,PromptMs,SampleMs,SampleMsPerToken,NumEncode,NumDecode,NumBatchDecode,NumPrompt,NumSample,NumFallbacksLogProb,NumFallbacksEntropy,NumAllocations,NumFrameCriticalChunks,NumThrottledGraphs,YieldMs,PeakUsedPhysicalMB,PeakMemoryDeltaMB,PeakKVCacheMB,WordErrorRate\n");
+		for (const FBenchmarkResult& Result : Results)
+		{
+			Output += FString::Printf(TEXT("\"%s\",\"%s\",%s,%d,%d,%d,%.3f,%.3f,%.4f,%.3f,%d,%.3f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.4f,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%.2f,%.1f,%.1f,%.1f,%s\n"),
+				*Result.ModelName, *Result.ModelFileName, *Result.PresetName, Result.NumOfThreads, Result.Iteration, Result.bSucceeded ? 1 : 0,
+				Result.AudioSeconds, Result.ProcessingSeconds, Result.GetRealTimeFactor(), Result.LoadSeconds, Result.NumOfChunks, Result.MaxChunkLatencySeconds,
+				Result.GetTokensPerSecond(), Result.GetDecoderTokensPerSecond(),
+				Result.StageTimings.MelMs, Result.StageTimings.EncodeMs, Result.StageTimings.DecodeMs, Result.StageTimings.BatchDecodeMs, Result.StageTimings.PromptMs, Result.StageTimings.SampleMs, Result.GetSampleMsPerToken(),
+				Result.StageTimings.NumEncode, Result.StageTimings.NumDecode, Result.StageTimings.NumBatchDecode, Result.StageTimings.NumPrompt, Result.StageTimings.NumSample,
+				Result.StageTimings.NumFallbacksLogProb, Result.StageTimings.NumFallbacksEntropy, Result.StageTimings.NumAllocations,
+				Result.StageTimings.NumFrameCriticalChunks, Result.StageTimings.NumThrottledGraphs, Result.StageTimings.YieldMs,
+				Result.PeakUsedPhysicalMB, Result.PeakMemoryDeltaMB, Result.PeakKVCacheMB,
+				Result.WordErrorRate >= 0 ? *FString::Printf(TEXT("%.4f"), Result.WordErrorRate) : TEXT(""));
+		}
+	}
+	else
+	{
+		TSharedRef<FJsonObject> RootObject = MakeShared<FJsonObject>();
+
+		// Information about the machine and the build to compare the results across hardware and builds
+		{
+			TSharedRef<FJsonObject> MachineObject = MakeShared<FJsonObject>();
+			MachineObject->SetStringField(TEXT("CPUBrand"), FPlatformMisc::GetCPUBrand().TrimStartAndEnd());
+			MachineObject->SetNumberField(TEXT("NumberOfCores"), FPlatformMisc::NumberOfCores());
+			MachineObject->SetNumberField(TEXT("NumberOfCoresIncludingHyperthreads"), FPlatformMisc::NumberOfCoresIncludingHyperthreads());
+			MachineObject->SetNumberField(TEXT("TotalPhysicalMB"), FPlatformMemory::GetConstants().TotalPhysical / (1024.0 * 1024.0));
+			MachineObject->SetStringField(TEXT("Platform"), FPlatformProperties::IniPlatformName());
+			MachineObject->SetStringField(TEXT("EngineVersion"), FEngineVersion::Current().ToString());
+			MachineObject->SetStringField(TEXT("BuildConfiguration"), LexToString(FApp::GetBuildConfiguration()));
+			MachineObject->SetStringField(TEXT("Date"), FDateTime::UtcNow().ToIso8601());
+			RootObject->SetObjectField(TEXT("Machine"), MachineObject);
+		}
+
+		TArray<TSharedPtr<FJsonValue>> ResultValues;
+		for (const FBenchmarkResult& Result : Results)
+		{
+			TSharedRef<FJsonObject> ResultObject = MakeShared<FJsonObject>();
+			ResultObject->SetStringField(TEXT("Model"), Result.ModelName);
+			ResultObject->SetStringField(TEXT("ModelFile"), Result.ModelFileName);
+			ResultObject->SetStringField(TEXT("Preset"), Result.PresetName);
+			ResultObject->SetNumberField(TEXT("Threads"), Result.NumOfThreads);
+			ResultObject->SetNumberField(TEXT("Iteration"), Result.Iteration);
+			ResultObject->SetBoolField(TEXT("Succeeded"), Result.bSucceeded);
+			ResultObject->SetNumberField(TEXT("AudioSeconds"), Result.AudioSeconds);
+			ResultObject->SetNumberField(TEXT("ProcessingSeconds"), Result.ProcessingSeconds);
+			ResultObject->SetNumberField(TEXT("RealTimeFactor"), Result.GetRealTimeFactor());
+			ResultObject->SetNumberField(TEXT("LoadSeconds"), Result.LoadSeconds);
+			ResultObject->SetNumberField(TEXT("Chunks"), Result.NumOfChunks);
+			ResultObject->SetNumberField(TEXT("MaxChunkLatencySeconds"), Result.MaxChunkLatencySeconds);
+			ResultObject->SetNumberField(TEXT("TokensPerSecond"), Result.GetTokensPerSecond());
+			ResultObject->SetNumberField(TEXT("DecoderTokensPerSecond"), Result.GetDecoderTokensPerSecond());
+			ResultObject->SetNumberField(TEXT("PeakUsedPhysicalMB"), Result.PeakUsedPhysicalMB);
+			ResultObject->SetNumberField(TEXT("PeakMemoryDeltaMB"), Result.PeakMemoryDeltaMB);
+			ResultObject->SetNumberField(TEXT("PeakKVCacheMB"), Result.PeakKVCacheMB);
+
+			TSharedRef<FJsonObject> StagesObject = MakeShared<FJsonObject>();
+			StagesObject->SetNumberField(TEXT("MelMs"), Result.StageTimings.MelMs);
+			StagesObject->SetNumberField(TEXT("EncodeMs"), Result.StageTimings.EncodeMs);
+			StagesObject->SetNumberField(TEXT("DecodeMs"), Result.StageTimings.DecodeMs);
+			StagesObject->SetNumberField(TEXT("BatchDecodeMs"), Result.StageTimings.BatchDecodeMs);
+			StagesObject->SetNumberField(TEXT("PromptMs"), Result.StageTimings.PromptMs);
+			StagesObject->SetNumberField(TEXT("SampleMs"), Result.StageTimings.SampleMs);
+			StagesObject->SetNumberField(TEXT("SampleMsPerToken"), Result.GetSampleMsPerToken());
+			StagesObject->SetNumberField(TEXT("NumEncode"), Result.StageTimings.NumEncode);
+			StagesObject->SetNumberField(TEXT("NumDecode"), Result.StageTimings.NumDecode);
+			StagesObject->SetNumberField(TEXT("NumBatchDecode"), Result.StageTimings.NumBatchDecode);
+			StagesObject->SetNumberField(TEXT("NumPrompt"), Result.StageTimings.NumPrompt);
+			StagesObject->SetNumberField(TEXT("NumSample"), Result.StageTimings.NumSample);
+			StagesObject->SetNumberField(TEXT("NumFallbacksLogProb"), Result.StageTimings.NumFallbacksLogProb);
+			StagesObject->SetNumberField(TEXT("NumFallbacksEntropy"), Result.StageTimings.NumFallbacksEntropy);
+			StagesObject->SetNumberField(TEXT("NumAllocations"), Result.StageTimings.NumAllocations);
+			StagesObject->SetNumberField(TEXT("NumFrameCriticalChunks"), Result.StageTimings.NumFrameCriticalChunks);
+			StagesObject->SetNumberField(TEXT("NumThrottledGraphs"), Result.StageTimings.NumThrottledGraphs);
+			StagesObject->SetNumberField(TEXT("YieldMs"), Result.StageTimings.YieldMs);
+			ResultObject->SetObjectField(TEXT("Stages"), StagesObject);
+
+			ResultObject->SetStringField(TEXT("Transcript"), Result.Transcript);
+
+			TArray<TSharedPtr<FJsonValue>> ClipTranscriptValues;
+			for (const FString& ClipTranscript : Result.ClipTranscripts)
+			{
+				ClipTranscriptValues.Add(MakeShared<FJsonValueString>(ClipTranscript));
+			}
+			ResultObject->SetArrayField(TEXT("ClipTranscripts"), ClipTranscriptValues);
+
+			if (Result.WordErrorRate >= 0)
+			{
+				ResultObject->SetNumberField(TEXT("WordErrorRate"), Result.WordErrorRate);
+			}
+			ResultValues.Add(MakeShared<FJsonValueObject>(ResultObject));
+		}
+		RootObject->SetArrayField(TEXT("Results"), ResultValues);
+
+		TSharedRef<TJsonWriter<>> JsonWriter = TJsonWriterFactory<>::Create(&Output);
+		if (!FJsonSerializer::Serialize(RootObject, JsonWriter))
+		{
+			return false;
+		}
+	}
+
+	return FFileHelper::SaveStringToFile(Output, *OutputPath);
+}
+
+double USpeechRecognizerBenchmarkCommandlet::ComputeWordErrorRate(const TArray<FString>& ReferenceTranscripts, const TArray<FString>& Transcripts)
+{
+	auto SplitIntoWords = [](const FString& Text)
+	{
+		TArray<FString> Words;
+		Text.ToLower().ParseIntoArrayWS(Words);
+		for (FString& Word : Words)
+		{
+			while (Word.Len() > 0 && FChar::IsPunct(Word[0]))
+			{
+				Word.RemoveAt(0);
+			}
+			while (Word.Len() > 0 && FChar::IsPunct(Word[Word.Len() - 1]))
+			{
+				Word.RemoveAt(Word.Len() - 1);
+			}
+		}
+		Words.RemoveAll([](const FString& Word) { return Word.IsEmpty(); });
+		return Words;
+	};
+
+	int32 NumOfEdits = 0;
+	int32 NumOfReferenceWords = 0;
+	for (int32 ClipIndex = 0; ClipIndex < FMath::Max(ReferenceTranscripts.Num(), Transcripts.Num()); ++ClipIndex)
+	{
+		const TArray<FString> ReferenceWords = ReferenceTranscripts.IsValidIndex(ClipIndex) ? SplitIntoWords(ReferenceTranscripts[ClipIndex]) : TArray<FString>();
+		const TArray<FString> Words = Transcripts.IsValidIndex(ClipIndex) ? SplitIntoWords(Transcripts[ClipIndex]) : TArray<FString>();
+
+		// Levenshtein distance over the words, keeping only the previous row of the table
+		TArray<int32> PreviousRow;
+		TArray<int32> CurrentRow;
+		PreviousRow.SetNumUninitialized(Words.Num() + 1);
+		CurrentRow.SetNumUninitialized(Words.Num() + 1);
+		for (int32 WordIndex = 0; WordIndex <= Words.Num(); ++WordIndex)
+		{
+			PreviousRow[WordIndex] = WordIndex;
+		}
+		for (int32 ReferenceIndex = 1; ReferenceIndex <= ReferenceWords.Num(); ++ReferenceIndex)
+		{
+			CurrentRow[0] = ReferenceIndex;
+			for (int32 WordIndex = 1; WordIndex <= Words.Num(); ++WordIndex)
+			{
+				const int32 SubstitutionCost = ReferenceWords[ReferenceIndex - 1] == Words[WordIndex - 1] ? 0 : 1;
+				CurrentRow[WordIndex] = FMath::Min3(PreviousRow[WordIndex - 1] + SubstitutionCost, PreviousRow[WordIndex] + 1, CurrentRow[WordIndex - 1] + 1);
+			}
+			Swap(PreviousRow, CurrentRow);
+		}
+
+		NumOfEdits += PreviousRow[Words.Num()];
+		NumOfReferenceWords += ReferenceWords.Num();
+	}
+
+	// Any word recognized where the reference has none is an error
+	return NumOfReferenceWords > 0 ? static_cast<double>(NumOfEdits) / NumOfReferenceWords : (NumOfEdits > 0 ? 1.0 : 0.0);
+}
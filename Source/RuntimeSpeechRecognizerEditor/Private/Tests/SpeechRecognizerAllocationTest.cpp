@@ -0,0 +1,64 @@
+﻿// Georgy Treshchev 2024.
+
+#include "SpeechRecognizerTestUtils.h"
+#include "Misc/AutomationTest.h"
+#include <atomic>
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpeechRecognizerSteadyStateAllocationTest, "RuntimeSpeechRecognizer.Allocations.SteadyStateStreaming", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSpeechRecognizerSteadyStateAllocationTest::RunTest(const FString& Parameters)
+{
+	const TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe> ModelData = SpeechRecognizerTests::LoadInstalledModel();
+	if (!ModelData.IsValid())
+	{
+		AddWarning(TEXT("Skipping the test since the language model selected in the project settings is not downloaded"));
+		return true;
+	}
+
+	FSpeechRecognizerThread::EnableAllocationCounting();
+
+	TSharedPtr<FSpeechRecognizerThread> Recognizer = MakeShared<FSpeechRecognizerThread>();
+	const FSpeechRecognitionParameters RecognitionParameters = FSpeechRecognitionParameters::GetStreamingDefaults();
+	if (!TestTrue(TEXT("Set the streaming parameters"), Recognizer->SetRecognitionParameters(RecognitionParameters))
+		|| !TestTrue(TEXT("Start the recognizer"), SpeechRecognizerTests::StartRecognizer(Recognizer, ModelData)))
+	{
+		return false;
+	}
+
+	std::atomic<int32> NumOfFinished{0};
+	Recognizer->OnRecognitionFinished.AddLambda([&NumOfFinished]()
+	{
+		++NumOfFinished;
+	});
+
+	// Every chunk has the size of a streaming step, the same way it would be captured from a microphone
+	const float ChunkSeconds = RecognitionParameters.StepSizeMs * 1e-3f;
+	auto RecognizeChunk = [this, &Recognizer, &NumOfFinished, ChunkSeconds]()
+	{
+		const int32 ExpectedNumOfFinished = NumOfFinished + 1;
+		Recognizer->ProcessPCMData(SpeechRecognizerTests::MakeToneAudio(ChunkSeconds), SpeechRecognizerTests::SampleRate, 1, true);
+		return TestTrue(TEXT("Recognize the chunk"), SpeechRecognizerTests::WaitUntil([&NumOfFinished, ExpectedNumOfFinished]() { return NumOfFinished >= ExpectedNumOfFinished; }));
+	};
+
+	// The buffers of the recognition grow to the size of the chunk during the warm-up, so that the measured chunks are the steady state
+	bool bSucceeded = RecognizeChunk();
+	Recognizer->ResetStageTimings();
+
+	constexpr int32 NumOfChunks = 8;
+	for (int32 ChunkIndex = 0; ChunkIndex < NumOfChunks && bSucceeded; ++ChunkIndex)
+	{
+		bSucceeded = RecognizeChunk();
+	}
+
+	if (bSucceeded)
+	{
+		TestEqual(TEXT("Steady-state allocations"), Recognizer->GetStageTimings().NumAllocations, 0);
+	}
+
+	SpeechRecognizerTests::StopRecognizer(Recognizer);
+	return bSucceeded;
+}
+
+#endif
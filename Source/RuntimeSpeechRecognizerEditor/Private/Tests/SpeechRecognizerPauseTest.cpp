@@ -0,0 +1,74 @@
+﻿// Georgy Treshchev 2024.
+
+#include "SpeechRecognizerTestUtils.h"
+#include "Misc/AutomationTest.h"
+#include "Async/Async.h"
+#include <atomic>
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FSpeechRecognizerPauseTest, "RuntimeSpeechRecognizer.Pause.KeepsQueuedAudio", EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+bool FSpeechRecognizerPauseTest::RunTest(const FString& Parameters)
+{
+	const TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe> ModelData = SpeechRecognizerTests::LoadInstalledModel();
+	if (!ModelData.IsValid())
+	{
+		AddWarning(TEXT("Skipping the test since the language model selected in the project settings is not downloaded"));
+		return true;
+	}
+
+	TSharedPtr<FSpeechRecognizerThread> Recognizer = MakeShared<FSpeechRecognizerThread>();
+	if (!TestTrue(TEXT("Start the recognizer"), SpeechRecognizerTests::StartRecognizer(Recognizer, ModelData)))
+	{
+		return false;
+	}
+
+	std::atomic<int32> NumOfFinished{0};
+	Recognizer->OnRecognitionFinished.AddLambda([&NumOfFinished]()
+	{
+		++NumOfFinished;
+	});
+
+	// Each chunk is submitted as the last data, so that it is enqueued on its own
+	// The audio is submitted off the game thread, so that it is enqueued synchronously rather than by a background task that could run after pausing
+	constexpr int32 NumOfChunks = 4;
+	const int32 NumOfProcessedChunksAtStart = Recognizer->GetMetrics().NumOfProcessedChunks;
+	Async(EAsyncExecution::ThreadPool, [&Recognizer]()
+	{
+		for (int32 ChunkIndex = 0; ChunkIndex < NumOfChunks; ++ChunkIndex)
+		{
+			Recognizer->ProcessPCMData(SpeechRecognizerTests::MakeToneAudio(2.f), SpeechRecognizerTests::SampleRate, 1, true);
+		}
+	}).Wait();
+	Recognizer->Pause();
+
+	// At most the chunk that was being recognized when pausing is finished, while the rest of the queue is kept
+	const int32 NumOfQueuedChunksAtPause = Recognizer->GetMetrics().NumOfQueuedChunks;
+	if (NumOfQueuedChunksAtPause == 0)
+	{
+		AddWarning(TEXT("Skipping the pause checks since the queue was drained before pausing"));
+	}
+	else
+	{
+		SpeechRecognizerTests::WaitUntil([]() { return false; }, 3);
+
+		const FSpeechRecognizerMetrics PausedMetrics = Recognizer->GetMetrics();
+		TestEqual(TEXT("Queued chunks while paused"), PausedMetrics.NumOfQueuedChunks, NumOfQueuedChunksAtPause);
+		TestTrue(TEXT("Processed chunks while paused"), PausedMetrics.NumOfProcessedChunks - NumOfProcessedChunksAtStart <= NumOfChunks - NumOfQueuedChunksAtPause);
+		TestEqual(TEXT("Recognition finished while paused"), NumOfFinished.load(), 0);
+	}
+
+	// Once resumed, the kept audio is recognized
+	Recognizer->Resume();
+	TestTrue(TEXT("Recognition finished after resuming"), SpeechRecognizerTests::WaitUntil([&NumOfFinished]() { return NumOfFinished > 0; }));
+
+	const FSpeechRecognizerMetrics ResumedMetrics = Recognizer->GetMetrics();
+	TestEqual(TEXT("Queued chunks after resuming"), ResumedMetrics.NumOfQueuedChunks, 0);
+	TestEqual(TEXT("Processed chunks after resuming"), ResumedMetrics.NumOfProcessedChunks - NumOfProcessedChunksAtStart, NumOfChunks);
+
+	SpeechRecognizerTests::StopRecognizer(Recognizer);
+	return true;
+}
+
+#endif
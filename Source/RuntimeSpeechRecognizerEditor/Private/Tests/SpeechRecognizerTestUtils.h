@@ -0,0 +1,129 @@
+﻿// Georgy Treshchev 2024.
+
+#pragma once
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+#include "CoreMinimal.h"
+#include "SpeechRecognizerThread.h"
+#include "SpeechRecognizerSettings.h"
+#include "RuntimeSpeechRecognizerEditor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/PlatformFileManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Modules/ModuleManager.h"
+
+namespace SpeechRecognizerTests
+{
+	/** Maximum time to wait for the recognizer in the tests, in seconds */
+	constexpr double TimeoutSeconds = 120;
+
+	/** Sample rate of the generated audio, matching the one whisper expects so that no resampling is involved */
+	constexpr int32 SampleRate = 16000;
+
+	/**
+	 * Loads the language model selected in the project settings, if it is downloaded
+	 *
+	 * @return The language model data, or nullptr if the language model is not downloaded
+	 */
+	inline TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe> LoadInstalledModel()
+	{
+		const USpeechRecognizerSettings* SpeechRecognizerSettings = GetDefault<USpeechRecognizerSettings>();
+		if (!SpeechRecognizerSettings)
+		{
+			return nullptr;
+		}
+
+		const FRuntimeSpeechRecognizerEditorModule& EditorModule = FModuleManager::LoadModuleChecked<FRuntimeSpeechRecognizerEditorModule>(TEXT("RuntimeSpeechRecognizerEditor"));
+		const FString FilePath = FPaths::ConvertRelativePathToFull(EditorModule.GetEditorLMFilePath(SpeechRecognizerSettings->ModelSize, SpeechRecognizerSettings->ModelLanguage));
+		if (!FPlatformFileManager::Get().GetPlatformFile().FileExists(*FilePath))
+		{
+			return nullptr;
+		}
+
+		TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe> ModelData = MakeShared<TArray64<uint8>, ESPMode::ThreadSafe>();
+		if (!FFileHelper::LoadFileToArray(*ModelData, *FilePath))
+		{
+			return nullptr;
+		}
+		return ModelData;
+	}
+
+	/**
+	 * Waits until the predicate is satisfied, processing the game thread tasks meanwhile so that the delegates of the recognizer are broadcast
+	 *
+	 * @param Predicate The condition to wait for
+	 * @param WaitSeconds The maximum time to wait, in seconds
+	 * @return True if the predicate was satisfied, false if timed out
+	 */
+	inline bool WaitUntil(TFunctionRef<bool()> Predicate, double WaitSeconds = TimeoutSeconds)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		while (!Predicate())
+		{
+			if (FPlatformTime::Seconds() - StartTime > WaitSeconds)
+			{
+				return false;
+			}
+
+			FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+			FPlatformProcess::Sleep(0.001f);
+		}
+		return true;
+	}
+
+	/**
+	 * Generates a mono tone
+	 *
+	 * @param DurationSeconds The duration of the tone, in seconds
+	 * @return The PCM data of the tone
+	 */
+	inline Audio::FAlignedFloatBuffer MakeToneAudio(float DurationSeconds)
+	{
+		const int32 NumOfSamples = static_cast<int32>(DurationSeconds * SampleRate);
+		Audio::FAlignedFloatBuffer PCMData;
+		PCMData.SetNumUninitialized(NumOfSamples);
+		for (int32 SampleIndex = 0; SampleIndex < NumOfSamples; ++SampleIndex)
+		{
+			PCMData[SampleIndex] = 0.1f * FMath::Sin(2.f * PI * 440.f * SampleIndex / SampleRate);
+		}
+		return PCMData;
+	}
+
+	/**
+	 * Starts the recognizer with the given language model data and waits until it is running
+	 *
+	 * @param Recognizer The recognizer to start
+	 * @param ModelData The language model data
+	 * @return True if the recognizer was started, false otherwise
+	 */
+	inline bool StartRecognizer(const TSharedPtr<FSpeechRecognizerThread>& Recognizer, const TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe>& ModelData)
+	{
+		if (!Recognizer->SetLanguageModelDataOverride(ModelData))
+		{
+			return false;
+		}
+
+		TFuture<bool> StartFuture = Recognizer->StartThread();
+		return WaitUntil([&StartFuture]() { return StartFuture.IsReady(); }) && StartFuture.Get();
+	}
+
+	/**
+	 * Stops the recognizer and makes sure no delegates are broadcast after returning
+	 *
+	 * @param Recognizer The recognizer to stop
+	 */
+	inline void StopRecognizer(const TSharedPtr<FSpeechRecognizerThread>& Recognizer)
+	{
+		Recognizer->StopThread();
+		WaitUntil([&Recognizer]() { return Recognizer->GetIsStopped() && !Recognizer->GetIsStopping(); });
+
+		Recognizer->OnRecognitionFinished.Clear();
+		Recognizer->OnRecognizedTextSegment.Clear();
+		FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+	}
+}
+
+#endif
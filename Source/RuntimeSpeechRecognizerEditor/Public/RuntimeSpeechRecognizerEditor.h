@@ -14,6 +14,9 @@ enum class ESpeechRecognizerModelSize : uint8;
 
 class FRuntimeSpeechRecognizerEditorModule : public IModuleInterface
 {
+	/** The benchmark commandlet needs access to the local cache of the language models */
+	friend class USpeechRecognizerBenchmarkCommandlet;
+
 public:
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
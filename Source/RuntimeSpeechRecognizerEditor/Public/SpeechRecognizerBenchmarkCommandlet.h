@@ -0,0 +1,210 @@
+﻿// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SpeechRecognizerTypes.h"
+#include "SpeechRecognizerThread.h"
+#include "SpeechRecognizerBenchmarkCommandlet.generated.h"
+
+/**
+ * Commandlet that measures the end-to-end real-time factor of the speech recognizer on the current machine
+ * Runs a fixed corpus of WAV files through every installed language model across the given thread counts and parameter presets,
+ * and writes the results (real-time factor, per-stage timings, tokens per second, peak memory) in a machine-readable format
+ *
+ * Usage: UnrealEditor-Cmd.exe <Project> -run=SpeechRecognizerBenchmark -Corpus=<WavFileOrDirectory> [-Models=Tiny,Base_Q5_1] [-Threads=1,2,4] [-Presets=NonStreaming,Streaming,KVCacheDefault,KVCacheQ8_0,Beam1,Beam2,Beam5,Sampling] [-Iterations=1] [-Output=<Path.json|Path.csv>] [-Timeout=600] [-CountAllocations] [-MaxKVCacheWER=0.05]
+ * With -CountAllocations, the corpus is recognized once more before the measured pass, and a run fails if the measured (steady-state) recognition allocates on the heap
+ * The transcripts of the KVCacheQ8_0 preset are compared with the ones of the KVCacheDefault preset (run as well if not requested) for the same model, clip, thread count and iteration,
+ * and a run fails if its word error rate against them is above -MaxKVCacheWER
+ * Installed language models are the ones present in the local cache of the plugin (downloaded at least once from the project settings)
+ */
+UCLASS()
+class RUNTIMESPEECHRECOGNIZEREDITOR_API USpeechRecognizerBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	USpeechRecognizerBenchmarkCommandlet();
+
+	//~ Begin UCommandlet Interface
+	virtual int32 Main(const FString& Params) override;
+	//~ End UCommandlet Interface
+
+private:
+	/**
+	 * Audio clip of the benchmark corpus
+	 */
+	struct FCorpusClip
+	{
+		/** Name of the clip (file name) */
+		FString Name;
+
+		/** PCM audio data in 32-bit floating point interleaved format */
+		Audio::FAlignedFloatBuffer PCMData;
+
+		/** The sample rate of the audio data */
+		float SampleRate = 0;
+
+		/** The number of channels in the audio data */
+		uint32 NumOfChannels = 0;
+
+		/** Returns the duration of the clip, in seconds */
+		double GetDuration() const
+		{
+			return SampleRate > 0 && NumOfChannels > 0 ? static_cast<double>(PCMData.Num()) / NumOfChannels / SampleRate : 0;
+		}
+	};
+
+	/**
+	 * Installed language model to benchmark
+	 */
+	struct FBenchmarkModel
+	{
+		/** The size of the language model */
+		ESpeechRecognizerModelSize ModelSize;
+
+		/** The language of the language model */
+		ESpeechRecognizerModelLanguage ModelLanguage;
+
+		/** Full path to the language model file */
+		FString FilePath;
+	};
+
+	/**
+	 * Named set of recognition parameters to benchmark
+	 */
+	struct FBenchmarkPreset
+	{
+		/** Name of the preset */
+		FString Name;
+
+		/** The recognition parameters used by the preset */
+		FSpeechRecognitionParameters Parameters;
+
+		/** Whether to split the clips into chunks of the step size (simulating streaming) instead of processing each clip at once */
+		bool bSplitIntoSteps = false;
+
+		/** Storage type of the attention KV caches used by the preset. The one from the project settings is used if not set */
+		TOptional<ESpeechRecognizerKVCacheType> KVCacheType;
+	};
+
+	/**
+	 * Result of a single benchmark run (model, preset, thread count, iteration)
+	 */
+	struct FBenchmarkResult
+	{
+		FString ModelName;
+		FString ModelFileName;
+		FString PresetName;
+		int32 NumOfThreads = 0;
+		int32 Iteration = 0;
+		bool bSucceeded = false;
+		double LoadSeconds = 0;
+		double AudioSeconds = 0;
+		double ProcessingSeconds = 0;
+		double MaxChunkLatencySeconds = 0;
+		int32 NumOfChunks = 0;
+		double PeakUsedPhysicalMB = 0;
+		double PeakMemoryDeltaMB = 0;
+		double PeakKVCacheMB = 0;
+		FSpeechRecognizerStageTimings StageTimings;
+		FString Transcript;
+
+		/** The transcript of every clip of the corpus, in the order of the corpus */
+		TArray<FString> ClipTranscripts;
+
+		/** Word error rate of the transcripts against the ones of the reference preset (e.g. KVCacheQ8_0 against KVCacheDefault), from 0. Negative if not compared */
+		double WordErrorRate = -1;
+
+		/** Returns the real-time factor (processing time divided by audio duration). Lower is faster, below 1 is faster than real time */
+		double GetRealTimeFactor() const
+		{
+			return AudioSeconds > 0 ? ProcessingSeconds / AudioSeconds : 0;
+		}
+
+		/** Returns the number of generated tokens per second of wall time */
+		double GetTokensPerSecond() const
+		{
+			return ProcessingSeconds > 0 ? StageTimings.GetNumDecodedTokens() / ProcessingSeconds : 0;
+		}
+
+		/** Returns the number of generated tokens per second of decoder time */
+		double GetDecoderTokensPerSecond() const
+		{
+			const double DecoderSeconds = (StageTimings.DecodeMs + StageTimings.BatchDecodeMs) * 1e-3;
+			return DecoderSeconds > 0 ? StageTimings.GetNumDecodedTokens() / DecoderSeconds : 0;
+		}
+
+		/** Returns the sampling time per sampled token, in milliseconds (every beam or best-of candidate samples its own token) */
+		double GetSampleMsPerToken() const
+		{
+			return StageTimings.NumSample > 0 ? StageTimings.SampleMs / StageTimings.NumSample : 0;
+		}
+	};
+
+	/**
+	 * Loads the benchmark corpus from a WAV file or from all WAV files in a directory
+	 *
+	 * @param CorpusPath Path to a WAV file or a directory containing WAV files
+	 * @param OutCorpus The loaded clips, sorted by name
+	 * @return True if at least one clip was loaded, false otherwise
+	 */
+	static bool LoadCorpus(const FString& CorpusPath, TArray<FCorpusClip>& OutCorpus);
+
+	/**
+	 * Finds the installed language models matching the given filter
+	 *
+	 * @param ModelsFilter Comma-separated list of model size names (e.g. "Tiny,Base_Q5_1"). All installed models are used if empty
+	 * @return The installed language models
+	 */
+	static TArray<FBenchmarkModel> FindInstalledModels(const FString& ModelsFilter);
+
+	/**
+	 * Runs a single benchmark configuration
+	 *
+	 * @param ModelData The language model data
+	 * @param Preset The parameter preset to use
+	 * @param NumOfThreads The number of threads to use
+	 * @param Corpus The corpus to recognize
+	 * @param OutResult The result of the run
+	 */
+	void RunConfiguration(const TSharedPtr<TArray64<uint8>, ESPMode::ThreadSafe>& ModelData, const FBenchmarkPreset& Preset, int32 NumOfThreads, const TArray<FCorpusClip>& Corpus, FBenchmarkResult& OutResult) const;
+
+	/**
+	 * Pumps the game thread tasks until the predicate is satisfied or the timeout is reached
+	 *
+	 * @param Predicate The condition to wait for
+	 * @param OnTick Called on every iteration of the wait loop
+	 * @return True if the predicate was satisfied, false if the timeout was reached
+	 */
+	bool WaitUntil(TFunctionRef<bool()> Predicate, TFunctionRef<void()> OnTick) const;
+
+	/**
+	 * Writes the benchmark results to a file. The format is determined by the extension (.csv or .json)
+	 *
+	 * @param OutputPath The path to write the results to
+	 * @param Results The benchmark results
+	 * @return True if the results were written successfully, false otherwise
+	 */
+	static bool WriteResults(const FString& OutputPath, const TArray<FBenchmarkResult>& Results);
+
+	/**
+	 * Computes the word error rate of the transcripts against the reference ones, clip by clip
+	 * The words are compared case-insensitively and without the surrounding punctuation
+	 *
+	 * @param ReferenceTranscripts The reference transcript of every clip
+	 * @param Transcripts The transcript of every clip to compare
+	 * @return The number of substituted, deleted and inserted words divided by the number of reference words
+	 */
+	static double ComputeWordErrorRate(const TArray<FString>& ReferenceTranscripts, const TArray<FString>& Transcripts);
+
+	/** Maximum time to wait for a single operation (thread start, chunk recognition, thread stop), in seconds */
+	double TimeoutSeconds;
+
+	/** Whether the heap allocations of the recognition are counted, and the runs whose steady state allocates are failed */
+	bool bCountAllocations;
+
+	/** Maximum word error rate of the quantized KV cache transcripts against the default KV cache ones, above which the run fails */
+	double MaxKVCacheWordErrorRate;
+};
@@ -21,6 +21,7 @@ public class RuntimeSpeechRecognizerEditor : ModuleRules
 				"Projects",
 				"EditorScriptingUtilities",
 				"HTTP",
+				"Json",
 				"EditorStyle"
 			}
 		);
@@ -621,6 +621,7 @@ extern "C" {
 
     // Scheduling priorities
     enum ggml_sched_priority {
+        GGML_SCHED_PRIO_LOW = -1,
         GGML_SCHED_PRIO_NORMAL,
         GGML_SCHED_PRIO_MEDIUM,
         GGML_SCHED_PRIO_HIGH,
@@ -2111,6 +2112,13 @@ extern "C" {
                     struct ggml_threadpool * threadpool /* = NULL */ );
     GGML_API enum ggml_status  ggml_graph_compute(struct ggml_cgraph * cgraph, struct ggml_cplan * cplan);
 
+    // optional per-node profiling of the CPU compute path
+    // the callback is called on the main compute thread after each node has been computed by all threads
+    // it is set per calling thread, so only graphs computed from the thread that set it are profiled (NULL to disable)
+    typedef void (*ggml_graph_profile_callback)(const struct ggml_cgraph * cgraph, int node_index, int n_threads, int64_t t_start_us, int64_t t_end_us, void * user_data);
+
+    GGML_API void ggml_graph_set_profile_callback(ggml_graph_profile_callback callback, void * user_data);
+
     // same as ggml_graph_compute() but the work data is allocated as a part of the context
     // note: the drawback of this API is that you must have ensured that the context has enough memory for the work data
     GGML_API enum ggml_status  ggml_graph_compute_with_ctx(struct ggml_context * ctx, struct ggml_cgraph * cgraph, int n_threads);
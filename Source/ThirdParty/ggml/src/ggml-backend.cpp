@@ -654,6 +654,14 @@ ggml_backend_t ggml_backend_init_best(void) {
 
 static const size_t TENSOR_ALIGNMENT = 32; // required for mmap as gguf only guarantees 32-byte alignment
 
+// allocation hooks for the host application, used for the memory of the CPU buffers (weights, KV caches, compute buffers)
+#ifndef GGML_CPU_BUFFER_MALLOC
+#define GGML_CPU_BUFFER_MALLOC(size) malloc(size)
+#endif
+#ifndef GGML_CPU_BUFFER_FREE
+#define GGML_CPU_BUFFER_FREE(ptr) free(ptr)
+#endif
+
 static const char * ggml_backend_cpu_buffer_get_name(ggml_backend_buffer_t buffer) {
     return "CPU";
 
@@ -672,7 +680,7 @@ static void * ggml_backend_cpu_buffer_get_base(ggml_backend_buffer_t buffer) {
 }
 
 static void ggml_backend_cpu_buffer_free_buffer(ggml_backend_buffer_t buffer) {
-    free(buffer->context);
+    GGML_CPU_BUFFER_FREE(buffer->context);
 }
 
 static void ggml_backend_cpu_buffer_memset_tensor(ggml_backend_buffer_t buffer, struct ggml_tensor * tensor, uint8_t value, size_t offset, size_t size) {
@@ -741,7 +749,7 @@ static const char * ggml_backend_cpu_buffer_type_get_name(ggml_backend_buffer_ty
 
 static ggml_backend_buffer_t ggml_backend_cpu_buffer_type_alloc_buffer(ggml_backend_buffer_type_t buft, size_t size) {
     size += TENSOR_ALIGNMENT;   // malloc may return an address that is not aligned
-    void * data = malloc(size); // TODO: use GGML_ALIGNED_MALLOC (move to ggml-impl.h)
+    void * data = GGML_CPU_BUFFER_MALLOC(size); // TODO: use GGML_ALIGNED_MALLOC (move to ggml-impl.h)
     if (data == NULL) {
         fprintf(stderr, "%s: failed to allocate buffer of size %zu\n", __func__, size);
         return NULL;
@@ -377,6 +377,11 @@ void ggml_log_callback_default(enum ggml_log_level level, const char * text, voi
 #define GGML_PRINT_DEBUG_10(...)
 #endif
 
+// hook for the host application, called on each compute worker thread when it starts (e.g. to name it for profilers)
+#ifndef GGML_WORKER_THREAD_STARTED
+#define GGML_WORKER_THREAD_STARTED(ith)
+#endif
+
 //
 // end of logging block
 //
@@ -19430,6 +19435,13 @@ static int ggml_get_n_tasks(struct ggml_tensor * node, int n_threads) {
 
 static thread_ret_t ggml_graph_compute_secondary_thread(void* data);
 
+// scheduling policy used for GGML_SCHED_PRIO_LOW (SCHED_BATCH is only available on Linux)
+#if defined(SCHED_BATCH)
+#define GGML_SCHED_POLICY_LOW SCHED_BATCH
+#else
+#define GGML_SCHED_POLICY_LOW SCHED_OTHER
+#endif
+
 #if defined(_WIN32)
 #include "windows.h"
 
@@ -19473,6 +19485,7 @@ static bool ggml_thread_apply_priority(int32_t prio) {
     // This is up to the applications.
     DWORD p = THREAD_PRIORITY_NORMAL;
     switch (prio) {
+        case GGML_SCHED_PRIO_LOW:      p = THREAD_PRIORITY_BELOW_NORMAL;  break;
         case GGML_SCHED_PRIO_NORMAL:   p = THREAD_PRIORITY_NORMAL;        break;
         case GGML_SCHED_PRIO_MEDIUM:   p = THREAD_PRIORITY_ABOVE_NORMAL;  break;
         case GGML_SCHED_PRIO_HIGH:     p = THREAD_PRIORITY_HIGHEST;       break;
@@ -19506,6 +19519,7 @@ static bool ggml_thread_apply_priority(int32_t prio) {
     struct sched_param p;
     int32_t policy = SCHED_OTHER;
     switch (prio) {
+        case GGML_SCHED_PRIO_LOW:      policy = GGML_SCHED_POLICY_LOW; p.sched_priority = 0; break;
         case GGML_SCHED_PRIO_NORMAL:   policy = SCHED_OTHER; p.sched_priority = 0;  break;
         case GGML_SCHED_PRIO_MEDIUM:   policy = SCHED_FIFO;  p.sched_priority = 40; break;
         case GGML_SCHED_PRIO_HIGH:     policy = SCHED_FIFO;  p.sched_priority = 80; break;
@@ -19562,6 +19576,7 @@ static bool ggml_thread_apply_priority(int32_t prio) {
     struct sched_param p;
     int32_t policy = SCHED_OTHER;
     switch (prio) {
+        case GGML_SCHED_PRIO_LOW:      policy = GGML_SCHED_POLICY_LOW; p.sched_priority = 0; break;
         case GGML_SCHED_PRIO_NORMAL:   policy = SCHED_OTHER; p.sched_priority = 0;  break;
         case GGML_SCHED_PRIO_MEDIUM:   policy = SCHED_FIFO;  p.sched_priority = 40; break;
         case GGML_SCHED_PRIO_HIGH:     policy = SCHED_FIFO;  p.sched_priority = 80; break;
@@ -19873,6 +19888,14 @@ struct ggml_cplan ggml_graph_plan(
     return cplan;
 }
 
+static thread_local ggml_graph_profile_callback g_graph_profile_callback           = NULL;
+static thread_local void *                      g_graph_profile_callback_user_data = NULL;
+
+void ggml_graph_set_profile_callback(ggml_graph_profile_callback callback, void * user_data) {
+    g_graph_profile_callback           = callback;
+    g_graph_profile_callback_user_data = user_data;
+}
+
 static thread_ret_t ggml_graph_compute_thread(void * data) {
     struct ggml_compute_state * state = (struct ggml_compute_state *) data;
     struct ggml_threadpool    * tp    = state->threadpool;
@@ -19880,6 +19903,9 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
     const struct ggml_cgraph * cgraph = tp->cgraph;
     const struct ggml_cplan  * cplan  = tp->cplan;
 
+    // only the main compute thread (the thread that called ggml_graph_compute) reports the node timings
+    const ggml_graph_profile_callback profile_callback = state->ith == 0 ? g_graph_profile_callback : NULL;
+
     set_numa_thread_affinity(state->ith);
 
     struct ggml_compute_params params = {
@@ -19893,6 +19919,8 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
     for (int node_n = 0; node_n < cgraph->n_nodes && !tp->abort; node_n++) {
         struct ggml_tensor * node = cgraph->nodes[node_n];
 
+        const int64_t t_node_start_us = profile_callback ? ggml_time_us() : 0;
+
         ggml_compute_forward(&params, node);
 
         if (state->ith == 0 && cplan->abort_callback &&
@@ -19902,6 +19930,10 @@ static thread_ret_t ggml_graph_compute_thread(void * data) {
         }
 
         ggml_barrier(state->threadpool);
+
+        if (profile_callback) {
+            profile_callback(cgraph, node_n, params.nth, t_node_start_us, ggml_time_us(), g_graph_profile_callback_user_data);
+        }
     }
 
     return 0;
@@ -19981,6 +20013,8 @@ static thread_ret_t ggml_graph_compute_secondary_thread(void* data) {
     struct ggml_compute_state * state = (struct ggml_compute_state *) data;
     struct ggml_threadpool * threadpool = state->threadpool;
 
+    GGML_WORKER_THREAD_STARTED(state->ith);
+
     ggml_thread_apply_priority(threadpool->prio);
     if (ggml_thread_cpumask_is_valid(state->cpumask)) {
         ggml_thread_apply_affinity(state->cpumask);
@@ -125,6 +125,15 @@ extern "C" {
         struct whisper_aheads dtw_aheads;
 
         size_t dtw_mem_size; // TODO: remove
+
+        // initial size of the KV caches of a new state (0 - size for the full model context)
+        // the caches are grown on demand when a later call needs a larger context
+        int kv_n_text_ctx;  // number of self-attention cells, for all the decoders
+        int kv_n_audio_ctx; // audio context of the cross-attention cache
+
+        // type of the KV caches (GGML_TYPE_COUNT - same as the model weights)
+        // block-quantized types (e.g. GGML_TYPE_Q8_0) are only read by the flash attention kernels and require flash_attn
+        enum ggml_type type_kv;
     };
 
     typedef struct whisper_token_data {
@@ -468,6 +477,9 @@ extern "C" {
         enum whisper_sampling_strategy strategy;
 
         int n_threads;
+        int n_threads_mel;      // number of threads for the log mel spectrogram (0 = n_threads)
+        int n_threads_encode;   // number of threads for the encoder and language detection (0 = n_threads)
+        int n_threads_decode;   // number of threads for the decoder and sampling (0 = n_threads)
         int n_max_text_ctx;     // max tokens to use from past text as prompt for the decoder
         int offset_ms;          // start offset in ms
         int duration_ms;        // audio duration to process in ms
@@ -525,7 +537,18 @@ extern "C" {
         float temperature_inc;
         float entropy_thold;    // similar to OpenAI's "compression_ratio_threshold"
         float logprob_thold;
-        float no_speech_thold;  // TODO: not implemented
+        float no_speech_thold;  // skip a window without decoding it if the probability of the no speech token after the first step is higher, 1.0f to disable
+                                // unlike the reference, the window is skipped before the average log probability of its text is known, so it is not also
+                                // required to be below logprob_thold and a higher threshold than the reference 0.6 is needed for the same amount of skipped speech
+
+        // number of fallback temperatures decoded together with the current one (greedy sampling only), 0 to decode them one after another
+        // the extra decoders share the prompt of the current one and are batched with it, up to WHISPER_MAX_DECODERS in total
+        int temperature_n_parallel;
+
+        // stop a decoder as soon as its last text tokens are the same n-gram of up to repetition_max_ngram tokens repeated repetition_n_repeats times in a row
+        // one copy of the n-gram is kept and the next window starts at the timestamp of the last kept token, instead of decoding the loop until the text context is full. 0 to disable
+        int repetition_max_ngram;
+        int repetition_n_repeats;
 
         struct {
             int best_of;    // ref: https://github.com/openai/whisper/blob/f82bc59f5ea234d4b97fb2860842ed38519f7e65/whisper/transcribe.py#L264
@@ -561,6 +584,12 @@ extern "C" {
         size_t                           n_grammar_rules;
         size_t                           i_start_rule;
         float                            grammar_penalty;
+
+        // text tokens the decoding is restricted to, e.g. the tokens that can spell the phrases of a grammar. No restriction if empty
+        // the decoder computes the logits of these tokens only (plus the end of text and the timestamp tokens), instead of projecting onto the whole vocabulary
+        // the language detection is not restricted
+        const whisper_token * allowed_tokens;
+        int                   n_allowed_tokens;
     };
 
     // NOTE: this function allocates memory, and it is the responsibility of the caller to free the pointer - see whisper_free_context_params & whisper_free_params()
@@ -572,6 +601,8 @@ extern "C" {
     // Run the entire model: PCM -> log mel spectrogram -> encoder -> decoder -> text
     // Not thread safe for same context
     // Uses the specified decoding strategy to obtain the text.
+    // With n_samples == 0, the log mel spectrogram of the previous call is reused, and so is the encoder output of its last window
+    // (e.g. to translate the audio that was just transcribed without encoding it again). Each task keeps its own text context.
     WHISPER_API int whisper_full(
                 struct whisper_context * ctx,
             struct whisper_full_params   params,
@@ -597,6 +628,29 @@ extern "C" {
                                    int   n_samples,
                                    int   n_processors);
 
+    // Command spotting: scores a fixed set of phrases against the audio instead of transcribing it
+    // The phrases are tokenized once into a prefix trie. Each call runs one encoder pass over the first window of the audio, then
+    // teacher-forces all the phrases in batched decoder passes over the trie, so the cost is bounded by the size of the trie
+    struct whisper_command_set;
+
+    // Returns nullptr if a phrase is too long. A space is prepended to the phrases that do not start with one,
+    // and the phrases should be written the way whisper transcribes them (e.g. with the same casing)
+    WHISPER_API struct whisper_command_set * whisper_command_set_init(struct whisper_context * ctx, const char ** phrases, int n_phrases);
+    WHISPER_API void whisper_command_set_free(struct whisper_command_set * commands);
+
+    // Fills logprobs[i] with the average log-probability per token of the i-th phrase followed by the end of text
+    // Uses the language, translate, thread counts, audio_ctx and abort callback of params. With n_samples == 0, the log mel spectrogram of the previous call is reused
+    // The command set holds the buffers of the scoring, so it must not be used by concurrent calls
+    // Returns the index of the most probable phrase, or a negative value on failure
+    WHISPER_API int whisper_command_set_score_with_state(
+                struct whisper_context * ctx,
+                  struct whisper_state * state,
+            struct whisper_command_set * commands,
+            struct whisper_full_params   params,
+                           const float * samples,
+                                   int   n_samples,
+                                 float * logprobs);
+
     // Number of generated text segments
     // A segment can be a few words, a sentence, or even a paragraph.
     WHISPER_API int whisper_full_n_segments           (struct whisper_context * ctx);
@@ -44,8 +44,10 @@
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
+#include <condition_variable>
 #include <fstream>
 #include <map>
+#include <mutex>
 #include <set>
 #include <string>
 #include <thread>
@@ -163,6 +165,27 @@ static void whisper_log_callback_default(ggml_log_level level, const char * text
 #define WHISPER_MAX_DECODERS 8
 #define WHISPER_MAX_NODES 4096
 
+// profiling hook for the host application, called at the start of each processing stage (Mel, Encode, Decode, Sample)
+#ifndef WHISPER_PROFILE_SCOPE
+#define WHISPER_PROFILE_SCOPE(stage)
+#endif
+
+// hook for the host application, called on each worker thread when it starts, the same one ggml calls for its compute threads
+#ifndef GGML_WORKER_THREAD_STARTED
+#define GGML_WORKER_THREAD_STARTED(ith)
+#endif
+
+// memory accounting hook for the host application, labels the allocations made in the scope (Weights, KVCache, Compute, Mel)
+#ifndef WHISPER_MEMORY_SCOPE
+#define WHISPER_MEMORY_SCOPE(category)
+#endif
+
+// scheduling hook for the host application, called before each graph is computed and returns the number of threads to compute it with
+// can be used to throttle or delay the inference while the application is busy
+#ifndef WHISPER_GRAPH_N_THREADS
+#define WHISPER_GRAPH_N_THREADS(n_threads) (n_threads)
+#endif
+
 //
 // ggml helpers
 //
@@ -190,6 +213,7 @@ static bool ggml_graph_compute_helper(
       ggml_backend_sched_t   sched,
         struct ggml_cgraph * graph,
                        int   n_threads) {
+    n_threads = WHISPER_GRAPH_N_THREADS(n_threads);
 
     for (int i = 0; i < ggml_backend_sched_get_n_backends(sched); ++i) {
         ggml_backend_t backend = ggml_backend_sched_get_backend(sched, i);
@@ -208,6 +232,40 @@ static bool ggml_graph_compute_helper(
     return t;
 }
 
+// makes the CPU backends compute on a thread pool with at least n_threads threads that persists across graphs
+// without it, ggml creates and destroys a thread pool (and its threads) for every graph, i.e. at every decoding step
+static bool whisper_threadpool_reserve(
+                   ggml_threadpool_t & threadpool,
+                             int32_t & threadpool_n_threads,
+   const std::vector<ggml_backend_t> & backends,
+                                 int   n_threads) {
+    if (threadpool && threadpool_n_threads >= n_threads) {
+        return true;
+    }
+
+    struct ggml_threadpool_params tpp = ggml_threadpool_params_default(n_threads);
+
+    ggml_threadpool_t threadpool_new = ggml_threadpool_new(&tpp);
+    if (!threadpool_new) {
+        return false;
+    }
+
+    for (auto & backend : backends) {
+        if (ggml_backend_is_cpu(backend)) {
+            ggml_backend_cpu_set_threadpool(backend, threadpool_new);
+        }
+    }
+
+    if (threadpool) {
+        ggml_threadpool_free(threadpool);
+    }
+
+    threadpool           = threadpool_new;
+    threadpool_n_threads = n_threads;
+
+    return true;
+}
+
 // faster matrix multiplications for tensors that do not have dimension 0 divisible by "pad"
 // the idea is to represent the original matrix multiplication:
 //
@@ -540,6 +598,8 @@ static size_t whisper_sched_size(struct whisper_sched & allocr) {
 
 // measure the memory usage of a graph and prepare the allocr's internal data buffer
 static bool whisper_sched_graph_init(struct whisper_sched & allocr, std::vector<ggml_backend_t> backends, std::function<struct ggml_cgraph *()> && get_graph) {
+    WHISPER_MEMORY_SCOPE(Compute);
+
     auto & sched = allocr.sched;
     auto & meta  = allocr.meta;
 
@@ -796,17 +856,128 @@ struct whisper_decoder {
     bool completed; // has the decoder completed the current segment?
     bool has_ts;    // have we already sampled a non-beg timestamp token for the current segment?
 
+    float temperature; // the decoding temperature of the current segment
+
     // new token probs, logits and logprobs after the last whisper_decode (1-dimensional array: [n_vocab])
     std::vector<float> probs;
     std::vector<float> logits;
     std::vector<float> logprobs;
 
-    // work container used to avoid memory allocations
+    // statistics of the probs gathered by whisper_process_logits, so that sampling does not need extra passes over the vocabulary
+    float         probs_sum;    // sum of all probs
+    float         probs_ts_sum; // sum of the timestamp token probs
+    float         probs_ts_max; // largest timestamp token prob
+    whisper_token probs_ts_id;  // timestamp token with the largest prob, -1 if all timestamp tokens are suppressed
+
+    // work containers used to avoid memory allocations
     std::vector<whisper_pair<double, whisper_vocab::id>> logits_id;
+    std::vector<whisper_token_data>                      tokens_topk;
 
     mutable std::mt19937 rng; // used for sampling at t > 0.0
 };
 
+// candidate continuation of a beam, see whisper_full_with_state
+struct whisper_beam_candidate {
+    int decoder_idx; // the parent beam
+
+    whisper_token_data token;
+
+    double sum_logprobs_all; // of the parent sequence extended with the token
+};
+
+// workers of the CPU stages that run outside of the ggml graphs (the mel spectrogram and the sampling)
+// the threads are created on first use and kept, instead of creating threads on every call
+struct whisper_worker_pool {
+    std::vector<std::thread> threads;
+
+    std::mutex              mutex;
+    std::condition_variable cv_start;
+    std::condition_variable cv_done;
+
+    // the current job, called with the index of the thread in [0, n_tasks)
+    void (*fn)(void * data, int ith) = nullptr;
+    void * data = nullptr;
+
+    int      n_tasks    = 0; // threads taking part in the current job, including the calling one
+    int      n_pending  = 0; // workers that have not finished the current job yet
+    uint64_t generation = 0; // incremented for every job
+    bool     stop       = false;
+
+    whisper_worker_pool() = default;
+    whisper_worker_pool(const whisper_worker_pool &) = delete;
+    whisper_worker_pool & operator=(const whisper_worker_pool &) = delete;
+
+    ~whisper_worker_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cv_start.notify_all();
+
+        for (auto & thread : threads) {
+            thread.join();
+        }
+    }
+
+    void worker(int ith, uint64_t generation_seen) {
+        GGML_WORKER_THREAD_STARTED(ith);
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            cv_start.wait(lock, [&] { return stop || generation != generation_seen; });
+            if (stop) {
+                return;
+            }
+            generation_seen = generation;
+
+            if (ith >= n_tasks) {
+                continue;
+            }
+
+            auto * fn_cur   = fn;
+            auto * data_cur = data;
+
+            lock.unlock();
+            fn_cur(data_cur, ith);
+            lock.lock();
+
+            if (--n_pending == 0) {
+                cv_done.notify_one();
+            }
+        }
+    }
+
+    // calls f(ith) for every ith in [0, n), with ith = 0 on the calling thread, and returns once all the calls are done
+    template <typename F>
+    void run(int n, F & f) {
+        if (n <= 1) {
+            f(0);
+            return;
+        }
+
+        // the jobs are only started from the thread that owns the state, so the generation can't change while the workers are created
+        while ((int) threads.size() < n - 1) {
+            threads.emplace_back(&whisper_worker_pool::worker, this, (int) threads.size() + 1, generation);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fn        = [](void * data, int ith) { (*(F *) data)(ith); };
+            data      = &f;
+            n_tasks   = n;
+            n_pending = n - 1;
+            ++generation;
+        }
+        cv_start.notify_all();
+
+        f(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        cv_done.wait(lock, [&] { return n_pending == 0; });
+    }
+};
+
 // [EXPERIMENTAL] Token-level timestamps with DTW
 struct whisper_aheads_masks {
     std::vector<struct ggml_tensor *> m;    // One mask per text layer.
@@ -829,6 +1000,8 @@ struct whisper_state {
     int32_t n_prompt = 0; // number of decoder calls with n_tokens >  1  (prompt encoding)
     int32_t n_fail_p = 0; // number of logprob threshold failures
     int32_t n_fail_h = 0; // number of entropy threshold failures
+    int32_t n_stop_r = 0; // number of decoders stopped by the repetition detector
+    int32_t n_skip_s = 0; // number of windows skipped by the no speech threshold
 
     // number of decoders for which we have constructed the KV cache
     int32_t kv_self_n_dec = 0;
@@ -849,6 +1022,10 @@ struct whisper_state {
 
     whisper_decoder decoders[WHISPER_MAX_DECODERS];
 
+    // beam search: the sequences and grammars of the parent beams, saved before the decoders are overwritten with the selected beams
+    whisper_sequence beam_sequences[WHISPER_MAX_DECODERS];
+    whisper_grammar  beam_grammars[WHISPER_MAX_DECODERS];
+
     std::vector<ggml_backend_t> backends;
 
     // - stores meta info about the intermediate tensors into the `meta` buffers
@@ -868,11 +1045,56 @@ struct whisper_state {
     // decode output (2-dimensional array: [n_tokens][n_vocab])
     std::vector<float> logits;
 
+    // sorted ids of the tokens the output head of whisper_full computes the logits of (see whisper_full_params::allowed_tokens)
+    std::vector<whisper_token> logits_ids;
+
+    // positions of the last text tokens of a sequence, used by the repetition detector
+    std::vector<int> repetition_pos;
+
     std::vector<whisper_segment> result_all;
     std::vector<whisper_token>   prompt_past;
+    std::vector<whisper_token>   prompt_past_translate; // text context of the translate task, kept apart so that both tasks can run over the same audio
+
+    // window of the current mel spectrogram whose encoder output is in the cross KV cache (-1 if none), and the audio context it was encoded with
+    int encoded_seek        = -1;
+    int encoded_n_audio_ctx = 0;
+
+    // per-call buffers of whisper_full, kept across calls so that a steady stream of calls does not allocate
+    std::vector<float>           temperatures;
+    std::vector<whisper_token>   prompt;
+    std::vector<whisper_token>   prompt_init;
+    std::vector<whisper_token>   prompt_kv;             // prompt whose KV cells were decoded last, and the logits of its last token
+    std::vector<float>           prompt_kv_logits;
+    float                        prompt_kv_no_speech_prob = 0.0f; // no speech probability at the sot position of the prompt, if requested
+    std::string                  initial_prompt;        // text the cached initial prompt tokens were tokenized from
+    std::vector<whisper_token>   initial_prompt_tokens;
+    std::string                  segment_text;
+    std::vector<whisper_segment> result_pool;           // segments of the previous call, recycled along with their storage
+
+    // candidates of the beam search, proposed by each decoder, merged and selected
+    std::vector<std::vector<whisper_beam_candidate>> beam_candidates_per_dec;
+    std::vector<whisper_beam_candidate>              beam_candidates;
+    std::vector<whisper_beam_candidate>              beam_selected;
+
+    // ids of the tokens suppressed with suppress_non_speech_tokens, collected on first use
+    std::vector<whisper_token> non_speech_token_ids;
+
+    // per-call buffers of the mel spectrogram
+    std::vector<float> mel_samples_padded;
+    std::vector<float> mel_fft_buf;
+
+    // thread pool of the CPU backends, kept across graphs instead of creating one for every graph
+    ggml_threadpool_t threadpool           = nullptr;
+    int32_t           threadpool_n_threads = 0;
+
+    // workers of the mel spectrogram and the sampling, which run outside of the ggml graphs
+    whisper_worker_pool workers;
 
     int lang_id = 0; // english by default
 
+    // probabilities of the languages computed by the last automatic language detection of whisper_full, indexed by language id
+    std::vector<float> lang_probs;
+
     std::string path_model; // populated by whisper_init_from_file_with_params()
 
 #ifdef WHISPER_USE_COREML
@@ -938,6 +1160,8 @@ static bool whisper_kv_cache_init(
                              int64_t   n_text_state,
                              int64_t   n_text_layer,
                                  int   n_ctx) {
+    WHISPER_MEMORY_SCOPE(KVCache);
+
     const int64_t n_mem      = n_text_layer*n_ctx;
     const int64_t n_elements = n_text_state*n_mem;
 
@@ -1100,6 +1324,35 @@ static void whisper_kv_cache_seq_cp(
     }
 }
 
+// keeps the cells of the first n_past positions for sequence 0 only, and frees all the other cells
+// returns false if some of the first n_past positions are not in the cache
+static bool whisper_kv_cache_keep_prefix(
+        struct whisper_kv_cache & cache,
+                    whisper_pos   n_past) {
+    whisper_pos n_kept = 0;
+
+    for (uint32_t i = 0; i < cache.size; ++i) {
+        auto & cell = cache.cells[i];
+
+        if (cell.pos < 0) {
+            continue;
+        }
+
+        cell.seq_id.clear();
+
+        if (cell.pos < n_past) {
+            cell.seq_id.insert(0);
+            n_kept++;
+        } else {
+            cell.pos = -1;
+        }
+    }
+
+    cache.head = 0;
+
+    return n_kept == n_past;
+}
+
 static uint32_t whisper_kv_cache_get_padding(const struct whisper_context & wctx) {
     if (!wctx.params.flash_attn || !wctx.params.use_gpu) {
         return 1u;
@@ -1120,6 +1373,27 @@ static uint32_t whisper_kv_cache_get_padding(const struct whisper_context & wctx
     return 1u;
 }
 
+// type of the KV caches: the requested one if the attention kernels can read it, otherwise the type of the model weights
+// the caches are viewed per attention head, so a block-quantized cache must store whole blocks per head and cell,
+// which only holds for the flash attention layout (the regular attention stores V transposed, one value per cell)
+static ggml_type whisper_kv_cache_type(const whisper_context & wctx) {
+    const ggml_type type = wctx.params.type_kv;
+
+    if (type == GGML_TYPE_COUNT || type == wctx.itype) {
+        return wctx.itype;
+    }
+
+    if (ggml_is_quantized(type)) {
+        const int64_t n_state_head = wctx.model.hparams.n_text_state/wctx.model.hparams.n_text_head;
+
+        if (!wctx.params.flash_attn || n_state_head % ggml_blck_size(type) != 0) {
+            return wctx.itype;
+        }
+    }
+
+    return type;
+}
+
 // [EXPERIMENTAL] Token-level timestamps with DTW
 static bool aheads_masks_init(
         const whisper_context_params & cparams,
@@ -1819,7 +2093,10 @@ static bool whisper_model_load(struct whisper_model_loader * loader, whisper_con
     }
 
     // allocate tensors in the backend buffers
-    model.buffer = ggml_backend_alloc_ctx_tensors_from_buft(model.ctx, whisper_default_buffer_type(wctx.params));
+    {
+        WHISPER_MEMORY_SCOPE(Weights);
+        model.buffer = ggml_backend_alloc_ctx_tensors_from_buft(model.ctx, whisper_default_buffer_type(wctx.params));
+    }
     if (!model.buffer) {
         WHISPER_LOG_ERROR("%s: failed to allocate memory for the model\n", __func__);
         return false;
@@ -2118,15 +2395,15 @@ static struct ggml_cgraph * whisper_build_graph_encoder(
                 struct ggml_tensor * K =
                     ggml_view_3d(ctx0, kv_pad.k,
                             n_state_head, n_ctx_pad, n_head,
-                            ggml_element_size(kv_pad.k)*n_state,
-                            ggml_element_size(kv_pad.k)*n_state_head,
+                            ggml_row_size(kv_pad.k->type, n_state),
+                            ggml_row_size(kv_pad.k->type, n_state_head),
                             0);
 
                 struct ggml_tensor * V =
                     ggml_view_3d(ctx0, kv_pad.v,
                             n_state_head, n_ctx_pad, n_head,
-                            ggml_element_size(kv_pad.v)*n_state,
-                            ggml_element_size(kv_pad.v)*n_state_head,
+                            ggml_row_size(kv_pad.v->type, n_state),
+                            ggml_row_size(kv_pad.v->type, n_state_head),
                             0);
 
                 cur = ggml_flash_attn_ext(ctx0, Q, K, V, nullptr, KQscale, 0.0f, 0.0f);
@@ -2292,10 +2569,10 @@ static struct ggml_cgraph * whisper_build_graph_cross(
 
         if (wctx.params.flash_attn) {
             k = ggml_view_1d(ctx0, wstate.kv_cross.k, n_state*n_ctx,
-                    (ggml_element_size(wstate.kv_cross.k)*n_state)*(il*n_ctx_pad));
+                    ggml_row_size(wstate.kv_cross.k->type, n_state)*(il*n_ctx_pad));
 
             v = ggml_view_1d(ctx0, wstate.kv_cross.v, n_state*n_ctx,
-                    (ggml_element_size(wstate.kv_cross.v)*n_state)*(il*n_ctx_pad));
+                    ggml_row_size(wstate.kv_cross.v->type, n_state)*(il*n_ctx_pad));
         } else {
             Vcross = ggml_transpose(ctx0, ggml_reshape_2d(ctx0, Vcross, n_state, n_ctx));
 
@@ -2328,6 +2605,8 @@ static struct ggml_cgraph * whisper_build_graph_cross(
 //   - n_threads:  number of threads to use
 //   - mel_offset: offset in the mel spectrogram (i.e. audio offset)
 //
+static bool whisper_kv_cross_reserve(whisper_context & wctx, whisper_state & wstate);
+
 static bool whisper_encode_internal(
         whisper_context & wctx,
           whisper_state & wstate,
@@ -2335,8 +2614,22 @@ static bool whisper_encode_internal(
               const int   n_threads,
     ggml_abort_callback   abort_callback,
                    void * abort_callback_data) {
+    WHISPER_PROFILE_SCOPE(Encode);
+    WHISPER_MEMORY_SCOPE(Compute);
+
     const int64_t t_start_us = ggml_time_us();
 
+    wstate.encoded_seek = -1;
+
+    // the KV caches are sized for the audio context used so far, grow them if this one is larger
+    if (!whisper_kv_cross_reserve(wctx, wstate)) {
+        return false;
+    }
+
+    if (!whisper_threadpool_reserve(wstate.threadpool, wstate.threadpool_n_threads, wstate.backends, n_threads)) {
+        return false;
+    }
+
     // conv
     {
         auto & sched = wstate.sched_conv.sched;
@@ -2423,6 +2716,9 @@ static bool whisper_encode_internal(
     wstate.t_encode_us += ggml_time_us() - t_start_us;
     wstate.n_encode++;
 
+    wstate.encoded_seek        = mel_offset;
+    wstate.encoded_n_audio_ctx = wstate.exp_n_audio_ctx;
+
     return !(abort_callback && abort_callback(abort_callback_data));
 }
 
@@ -2431,7 +2727,8 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
          whisper_state   & wstate,
      const whisper_batch & batch,
                     bool   save_alignment_heads_QKs,
-                    bool   worst_case) {
+                    bool   worst_case,
+    const std::vector<whisper_token> * logits_ids) {
     const auto & model   = wctx.model;
     const auto & hparams = model.hparams;
 
@@ -2542,10 +2839,10 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
 
                 if (wctx.params.flash_attn) {
                     k = ggml_view_1d(ctx0, kv_self.k, n_tokens*n_state,
-                            (ggml_element_size(kv_self.k)*n_state)*(il*n_ctx + kv_head));
+                            ggml_row_size(kv_self.k->type, n_state)*(il*n_ctx + kv_head));
 
                     v = ggml_view_1d(ctx0, kv_self.v, n_tokens*n_state,
-                            (ggml_element_size(kv_self.v)*n_state)*(il*n_ctx + kv_head));
+                            ggml_row_size(kv_self.v->type, n_state)*(il*n_ctx + kv_head));
                 } else {
                     Vcur = ggml_transpose(ctx0, ggml_reshape_2d(ctx0, Vcur, n_state, n_tokens));
 
@@ -2571,17 +2868,17 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
             struct ggml_tensor * K =
                 ggml_view_3d(ctx0, kv_self.k,
                         n_state_head, n_kv, n_head,
-                        ggml_element_size(kv_self.k)*n_state,
-                        ggml_element_size(kv_self.k)*n_state_head,
-                        ggml_element_size(kv_self.k)*n_state*n_ctx*il);
+                        ggml_row_size(kv_self.k->type, n_state),
+                        ggml_row_size(kv_self.k->type, n_state_head),
+                        ggml_row_size(kv_self.k->type, n_state)*n_ctx*il);
 
             if (wctx.params.flash_attn) {
                 struct ggml_tensor * V =
                     ggml_view_3d(ctx0, kv_self.v,
                             n_state_head, n_kv, n_head,
-                            ggml_element_size(kv_self.v)*n_state,
-                            ggml_element_size(kv_self.v)*n_state_head,
-                            ggml_element_size(kv_self.v)*n_state*n_ctx*il);
+                            ggml_row_size(kv_self.v->type, n_state),
+                            ggml_row_size(kv_self.v->type, n_state_head),
+                            ggml_row_size(kv_self.v->type, n_state)*n_ctx*il);
 
                 cur = ggml_flash_attn_ext(ctx0, Q, K, V, KQ_mask_f16, 1.0f, 0.0f, 0.0f);
 
@@ -2652,16 +2949,16 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
                 struct ggml_tensor * Kcross =
                     ggml_view_3d(ctx0, wstate.kv_cross.k,
                             n_state_head, n_audio_ctx_pad, n_head,
-                            ggml_element_size(wstate.kv_cross.k)*n_state,
-                            ggml_element_size(wstate.kv_cross.k)*n_state_head,
-                            ggml_element_size(wstate.kv_cross.k)*n_state*n_audio_ctx_pad*il);
+                            ggml_row_size(wstate.kv_cross.k->type, n_state),
+                            ggml_row_size(wstate.kv_cross.k->type, n_state_head),
+                            ggml_row_size(wstate.kv_cross.k->type, n_state)*n_audio_ctx_pad*il);
 
                 struct ggml_tensor * Vcross =
                     ggml_view_3d(ctx0, wstate.kv_cross.v,
                             n_state_head, n_audio_ctx_pad, n_head,
-                            ggml_element_size(wstate.kv_cross.v)*n_state,
-                            ggml_element_size(wstate.kv_cross.v)*n_state_head,
-                            ggml_element_size(wstate.kv_cross.v)*n_state*n_audio_ctx_pad*il);
+                            ggml_row_size(wstate.kv_cross.v->type, n_state),
+                            ggml_row_size(wstate.kv_cross.v->type, n_state_head),
+                            ggml_row_size(wstate.kv_cross.v->type, n_state)*n_audio_ctx_pad*il);
 
                 cur = ggml_flash_attn_ext(ctx0, Q, Kcross, Vcross, nullptr, KQscale, 0.0f, 0.0f);
 
@@ -2787,7 +3084,18 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
     // might be useful in the future
     //cur = ggml_view_2d(ctx0, cur, cur->ne[0], 1, cur->nb[1], (cur->ne[1] - 1)*cur->nb[1]);
 
-    struct ggml_tensor * logits = ggml_mul_mat(ctx0, model.d_te, cur);
+    struct ggml_tensor * logits = nullptr;
+
+    if (logits_ids) {
+        // gathered projection: only the rows of the allowed tokens are multiplied, instead of the whole vocabulary
+        struct ggml_tensor * inp_logits_ids = ggml_new_tensor_1d(ctx0, GGML_TYPE_I32, logits_ids->size());
+        ggml_set_name(inp_logits_ids, "logits_ids");
+        ggml_set_input(inp_logits_ids);
+
+        logits = ggml_mul_mat(ctx0, ggml_get_rows(ctx0, model.d_te, inp_logits_ids), cur);
+    } else {
+        logits = ggml_mul_mat(ctx0, model.d_te, cur);
+    }
 
     // [EXPERIMENTAL] Token-level timestamps with DTW
     if (wctx.params.dtw_token_timestamps && aheads_cross_QKs != nullptr) {
@@ -2816,14 +3124,141 @@ static struct ggml_cgraph * whisper_build_graph_decoder(
 //   - n_tokens:   number of tokens in the prompt
 //   - n_past:     number of past tokens to prefix the prompt with
 //
+// reserves the decoder compute buffers for the worst-case graph that fits in the current self-attention KV cache
+static bool whisper_sched_decode_init(whisper_context & wctx, whisper_state & wstate) {
+    return whisper_sched_graph_init(wstate.sched_decode, wstate.backends,
+            [&]() {
+                const auto & hparams = wctx.model.hparams;
+
+                // TODO: make sure this is the worst-case scenario
+                const int n_tokens = std::min(hparams.n_text_ctx, (int32_t) wstate.kv_self.size);
+                const int n_past   = 0;
+
+                whisper_batch_prep_legacy(wstate.batch, nullptr, n_tokens, n_past, 0);
+
+                return whisper_build_graph_decoder(wctx, wstate, wstate.batch, wctx.params.dtw_token_timestamps, true, nullptr);
+            });
+}
+
+// grows the self-attention KV cache so that it holds at least n_ctx cells
+// the cache is only reallocated when it is too small, and the decoder compute buffers are reserved again for the new size
+static bool whisper_kv_self_reserve(whisper_context & wctx, whisper_state & wstate, int32_t n_ctx) {
+    n_ctx = GGML_PAD(n_ctx, std::max(32u, whisper_kv_cache_get_padding(wctx)));
+
+    if (wstate.kv_self.ctx && (int32_t) wstate.kv_self.size >= n_ctx) {
+        return true;
+    }
+
+    WHISPER_LOG_DEBUG("%s: growing the self-attention KV cache: %d -> %d cells\n", __func__, (int) wstate.kv_self.size, n_ctx);
+
+    whisper_kv_cache_free(wstate.kv_self);
+
+    if (!whisper_kv_cache_init(wstate.kv_self, wstate.backends[0], whisper_kv_cache_type(wctx),
+                wctx.model.hparams.n_text_state,
+                wctx.model.hparams.n_text_layer,
+                n_ctx)) {
+        WHISPER_LOG_ERROR("%s: whisper_kv_cache_init() failed for self-attention cache\n", __func__);
+        return false;
+    }
+
+    ggml_backend_sched_free(wstate.sched_decode.sched);
+    wstate.sched_decode.sched = nullptr;
+
+    if (!whisper_sched_decode_init(wctx, wstate)) {
+        WHISPER_LOG_ERROR("%s: failed to init decoder allocator\n", __func__);
+        return false;
+    }
+
+    return true;
+}
+
+// grows the cross-attention and encoder padding KV caches so that they hold the current audio context
+// the compute buffers of all the graphs depend on the audio context, so they are reserved again along with the caches
+static bool whisper_kv_cross_reserve(whisper_context & wctx, whisper_state & wstate) {
+    const auto & hparams = wctx.model.hparams;
+
+    const int n_audio_ctx = wstate.exp_n_audio_ctx > 0 ? wstate.exp_n_audio_ctx : hparams.n_audio_ctx;
+    const int n_ctx       = GGML_PAD(n_audio_ctx, 256);
+
+    if (wstate.kv_cross.ctx && wstate.kv_pad.ctx && (int) wstate.kv_cross.size >= n_ctx) {
+        return true;
+    }
+
+    WHISPER_LOG_DEBUG("%s: growing the cross-attention KV cache: %d -> %d cells\n", __func__, (int) wstate.kv_cross.size, n_ctx);
+
+    whisper_kv_cache_free(wstate.kv_cross);
+    whisper_kv_cache_free(wstate.kv_pad);
+
+    if (!whisper_kv_cache_init(wstate.kv_cross, wstate.backends[0], whisper_kv_cache_type(wctx),
+                hparams.n_text_state,
+                hparams.n_text_layer,
+                n_ctx)) {
+        WHISPER_LOG_ERROR("%s: whisper_kv_cache_init() failed for cross-attention cache\n", __func__);
+        return false;
+    }
+
+    if (!whisper_kv_cache_init(wstate.kv_pad, wstate.backends[0], whisper_kv_cache_type(wctx),
+                hparams.n_audio_state,
+                1,
+                n_ctx)) {
+        WHISPER_LOG_ERROR("%s: whisper_kv_cache_init() failed for self-attention cache\n", __func__);
+        return false;
+    }
+
+    ggml_backend_sched_free(wstate.sched_conv.sched);
+    ggml_backend_sched_free(wstate.sched_encode.sched);
+    ggml_backend_sched_free(wstate.sched_cross.sched);
+    ggml_backend_sched_free(wstate.sched_decode.sched);
+
+    wstate.sched_conv.sched   = nullptr;
+    wstate.sched_encode.sched = nullptr;
+    wstate.sched_cross.sched  = nullptr;
+    wstate.sched_decode.sched = nullptr;
+
+    if (!whisper_sched_graph_init(wstate.sched_conv, wstate.backends,
+                [&]() {
+                    return whisper_build_graph_conv(wctx, wstate);
+                })) {
+        WHISPER_LOG_ERROR("%s: failed to init conv allocator\n", __func__);
+        return false;
+    }
+
+    if (!whisper_encode_external(wstate) && !whisper_sched_graph_init(wstate.sched_encode, wstate.backends,
+                [&]() {
+                    return whisper_build_graph_encoder(wctx, wstate);
+                })) {
+        WHISPER_LOG_ERROR("%s: failed to init encoder allocator\n", __func__);
+        return false;
+    }
+
+    if (!whisper_sched_graph_init(wstate.sched_cross, wstate.backends,
+                [&]() {
+                    return whisper_build_graph_cross(wctx, wstate);
+                })) {
+        WHISPER_LOG_ERROR("%s: failed to init cross allocator\n", __func__);
+        return false;
+    }
+
+    if (!whisper_sched_decode_init(wctx, wstate)) {
+        WHISPER_LOG_ERROR("%s: failed to init decoder allocator\n", __func__);
+        return false;
+    }
+
+    return true;
+}
+
 static bool whisper_decode_internal(
         whisper_context & wctx,
           whisper_state & wstate,
     const whisper_batch & batch,
               const int   n_threads,
                    bool   save_alignment_heads_QKs,
+    const std::vector<whisper_token> * logits_ids,
     ggml_abort_callback   abort_callback,
                    void * abort_callback_data) {
+    WHISPER_PROFILE_SCOPE(Decode);
+    WHISPER_MEMORY_SCOPE(Compute);
+
     const int64_t t_start_us = ggml_time_us();
 
     const auto & model   = wctx.model;
@@ -2836,6 +3271,10 @@ static bool whisper_decode_internal(
 
     struct ggml_tensor * logits;
 
+    if (!whisper_threadpool_reserve(wstate.threadpool, wstate.threadpool_n_threads, wstate.backends, n_threads)) {
+        return false;
+    }
+
     // find KV slot for the batch
     {
         auto & kv_self = wstate.kv_self;
@@ -2855,7 +3294,7 @@ static bool whisper_decode_internal(
     {
         auto & sched = wstate.sched_decode.sched;
 
-        ggml_cgraph * gf = whisper_build_graph_decoder(wctx, wstate, batch, save_alignment_heads_QKs, false);
+        ggml_cgraph * gf = whisper_build_graph_decoder(wctx, wstate, batch, save_alignment_heads_QKs, false, logits_ids);
 
         if (!ggml_backend_sched_alloc_graph(sched, gf)) {
             // should never happen as we pre-allocate the memory
@@ -2910,6 +3349,11 @@ static bool whisper_decode_internal(
             ggml_backend_tensor_set(KQ_mask, wstate.inp_mask.data(), 0, ggml_nelements(KQ_mask)*sizeof(float));
         }
 
+        if (logits_ids) {
+            struct ggml_tensor * inp_logits_ids = ggml_graph_get_tensor(gf, "logits_ids");
+            ggml_backend_tensor_set(inp_logits_ids, logits_ids->data(), 0, ggml_nbytes(inp_logits_ids));
+        }
+
         logits = ggml_graph_node(gf, -1);
 
         if (!ggml_graph_compute_helper(sched, gf, n_threads)) {
@@ -2918,11 +3362,35 @@ static bool whisper_decode_internal(
     }
 
     logits_out.resize(n_tokens*n_vocab);
-    for (int i = 0; i < n_tokens; i++) {
-        if (batch.logits[i] == 0) {
-            continue;
+    if (logits_ids) {
+        const int n_ids = logits_ids->size();
+
+        for (int i = 0; i < n_tokens; i++) {
+            if (batch.logits[i] == 0) {
+                continue;
+            }
+
+            float * row = logits_out.data() + (n_vocab*i);
+            ggml_backend_tensor_get(logits, row, sizeof(float)*(n_ids*i), sizeof(float)*n_ids);
+
+            // scatter the gathered logits in place, starting from the back: the ids are sorted, so each logit moves to a position at or after its own
+            int end = n_vocab;
+            for (int j = n_ids - 1; j >= 0; --j) {
+                const whisper_token id = (*logits_ids)[j];
+                const float logit = row[j];
+                std::fill(row + id + 1, row + end, -INFINITY);
+                row[id] = logit;
+                end = id;
+            }
+            std::fill(row, row + end, -INFINITY);
+        }
+    } else {
+        for (int i = 0; i < n_tokens; i++) {
+            if (batch.logits[i] == 0) {
+                continue;
+            }
+            ggml_backend_tensor_get(logits, logits_out.data() + (n_vocab*i), sizeof(float)*(n_vocab*i), sizeof(float)*n_vocab);
         }
-        ggml_backend_tensor_get(logits, logits_out.data() + (n_vocab*i), sizeof(float)*(n_vocab*i), sizeof(float)*n_vocab);
     }
 
     if (batch.n_tokens > 1) {
@@ -3072,11 +3540,12 @@ static void fft(float* in, int N, float* out) {
     }
 }
 
+// fft_in and fft_out are scratch buffers of frame_size * 2 and frame_size * 8 floats owned by the caller
 static void log_mel_spectrogram_worker_thread(int ith, const float * hann, const std::vector<float> & samples,
                                               int n_samples, int frame_size, int frame_step, int n_threads,
-                                              const whisper_filters & filters, whisper_mel & mel) {
-    std::vector<float> fft_in(frame_size * 2, 0.0);
-    std::vector<float> fft_out(frame_size * 2 * 2 * 2);
+                                              const whisper_filters & filters, whisper_mel & mel,
+                                              float * fft_in, float * fft_out) {
+    std::fill(fft_in, fft_in + frame_size * 2, 0.0f);
 
     int n_fft = filters.n_fft;
     int i = ith;
@@ -3095,11 +3564,11 @@ static void log_mel_spectrogram_worker_thread(int ith, const float * hann, const
 
         // fill the rest with zeros
         if (n_samples - offset < frame_size) {
-            std::fill(fft_in.begin() + (n_samples - offset), fft_in.end(), 0.0);
+            std::fill(fft_in + (n_samples - offset), fft_in + frame_size * 2, 0.0f);
         }
 
         // FFT
-        fft(fft_in.data(), frame_size, fft_out.data());
+        fft(fft_in, frame_size, fft_out);
 
         // Calculate modulus^2 of complex numbers
         // Use pow(fft_out[2 * j + 0], 2) + pow(fft_out[2 * j + 1], 2) causes inference quality problem? Interesting.
@@ -3160,8 +3629,8 @@ static bool log_mel_spectrogram(
     int64_t stage_1_pad = WHISPER_SAMPLE_RATE * 30;
     int64_t stage_2_pad = frame_size / 2;
 
-    // Initialize a vector and copy data from C array to it.
-    std::vector<float> samples_padded;
+    // Initialize a vector and copy data from C array to it. The vector is kept in the state, so that it is only allocated once
+    auto & samples_padded = wstate.mel_samples_padded;
     samples_padded.resize(n_samples + stage_1_pad + stage_2_pad * 2);
     std::copy(samples, samples + n_samples, samples_padded.begin() + stage_2_pad);
 
@@ -3180,20 +3649,18 @@ static bool log_mel_spectrogram(
     mel.data.resize(mel.n_mel * mel.n_len);
 
     {
-        std::vector<std::thread> workers(n_threads - 1);
-        for (int iw = 0; iw < n_threads - 1; ++iw) {
-            workers[iw] = std::thread(
-                    log_mel_spectrogram_worker_thread, iw + 1, hann, samples_padded,
-                    n_samples + stage_2_pad, frame_size, frame_step, n_threads,
-                    std::cref(filters), std::ref(mel));
-        }
+        // FFT scratch buffers of every thread
+        const int fft_in_size  = frame_size * 2;
+        const int fft_out_size = frame_size * 2 * 2 * 2;
+        wstate.mel_fft_buf.resize((size_t) n_threads * (fft_in_size + fft_out_size));
 
-        // main thread
-        log_mel_spectrogram_worker_thread(0, hann, samples_padded, n_samples + stage_2_pad, frame_size, frame_step, n_threads, filters, mel);
+        auto fft_scratch = [&](int ith) { return wstate.mel_fft_buf.data() + (size_t) ith * (fft_in_size + fft_out_size); };
 
-        for (int iw = 0; iw < n_threads - 1; ++iw) {
-            workers[iw].join();
-        }
+        auto worker = [&](int ith) {
+            log_mel_spectrogram_worker_thread(ith, hann, samples_padded, n_samples + stage_2_pad, frame_size, frame_step, n_threads, filters, mel, fft_scratch(ith), fft_scratch(ith) + fft_in_size);
+        };
+
+        wstate.workers.run(n_threads, worker);
     }
 
     // clamping and normalization
@@ -3352,49 +3819,32 @@ struct whisper_state * whisper_init_state(whisper_context * ctx) {
         return nullptr;
     }
 
-    // at this point, we don't know yet how many decoders will be used
-    // later during decoding, if more decoders are used, we will recreate the KV cache respectively
-    state->kv_self_n_dec = 1;
-    if (!whisper_kv_cache_init(state->kv_self, state->backends[0], ctx->itype,
-                ctx->model.hparams.n_text_state,
-                ctx->model.hparams.n_text_layer,
-                GGML_PAD(ctx->model.hparams.n_text_ctx, 256))) {
-        WHISPER_LOG_ERROR("%s: whisper_kv_cache_init() failed for self-attention cache\n", __func__);
-        whisper_free_state(state);
-        return nullptr;
-    }
-
-    {
-        const size_t memory_size = ggml_nbytes(state->kv_self.k) + ggml_nbytes(state->kv_self.v);
-        WHISPER_LOG_INFO("%s: kv self size  = %7.2f MB\n", __func__, memory_size / 1e6);
-    }
+    const auto & hparams = ctx->model.hparams;
 
-    if (!whisper_kv_cache_init(state->kv_cross, state->backends[0], ctx->itype,
-                ctx->model.hparams.n_text_state,
-                ctx->model.hparams.n_text_layer,
-                GGML_PAD(ctx->model.hparams.n_audio_ctx, 256))) {
-        WHISPER_LOG_ERROR("%s: whisper_kv_cache_init() failed for cross-attention cache\n", __func__);
-        whisper_free_state(state);
-        return nullptr;
-    }
+    // the KV caches are sized from the hints in the context params, or for the full model context without them
+    // at this point, we don't know yet how many decoders and which audio context will be used
+    // later during decoding, if a larger context is needed, the KV caches are grown respectively
+    const int n_text_ctx_kv  = ctx->params.kv_n_text_ctx  > 0 ? std::min(ctx->params.kv_n_text_ctx,  GGML_PAD(hparams.n_text_ctx, 256)*(WHISPER_MAX_DECODERS + 2)) : GGML_PAD(hparams.n_text_ctx, 256);
+    const int n_audio_ctx_kv = ctx->params.kv_n_audio_ctx > 0 ? std::min(ctx->params.kv_n_audio_ctx, hparams.n_audio_ctx) : hparams.n_audio_ctx;
 
-    {
-        const size_t memory_size = ggml_nbytes(state->kv_cross.k) + ggml_nbytes(state->kv_cross.v);
-        WHISPER_LOG_INFO("%s: kv cross size = %7.2f MB\n", __func__, memory_size / 1e6);
+    if (ctx->params.type_kv != GGML_TYPE_COUNT && whisper_kv_cache_type(*ctx) != ctx->params.type_kv) {
+        WHISPER_LOG_WARN("%s: KV cache type %s is not supported with the current attention (flash attn = %d) - using %s\n", __func__,
+                ggml_type_name(ctx->params.type_kv), ctx->params.flash_attn, ggml_type_name(ctx->itype));
     }
 
-    if (!whisper_kv_cache_init(state->kv_pad, state->backends[0], ctx->itype,
-                ctx->model.hparams.n_audio_state,
-                1,
-                GGML_PAD(ctx->model.hparams.n_audio_ctx, 256))) {
+    state->kv_self_n_dec = 1;
+    if (!whisper_kv_cache_init(state->kv_self, state->backends[0], whisper_kv_cache_type(*ctx),
+                hparams.n_text_state,
+                hparams.n_text_layer,
+                GGML_PAD(n_text_ctx_kv, std::max(32u, whisper_kv_cache_get_padding(*ctx))))) {
         WHISPER_LOG_ERROR("%s: whisper_kv_cache_init() failed for self-attention cache\n", __func__);
         whisper_free_state(state);
         return nullptr;
     }
 
     {
-        const size_t memory_size = ggml_nbytes(state->kv_pad.k) + ggml_nbytes(state->kv_pad.v);
-        WHISPER_LOG_INFO("%s: kv pad  size  = %7.2f MB\n", __func__, memory_size / 1e6);
+        const size_t memory_size = ggml_nbytes(state->kv_self.k) + ggml_nbytes(state->kv_self.v);
+        WHISPER_LOG_INFO("%s: kv self size  = %7.2f MB\n", __func__, memory_size / 1e6);
     }
 
     // [EXPERIMENTAL] Token-level timestamps with DTW
@@ -3437,81 +3887,40 @@ struct whisper_state * whisper_init_state(whisper_context * ctx) {
     state->decoders[0].logits.reserve   (ctx->vocab.n_vocab);
     state->decoders[0].logprobs.reserve (ctx->vocab.n_vocab);
     state->decoders[0].logits_id.reserve(ctx->model.hparams.n_vocab);
+    state->decoders[0].tokens_topk.reserve(WHISPER_MAX_DECODERS);
 
     state->decoders[0].rng = std::mt19937(0);
 
-    // conv allocator
-    {
-        bool ok = whisper_sched_graph_init(state->sched_conv, state->backends,
-                [&]() {
-                    return whisper_build_graph_conv(*ctx, *state);
-                });
-
-        if (!ok) {
-            WHISPER_LOG_ERROR("%s: failed to init conv allocator\n", __func__);
-            whisper_free_state(state);
-            return nullptr;
-        }
+    // the cross-attention caches and the compute buffers of all the graphs are sized for the audio context from the hints
+    state->exp_n_audio_ctx = n_audio_ctx_kv;
 
-        WHISPER_LOG_INFO("%s: compute buffer (conv)   = %7.2f MB\n", __func__, whisper_sched_size(state->sched_conv) / 1e6);
+    if (!whisper_kv_cross_reserve(*ctx, *state)) {
+        WHISPER_LOG_ERROR("%s: failed to init the cross-attention cache and the allocators\n", __func__);
+        whisper_free_state(state);
+        return nullptr;
     }
 
-    // encoder allocator
-    if (!whisper_encode_external(*state)) {
-        bool ok = whisper_sched_graph_init(state->sched_encode, state->backends,
-                [&]() {
-                    return whisper_build_graph_encoder(*ctx, *state);
-                });
-
-        if (!ok) {
-            WHISPER_LOG_ERROR("%s: failed to init encoder allocator\n", __func__);
-            whisper_free_state(state);
-            return nullptr;
-        }
-
-        WHISPER_LOG_INFO("%s: compute buffer (encode) = %7.2f MB\n", __func__, whisper_sched_size(state->sched_encode) / 1e6);
-    }
+    state->exp_n_audio_ctx = 0;
 
-    // cross allocator
     {
-        bool ok = whisper_sched_graph_init(state->sched_cross, state->backends,
-                [&]() {
-                    return whisper_build_graph_cross(*ctx, *state);
-                });
-
-        if (!ok) {
-            WHISPER_LOG_ERROR("%s: failed to init cross allocator\n", __func__);
-            whisper_free_state(state);
-            return nullptr;
-        }
-
-        WHISPER_LOG_INFO("%s: compute buffer (cross)  = %7.2f MB\n", __func__, whisper_sched_size(state->sched_cross) / 1e6);
+        const size_t memory_size = ggml_nbytes(state->kv_cross.k) + ggml_nbytes(state->kv_cross.v);
+        WHISPER_LOG_INFO("%s: kv cross size = %7.2f MB\n", __func__, memory_size / 1e6);
     }
 
-    // decoder allocator
     {
-        bool ok = whisper_sched_graph_init(state->sched_decode, state->backends,
-                [&]() {
-                    const auto & hparams = ctx->model.hparams;
-
-                    // TODO: make sure this is the worst-case scenario
-                    const int n_tokens = hparams.n_text_ctx;
-                    const int n_past   = 0;
-
-                    whisper_batch_prep_legacy(state->batch, nullptr, n_tokens, n_past, 0);
-
-                    return whisper_build_graph_decoder(*ctx, *state, state->batch, ctx->params.dtw_token_timestamps, true);
-                });
+        const size_t memory_size = ggml_nbytes(state->kv_pad.k) + ggml_nbytes(state->kv_pad.v);
+        WHISPER_LOG_INFO("%s: kv pad  size  = %7.2f MB\n", __func__, memory_size / 1e6);
+    }
 
-        if (!ok) {
-            WHISPER_LOG_ERROR("%s: failed to init decoder allocator\n", __func__);
-            whisper_free_state(state);
-            return nullptr;
-        }
+    WHISPER_LOG_INFO("%s: compute buffer (conv)   = %7.2f MB\n", __func__, whisper_sched_size(state->sched_conv) / 1e6);
 
-        WHISPER_LOG_INFO("%s: compute buffer (decode) = %7.2f MB\n", __func__, whisper_sched_size(state->sched_decode) / 1e6);
+    if (!whisper_encode_external(*state)) {
+        WHISPER_LOG_INFO("%s: compute buffer (encode) = %7.2f MB\n", __func__, whisper_sched_size(state->sched_encode) / 1e6);
     }
 
+    WHISPER_LOG_INFO("%s: compute buffer (cross)  = %7.2f MB\n", __func__, whisper_sched_size(state->sched_cross) / 1e6);
+    WHISPER_LOG_INFO("%s: compute buffer (decode) = %7.2f MB\n", __func__, whisper_sched_size(state->sched_decode) / 1e6);
+
     return state;
 }
 
@@ -3588,6 +3997,11 @@ struct whisper_context_params whisper_context_default_params() {
             /*.heads            =*/ NULL,
         },
         /*.dtw_mem_size         =*/ 1024*1024*128,
+
+        /*.kv_n_text_ctx        =*/ 0,
+        /*.kv_n_audio_ctx       =*/ 0,
+
+        /*.type_kv              =*/ GGML_TYPE_COUNT,
     };
     return result;
 }
@@ -3801,6 +4215,10 @@ void whisper_free_state(struct whisper_state * state) {
             ggml_backend_free(backend);
         }
 
+        if (state->threadpool) {
+            ggml_threadpool_free(state->threadpool);
+        }
+
         // [EXPERIMENTAL] Token-level timestamps with DTW
         aheads_masks_free(state->aheads_masks);
 
@@ -3833,11 +4251,16 @@ void whisper_free_params(struct whisper_full_params * params) {
 }
 
 int whisper_pcm_to_mel_with_state(struct whisper_context * ctx, struct whisper_state * state, const float * samples, int n_samples, int n_threads) {
+    WHISPER_PROFILE_SCOPE(Mel);
+    WHISPER_MEMORY_SCOPE(Mel);
+
     if (!log_mel_spectrogram(*state, samples, n_samples, WHISPER_SAMPLE_RATE, WHISPER_N_FFT, WHISPER_HOP_LENGTH, ctx->model.filters.n_mel, n_threads, ctx->model.filters, false, state->mel)) {
         WHISPER_LOG_ERROR("%s: failed to compute mel spectrogram\n", __func__);
         return -1;
     }
 
+    state->encoded_seek = -1;
+
     return 0;
 }
 
@@ -3863,6 +4286,8 @@ int whisper_set_mel_with_state(
     state->mel.data.resize(n_len*n_mel);
     memcpy(state->mel.data.data(), data, n_len*n_mel*sizeof(float));
 
+    state->encoded_seek = -1;
+
     return 0;
 }
 
@@ -3897,7 +4322,7 @@ int whisper_decode_with_state(struct whisper_context * ctx, struct whisper_state
 
     whisper_kv_cache_seq_rm(state->kv_self, 0, n_past, -1);
 
-    if (!whisper_decode_internal(*ctx, *state, state->batch, n_threads, false, nullptr, nullptr)) {
+    if (!whisper_decode_internal(*ctx, *state, state->batch, n_threads, false, nullptr, nullptr, nullptr)) {
         WHISPER_LOG_ERROR("%s: failed to eval\n", __func__);
         return 1;
     }
@@ -4002,9 +4427,9 @@ int whisper_lang_auto_detect_with_state(
         return -6;
     }
 
-    const std::vector<whisper_token> prompt = { whisper_token_sot(ctx) };
+    const whisper_token token_sot = whisper_token_sot(ctx);
 
-    if (whisper_decode_with_state(ctx, state, prompt.data(), prompt.size(), 0, n_threads) != 0) {
+    if (whisper_decode_with_state(ctx, state, &token_sot, 1, 0, n_threads) != 0) {
         WHISPER_LOG_ERROR("%s: failed to decode\n", __func__);
         return -7;
     }
@@ -4654,6 +5079,11 @@ static void whisper_suppress_invalid_grammar(
     std::vector<whisper_grammar_candidate>                              candidates_grammar;
 
     for (whisper_token id = 0; id < eot; ++id) {
+        // tokens that are already suppressed (e.g. outside of the allowed tokens) cannot be sampled anyway
+        if (logits[id] == -INFINITY) {
+            continue;
+        }
+
         const std::string & text = ctx.vocab.id_to_token[id];
         if (!text.empty()) {
             candidates_decoded.push_back(decode_utf8(text.c_str(), grammar.partial_utf8));
@@ -4725,6 +5155,9 @@ struct whisper_full_params whisper_full_default_params(enum whisper_sampling_str
         /*.strategy          =*/ strategy,
 
         /*.n_threads         =*/ std::min(4, (int32_t) std::thread::hardware_concurrency()),
+        /*.n_threads_mel     =*/ 0,
+        /*.n_threads_encode  =*/ 0,
+        /*.n_threads_decode  =*/ 0,
         /*.n_max_text_ctx    =*/ 16384,
         /*.offset_ms         =*/ 0,
         /*.duration_ms       =*/ 0,
@@ -4769,7 +5202,12 @@ struct whisper_full_params whisper_full_default_params(enum whisper_sampling_str
         /*.temperature_inc   =*/  0.2f,
         /*.entropy_thold     =*/  2.4f,
         /*.logprob_thold     =*/ -1.0f,
-        /*.no_speech_thold   =*/  0.6f,
+        /*.no_speech_thold   =*/  1.0f,
+
+        /*.temperature_n_parallel =*/ 0,
+
+        /*.repetition_max_ngram =*/ 0,
+        /*.repetition_n_repeats =*/ 4,
 
         /*.greedy            =*/ {
             /*.best_of   =*/ -1,
@@ -4800,6 +5238,9 @@ struct whisper_full_params whisper_full_default_params(enum whisper_sampling_str
         /*.n_grammar_rules =*/ 0,
         /*.i_start_rule    =*/ 0,
         /*.grammar_penalty =*/ 100.0f,
+
+        /*.allowed_tokens   =*/ nullptr,
+        /*.n_allowed_tokens =*/ 0,
     };
 
     switch (strategy) {
@@ -4910,16 +5351,144 @@ static const std::vector<std::string> non_speech_tokens = {
     "♪♪♪","♩", "♪", "♫", "♬", "♭", "♮", "♯"
 };
 
+// collect the ids of the non-speech tokens present in the vocabulary, so that suppressing them does not have to look them up (and build strings) for every token
+static void whisper_init_non_speech_token_ids(const whisper_vocab & vocab, std::vector<whisper_token> & ids) {
+    ids.clear();
+
+    for (const std::string & token : non_speech_tokens) {
+        const std::string suppress_tokens[] = {token, " " + token};
+        for (const std::string & suppress_token : suppress_tokens) {
+            const auto it = vocab.token_to_id.find(suppress_token);
+            if (it != vocab.token_to_id.end()) {
+                ids.push_back(it->second);
+            }
+        }
+    }
+
+    // allow hyphens "-" and single quotes "'" between words, but not at the beginning of a word
+    for (const char * suppress_token : { " -", " '" }) {
+        const auto it = vocab.token_to_id.find(suppress_token);
+        if (it != vocab.token_to_id.end()) {
+            ids.push_back(it->second);
+        }
+    }
+}
+
+// append a segment to the results, reusing the storage of a segment of the previous call if there is one
+static whisper_segment & whisper_result_push_segment(struct whisper_state & state, int64_t t0, int64_t t1, const std::string & text, bool speaker_turn_next) {
+    auto & result_all = state.result_all;
+
+    if (result_all.size() < state.result_pool.size()) {
+        result_all.push_back(std::move(state.result_pool[result_all.size()]));
+    } else {
+        result_all.emplace_back();
+    }
+
+    auto & segment = result_all.back();
+
+    segment.t0 = t0;
+    segment.t1 = t1;
+    segment.text.assign(text);
+    segment.tokens.clear();
+    segment.speaker_turn_next = speaker_turn_next;
+
+    return segment;
+}
+
+// the helpers below are the loops of the logits processing that run over the whole vocabulary for every decoder and every token
+// they are branch-free and keep independent accumulators per lane, so that the compiler can vectorize them on every target
+
+#define WHISPER_VEC_LANES 8
+
+// max(x[0..n)), -INFINITY if n == 0
+static float whisper_vec_max(const float * x, int n) {
+    float m[WHISPER_VEC_LANES];
+    std::fill(m, m + WHISPER_VEC_LANES, -INFINITY);
+
+    int i = 0;
+    for (; i + WHISPER_VEC_LANES <= n; i += WHISPER_VEC_LANES) {
+        for (int l = 0; l < WHISPER_VEC_LANES; ++l) {
+            m[l] = x[i + l] > m[l] ? x[i + l] : m[l];
+        }
+    }
+    for (; i < n; ++i) {
+        m[0] = x[i] > m[0] ? x[i] : m[0];
+    }
+
+    return *std::max_element(m, m + WHISPER_VEC_LANES);
+}
+
+// exp(x) with the polynomial of ggml_v_expf (the vectorized exp of ggml_vec_soft_max_f32), with a relative error below 2e-7
+// unlike expf, it is branch-free and does not call into the C library, so that the lane loops below vectorize
+// valid for x below 88, x below -87 (where the result would be denormal) flushes to zero, which includes -INFINITY
+static inline float whisper_expf(float x) {
+    const float x_clamped = x < -87.0f ? -87.0f : x;
+
+    // x = n*ln(2) + b, with n = round(x/ln(2)) and ln(2) split into two parts for the precision of b
+    const float   t  = x_clamped*1.44269502f;
+    const int32_t n  = (int32_t) (t + (t < 0.0f ? -0.5f : 0.5f));
+    const float   nf = (float) n;
+    const float   b  = x_clamped - nf*0.693145752f - nf*1.42860677e-06f;
+
+    // 2^n, built from its exponent bits
+    const uint32_t k_bits = (uint32_t) (n + 127) << 23;
+    float k;
+    std::memcpy(&k, &k_bits, sizeof(k));
+
+    // exp(b) - 1 on [-ln(2)/2, ln(2)/2]
+    const float u = b*b;
+    const float j = ((0.00824739039f*b + 0.0418997668f)*u + (0.166683957f*b + 0.499991268f))*u + 0.999999404f*b;
+
+    return x < -87.0f ? 0.0f : k + k*j;
+}
+
+// y[i] = exp(x[i] - max), returns the sum of y[0..n)
+// a -INFINITY max means that all x are -INFINITY, in which case all y are 0
+static float whisper_vec_exp_sum(float * y, const float * x, int n, float max) {
+    const float shift = max == -INFINITY ? 0.0f : max;
+
+    float sum[WHISPER_VEC_LANES] = { 0.0f };
+
+    int i = 0;
+    for (; i + WHISPER_VEC_LANES <= n; i += WHISPER_VEC_LANES) {
+        for (int l = 0; l < WHISPER_VEC_LANES; ++l) {
+            y[i + l] = whisper_expf(x[i + l] - shift);
+            sum[l] += y[i + l];
+        }
+    }
+    for (; i < n; ++i) {
+        y[i] = whisper_expf(x[i] - shift);
+        sum[0] += y[i];
+    }
+
+    float result = 0.0f;
+    for (int l = 0; l < WHISPER_VEC_LANES; ++l) {
+        result += sum[l];
+    }
+
+    return result;
+}
+
+// logprobs[i] = logits[i] - logsumexp, probs[i] *= scale
+static void whisper_vec_log_softmax(float * logprobs, float * probs, const float * logits, int n, float logsumexp, float scale) {
+    for (int i = 0; i < n; ++i) {
+        logprobs[i] = logits[i] - logsumexp;
+        probs[i]   *= scale;
+    }
+}
+
 // process the logits for the selected decoder
 // - applies logit filters
 // - computes logprobs and probs
-// TODO: optimize
+// - gathers the statistics of the probs used by the sampling
 static void whisper_process_logits(
               struct whisper_context & ctx,
                struct whisper_state  & state,
               struct whisper_decoder & decoder,
     const struct whisper_full_params   params,
                                float   temperature) {
+    WHISPER_PROFILE_SCOPE(Sample);
+
     const auto & vocab      = ctx.vocab;
     const auto & tokens_cur = decoder.sequence.tokens;
 
@@ -4935,12 +5504,17 @@ static void whisper_process_logits(
     auto & logprobs = decoder.logprobs;
     {
         logits.resize(n_logits);
-        memcpy(logits.data(), state.logits.data() + decoder.i_batch*n_logits, n_logits*sizeof(float));
 
+        const float * logits_batch = state.logits.data() + decoder.i_batch*n_logits;
+
+        // the temperature is applied while copying, so that the row is read only once
         if (temperature > 0.0f) {
+            const float scale = 1.0f/temperature;
             for (int i = 0; i < n_logits; i++) {
-                logits[i] /= temperature;
+                logits[i] = logits_batch[i]*scale;
             }
+        } else {
+            memcpy(logits.data(), logits_batch, n_logits*sizeof(float));
         }
 
         // will be populated a bit later
@@ -4964,9 +5538,7 @@ static void whisper_process_logits(
         // ref: https://github.com/openai/whisper/blob/0b1ba3d46ebf7fe6f953acfd8cad62a4f851b49f/whisper/decoding.py#L410-L412
         logits[vocab.token_not] = -INFINITY;
         if (params.no_timestamps) {
-            for (int i = vocab.token_beg; i < n_logits; ++i) {
-                logits[i] = -INFINITY;
-            }
+            std::fill(logits.begin() + vocab.token_beg, logits.end(), -INFINITY);
         }
 
         // suppress sot and nosp tokens
@@ -5009,21 +5581,8 @@ static void whisper_process_logits(
         // suppress non-speech tokens
         // ref: https://github.com/openai/whisper/blob/7858aa9c08d98f75575035ecd6481f462d66ca27/whisper/tokenizer.py#L224-L253
         if (params.suppress_non_speech_tokens) {
-            for (const std::string & token : non_speech_tokens) {
-                const std::string suppress_tokens[] = {token, " " + token};
-                for (const std::string & suppress_token : suppress_tokens) {
-                    if (vocab.token_to_id.find(suppress_token) != vocab.token_to_id.end()) {
-                        logits[vocab.token_to_id.at(suppress_token)] = -INFINITY;
-                    }
-                }
-            }
-
-            // allow hyphens "-" and single quotes "'" between words, but not at the beginning of a word
-            if (vocab.token_to_id.find(" -") != vocab.token_to_id.end()) {
-                logits[vocab.token_to_id.at(" -")] = -INFINITY;
-            }
-            if (vocab.token_to_id.find(" '") != vocab.token_to_id.end()) {
-                logits[vocab.token_to_id.at(" '")] = -INFINITY;
+            for (const whisper_token id : state.non_speech_token_ids) {
+                logits[id] = -INFINITY;
             }
         }
 
@@ -5037,13 +5596,9 @@ static void whisper_process_logits(
 
             if (last_was_timestamp) {
                 if (penultimate_was_timestamp) {
-                    for (int i = vocab.token_beg; i < n_logits; ++i) {
-                        logits[i] = -INFINITY;
-                    }
+                    std::fill(logits.begin() + vocab.token_beg, logits.end(), -INFINITY);
                 } else {
-                    for (int i = 0; i < vocab.token_eot; ++i) {
-                        logits[i] = -INFINITY;
-                    }
+                    std::fill(logits.begin(), logits.begin() + vocab.token_eot, -INFINITY);
                 }
             }
         }
@@ -5054,8 +5609,8 @@ static void whisper_process_logits(
             const float precision = float(WHISPER_CHUNK_SIZE)/ctx.model.hparams.n_audio_ctx;
             const int   tid0      = std::round(params.max_initial_ts/precision);
 
-            for (int i = vocab.token_beg + tid0 + 1; i < n_logits; ++i) {
-                logits[i] = -INFINITY;
+            if (vocab.token_beg + tid0 + 1 < n_logits) {
+                std::fill(logits.begin() + vocab.token_beg + tid0 + 1, logits.end(), -INFINITY);
             }
         }
 
@@ -5064,95 +5619,81 @@ static void whisper_process_logits(
         if (decoder.has_ts) {
             const int tid0 = decoder.seek_delta/2;
 
-            for (int i = vocab.token_beg; i < vocab.token_beg + tid0; ++i) {
-                logits[i] = -INFINITY;
-            }
+            std::fill(logits.begin() + vocab.token_beg, logits.begin() + std::min(vocab.token_beg + tid0, n_logits), -INFINITY);
         }
 
-        // populate the logprobs array (log_softmax)
-        {
-            const float logit_max = *std::max_element(logits.begin(), logits.end());
-            float logsumexp = 0.0f;
-            for (int i = 0; i < n_logits; ++i) {
-                if (logits[i] > -INFINITY) {
-                    logsumexp += expf(logits[i] - logit_max);
-                }
-            }
-            logsumexp = logf(logsumexp) + logit_max;
+        // populate the probs and logprobs arrays (softmax and log_softmax)
+        // the maximum and the sum of the exponents are gathered separately for the text and the timestamp tokens,
+        // so that the timestamp rule below is decided without extra passes over the logprobs
+        const int n_text = vocab.token_beg;
+        const int n_ts   = n_logits - vocab.token_beg;
 
-            for (int i = 0; i < n_logits; ++i) {
-                if (logits[i] > -INFINITY) {
-                    logprobs[i] = logits[i] - logsumexp;
-                } else {
-                    logprobs[i] = -INFINITY;
-                }
-            }
-        }
+        float logit_max_text = -INFINITY;
+        float logit_max      = -INFINITY;
+        float sum_text       = 0.0f;
+        float sum_ts         = 0.0f;
+
+        const auto compute_softmax_stats = [&]() {
+            logit_max_text = whisper_vec_max(logits.data(), n_text);
+            logit_max      = std::max(logit_max_text, whisper_vec_max(logits.data() + n_text, n_ts));
+
+            // probs temporarily hold the unnormalized exponents
+            sum_text = whisper_vec_exp_sum(probs.data(),          logits.data(),          n_text, logit_max);
+            sum_ts   = whisper_vec_exp_sum(probs.data() + n_text, logits.data() + n_text, n_ts,   logit_max);
+        };
+
+        compute_softmax_stats();
 
         // if sum of probability over timestamps is above any other token, sample timestamp
         // ref: https://github.com/openai/whisper/blob/0b1ba3d46ebf7fe6f953acfd8cad62a4f851b49f/whisper/decoding.py#L431-L437
-        {
-            // logsumexp over timestamps
-            float timestamp_logprob = -INFINITY;
-            {
-                float logsumexp = 0.0f;
-                const float logprob_max = *std::max_element(logprobs.begin() + vocab.token_beg, logprobs.end());
-                for (int i = vocab.token_beg; i < n_logits; ++i) {
-                    if (logprobs[i] > -INFINITY) {
-                        logsumexp += expf(logprobs[i] - logprob_max);
-                    }
-                }
-                if (logsumexp > 0.0f) {
-                    timestamp_logprob = logf(logsumexp) + logprob_max;
-                }
-            }
+        // log(sum_ts) + logit_max and logit_max_text are the timestamp logprob and the max text token logprob, both offset by the same logsumexp
+        const bool sample_ts = sum_ts > 0.0f && logf(sum_ts) + logit_max > logit_max_text;
 
-            const float max_text_token_logprob = *std::max_element(logprobs.begin(), logprobs.begin() + vocab.token_beg);
+        if (sample_ts) {
+            std::fill(logits.begin(), logits.begin() + n_text, -INFINITY);
+            std::fill(probs.begin(),  probs.begin()  + n_text, 0.0f);
+        } else if (params.n_grammar_rules > 0) {
+            whisper_suppress_invalid_grammar(ctx, params, logits, decoder.grammar);
 
-            //WHISPER_LOG_INFO("timestamp_logprob=%f max_text_token_logprob=%f\n", timestamp_logprob, max_text_token_logprob);
+            compute_softmax_stats();
+        }
 
-            if (timestamp_logprob > max_text_token_logprob) {
-                for (int i = 0; i < vocab.token_beg; ++i) {
-                    logits[i]   = -INFINITY;
-                    logprobs[i] = -INFINITY;
-                }
-            } else {
-                if (params.n_grammar_rules > 0) {
-                    whisper_suppress_invalid_grammar(ctx, params, logits, decoder.grammar);
+        // the probs of the text tokens suppressed by the timestamp rule are not redistributed, as in the reference implementation
+        const float sum = sum_text + sum_ts;
 
-                    // populate the logprobs array (log_softmax)
-                    {
-                        const float logit_max = *std::max_element(logits.begin(), logits.end());
-                        float logsumexp = 0.0f;
-                        for (int i = 0; i < n_logits; ++i) {
-                            if (logits[i] > -INFINITY) {
-                                logsumexp += expf(logits[i] - logit_max);
-                            }
-                        }
-                        logsumexp = logf(logsumexp) + logit_max;
+        if (sum > 0.0f) {
+            const float logsumexp = logf(sum) + logit_max;
+            const float scale     = 1.0f/sum;
 
-                        for (int i = 0; i < n_logits; ++i) {
-                            if (logits[i] > -INFINITY) {
-                                logprobs[i] = logits[i] - logsumexp;
-                            } else {
-                                logprobs[i] = -INFINITY;
-                            }
-                        }
-                    }
-                }
-            }
+            // suppressed tokens end up with -INFINITY logprobs and zero probs without branching
+            whisper_vec_log_softmax(logprobs.data(), probs.data(), logits.data(), n_logits, logsumexp, scale);
+
+            decoder.probs_sum = (sample_ts ? sum_ts : sum)*scale;
+        } else {
+            std::fill(logprobs.begin(), logprobs.end(), -INFINITY);
+            std::fill(probs.begin(),    probs.end(),    0.0f);
+
+            decoder.probs_sum = 0.0f;
         }
     }
 
-    // compute probs
+    // timestamp token statistics, used by the sampling to compute pt and ptsum
     {
-        for (int i = 0; i < n_logits; ++i) {
-            if (logits[i] == -INFINITY) {
-                probs[i] = 0.0f;
-            } else {
-                probs[i] = expf(logprobs[i]);
+        float ts_sum = 0.0f;
+        float ts_max = 0.0f;
+        whisper_token ts_id = -1;
+
+        for (int i = vocab.token_beg; i < n_logits; ++i) {
+            ts_sum += probs[i];
+            if (ts_max < probs[i]) {
+                ts_max = probs[i];
+                ts_id  = i;
             }
         }
+
+        decoder.probs_ts_sum = ts_sum;
+        decoder.probs_ts_max = ts_max;
+        decoder.probs_ts_id  = ts_id;
     }
 
 #if 0
@@ -5222,10 +5763,36 @@ static bool whisper_sequence_tokens_equal(const whisper_sequence & a, const whis
     return true;
 }
 
+// draws a token id from the probs, like std::discrete_distribution but without building its table of cumulative probabilities for every draw
+static whisper_token whisper_sample_probs(
+    const std::vector<float> & probs,
+                       float   probs_sum,
+                std::mt19937 & rng) {
+    const double r = std::uniform_real_distribution<double>(0.0, probs_sum)(rng);
+
+    whisper_token last = 0;
+
+    double acc = 0.0;
+    for (int i = 0; i < (int) probs.size(); ++i) {
+        if (probs[i] > 0.0f) {
+            acc += probs[i];
+            if (acc > r) {
+                return i;
+            }
+            last = i;
+        }
+    }
+
+    // the accumulated sum can end up slightly below probs_sum due to rounding
+    return last;
+}
+
 static whisper_token_data whisper_sample_token(
             whisper_context & ctx,
       const whisper_decoder & decoder,
                        bool   best) {
+    WHISPER_PROFILE_SCOPE(Sample);
+
     whisper_token_data result = {
         0, 0, 0.0f, 0.0f, 0.0f, 0.0f, -1, -1, -1, 0.0f,
     };
@@ -5237,25 +5804,11 @@ static whisper_token_data whisper_sample_token(
 
     const int n_logits = vocab.n_vocab;
 
-    {
-        double sum_ts = 0.0;
-        double max_ts = 0.0;
-
-        for (int i = vocab.token_beg; i < n_logits; i++) {
-            if (probs[i] == -INFINITY) {
-                continue;
-            }
-
-            sum_ts += probs[i];
-            if (max_ts < probs[i]) {
-                max_ts = probs[i];
-                result.tid = i;
-            }
-        }
-
-        result.pt    = max_ts/(sum_ts + 1e-10);
-        result.ptsum = sum_ts;
+    if (decoder.probs_ts_id >= 0) {
+        result.tid = decoder.probs_ts_id;
     }
+    result.pt    = decoder.probs_ts_max/(decoder.probs_ts_sum + 1e-10);
+    result.ptsum = decoder.probs_ts_sum;
 
     if (best) {
         for (int i = 0; i < n_logits; ++i) {
@@ -5266,9 +5819,7 @@ static whisper_token_data whisper_sample_token(
             }
         }
     } else {
-        std::discrete_distribution<> dist(probs.begin(), probs.end());
-
-        result.id   = dist(decoder.rng);
+        result.id   = whisper_sample_probs(probs, decoder.probs_sum, decoder.rng);
         result.p    = probs[result.id];
         result.plog = logprobs[result.id];
     }
@@ -5281,79 +5832,111 @@ static whisper_token_data whisper_sample_token(
     return result;
 }
 
-static std::vector<whisper_token_data> whisper_sample_token_topk(
+// fills decoder.tokens_topk with k candidate tokens for the beam search
+// at zero temperature these are the k most likely tokens, selected with a bounded min-heap in a single pass over the vocabulary,
+// otherwise they are k draws from the probs
+static void whisper_sample_token_topk(
             whisper_context & ctx,
             whisper_decoder & decoder,
-                        int   k) {
+                        int   k,
+                      float   temperature) {
+    WHISPER_PROFILE_SCOPE(Sample);
+
     const auto & vocab = ctx.vocab;
 
     const auto & probs    = decoder.probs;
-    const auto & logits   = decoder.logits;
     const auto & logprobs = decoder.logprobs;
 
     const int n_logits = vocab.n_vocab;
 
-    auto & logits_id = decoder.logits_id;
+    auto & result = decoder.tokens_topk;
+    result.clear();
 
-    logits_id.resize(n_logits);
-    for (int i = 0; i < n_logits; ++i) {
-        logits_id[i].first = logits[i];
-        logits_id[i].second = i;
-    }
+    const whisper_token tid   = decoder.probs_ts_id >= 0 ? decoder.probs_ts_id : vocab.token_beg;
+    const float         pt    = decoder.probs_ts_max/(decoder.probs_ts_sum + 1e-10);
+    const float         ptsum = decoder.probs_ts_sum;
 
-    {
-        using pair_type = std::remove_reference<decltype(logits_id)>::type::value_type;
-        std::partial_sort(
-                logits_id.begin(),
-                logits_id.begin() + k, logits_id.end(),
-                [](const pair_type & a, const pair_type & b) {
-            return a.first > b.first;
-        });
-    }
+    const auto push_token = [&](whisper_token id) {
+        result.push_back({ id, tid, probs[id], logprobs[id], pt, ptsum, -1, -1, -1, 0.0f, });
 
-    std::vector<whisper_token_data> result;
-    result.reserve(k);
+        if (result.back().id >= vocab.token_beg) {
+            result.back().tid = result.back().id;
+            result.back().pt  = result.back().p;
+        }
+    };
 
-    whisper_token tid = vocab.token_beg;
+    if (temperature < 1e-6f) {
+        auto & logits_id = decoder.logits_id;
+        logits_id.clear();
 
-    float pt    = 0.0;
-    float ptsum = 0.0;
+        using pair_type = std::remove_reference<decltype(logits_id)>::type::value_type;
 
-    {
-        double sum_ts = 0.0;
-        double max_ts = 0.0;
+        // the front of the heap is the least likely of the k tokens kept so far
+        const auto greater = [](const pair_type & a, const pair_type & b) {
+            return a.first > b.first;
+        };
 
-        for (int i = vocab.token_beg; i < n_logits; i++) {
-            if (probs[i] == -INFINITY) {
+        for (int i = 0; i < n_logits; ++i) {
+            if (logprobs[i] == -INFINITY) {
                 continue;
             }
 
-            sum_ts += probs[i];
-            if (max_ts < probs[i]) {
-                max_ts = probs[i];
-                tid = i;
+            if ((int) logits_id.size() < k) {
+                logits_id.emplace_back(logprobs[i], i);
+                std::push_heap(logits_id.begin(), logits_id.end(), greater);
+            } else if (logprobs[i] > logits_id.front().first) {
+                std::pop_heap(logits_id.begin(), logits_id.end(), greater);
+                logits_id.back() = pair_type(logprobs[i], i);
+                std::push_heap(logits_id.begin(), logits_id.end(), greater);
             }
         }
 
-        pt    = max_ts/(sum_ts + 1e-10);
-        ptsum = sum_ts;
+        // most likely first
+        std::sort_heap(logits_id.begin(), logits_id.end(), greater);
+
+        for (const auto & logit_id : logits_id) {
+            push_token(logit_id.second);
+        }
+    } else {
+        for (int i = 0; i < k; ++i) {
+            push_token(whisper_sample_probs(probs, decoder.probs_sum, decoder.rng));
+        }
     }
+}
 
-    std::discrete_distribution<> dist(probs.begin(), probs.end());
+// finds a repetition loop at the end of the text of the sequence: the same n-gram of up to max_ngram text tokens repeated n_repeats times in a row
+// returns the number of tokens of the sequence up to the end of the first copy of the n-gram, or 0 if the sequence does not end with such a loop
+static int whisper_sequence_find_repetition(
+        const whisper_sequence & sequence,
+                 whisper_token   token_eot,
+                           int   max_ngram,
+                           int   n_repeats,
+              std::vector<int> & pos) {
+    const auto & tokens = sequence.tokens;
 
-    for (int i = 0; i < k; ++i) {
-        const auto id = dist(decoder.rng);
-        //printf("XXX %d %d %f %f %f %f\n", id, tid, probs[id], logprobs[id], pt, ptsum);
+    // the positions of the last text tokens, from the newest one backwards
+    pos.clear();
+    for (int i = (int) tokens.size() - 1; i >= 0 && (int) pos.size() < max_ngram*n_repeats; --i) {
+        if (tokens[i].id < token_eot) {
+            pos.push_back(i);
+        }
+    }
 
-        result.push_back({ id, tid, probs[id], logprobs[id], pt, ptsum, -1, -1, -1, 0.0f, });
+    for (int n = 1; n <= max_ngram && n*n_repeats <= (int) pos.size(); ++n) {
+        bool repeated = true;
+        for (int k = 0; k < n*(n_repeats - 1); ++k) {
+            if (tokens[pos[k]].id != tokens[pos[k + n]].id) {
+                repeated = false;
+                break;
+            }
+        }
 
-        if (result[i].id >= vocab.token_beg) {
-            result[i].tid = result[i].id;
-            result[i].pt  = result[i].p;
+        if (repeated) {
+            return pos[n*(n_repeats - 1)] + 1;
         }
     }
 
-    return result;
+    return 0;
 }
 
 // ref: https://github.com/openai/whisper/blob/0b1ba3d46ebf7fe6f953acfd8cad62a4f851b49f/whisper/decoding.py#L178-L192
@@ -5411,24 +5994,39 @@ int whisper_full_with_state(
     struct whisper_full_params   params,
                    const float * samples,
                            int   n_samples) {
-    // clear old results
+    // clear old results, keeping their storage for the segments of this call
     auto & result_all = state->result_all;
 
+    state->result_pool.swap(result_all);
     result_all.clear();
 
+    // per-stage thread counts: the encoder scales with the number of cores, while single-token decode steps often do not
+    const int n_threads_mel    = params.n_threads_mel    > 0 ? params.n_threads_mel    : params.n_threads;
+    const int n_threads_encode = params.n_threads_encode > 0 ? params.n_threads_encode : params.n_threads;
+    const int n_threads_decode = params.n_threads_decode > 0 ? params.n_threads_decode : params.n_threads;
+
     if (n_samples > 0) {
         // compute log mel spectrogram
-        if (whisper_pcm_to_mel_with_state(ctx, state, samples, n_samples, params.n_threads) != 0) {
+        if (whisper_pcm_to_mel_with_state(ctx, state, samples, n_samples, n_threads_mel) != 0) {
             WHISPER_LOG_ERROR("%s: failed to compute log mel spectrogram\n", __func__);
             return -2;
         }
     }
 
+    // overwrite audio_ctx, max allowed is hparams.n_audio_ctx
+    // set before the language detection, so that it encodes the window with the same audio context as the decoding does
+    if (params.audio_ctx > whisper_n_audio_ctx(ctx)) {
+        WHISPER_LOG_ERROR("%s: audio_ctx is larger than the maximum allowed (%d > %d)\n", __func__, params.audio_ctx, whisper_n_audio_ctx(ctx));
+        return -5;
+    }
+    state->exp_n_audio_ctx = params.audio_ctx;
+
     // auto-detect language if not specified
     if (params.language == nullptr || strlen(params.language) == 0 || strcmp(params.language, "auto") == 0 || params.detect_language) {
-        std::vector<float> probs(whisper_lang_max_id() + 1, 0.0f);
+        auto & probs = state->lang_probs;
+        probs.assign(whisper_lang_max_id() + 1, 0.0f);
 
-        const auto lang_id = whisper_lang_auto_detect_with_state(ctx, state, 0, params.n_threads, probs.data());
+        const auto lang_id = whisper_lang_auto_detect_with_state(ctx, state, 0, n_threads_encode, probs.data());
         if (lang_id < 0) {
             WHISPER_LOG_ERROR("%s: failed to auto-detect language\n", __func__);
             return -3;
@@ -5442,6 +6040,31 @@ int whisper_full_with_state(
         }
     }
 
+    // restrict the output head to the allowed text tokens, along with the end of text and the timestamp tokens the sampling relies on
+    const std::vector<whisper_token> * logits_ids = nullptr;
+    if (params.allowed_tokens != nullptr && params.n_allowed_tokens > 0) {
+        const whisper_token token_eot = whisper_token_eot(ctx);
+
+        auto & ids = state->logits_ids;
+        ids.clear();
+        for (int i = 0; i < params.n_allowed_tokens; ++i) {
+            if (params.allowed_tokens[i] >= 0 && params.allowed_tokens[i] < token_eot) {
+                ids.push_back(params.allowed_tokens[i]);
+            }
+        }
+        ids.push_back(token_eot);
+        ids.push_back(whisper_token_nosp(ctx));
+        if (!params.no_timestamps) {
+            for (whisper_token id = whisper_token_beg(ctx); id < whisper_n_vocab(ctx); ++id) {
+                ids.push_back(id);
+            }
+        }
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+        logits_ids = &ids;
+    }
+
     if (params.token_timestamps) {
         state->t_beg    = 0;
         state->t_last   = 0;
@@ -5464,7 +6087,8 @@ int whisper_full_with_state(
 
     // a set of temperatures to use
     // [ t0, t0 + delta, t0 + 2*delta, ..., < 1.0f + 1e-6f ]
-    std::vector<float> temperatures;
+    auto & temperatures = state->temperatures;
+    temperatures.clear();
     if (params.temperature_inc > 0.0f) {
         for (float t = params.temperature; t < 1.0f + 1e-6f; t += params.temperature_inc) {
             temperatures.push_back(t);
@@ -5489,6 +6113,11 @@ int whisper_full_with_state(
 
     n_decoders = std::max(1, n_decoders);
 
+    // the fallback temperatures decoded in parallel need their own decoders, as many as fit
+    if (params.strategy == WHISPER_SAMPLING_GREEDY && params.temperature_n_parallel > 0 && n_decoders <= WHISPER_MAX_DECODERS) {
+        n_decoders = std::min(WHISPER_MAX_DECODERS, n_decoders*(1 + params.temperature_n_parallel));
+    }
+
     if (n_decoders > WHISPER_MAX_DECODERS) {
         WHISPER_LOG_ERROR("%s: too many decoders requested (%d), max = %d\n", __func__, n_decoders, WHISPER_MAX_DECODERS);
         return -4;
@@ -5504,29 +6133,34 @@ int whisper_full_with_state(
         decoder.logits.resize  (ctx->vocab.n_vocab);
         decoder.logprobs.resize(ctx->vocab.n_vocab);
         decoder.logits_id.reserve(ctx->model.hparams.n_vocab);
+        decoder.tokens_topk.reserve(WHISPER_MAX_DECODERS);
 
         decoder.rng = std::mt19937(0);
     }
 
-    // the accumulated text context so far
-    auto & prompt_past = state->prompt_past;
+    // the accumulated text context so far, in the language of the task
+    auto & prompt_past = params.translate ? state->prompt_past_translate : state->prompt_past;
     if (params.no_context) {
         prompt_past.clear();
     }
 
     // prepare prompt
     {
-        std::vector<whisper_token> prompt_tokens;
-
-        // initial prompt
+        // initial prompt, tokenized again only when it changes
         if (!params.prompt_tokens && params.initial_prompt) {
-            prompt_tokens.resize(1024);
-            int n_needed = whisper_tokenize(ctx, params.initial_prompt, prompt_tokens.data(), prompt_tokens.size());
-            if (n_needed < 0) {
-                prompt_tokens.resize(-n_needed);
-                n_needed = whisper_tokenize(ctx, params.initial_prompt, prompt_tokens.data(), prompt_tokens.size());
+            auto & prompt_tokens = state->initial_prompt_tokens;
+
+            if (state->initial_prompt != params.initial_prompt) {
+                prompt_tokens.resize(std::max<size_t>(prompt_tokens.capacity(), 1024));
+                int n_needed = whisper_tokenize(ctx, params.initial_prompt, prompt_tokens.data(), prompt_tokens.size());
+                if (n_needed < 0) {
+                    prompt_tokens.resize(-n_needed);
+                    n_needed = whisper_tokenize(ctx, params.initial_prompt, prompt_tokens.data(), prompt_tokens.size());
+                }
+                prompt_tokens.resize(n_needed);
+                state->initial_prompt = params.initial_prompt;
             }
-            prompt_tokens.resize(n_needed);
+
             params.prompt_tokens   = prompt_tokens.data();
             params.prompt_n_tokens = prompt_tokens.size();
         }
@@ -5541,15 +6175,14 @@ int whisper_full_with_state(
         }
     }
 
-    // overwrite audio_ctx, max allowed is hparams.n_audio_ctx
-    if (params.audio_ctx > whisper_n_audio_ctx(ctx)) {
-        WHISPER_LOG_ERROR("%s: audio_ctx is larger than the maximum allowed (%d > %d)\n", __func__, params.audio_ctx, whisper_n_audio_ctx(ctx));
-        return -5;
+    if (params.suppress_non_speech_tokens && state->non_speech_token_ids.empty()) {
+        whisper_init_non_speech_token_ids(ctx->vocab, state->non_speech_token_ids);
     }
-    state->exp_n_audio_ctx = params.audio_ctx;
 
     // these tokens determine the task that will be performed
-    std::vector<whisper_token> prompt_init = { whisper_token_sot(ctx), };
+    auto & prompt_init = state->prompt_init;
+    prompt_init.clear();
+    prompt_init.push_back(whisper_token_sot(ctx));
 
     if (whisper_is_multilingual(ctx)) {
         const int lang_id = whisper_lang_id(params.language);
@@ -5577,21 +6210,33 @@ int whisper_full_with_state(
 
     int seek = seek_start;
 
-    std::vector<whisper_token> prompt;
+    auto & prompt = state->prompt;
     prompt.reserve(whisper_n_text_ctx(ctx));
 
-    struct beam_candidate {
-        int decoder_idx;
-        int seek_delta;
-
-        bool has_ts;
+    // a beam extended with one token
+    // the sequence of the parent beam is not copied into the candidate - only the selected candidates copy it, and only when they move to another decoder
+    using beam_candidate = whisper_beam_candidate;
 
-        whisper_sequence sequence;
-        whisper_grammar grammar;
+    // heap order: the top of the heap is the candidate with the highest log probability (the lowest decoder index on ties)
+    const auto beam_candidate_less = [](const beam_candidate & a, const beam_candidate & b) {
+        if (a.sum_logprobs_all != b.sum_logprobs_all) {
+            return a.sum_logprobs_all < b.sum_logprobs_all;
+        }
+        return a.decoder_idx > b.decoder_idx;
     };
 
-    std::vector<std::vector<beam_candidate>> bc_per_dec(n_decoders);
-    std::vector<beam_candidate> beam_candidates;
+    // the candidates are only used by beam search, so the greedy path does not allocate them
+    // the candidates of the decoders of a previous call are cleared too, since all of them are merged
+    auto & bc_per_dec      = state->beam_candidates_per_dec;
+    auto & beam_candidates = state->beam_candidates;
+    auto & beam_selected   = state->beam_selected;
+
+    for (auto & bc : bc_per_dec) {
+        bc.clear();
+    }
+    if (params.strategy == WHISPER_SAMPLING_BEAM_SEARCH && (int) bc_per_dec.size() < n_decoders) {
+        bc_per_dec.resize(n_decoders);
+    }
 
     // main loop
     while (true) {
@@ -5614,9 +6259,14 @@ int whisper_full_with_state(
             }
         }
 
-        // encode audio features starting at offset seek
-        if (!whisper_encode_internal(*ctx, *state, seek, params.n_threads, params.abort_callback, params.abort_callback_user_data)) {
-            WHISPER_LOG_ERROR("%s: failed to encode\n", __func__);
+        // encode audio features starting at offset seek, unless this window is already encoded, e.g. by the language detection or by a call with another task over the same audio
+        // the decoder only writes to the self-attention KV cache, so the cross KV cache still holds the encoder output
+        if (seek != state->encoded_seek || state->exp_n_audio_ctx != state->encoded_n_audio_ctx) {
+            if (!whisper_encode_internal(*ctx, *state, seek, n_threads_encode, params.abort_callback, params.abort_callback_user_data)) {
+                WHISPER_LOG_ERROR("%s: failed to encode\n", __func__);
+                return -6;
+            }
+        } else if (params.abort_callback && params.abort_callback(params.abort_callback_user_data)) {
             return -6;
         }
 
@@ -5628,7 +6278,14 @@ int whisper_full_with_state(
 
         int best_decoder_id = 0;
 
-        for (int it = 0; it < (int) temperatures.size(); ++it) {
+        // set when the no speech probability after the first step is above no_speech_thold
+        bool no_speech = false;
+
+        // the KV cells of the prompt decoded for a temperature are reused by the next temperatures that use the same prompt
+        // they depend on the encoder output of this window through cross-attention, so they are not reused by the next windows
+        bool prompt_kv_valid = false;
+
+        for (int it = 0, n_temperatures_cur = 1; it < (int) temperatures.size(); it += n_temperatures_cur) {
             const float t_cur = temperatures[it];
 
             int n_decoders_cur = 1;
@@ -5652,9 +6309,42 @@ int whisper_full_with_state(
 
             n_decoders_cur = std::max(1, n_decoders_cur);
 
-            WHISPER_LOG_DEBUG("\n%s: strategy = %d, decoding with %d decoders, temperature = %.2f\n", __func__, params.strategy, n_decoders_cur, t_cur);
+            // the decoders [dec_begin[k], dec_begin[k + 1]) decode with temperatures[it + k]
+            int dec_begin[WHISPER_MAX_DECODERS + 1] = { 0, n_decoders_cur };
+
+            // decode the next fallback temperatures together with the current one, so that a failed segment does not need another pass
+            // they have to share the prompt, which includes the past text only below temperature 0.5
+            n_temperatures_cur = 1;
+            if (params.strategy == whisper_sampling_strategy::WHISPER_SAMPLING_GREEDY && params.temperature_n_parallel > 0) {
+                const bool has_prompt_past = !prompt_past.empty() && params.n_max_text_ctx > 0;
+
+                while (n_temperatures_cur <= params.temperature_n_parallel && it + n_temperatures_cur < (int) temperatures.size()) {
+                    const float t_next = temperatures[it + n_temperatures_cur];
+
+                    if (has_prompt_past && (t_next < 0.5f) != (t_cur < 0.5f)) {
+                        break;
+                    }
+
+                    const int n_decoders_next = t_next > 0.0f ? std::max(1, params.greedy.best_of) : 1;
+
+                    if (n_decoders_cur + n_decoders_next > WHISPER_MAX_DECODERS) {
+                        break;
+                    }
+
+                    n_decoders_cur += n_decoders_next;
+                    dec_begin[++n_temperatures_cur] = n_decoders_cur;
+                }
+            }
+
+            WHISPER_LOG_DEBUG("\n%s: strategy = %d, decoding with %d decoders, temperature = %.2f, parallel temperatures = %d\n", __func__, params.strategy, n_decoders_cur, t_cur, n_temperatures_cur);
 
             // TAGS: WHISPER_DECODER_INIT
+            for (int k = 0; k < n_temperatures_cur; ++k) {
+                for (int j = dec_begin[k]; j < dec_begin[k + 1]; ++j) {
+                    state->decoders[j].temperature = temperatures[it + k];
+                }
+            }
+
             for (int j = 0; j < n_decoders_cur; ++j) {
                 auto & decoder = state->decoders[j];
 
@@ -5680,7 +6370,6 @@ int whisper_full_with_state(
             }
 
             // init prompt and kv cache for the current iteration
-            // TODO: do not recompute the prompt if it is the same as previous time
             {
                 prompt.clear();
 
@@ -5702,57 +6391,173 @@ int whisper_full_with_state(
                 }
                 WHISPER_LOG_DEBUG("\n\n");
 
-                // recreate the KV cache if the number of decoders has changed
-                if (state->kv_self_n_dec < n_decoders_cur) {
-                    WHISPER_LOG_DEBUG("%s: recreating KV cache: n_decoders_cur = %d\n", __func__, n_decoders_cur);
-
-                    whisper_kv_cache_free(state->kv_self);
+                // grow the KV cache if the prompt and the tokens that can be generated for the segment do not fit
+                {
+                    // the generation loop below stops after n_max tokens, or after max_tokens if set
+                    const int n_max = whisper_n_text_ctx(ctx)/2 - 4;
+                    const int n_gen = params.max_tokens > 0 ? std::min(params.max_tokens + 1, n_max) : n_max;
 
                     // overallocate to workaround KV cache fragmentation issues
                     const int factor = n_decoders_cur > 1 ? n_decoders_cur + 2 : 1;
 
-                    if (!whisper_kv_cache_init(state->kv_self, state->backends[0], ctx->itype,
-                                ctx->model.hparams.n_text_state,
-                                ctx->model.hparams.n_text_layer,
-                                GGML_PAD(ctx->model.hparams.n_text_ctx, 256)*factor)) {
-                        WHISPER_LOG_ERROR("%s: whisper_kv_cache_init() failed for self-attention cache\n", __func__);
-                        whisper_free_state(state);
+                    const uint32_t kv_self_size = state->kv_self.size;
+
+                    if (!whisper_kv_self_reserve(*ctx, *state, ((int) prompt.size() + n_gen)*factor)) {
+                        WHISPER_LOG_ERROR("%s: failed to grow the self-attention cache: n_decoders_cur = %d\n", __func__, n_decoders_cur);
                         return -7;
                     }
 
-                    state->kv_self_n_dec = n_decoders_cur;
+                    // growing the cache drops its contents
+                    if (state->kv_self.size != kv_self_size) {
+                        prompt_kv_valid = false;
+                    }
+
+                    state->kv_self_n_dec = std::max(state->kv_self_n_dec, n_decoders_cur);
                 }
 
-                whisper_kv_cache_clear(state->kv_self);
+                const int n_vocab = ctx->vocab.n_vocab;
+
+                int i_batch_prompt = prompt.size() - 1;
 
-                whisper_batch_prep_legacy(state->batch, prompt.data(), prompt.size(), 0, 0);
+                if (prompt_kv_valid && prompt == state->prompt_kv && whisper_kv_cache_keep_prefix(state->kv_self, prompt.size())) {
+                    WHISPER_LOG_DEBUG("%s: reusing the KV cells of the prompt (%d tokens)\n", __func__, (int) prompt.size());
 
-                if (!whisper_decode_internal(*ctx, *state, state->batch, params.n_threads, false, params.abort_callback, params.abort_callback_user_data)) {
-                    WHISPER_LOG_ERROR("%s: failed to decode\n", __func__);
-                    return -8;
+                    memcpy(state->logits.data(), state->prompt_kv_logits.data(), n_vocab*sizeof(float));
+                    i_batch_prompt = 0;
+                } else {
+                    whisper_kv_cache_clear(state->kv_self);
+
+                    // the no speech token is predicted at the sot position, which follows the previous text of the prompt
+                    // ref: https://github.com/openai/whisper/blob/0b1ba3d46ebf7fe6f953acfd8cad62a4f851b49f/whisper/decoding.py#L692-L697
+                    const int i_batch_sot = prompt.size() - prompt_init.size();
+
+                    whisper_batch_prep_legacy(state->batch, prompt.data(), prompt.size(), 0, 0);
+                    if (params.no_speech_thold < 1.0f) {
+                        state->batch.logits[i_batch_sot] = 1;
+                    }
+
+                    if (!whisper_decode_internal(*ctx, *state, state->batch, n_threads_decode, false, logits_ids, params.abort_callback, params.abort_callback_user_data)) {
+                        WHISPER_LOG_ERROR("%s: failed to decode\n", __func__);
+                        return -8;
+                    }
+
+                    state->prompt_kv = prompt;
+                    state->prompt_kv_logits.assign(state->logits.begin() + i_batch_prompt*n_vocab, state->logits.begin() + (i_batch_prompt + 1)*n_vocab);
+                    state->prompt_kv_no_speech_prob = 0.0f;
+                    prompt_kv_valid = true;
+
+                    if (params.no_speech_thold < 1.0f) {
+                        const float * logits = state->logits.data() + i_batch_sot*n_vocab;
+
+                        // the probs of the first decoder are overwritten when the logits are processed below, so they serve as scratch space
+                        const float logit_max = whisper_vec_max(logits, n_vocab);
+                        const float sum = whisper_vec_exp_sum(state->decoders[0].probs.data(), logits, n_vocab, logit_max);
+
+                        state->prompt_kv_no_speech_prob = sum > 0.0f ? state->decoders[0].probs[whisper_token_nosp(ctx)]/sum : 0.0f;
+                    }
+                }
+
+                // the no speech probability is checked before the first temperature samples any token
+                if (it == 0 && params.no_speech_thold < 1.0f) {
+                    const float no_speech_prob = state->prompt_kv_no_speech_prob;
+
+                    if (no_speech_prob > params.no_speech_thold) {
+                        WHISPER_LOG_DEBUG("%s: no speech probability %.3f > %.3f, skipping the window\n", __func__, no_speech_prob, params.no_speech_thold);
+                        no_speech = true;
+                        break;
+                    }
                 }
 
                 {
                     const int64_t t_start_sample_us = ggml_time_us();
 
-                    state->decoders[0].i_batch = prompt.size() - 1;
+                    // the logits of the prompt are processed once per temperature and shared by the decoders of that temperature
+                    for (int k = 0; k < n_temperatures_cur; ++k) {
+                        auto & decoder_first = state->decoders[dec_begin[k]];
 
-                    whisper_process_logits(*ctx, *state, state->decoders[0], params, t_cur);
+                        if (k > 0) {
+                            whisper_kv_cache_seq_cp(state->kv_self, 0, dec_begin[k], -1, -1);
+                        }
 
-                    for (int j = 1; j < n_decoders_cur; ++j) {
-                        auto & decoder = state->decoders[j];
+                        decoder_first.i_batch = i_batch_prompt;
+
+                        whisper_process_logits(*ctx, *state, decoder_first, params, decoder_first.temperature);
+
+                        for (int j = dec_begin[k] + 1; j < dec_begin[k + 1]; ++j) {
+                            auto & decoder = state->decoders[j];
 
-                        whisper_kv_cache_seq_cp(state->kv_self, 0, j, -1, -1);
+                            whisper_kv_cache_seq_cp(state->kv_self, 0, j, -1, -1);
 
-                        memcpy(decoder.probs.data(),    state->decoders[0].probs.data(),    decoder.probs.size()*sizeof(decoder.probs[0]));
-                        memcpy(decoder.logits.data(),   state->decoders[0].logits.data(),   decoder.logits.size()*sizeof(decoder.logits[0]));
-                        memcpy(decoder.logprobs.data(), state->decoders[0].logprobs.data(), decoder.logprobs.size()*sizeof(decoder.logprobs[0]));
+                            memcpy(decoder.probs.data(),    decoder_first.probs.data(),    decoder.probs.size()*sizeof(decoder.probs[0]));
+                            memcpy(decoder.logits.data(),   decoder_first.logits.data(),   decoder.logits.size()*sizeof(decoder.logits[0]));
+                            memcpy(decoder.logprobs.data(), decoder_first.logprobs.data(), decoder.logprobs.size()*sizeof(decoder.logprobs[0]));
+
+                            decoder.probs_sum    = decoder_first.probs_sum;
+                            decoder.probs_ts_sum = decoder_first.probs_ts_sum;
+                            decoder.probs_ts_max = decoder_first.probs_ts_max;
+                            decoder.probs_ts_id  = decoder_first.probs_ts_id;
+                        }
                     }
 
                     state->t_sample_us += ggml_time_us() - t_start_sample_us;
                 }
             }
 
+            // selects the best decoder of the temperature, -1 if all of them failed
+            // with commit, the results are trimmed and the decoders failing the entropy threshold are marked as failed
+            const auto select_best_decoder = [&](int k, bool commit) {
+                int    best_id    = -1;
+                double best_score = -INFINITY;
+
+                for (int j = dec_begin[k]; j < dec_begin[k + 1]; ++j) {
+                    auto & decoder = state->decoders[j];
+
+                    if (decoder.failed) {
+                        continue;
+                    }
+
+                    if (commit) {
+                        decoder.sequence.tokens.resize(decoder.sequence.result_len);
+                    }
+                    whisper_sequence_score(params, decoder.sequence);
+
+                    if (commit) {
+                        WHISPER_LOG_DEBUG("%s: decoder %2d: score = %8.5f, result_len = %3d, avg_logprobs = %8.5f, entropy = %8.5f\n",
+                                __func__, j, decoder.sequence.score, decoder.sequence.result_len, decoder.sequence.avg_logprobs, decoder.sequence.entropy);
+                    }
+
+                    if (decoder.sequence.result_len > 32 && decoder.sequence.entropy < params.entropy_thold) {
+                        if (commit) {
+                            WHISPER_LOG_DEBUG("%s: decoder %2d: failed due to entropy %8.5f < %8.5f\n",
+                                    __func__, j, decoder.sequence.entropy, params.entropy_thold);
+
+                            decoder.failed = true;
+                            state->n_fail_h++;
+                        }
+
+                        continue;
+                    }
+
+                    if (best_score < decoder.sequence.score) {
+                        best_score = decoder.sequence.score;
+                        best_id = j;
+                    }
+                }
+
+                return best_id;
+            };
+
+            // was the decoding successful for the temperature?
+            // do fallback only if:
+            // - we are not at the last temperature
+            const auto is_decoder_accepted = [&](int k, int best_id) {
+                if (it + k == (int) temperatures.size() - 1) {
+                    return true;
+                }
+
+                return best_id >= 0 && state->decoders[best_id].sequence.avg_logprobs >= params.logprob_thold;
+            };
+
             for (int i = 0, n_max = whisper_n_text_ctx(ctx)/2 - 4; i < n_max; ++i) {
                 const int64_t t_start_sample_us = ggml_time_us();
 
@@ -5763,7 +6568,6 @@ int whisper_full_with_state(
                 }
 
                 // sampling
-                // TODO: avoid memory allocations, optimize, avoid threads?
                 {
                     std::atomic<int> j_cur(0);
 
@@ -5784,7 +6588,7 @@ int whisper_full_with_state(
                             switch (params.strategy) {
                                 case whisper_sampling_strategy::WHISPER_SAMPLING_GREEDY:
                                     {
-                                        if (t_cur < 1e-6f) {
+                                        if (decoder.temperature < 1e-6f) {
                                             decoder.sequence.tokens.push_back(whisper_sample_token(*ctx, decoder, true));
                                         } else {
                                             decoder.sequence.tokens.push_back(whisper_sample_token(*ctx, decoder, false));
@@ -5794,35 +6598,19 @@ int whisper_full_with_state(
                                     } break;
                                 case whisper_sampling_strategy::WHISPER_SAMPLING_BEAM_SEARCH:
                                     {
-                                        const auto tokens_new = whisper_sample_token_topk(*ctx, decoder, params.beam_search.beam_size);
+                                        whisper_sample_token_topk(*ctx, decoder, params.beam_search.beam_size, decoder.temperature);
 
-                                        for (const auto & token : tokens_new) {
-                                            bc_per_dec[j].push_back({ j, decoder.seek_delta, decoder.has_ts, decoder.sequence, decoder.grammar, });
-                                            bc_per_dec[j].back().sequence.tokens.push_back(token);
-                                            bc_per_dec[j].back().sequence.sum_logprobs_all += token.plog;
+                                        for (const auto & token : decoder.tokens_topk) {
+                                            bc_per_dec[j].push_back({ j, token, decoder.sequence.sum_logprobs_all + token.plog, });
                                         }
                                     } break;
                             };
                         }
                     };
 
-                    const int n_threads = std::min(params.n_threads, n_decoders_cur);
-
-                    if (n_threads == 1) {
-                        process();
-                    } else {
-                        std::vector<std::thread> threads(n_threads - 1);
+                    auto worker = [&](int) { process(); };
 
-                        for (int t = 0; t < n_threads - 1; ++t) {
-                            threads[t] = std::thread(process);
-                        }
-
-                        process();
-
-                        for (int t = 0; t < n_threads - 1; ++t) {
-                            threads[t].join();
-                        }
-                    }
+                    state->workers.run(std::min(n_threads_decode, n_decoders_cur), worker);
                 }
 
                 beam_candidates.clear();
@@ -5835,57 +6623,89 @@ int whisper_full_with_state(
                 }
 
                 // for beam-search, choose the top candidates and update the KV caches
+                // the candidates are popped from a heap, so only as many of them as there are beams get ordered
                 if (params.strategy == whisper_sampling_strategy::WHISPER_SAMPLING_BEAM_SEARCH) {
-                    std::sort(
-                            beam_candidates.begin(),
-                            beam_candidates.end(),
-                            [](const beam_candidate & a, const beam_candidate & b) {
-                        if (a.sequence.sum_logprobs_all != b.sequence.sum_logprobs_all) {
-                            return a.sequence.sum_logprobs_all > b.sequence.sum_logprobs_all;
-                        }
-                        return a.decoder_idx < b.decoder_idx;
-                    });
+                    std::make_heap(beam_candidates.begin(), beam_candidates.end(), beam_candidate_less);
 
-                    uint32_t cur_c = 0;
+                    // two candidates are the same beam if they extend equal sequences with the same token
+                    const auto beam_candidate_equal = [&](const beam_candidate & a, const beam_candidate & b) {
+                        return a.token.id == b.token.id && (a.decoder_idx == b.decoder_idx ||
+                            whisper_sequence_tokens_equal(state->decoders[a.decoder_idx].sequence, state->decoders[b.decoder_idx].sequence));
+                    };
 
+                    int n_active = 0;
                     for (int j = 0; j < n_decoders_cur; ++j) {
-                        auto & decoder = state->decoders[j];
+                        if (!state->decoders[j].completed && !state->decoders[j].failed) {
+                            ++n_active;
+                        }
+                    }
 
-                        if (decoder.completed || decoder.failed) {
+                    beam_selected.clear();
+                    while ((int) beam_selected.size() < n_active && !beam_candidates.empty()) {
+                        std::pop_heap(beam_candidates.begin(), beam_candidates.end(), beam_candidate_less);
+                        const beam_candidate cur = beam_candidates.back();
+                        beam_candidates.pop_back();
+
+                        // all the decoders start from the same prompt, so at zero temperature they propose the same candidates for the first token
+                        if (!beam_selected.empty() && beam_candidate_equal(beam_selected.back(), cur)) {
                             continue;
                         }
 
-                        if (cur_c >= beam_candidates.size()) {
-                            cur_c = 0;
+                        beam_selected.push_back(cur);
+                    }
+
+                    // save the parents of the beams that move to another decoder, before any decoder is overwritten
+                    // the KV cells of the parent are shared with the new beam by adding the beam's sequence id to them - the cells are not copied
+                    int  beam_seek_delta[WHISPER_MAX_DECODERS];
+                    bool beam_has_ts[WHISPER_MAX_DECODERS];
+
+                    for (int j = 0, k = 0; j < n_decoders_cur; ++j) {
+                        const auto & decoder = state->decoders[j];
+
+                        if (decoder.completed || decoder.failed || beam_selected.empty()) {
+                            continue;
                         }
 
-                        auto & cur = beam_candidates[cur_c++];
+                        const auto & cur = beam_selected[k++ % beam_selected.size()];
 
-                        while (beam_candidates.size() > cur_c && whisper_sequence_tokens_equal(beam_candidates[cur_c].sequence, cur.sequence) && i > 0) {
-                            ++cur_c;
+                        if (cur.decoder_idx == j) {
+                            continue;
                         }
 
-                        decoder.seek_delta = cur.seek_delta;
-                        decoder.has_ts     = cur.has_ts;
-                        decoder.sequence   = cur.sequence;
-                        decoder.grammar    = cur.grammar;
+                        state->beam_sequences[j] = state->decoders[cur.decoder_idx].sequence;
+                        state->beam_grammars[j]  = state->decoders[cur.decoder_idx].grammar;
+                        beam_seek_delta[j]       = state->decoders[cur.decoder_idx].seek_delta;
+                        beam_has_ts[j]           = state->decoders[cur.decoder_idx].has_ts;
 
                         whisper_kv_cache_seq_cp(state->kv_self, cur.decoder_idx, WHISPER_MAX_DECODERS + j, -1, -1);
-
-                        WHISPER_LOG_DEBUG("%s: beam search: decoder %d: from decoder %d: token = %10s, plog = %8.5f, sum_logprobs = %8.5f\n",
-                                __func__, j, cur.decoder_idx, ctx->vocab.id_to_token.at(decoder.sequence.tokens.back().id).c_str(), decoder.sequence.tokens.back().plog, decoder.sequence.sum_logprobs_all);
                     }
 
-                    for (int j = 0; j < n_decoders_cur; ++j) {
+                    for (int j = 0, k = 0; j < n_decoders_cur; ++j) {
                         auto & decoder = state->decoders[j];
 
-                        if (decoder.completed || decoder.failed) {
+                        if (decoder.completed || decoder.failed || beam_selected.empty()) {
                             continue;
                         }
 
-                        whisper_kv_cache_seq_rm(state->kv_self, j,                           -1, -1);
-                        whisper_kv_cache_seq_cp(state->kv_self, WHISPER_MAX_DECODERS + j, j, -1, -1);
-                        whisper_kv_cache_seq_rm(state->kv_self, WHISPER_MAX_DECODERS + j,    -1, -1);
+                        const auto & cur = beam_selected[k++ % beam_selected.size()];
+
+                        if (cur.decoder_idx != j) {
+                            decoder.seek_delta = beam_seek_delta[j];
+                            decoder.has_ts     = beam_has_ts[j];
+
+                            std::swap(decoder.sequence, state->beam_sequences[j]);
+                            std::swap(decoder.grammar,  state->beam_grammars[j]);
+
+                            whisper_kv_cache_seq_rm(state->kv_self, j,                           -1, -1);
+                            whisper_kv_cache_seq_cp(state->kv_self, WHISPER_MAX_DECODERS + j, j, -1, -1);
+                            whisper_kv_cache_seq_rm(state->kv_self, WHISPER_MAX_DECODERS + j,    -1, -1);
+                        }
+
+                        decoder.sequence.tokens.push_back(cur.token);
+                        decoder.sequence.sum_logprobs_all = cur.sum_logprobs_all;
+
+                        WHISPER_LOG_DEBUG("%s: beam search: decoder %d: from decoder %d: token = %10s, plog = %8.5f, sum_logprobs = %8.5f\n",
+                                __func__, j, cur.decoder_idx, ctx->vocab.id_to_token.at(decoder.sequence.tokens.back().id).c_str(), decoder.sequence.tokens.back().plog, decoder.sequence.sum_logprobs_all);
                     }
                 }
 
@@ -5966,6 +6786,34 @@ int whisper_full_with_state(
                             completed = true;
                             continue;
                         }
+
+                        // stop a decoder stuck in a repetition loop as soon as the loop shows up, instead of decoding it until n_max and then falling back
+                        // one copy of the repeated text is kept, and the next window starts at the timestamp of the last kept token,
+                        // so that the audio the decoder was looping over is decoded again instead of being skipped
+                        if (params.repetition_max_ngram > 0 && params.repetition_n_repeats > 1 && token.id < whisper_token_eot(ctx)) {
+                            const int n_keep = whisper_sequence_find_repetition(decoder.sequence, whisper_token_eot(ctx), params.repetition_max_ngram, params.repetition_n_repeats, state->repetition_pos);
+                            if (n_keep > 0) {
+                                const auto & tokens_keep = decoder.sequence.tokens;
+                                const whisper_token token_beg = whisper_token_beg(ctx);
+
+                                // the most likely timestamp of the last kept token, but not before the last kept timestamp token, which ends a segment
+                                int seek_delta_keep = 2*(tokens_keep[n_keep - 1].tid - token_beg);
+                                for (int k = n_keep - 1; k >= 0; --k) {
+                                    if (tokens_keep[k].id > token_beg) {
+                                        seek_delta_keep = std::max(seek_delta_keep, 2*(tokens_keep[k].id - token_beg));
+                                        break;
+                                    }
+                                }
+
+                                WHISPER_LOG_DEBUG("%s: decoder %d: stopped due to repetition loop, keeping %d of %d tokens, seek_delta %d\n", __func__, j, n_keep, i + 1, seek_delta_keep);
+                                result_len = n_keep;
+                                // without timestamps, there is no position to resume from, so the rest of the window is skipped
+                                seek_delta = seek_delta_keep > 0 ? std::min(seek_delta_keep, 100*WHISPER_CHUNK_SIZE) : 100*WHISPER_CHUNK_SIZE;
+                                completed  = true;
+                                state->n_stop_r++;
+                                continue;
+                            }
+                        }
                     }
 
                     // sometimes, the decoding can get stuck in a repetition loop
@@ -5996,6 +6844,45 @@ int whisper_full_with_state(
                     }
                 }
 
+                // with parallel temperatures, stop as soon as the lowest accepted temperature is known
+                // the decoders of the higher temperatures are cancelled - their results would be discarded anyway
+                if (n_temperatures_cur > 1) {
+                    int k_accepted = -1;
+
+                    for (int k = 0; k < n_temperatures_cur; ++k) {
+                        bool completed_all = true;
+
+                        for (int j = dec_begin[k]; j < dec_begin[k + 1]; ++j) {
+                            if (!state->decoders[j].completed && !state->decoders[j].failed) {
+                                completed_all = false;
+                                break;
+                            }
+                        }
+
+                        if (!completed_all) {
+                            break;
+                        }
+
+                        if (is_decoder_accepted(k, select_best_decoder(k, false))) {
+                            k_accepted = k;
+                            break;
+                        }
+                    }
+
+                    if (k_accepted >= 0) {
+                        for (int j = dec_begin[k_accepted + 1]; j < n_decoders_cur; ++j) {
+                            auto & decoder = state->decoders[j];
+
+                            if (!decoder.completed && !decoder.failed) {
+                                WHISPER_LOG_DEBUG("%s: decoder %d cancelled, temperature = %.2f accepted\n", __func__, j, temperatures[it + k_accepted]);
+                                decoder.failed = true;
+                            }
+                        }
+
+                        break;
+                    }
+                }
+
                 state->t_sample_us += ggml_time_us() - t_start_sample_us;
 
                 // obtain logits for the next token
@@ -6027,7 +6914,7 @@ int whisper_full_with_state(
 
                     assert(batch.n_tokens > 0);
 
-                    if (!whisper_decode_internal(*ctx, *state, state->batch, params.n_threads, false, params.abort_callback, params.abort_callback_user_data)) {
+                    if (!whisper_decode_internal(*ctx, *state, state->batch, n_threads_decode, false, logits_ids, params.abort_callback, params.abort_callback_user_data)) {
                         WHISPER_LOG_ERROR("%s: failed to decode\n", __func__);
                         return -9;
                     }
@@ -6052,82 +6939,41 @@ int whisper_full_with_state(
                                     continue;
                                 }
 
-                                whisper_process_logits(*ctx, *state, decoder, params, t_cur);
+                                whisper_process_logits(*ctx, *state, decoder, params, decoder.temperature);
                             }
                         };
 
-                        const int n_threads = std::min(params.n_threads, n_decoders_cur);
-
-                        if (n_threads == 1) {
-                            process();
-                        } else {
-                            std::vector<std::thread> threads(n_threads - 1);
+                        auto worker = [&](int) { process(); };
 
-                            for (int t = 0; t < n_threads - 1; ++t) {
-                                threads[t] = std::thread(process);
-                            }
-
-                            process();
-
-                            for (int t = 0; t < n_threads - 1; ++t) {
-                                threads[t].join();
-                            }
-                        }
+                        state->workers.run(std::min(n_threads_decode, n_decoders_cur), worker);
                     }
 
                     state->t_sample_us += ggml_time_us() - t_start_sample_us;
                 }
             }
 
-            // rank the resulting sequences and select the best one
-            {
-                double best_score = -INFINITY;
+            // rank the resulting sequences and select the best one of each temperature
+            // the lowest temperature that is accepted is used
+            bool success = false;
 
-                for (int j = 0; j < n_decoders_cur; ++j) {
-                    auto & decoder = state->decoders[j];
-
-                    if (decoder.failed) {
-                        continue;
-                    }
-
-                    decoder.sequence.tokens.resize(decoder.sequence.result_len);
-                    whisper_sequence_score(params, decoder.sequence);
+            for (int k = 0; k < n_temperatures_cur; ++k) {
+                const int best_id = select_best_decoder(k, true);
 
-                    WHISPER_LOG_DEBUG("%s: decoder %2d: score = %8.5f, result_len = %3d, avg_logprobs = %8.5f, entropy = %8.5f\n",
-                            __func__, j, decoder.sequence.score, decoder.sequence.result_len, decoder.sequence.avg_logprobs, decoder.sequence.entropy);
-
-                    if (decoder.sequence.result_len > 32 && decoder.sequence.entropy < params.entropy_thold) {
-                        WHISPER_LOG_DEBUG("%s: decoder %2d: failed due to entropy %8.5f < %8.5f\n",
-                                __func__, j, decoder.sequence.entropy, params.entropy_thold);
-
-                        decoder.failed = true;
-                        state->n_fail_h++;
-
-                        continue;
-                    }
-
-                    if (best_score < decoder.sequence.score) {
-                        best_score = decoder.sequence.score;
-                        best_decoder_id = j;
-                    }
+                if (best_id >= 0) {
+                    best_decoder_id = best_id;
+                } else if (k > 0) {
+                    best_decoder_id = dec_begin[k];
                 }
 
-                WHISPER_LOG_DEBUG("%s: best decoder = %d\n", __func__, best_decoder_id);
-            }
+                WHISPER_LOG_DEBUG("%s: best decoder = %d, temperature = %.2f\n", __func__, best_decoder_id, temperatures[it + k]);
 
-            bool success = true;
-
-            // was the decoding successful for the current temperature?
-            // do fallback only if:
-            // - we are not at the last temperature
-            if (it != (int) temperatures.size() - 1) {
-                const auto & decoder = state->decoders[best_decoder_id];
-
-                if (decoder.failed || decoder.sequence.avg_logprobs < params.logprob_thold) {
-                    WHISPER_LOG_DEBUG("%s: failed due to avg_logprobs %8.5f < %8.5f\n", __func__, decoder.sequence.avg_logprobs, params.logprob_thold);
-                    success = false;
-                    state->n_fail_p++;
+                if (is_decoder_accepted(k, best_id)) {
+                    success = true;
+                    break;
                 }
+
+                WHISPER_LOG_DEBUG("%s: failed due to avg_logprobs %8.5f < %8.5f\n", __func__, state->decoders[best_decoder_id].sequence.avg_logprobs, params.logprob_thold);
+                state->n_fail_p++;
             }
 
             if (success) {
@@ -6141,6 +6987,13 @@ int whisper_full_with_state(
             WHISPER_LOG_DEBUG("\n%s: failed to decode with temperature = %.2f\n", __func__, t_cur);
         }
 
+        // the window is skipped without segments, and the past text stays the prompt of the next window
+        if (no_speech) {
+            state->n_skip_s++;
+            seek += std::min(100*WHISPER_CHUNK_SIZE, seek_end - seek);
+            continue;
+        }
+
         // output results through a user-provided callback
         {
             const auto & best_decoder = state->decoders[best_decoder_id];
@@ -6169,7 +7022,8 @@ int whisper_full_with_state(
                 int  i0 = 0;
                 auto t0 = seek + 2*(tokens_cur.front().tid - whisper_token_beg(ctx));
 
-                std::string text;
+                auto & text = state->segment_text;
+                text.clear();
                 bool speaker_turn_next = false;
 
                 for (int i = 0; i < (int) tokens_cur.size(); i++) {
@@ -6204,7 +7058,7 @@ int whisper_full_with_state(
 
                             //printf("tt0 = %d, tt1 = %d, text = %s, token = %s, token_id = %d, tid = %d\n", tt0, tt1, text.c_str(), ctx->vocab.id_to_token[tokens_cur[i].id].c_str(), tokens_cur[i].id, tokens_cur[i].tid);
 
-                            result_all.push_back({ tt0, tt1, text, {}, speaker_turn_next });
+                            whisper_result_push_segment(*state, tt0, tt1, text, speaker_turn_next);
                             for (int j = i0; j <= i; j++) {
                                 result_all.back().tokens.push_back(tokens_cur[j]);
                             }
@@ -6223,7 +7077,7 @@ int whisper_full_with_state(
                                 params.new_segment_callback(ctx, state, n_new, params.new_segment_callback_user_data);
                             }
                         }
-                        text = "";
+                        text.clear();
                         while (i < (int) tokens_cur.size() && tokens_cur[i].id > whisper_token_beg(ctx)) {
                             i++;
                         }
@@ -6249,7 +7103,7 @@ int whisper_full_with_state(
                         }
                     }
 
-                    result_all.push_back({ tt0, tt1, text, {} , speaker_turn_next });
+                    whisper_result_push_segment(*state, tt0, tt1, text, speaker_turn_next);
                     for (int j = i0; j < (int) tokens_cur.size(); j++) {
                         result_all.back().tokens.push_back(tokens_cur[j]);
                     }
@@ -6277,7 +7131,7 @@ int whisper_full_with_state(
                 if (ctx->params.dtw_token_timestamps && n_segments) {
                     const int n_frames = std::min(std::min(WHISPER_CHUNK_SIZE * 100, seek_delta), seek_end - seek);
                     whisper_exp_compute_token_level_timestamps_dtw(
-                            ctx, state, params, result_all.size() - n_segments, n_segments, seek, n_frames, 7, params.n_threads);
+                            ctx, state, params, result_all.size() - n_segments, n_segments, seek, n_frames, 7, n_threads_decode);
                 }
             }
 
@@ -6414,6 +7268,272 @@ int whisper_full_parallel(
     return ret;
 }
 
+//
+// command spotting
+//
+
+struct whisper_command_set {
+    // node of the prefix trie of the tokenized phrases
+    struct node {
+        whisper_token token;
+        int32_t       parent; // -1 for the first token of the phrases, which follows the task prompt
+        int32_t       depth;  // 1 for the first token of the phrases
+
+        std::vector<whisper_seq_id> seq_ids;  // phrases going through the node, used as KV cache sequences
+        std::vector<int32_t>        children;
+    };
+
+    // breadth-first, so that the prefix of every node is decoded before the node itself
+    std::vector<node>    nodes;
+    std::vector<int32_t> root_children;
+
+    // node of the last token of each phrase, -1 for the phrases without tokens
+    std::vector<int32_t> phrase_end;
+
+    // per-call buffers of the scoring, kept so that a steady stream of calls does not allocate
+    whisper_batch        batch;
+    std::vector<float>   node_logprob; // log-probability of the token of each node given its prefix
+    std::vector<float>   end_logprob;  // log-probability of the end of text after each node
+    std::vector<float>   probs;
+};
+
+struct whisper_command_set * whisper_command_set_init(struct whisper_context * ctx, const char ** phrases, int n_phrases) {
+    if (n_phrases <= 0) {
+        WHISPER_LOG_ERROR("%s: no phrases to spot\n", __func__);
+        return nullptr;
+    }
+
+    const int n_text_ctx = whisper_n_text_ctx(ctx);
+
+    std::vector<std::vector<whisper_token>> tokens(n_phrases);
+    int n_depth = 0;
+    for (int i = 0; i < n_phrases; ++i) {
+        // the text tokens of whisper start with the space that separates them from the previous word
+        std::string text = phrases[i] ? phrases[i] : "";
+        if (!text.empty() && text[0] != ' ') {
+            text = " " + text;
+        }
+
+        tokens[i] = ::tokenize(ctx->vocab, text);
+        if ((int) tokens[i].size() > n_text_ctx/2) {
+            WHISPER_LOG_ERROR("%s: phrase %d is too long (%d tokens, max %d)\n", __func__, i, (int) tokens[i].size(), n_text_ctx/2);
+            return nullptr;
+        }
+        if (tokens[i].empty()) {
+            WHISPER_LOG_WARN("%s: phrase %d is empty and will never be spotted\n", __func__, i);
+        }
+
+        n_depth = std::max(n_depth, (int) tokens[i].size());
+    }
+
+    if (n_depth == 0) {
+        WHISPER_LOG_ERROR("%s: all the phrases are empty\n", __func__);
+        return nullptr;
+    }
+
+    auto * commands = new whisper_command_set;
+    commands->phrase_end.assign(n_phrases, -1);
+
+    // the phrases sharing a prefix share its nodes, so the prefix is decoded only once
+    std::vector<int32_t> node_cur(n_phrases, -1);
+    for (int depth = 1; depth <= n_depth; ++depth) {
+        std::map<std::pair<int32_t, whisper_token>, int32_t> depth_nodes;
+
+        for (int i = 0; i < n_phrases; ++i) {
+            if ((int) tokens[i].size() < depth) {
+                continue;
+            }
+
+            const whisper_token token = tokens[i][depth - 1];
+            const auto key = std::make_pair(node_cur[i], token);
+
+            auto it = depth_nodes.find(key);
+            if (it == depth_nodes.end()) {
+                const int32_t id = commands->nodes.size();
+                commands->nodes.push_back({ token, node_cur[i], depth, {}, {} });
+                (node_cur[i] < 0 ? commands->root_children : commands->nodes[node_cur[i]].children).push_back(id);
+                it = depth_nodes.emplace(key, id).first;
+            }
+
+            commands->nodes[it->second].seq_ids.push_back(i);
+            node_cur[i] = it->second;
+
+            if ((int) tokens[i].size() == depth) {
+                commands->phrase_end[i] = it->second;
+            }
+        }
+    }
+
+    commands->batch = whisper_batch_init(n_text_ctx, n_phrases);
+    commands->node_logprob.resize(commands->nodes.size());
+    commands->end_logprob.resize(commands->nodes.size());
+    commands->probs.resize(ctx->vocab.n_vocab);
+
+    WHISPER_LOG_INFO("%s: %d phrases, %d trie nodes\n", __func__, n_phrases, (int) commands->nodes.size());
+
+    return commands;
+}
+
+void whisper_command_set_free(struct whisper_command_set * commands) {
+    if (commands) {
+        whisper_batch_free(commands->batch);
+        delete commands;
+    }
+}
+
+int whisper_command_set_score_with_state(
+        struct whisper_context * ctx,
+          struct whisper_state * state,
+    struct whisper_command_set * commands,
+    struct whisper_full_params   params,
+                   const float * samples,
+                           int   n_samples,
+                         float * logprobs) {
+    const int n_threads_mel    = params.n_threads_mel    > 0 ? params.n_threads_mel    : params.n_threads;
+    const int n_threads_encode = params.n_threads_encode > 0 ? params.n_threads_encode : params.n_threads;
+    const int n_threads_decode = params.n_threads_decode > 0 ? params.n_threads_decode : params.n_threads;
+
+    if (n_samples > 0) {
+        if (whisper_pcm_to_mel_with_state(ctx, state, samples, n_samples, n_threads_mel) != 0) {
+            WHISPER_LOG_ERROR("%s: failed to compute log mel spectrogram\n", __func__);
+            return -2;
+        }
+    }
+
+    if (params.audio_ctx > whisper_n_audio_ctx(ctx)) {
+        WHISPER_LOG_ERROR("%s: audio_ctx is larger than the maximum allowed (%d > %d)\n", __func__, params.audio_ctx, whisper_n_audio_ctx(ctx));
+        return -5;
+    }
+    state->exp_n_audio_ctx = params.audio_ctx;
+
+    // the task prompt, without timestamps since the phrases are scored as plain text
+    whisper_token prompt[4];
+    int n_prompt = 0;
+
+    prompt[n_prompt++] = whisper_token_sot(ctx);
+    if (whisper_is_multilingual(ctx)) {
+        int lang_id = whisper_lang_id(params.language);
+        if (params.language == nullptr || strlen(params.language) == 0 || strcmp(params.language, "auto") == 0) {
+            lang_id = whisper_lang_auto_detect_with_state(ctx, state, 0, n_threads_encode, nullptr);
+            if (lang_id < 0) {
+                WHISPER_LOG_ERROR("%s: failed to auto-detect language\n", __func__);
+                return -3;
+            }
+        }
+        state->lang_id = lang_id;
+        prompt[n_prompt++] = whisper_token_lang(ctx, lang_id);
+        prompt[n_prompt++] = params.translate ? whisper_token_translate(ctx) : whisper_token_transcribe(ctx);
+    }
+    prompt[n_prompt++] = whisper_token_not(ctx);
+
+    // the language detection encodes the same window
+    if (state->encoded_seek != 0 || state->exp_n_audio_ctx != state->encoded_n_audio_ctx) {
+        if (!whisper_encode_internal(*ctx, *state, 0, n_threads_encode, params.abort_callback, params.abort_callback_user_data)) {
+            WHISPER_LOG_ERROR("%s: failed to encode\n", __func__);
+            return -6;
+        }
+    }
+
+    const auto & nodes = commands->nodes;
+
+    const int n_total  = n_prompt + nodes.size();
+    const int n_seqs   = commands->phrase_end.size();
+
+    if (!whisper_kv_self_reserve(*ctx, *state, n_total)) {
+        WHISPER_LOG_ERROR("%s: failed to grow the self-attention cache for %d tokens\n", __func__, n_total);
+        return -7;
+    }
+    whisper_kv_cache_clear(state->kv_self);
+
+    const int n_vocab = ctx->vocab.n_vocab;
+    const whisper_token token_eot = whisper_token_eot(ctx);
+
+    // log-probabilities of the tokens following the given logits
+    auto & probs = commands->probs;
+    auto score_children = [&](const float * logits, const std::vector<int32_t> & children, int32_t parent) {
+        const float max = whisper_vec_max(logits, n_vocab);
+        const float lse = max + logf(whisper_vec_exp_sum(probs.data(), logits, n_vocab, max));
+
+        for (const int32_t child : children) {
+            commands->node_logprob[child] = logits[nodes[child].token] - lse;
+        }
+        if (parent >= 0) {
+            commands->end_logprob[parent] = logits[token_eot] - lse;
+        }
+    };
+
+    // all the phrases are teacher-forced in one pass over the trie: the cells of a node belong to the sequences of all the phrases
+    // going through it, and a token only attends to the cells of its first sequence, which are exactly its prefix
+    // the tokens are decoded in batches of at most the size the decoder compute buffers are reserved for
+    auto & batch = commands->batch;
+    const int n_batch_max = std::min(whisper_n_text_ctx(ctx), (int) state->kv_self.size);
+
+    for (int i0 = 0; i0 < n_total; i0 += n_batch_max) {
+        batch.n_tokens = std::min(n_batch_max, n_total - i0);
+
+        for (int j = 0; j < batch.n_tokens; ++j) {
+            const int i = i0 + j;
+            if (i < n_prompt) {
+                batch.token   [j] = prompt[i];
+                batch.pos     [j] = i;
+                batch.n_seq_id[j] = n_seqs;
+                for (int s = 0; s < n_seqs; ++s) {
+                    batch.seq_id[j][s] = s;
+                }
+                batch.logits  [j] = i == n_prompt - 1;
+            } else {
+                const auto & node = nodes[i - n_prompt];
+                batch.token   [j] = node.token;
+                batch.pos     [j] = n_prompt - 1 + node.depth;
+                batch.n_seq_id[j] = node.seq_ids.size();
+                std::copy(node.seq_ids.begin(), node.seq_ids.end(), batch.seq_id[j]);
+                batch.logits  [j] = 1;
+            }
+        }
+
+        if (!whisper_decode_internal(*ctx, *state, batch, n_threads_decode, false, nullptr, params.abort_callback, params.abort_callback_user_data)) {
+            WHISPER_LOG_ERROR("%s: failed to decode\n", __func__);
+            return -8;
+        }
+
+        for (int j = 0; j < batch.n_tokens; ++j) {
+            if (!batch.logits[j]) {
+                continue;
+            }
+
+            const float * logits = state->logits.data() + (size_t) j*n_vocab;
+            const int i = i0 + j;
+            if (i < n_prompt) {
+                score_children(logits, commands->root_children, -1);
+            } else {
+                score_children(logits, nodes[i - n_prompt].children, i - n_prompt);
+            }
+        }
+    }
+
+    // the average log-probability per token does not favor the shorter phrases, and the end of text tells a phrase apart from its longer variants
+    int best_id = -1;
+    for (int s = 0; s < n_seqs; ++s) {
+        const int32_t end = commands->phrase_end[s];
+        if (end < 0) {
+            logprobs[s] = -INFINITY;
+            continue;
+        }
+
+        float sum = commands->end_logprob[end];
+        for (int32_t id = end; id >= 0; id = nodes[id].parent) {
+            sum += commands->node_logprob[id];
+        }
+        logprobs[s] = sum/(nodes[end].depth + 1);
+
+        if (best_id < 0 || logprobs[s] > logprobs[best_id]) {
+            best_id = s;
+        }
+    }
+
+    return best_id;
+}
+
 int whisper_full_n_segments_from_state(struct whisper_state * state) {
     return state->result_all.size();
 }
@@ -7292,7 +8412,7 @@ static void whisper_exp_compute_token_level_timestamps_dtw(
     whisper_kv_cache_clear(state->kv_self);
     whisper_batch_prep_legacy(state->batch, tokens.data(), tokens.size(), 0, 0);
     whisper_kv_cache_seq_rm(state->kv_self, 0, 0, -1);
-    if (!whisper_decode_internal(*ctx, *state, state->batch, n_threads, true, nullptr, nullptr)) {
+    if (!whisper_decode_internal(*ctx, *state, state->batch, n_threads, true, nullptr, nullptr, nullptr)) {
         WHISPER_LOG_INFO("DECODER FAILED\n");
         WHISPER_ASSERT(0);
     }